@@ -19,6 +19,7 @@ TARGET = gshell
 TEMPLATE = app
 
 SOURCES += \
+    bandwidthlimiter.cpp \
     fileexplorerwidget.cpp \
     ftpclient.cpp \
     main.cpp \
@@ -28,9 +29,24 @@ SOURCES += \
     sessionmanagerdialog.cpp \
     sshclient.cpp \
     sshconnectionthread.cpp \
-    terminalwidget.cpp
+    syncjob.cpp \
+    terminaldecoder.cpp \
+    terminalhighlighter.cpp \
+    terminalkeyencoder.cpp \
+    terminallogger.cpp \
+    terminalparserthread.cpp \
+    terminalpredictor.cpp \
+    terminalreplay.cpp \
+    terminalscreen.cpp \
+    terminalscrollback.cpp \
+    terminalsearch.cpp \
+    terminalview.cpp \
+    terminalwidget.cpp \
+    transfermetrics.cpp \
+    vtparser.cpp
 
 HEADERS += \
+    bandwidthlimiter.h \
     fileexplorerwidget.h \
     ftpclient.h \
     mainwindow.h \
@@ -40,7 +56,21 @@ HEADERS += \
     sessionmanagerdialog.h \
     sshclient.h \
     sshconnectionthread.h \
-    terminalwidget.h
+    syncjob.h \
+    terminaldecoder.h \
+    terminalhighlighter.h \
+    terminalkeyencoder.h \
+    terminallogger.h \
+    terminalparserthread.h \
+    terminalpredictor.h \
+    terminalreplay.h \
+    terminalscreen.h \
+    terminalscrollback.h \
+    terminalsearch.h \
+    terminalview.h \
+    terminalwidget.h \
+    transfermetrics.h \
+    vtparser.h
 
 FORMS += \
     mainwindow.ui \
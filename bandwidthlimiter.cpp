@@ -0,0 +1,121 @@
+#include "bandwidthlimiter.h"
+#include <QMutexLocker>
+#include <QAtomicInteger>
+#include <QThread>
+#include <QCoreApplication>
+#include <QDateTime>
+
+// Bursts are limited to this much traffic at the configured rate
+static const double kBurstSeconds = 0.25;
+
+// How long after a keystroke the shell counts as active, and how long bulk
+// transfers pause per chunk while it is
+static const qint64 kInteractiveWindowMs = 300;
+static const qint64 kInteractiveYieldMs = 15;
+static const qint64 kInteractiveChunkSize = 32 * 1024;
+
+static const qint64 kMinimumChunkSize = 4 * 1024;
+
+static QAtomicInteger<qint64> g_lastInteractiveActivity(0);
+
+TokenBucket::TokenBucket(qint64 bytesPerSecond)
+    : m_rate(qMax<qint64>(0, bytesPerSecond)), m_tokens(0)
+{
+    m_clock.start();
+    m_tokens = m_rate * kBurstSeconds;
+}
+
+void TokenBucket::setRate(qint64 bytesPerSecond)
+{
+    QMutexLocker locker(&m_mutex);
+    m_rate = qMax<qint64>(0, bytesPerSecond);
+    m_tokens = m_rate * kBurstSeconds;
+    m_clock.restart();
+}
+
+qint64 TokenBucket::rate() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_rate;
+}
+
+qint64 TokenBucket::consume(qint64 bytes)
+{
+    QMutexLocker locker(&m_mutex);
+    if (m_rate <= 0) {
+        return 0;
+    }
+    
+    double elapsed = m_clock.nsecsElapsed() / 1e9;
+    m_clock.restart();
+    m_tokens = qMin(m_tokens + elapsed * m_rate, m_rate * kBurstSeconds);
+    m_tokens -= bytes;
+    
+    if (m_tokens >= 0) {
+        return 0;
+    }
+    return static_cast<qint64>(-m_tokens * 1000.0 / m_rate) + 1;
+}
+
+TokenBucket *BandwidthLimiter::globalBucket()
+{
+    static TokenBucket bucket;
+    return &bucket;
+}
+
+void BandwidthLimiter::noteInteractiveActivity()
+{
+    g_lastInteractiveActivity.storeRelease(QDateTime::currentMSecsSinceEpoch());
+}
+
+bool BandwidthLimiter::interactiveActive()
+{
+    return QDateTime::currentMSecsSinceEpoch() - g_lastInteractiveActivity.loadAcquire() < kInteractiveWindowMs;
+}
+
+qint64 BandwidthLimiter::chunkSizeFor(qint64 preferred, const QList<TokenBucket*> &buckets)
+{
+    qint64 chunkSize = preferred;
+    for (TokenBucket *bucket : buckets) {
+        qint64 rate = bucket ? bucket->rate() : 0;
+        if (rate > 0) {
+            chunkSize = qMin(chunkSize, rate / 8);
+        }
+    }
+    
+    // Smaller writes bound how long a keystroke can wait behind a transfer write
+    if (interactiveActive()) {
+        chunkSize = qMin(chunkSize, kInteractiveChunkSize);
+    }
+    
+    return qMax(qMin(kMinimumChunkSize, preferred), chunkSize);
+}
+
+void BandwidthLimiter::throttle(qint64 bytes, const QList<TokenBucket*> &buckets)
+{
+    qint64 waitMs = 0;
+    for (TokenBucket *bucket : buckets) {
+        if (bucket) {
+            waitMs = qMax(waitMs, bucket->consume(bytes));
+        }
+    }
+    
+    if (interactiveActive()) {
+        waitMs = qMax(waitMs, kInteractiveYieldMs);
+    }
+    
+    if (waitMs <= 0) {
+        return;
+    }
+    
+    if (QCoreApplication::instance() && QThread::currentThread() == QCoreApplication::instance()->thread()) {
+        QElapsedTimer timer;
+        timer.start();
+        while (timer.elapsed() < waitMs) {
+            QCoreApplication::processEvents();
+            QThread::msleep(static_cast<unsigned long>(qMin<qint64>(5, waitMs - timer.elapsed() + 1)));
+        }
+    } else {
+        QThread::msleep(static_cast<unsigned long>(waitMs));
+    }
+}
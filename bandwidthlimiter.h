@@ -0,0 +1,47 @@
+#ifndef BANDWIDTHLIMITER_H
+#define BANDWIDTHLIMITER_H
+
+#include <QMutex>
+#include <QElapsedTimer>
+#include <QList>
+
+// Token bucket that can be shared by several transfers. A rate of 0 means unlimited.
+class TokenBucket
+{
+public:
+    explicit TokenBucket(qint64 bytesPerSecond = 0);
+
+    void setRate(qint64 bytesPerSecond);
+    qint64 rate() const;
+
+    // Takes bytes out of the bucket and returns how long the caller has to wait (ms)
+    // before sending them. The bucket may go into debt, which later callers pay off.
+    qint64 consume(qint64 bytes);
+
+private:
+    mutable QMutex m_mutex;
+    qint64 m_rate;
+    double m_tokens;
+    QElapsedTimer m_clock;
+};
+
+class BandwidthLimiter
+{
+public:
+    // Cap shared by every transfer in the application
+    static TokenBucket *globalBucket();
+
+    // Terminals report keystrokes here; while the user is typing, bulk transfers
+    // back off briefly so keystrokes and echoes are not queued behind them
+    static void noteInteractiveActivity();
+    static bool interactiveActive();
+
+    // Largest chunk that keeps the buckets' pacing smooth (about 1/8 s of traffic)
+    static qint64 chunkSizeFor(qint64 preferred, const QList<TokenBucket*> &buckets);
+
+    // Charges bytes to all buckets and waits as long as the most restrictive one requires.
+    // On the GUI thread the wait keeps processing events.
+    static void throttle(qint64 bytes, const QList<TokenBucket*> &buckets);
+};
+
+#endif // BANDWIDTHLIMITER_H
@@ -0,0 +1,6 @@
+# Builds every benchmark next to the application: qmake benchmarks.pro && make
+TEMPLATE = subdirs
+
+SUBDIRS += \
+    termbench \
+    vtparserbench
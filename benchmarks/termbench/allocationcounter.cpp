@@ -0,0 +1,112 @@
+#include "allocationcounter.h"
+#include <atomic>
+#include <cstddef>
+#include <new>
+
+namespace {
+
+std::atomic<long long> allocations(0);
+
+void countAllocation()
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+}
+
+} // namespace
+
+#if defined(__GLIBC__)
+
+// Definitions in the executable take precedence over libc's; the __libc_ entry points
+// are glibc's own implementations. Nothing here may include <cstdlib>, whose
+// declarations would clash with these.
+extern "C" {
+
+void *__libc_malloc(std::size_t size);
+void *__libc_calloc(std::size_t count, std::size_t size);
+void *__libc_realloc(void *pointer, std::size_t size);
+
+void *malloc(std::size_t size)
+{
+    countAllocation();
+    return __libc_malloc(size);
+}
+
+void *calloc(std::size_t count, std::size_t size)
+{
+    countAllocation();
+    return __libc_calloc(count, size);
+}
+
+// Growing a buffer in place or moving it costs about as much as a new allocation
+void *realloc(void *pointer, std::size_t size)
+{
+    countAllocation();
+    return __libc_realloc(pointer, size);
+}
+
+} // extern "C"
+
+bool AllocationCounter::countsMalloc()
+{
+    return true;
+}
+
+#else
+
+#include <cstdlib>
+
+void *operator new(std::size_t size)
+{
+    countAllocation();
+    if (void *pointer = std::malloc(size ? size : 1))
+        return pointer;
+    throw std::bad_alloc();
+}
+
+void *operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept
+{
+    countAllocation();
+    return std::malloc(size ? size : 1);
+}
+
+void *operator new[](std::size_t size, const std::nothrow_t &tag) noexcept
+{
+    return operator new(size, tag);
+}
+
+void operator delete(void *pointer) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete[](void *pointer) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete(void *pointer, std::size_t) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete[](void *pointer, std::size_t) noexcept
+{
+    std::free(pointer);
+}
+
+bool AllocationCounter::countsMalloc()
+{
+    return false;
+}
+
+#endif
+
+long long AllocationCounter::count()
+{
+    return allocations.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,14 @@
+#ifndef ALLOCATIONCOUNTER_H
+#define ALLOCATIONCOUNTER_H
+
+// Counts heap allocations made anywhere in the process. With glibc, malloc itself is
+// replaced, so Qt's containers (which allocate with malloc) are counted as well;
+// elsewhere only operator new is.
+namespace AllocationCounter {
+
+long long count();
+bool countsMalloc();
+
+} // namespace AllocationCounter
+
+#endif // ALLOCATIONCOUNTER_H
@@ -0,0 +1,424 @@
+// Measures the terminal's hot path without a network: canned byte streams, and asciicast
+// recordings named on the command line, are fed straight into TerminalScreen the way the
+// parser thread does, then once more through a TerminalView painting into an offscreen
+// window. Reports throughput, heap allocations per MB and frame times. A log flood is fed
+// with 0, 1 and 50 highlight rules, which should cost about the same.
+//
+//   termbench [--megabytes N] [--chunk BYTES] [--no-render] [recording.cast ...]
+
+#include "terminalscreen.h"
+#include "terminalview.h"
+#include "terminalreplay.h"
+#include "terminalhighlighter.h"
+#include "allocationcounter.h"
+#include <QApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QFontDatabase>
+#include <QFontMetrics>
+#include <QMutexLocker>
+#include <QScrollBar>
+#include <QVector>
+#include <algorithm>
+#include <cstdio>
+
+namespace {
+
+// The defaults of a terminal tab
+const int ScrollbackMemoryMB = 32;
+const int GlobalScrollbackMemoryMB = 256;
+// SSHClient::readChannel hands up to 256 KB per dataReceived, which
+// TerminalParserThread feeds to the screen in ParseSliceBytes (16 KB) slices
+const int DefaultChunkBytes = 16 * 1024;
+// Output arriving between two repaints of a busy tab
+const int FrameBytes = 16 * 1024;
+// Recordings are painted at 60 Hz of recording time
+const int FrameMs = 16;
+
+QByteArray repeatTo(const QByteArray &unit, int size)
+{
+    QByteArray text;
+    text.reserve(size + unit.size());
+    while (text.size() < size)
+        text += unit;
+    return text;
+}
+
+QByteArray plainText(int size)
+{
+    return repeatTo("The quick brown fox jumps over the lazy dog; 0123456789 ABCDEFGHIJKLMNOPQRSTUVWXYZ\r\n", size);
+}
+
+QByteArray colorListing(int size)
+{
+    return repeatTo("drwxr-xr-x 2 user user 4096 Jan  1 12:00 \x1b[01;34mdirectory\x1b[0m  "
+                    "\x1b[01;32mscript.sh\x1b[0m  \x1b[01;31marchive.tar.gz\x1b[0m  plain.txt\r\n", size);
+}
+
+QByteArray codeLine(int number)
+{
+    return "\x1b[33m" + QByteArray::number(number).rightJustified(4) + " \x1b[m"
+           "    \x1b[38;5;130mif\x1b[m (count > " + QByteArray::number(number % 97) + ") {"
+           " \x1b[38;5;28mreturn\x1b[m value[index];\x1b[38;5;244m // checked above\x1b[m\x1b[K";
+}
+
+// A full redraw of the window on the alternate screen, then scrolling one line at a time
+// inside the scroll region, as vim does while paging through a file
+QByteArray vimRedraws(int size)
+{
+    QByteArray text = "\x1b[?1049h\x1b[?25l\x1b[1;23r";
+    int top = 1;
+    while (text.size() < size) {
+        text += "\x1b[H\x1b[2J";
+        for (int row = 1; row <= 23; ++row)
+            text += "\x1b[" + QByteArray::number(row) + ";1H" + codeLine(top + row - 1);
+        for (int step = 1; step <= 10; ++step)
+            text += "\x1b[23;1H\r\n" + codeLine(top + 22 + step);
+        text += "\x1b[24;1H\x1b[7mterminalscreen.cpp [+]\x1b[27m\x1b[K\x1b[24;60H"
+                + QByteArray::number(top + 32) + ",1\x1b[1;1H";
+        top += 33;
+    }
+    return text + "\x1b[r\x1b[?25h\x1b[?1049l";
+}
+
+// CPU meters and a process list with 256 colours and a highlighted row, every row
+// positioned and cleared separately
+QByteArray htopFrames(int size)
+{
+    QByteArray text = "\x1b[?1049h\x1b[?25l";
+    for (int frame = 0; text.size() < size; ++frame) {
+        for (int cpu = 0; cpu < 4; ++cpu) {
+            int user = (frame * 7 + cpu * 13) % 30;
+            int system = (frame * 3 + cpu * 5) % 10;
+            text += "\x1b[" + QByteArray::number(cpu + 1) + ";3H\x1b[1m" + QByteArray::number(cpu)
+                    + "\x1b[m[\x1b[32m" + QByteArray(user, '|') + "\x1b[31m" + QByteArray(system, '|')
+                    + QByteArray(40 - user - system, ' ') + "\x1b[m" + QByteArray::number(user + system) + "%]\x1b[K";
+        }
+        text += "\x1b[6;1H\x1b[30;42m  PID USER      PR  NI    VIRT    RES  %CPU  %MEM Command\x1b[K\x1b[m";
+        for (int row = 7; row <= 24; ++row) {
+            QByteArray line = QByteArray::number(1000 + (row * 31 + frame) % 9000).rightJustified(5)
+                              + " user      20   0  " + QByteArray::number(100000 + row * 977).rightJustified(6)
+                              + "  " + QByteArray::number((row * 13 + frame) % 100).rightJustified(4) + ".0"
+                              + " \x1b[38;5;" + QByteArray::number((row * 11 + frame) % 256) + "mprocess-" + QByteArray::number(row);
+            text += "\x1b[" + QByteArray::number(row) + ";1H";
+            text += row == 7 + frame % 18 ? "\x1b[30;46m" + line + "\x1b[K\x1b[m" : line + "\x1b[m\x1b[K";
+        }
+    }
+    return text + "\x1b[?25h\x1b[?1049l";
+}
+
+// ASCII mixed with CJK ideographs, kana and Hangul (two cells each), combining accents and
+// four-byte emoji
+QByteArray cjkMix(int size)
+{
+    QByteArray lines;
+    for (int line = 0; line < 64; ++line) {
+        QVector<uint> codepoints;
+        for (char c : QByteArray("log: "))
+            codepoints.append(uchar(c));
+        for (int i = 0; i < 12; ++i) {
+            codepoints.append(0x4E00 + (line * 97 + i * 31) % 0x5000);
+            codepoints.append(i % 3 == 0 ? 0x3042 + i : 0xAC00 + (line * 53 + i) % 0x2B00);
+            if (i % 4 == 0) {
+                codepoints.append('e');
+                codepoints.append(0x0301);
+            }
+            if (i % 5 == 0)
+                codepoints.append(0x1F600 + (line + i) % 0x40);
+            codepoints.append(' ');
+        }
+        lines += QString::fromUcs4(codepoints.constData(), codepoints.size()).toUtf8() + "\r\n";
+    }
+    return repeatTo(lines, size);
+}
+
+// Truncated, overlong, unknown and aborted sequences, 8-bit controls and invalid UTF-8,
+// in a fixed pseudo-random order
+QByteArray malformedEscapes(int size)
+{
+    const QByteArray fragments[] = {
+        "plain words ",
+        "\x1b[12;",
+        "\x1b[" + repeatTo("99999;", 240) + "m",
+        "\x1b[1;2;3y",
+        "\x1b\x1b\x1b",
+        "\x9b" "31m",
+        "\xc3\x28\xff\xfe\x80\xbf\xe2\x82",
+        "\x1b]0;title without an end ",
+        "\x1b[31\x18",
+        "\x1b[\x1a",
+        "\x1bP1$r0m\x1b\\",
+        "\x1b]2;" + QByteArray(2000, 'A') + "\x07",
+        QByteArray("\0\0\x7f", 3),
+        "\r\n"
+    };
+    const int fragmentCount = int(sizeof(fragments) / sizeof(fragments[0]));
+
+    QByteArray text;
+    quint32 state = 12345;
+    while (text.size() < size) {
+        state = state * 1103515245u + 12345u;
+        text += fragments[(state >> 16) % fragmentCount];
+    }
+    return text;
+}
+
+QByteArray logFlood(int size)
+{
+    QByteArray text;
+    text.reserve(size + 256);
+    for (int line = 0; text.size() < size; ++line) {
+        QByteArray number = QByteArray::number(line);
+        text += "2024-05-01 12:00:" + QByteArray::number(line % 60).rightJustified(2, '0') + "." + number.right(3)
+                + (line % 20 == 0 ? " ERROR" : line % 7 == 0 ? " WARN " : " INFO ")
+                + " [worker-" + QByteArray::number(line % 16) + "] request " + number + " from 10.0."
+                + QByteArray::number(line % 256) + "." + QByteArray::number(line % 200 + 1)
+                + " served in " + QByteArray::number(line % 900) + " ms\r\n";
+    }
+    return text;
+}
+
+// The first rule is the usual ERROR; the rest are a typical mix of literals and regular
+// expressions, most of which never match
+QSharedPointer<const TerminalHighlighter> highlighter(int ruleCount)
+{
+    if (ruleCount == 0)
+        return QSharedPointer<const TerminalHighlighter>();
+
+    QVector<TerminalHighlightRule> rules;
+    for (int i = 0; i < ruleCount; ++i) {
+        TerminalHighlightRule rule;
+        rule.foreground = TerminalAttributes::rgbColor(255, 95, 95);
+        if (i == 0) {
+            rule.pattern = "ERROR";
+        } else if (i == 5) {
+            rule.pattern = "(?:\\d{1,3}\\.){3}\\d{1,3}";
+            rule.regex = true;
+        } else if (i % 10 == 0) {
+            rule.pattern = QString("job-%1\\d+").arg(i);
+            rule.regex = true;
+        } else if (i % 10 == 5) {
+            rule.pattern = QString("port %1\\d*").arg(i);
+            rule.regex = true;
+        } else {
+            rule.pattern = QString("keyword%1").arg(i);
+            rule.caseSensitive = i % 2 == 0;
+        }
+        rules.append(rule);
+    }
+
+    QSharedPointer<TerminalHighlighter> compiled(new TerminalHighlighter);
+    QString error = compiled->compile(rules);
+    if (!error.isEmpty()) {
+        std::printf("highlight rules: %s\n", qPrintable(error));
+        return QSharedPointer<const TerminalHighlighter>();
+    }
+    return compiled;
+}
+
+void configure(TerminalScreen &screen)
+{
+    screen.setScrollbackSpill(true);
+    screen.setScrollbackSearchIndex(true);
+    screen.setScrollbackLimits(TerminalScrollback::DefaultMaxLines, qint64(ScrollbackMemoryMB) * 1024 * 1024);
+}
+
+void feedStream(TerminalScreen &screen, const QByteArray &stream, int from, int to, int chunkBytes)
+{
+    for (int offset = from; offset < to; offset += chunkBytes) {
+        QMutexLocker locker(screen.mutex());
+        screen.feed(stream.constData() + offset, qMin(chunkBytes, to - offset));
+    }
+}
+
+double megabytes(qint64 bytes)
+{
+    return bytes / (1024.0 * 1024.0);
+}
+
+class FrameStats
+{
+public:
+    FrameStats() : m_allocations(0) {}
+
+    // Hands the damage to the view and lets it paint, as TerminalWidget::renderFrame does
+    void render(TerminalView &view)
+    {
+        long long allocations = AllocationCounter::count();
+        QElapsedTimer timer;
+        timer.start();
+        view.updateDamage();
+        QApplication::processEvents();
+        m_times.append(timer.nsecsElapsed());
+        m_allocations += AllocationCounter::count() - allocations;
+    }
+
+    void print(const QByteArray &name, qint64 bytes, qint64 totalNs)
+    {
+        if (m_times.isEmpty()) {
+            std::printf("%-20s render  no frames\n", name.constData());
+            return;
+        }
+        std::sort(m_times.begin(), m_times.end());
+        qint64 sum = 0;
+        for (qint64 time : m_times)
+            sum += time;
+        auto percentile = [this](int p) { return m_times.at((m_times.size() - 1) * p / 100) / 1e6; };
+        std::printf("%-20s render  %9.1f MB/s  %6d frames  mean %6.2f  p50 %6.2f  p99 %6.2f  max %6.2f ms"
+                    "  %8.1f allocs/frame\n",
+                    name.constData(), megabytes(bytes) / (totalNs / 1e9), m_times.size(),
+                    sum / 1e6 / m_times.size(), percentile(50), percentile(99), m_times.constLast() / 1e6,
+                    double(m_allocations) / m_times.size());
+    }
+
+private:
+    QVector<qint64> m_times;
+    long long m_allocations;
+};
+
+void showView(TerminalView &view, int columns, int rows)
+{
+    QFont font = QFontDatabase::systemFont(QFontDatabase::FixedFont);
+    view.setTerminalFont(font);
+    view.setDefaultColors(QColor("#DCDCDC"), QColor("#1E1E1E"));
+    QFontMetrics metrics(font);
+    int frame = 2 * view.frameWidth();
+    view.resize(columns * metrics.horizontalAdvance(QLatin1Char('M')) + view.verticalScrollBar()->sizeHint().width() + frame,
+                rows * metrics.height() + frame);
+    view.show();
+    QApplication::processEvents();
+}
+
+void benchmarkStream(const char *name, const QByteArray &stream, int chunkBytes, bool render,
+                     const QSharedPointer<const TerminalHighlighter> &highlighter = QSharedPointer<const TerminalHighlighter>())
+{
+    {
+        TerminalScreen screen(80, 24);
+        configure(screen);
+        screen.setHighlighter(highlighter);
+        // An untimed pass first, so the timed one runs with the scrollback at its limits
+        feedStream(screen, stream, 0, stream.size(), chunkBytes);
+
+        long long allocations = AllocationCounter::count();
+        QElapsedTimer timer;
+        timer.start();
+        feedStream(screen, stream, 0, stream.size(), chunkBytes);
+        qint64 elapsed = timer.nsecsElapsed();
+        allocations = AllocationCounter::count() - allocations;
+        std::printf("%-20s screen  %9.1f MB/s  %9.1f allocs/MB\n",
+                    name, megabytes(stream.size()) / (elapsed / 1e9), allocations / megabytes(stream.size()));
+    }
+
+    if (!render)
+        return;
+
+    TerminalScreen screen(80, 24);
+    configure(screen);
+    screen.setHighlighter(highlighter);
+    TerminalView view(&screen);
+    showView(view, 80, 24);
+
+    FrameStats frames;
+    QElapsedTimer timer;
+    timer.start();
+    for (int offset = 0; offset < stream.size(); offset += FrameBytes) {
+        feedStream(screen, stream, offset, qMin(stream.size(), offset + FrameBytes), chunkBytes);
+        frames.render(view);
+    }
+    frames.print(name, stream.size(), timer.nsecsElapsed());
+}
+
+void benchmarkRecording(const QString &fileName, bool render)
+{
+    QByteArray name = QFileInfo(fileName).fileName().toLocal8Bit();
+    TerminalScreen screen(80, 24);
+    configure(screen);
+    TerminalReplay replay(&screen);
+    QString error = replay.load(fileName);
+    if (!error.isEmpty()) {
+        std::fprintf(stderr, "%s: %s\n", qPrintable(fileName), qPrintable(error));
+        return;
+    }
+
+    // The first pass takes the keyframes, the timed one restores the first of them
+    replay.feedUntil(replay.duration());
+    long long allocations = AllocationCounter::count();
+    QElapsedTimer timer;
+    timer.start();
+    replay.seek(0);
+    replay.feedUntil(replay.duration());
+    qint64 elapsed = timer.nsecsElapsed();
+    allocations = AllocationCounter::count() - allocations;
+    std::printf("%-20s screen  %9.1f MB/s  %9.1f allocs/MB\n",
+                name.constData(), megabytes(replay.outputBytes()) / (elapsed / 1e9),
+                allocations / qMax(megabytes(replay.outputBytes()), 1e-9));
+
+    if (!render)
+        return;
+
+    // The grid keeps the recorded size, as in a replaying tab
+    TerminalView view(&screen);
+    view.setGridLocked(true);
+    replay.seek(0);
+    showView(view, replay.columns(), replay.rows());
+
+    bool changed = false;
+    QObject::connect(&replay, &TerminalReplay::screenChanged, [&changed]() { changed = true; });
+    FrameStats frames;
+    timer.restart();
+    for (qint64 time = 0; ; time += FrameMs) {
+        changed = false;
+        replay.feedUntil(qMin(time, replay.duration()));
+        if (changed)
+            frames.render(view);
+        if (time >= replay.duration())
+            break;
+    }
+    frames.print(name, replay.outputBytes(), timer.nsecsElapsed());
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    // Headless unless asked otherwise
+    if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM"))
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    QApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Terminal parser, screen model and renderer throughput");
+    parser.addHelpOption();
+    QCommandLineOption megabytesOption("megabytes", "Size of each canned stream.", "N", "8");
+    QCommandLineOption chunkOption("chunk", "Bytes per feed() call.", "BYTES", QString::number(DefaultChunkBytes));
+    QCommandLineOption noRenderOption("no-render", "Only measure the screen model.");
+    parser.addOption(megabytesOption);
+    parser.addOption(chunkOption);
+    parser.addOption(noRenderOption);
+    parser.addPositionalArgument("recordings", "asciicast v2 files to replay as well.", "[recording.cast...]");
+    parser.process(app);
+
+    int size = qBound(1, parser.value(megabytesOption).toInt(), 1024) * 1024 * 1024;
+    int chunkBytes = qMax(1, parser.value(chunkOption).toInt());
+    bool render = !parser.isSet(noRenderOption);
+
+    TerminalScrollback::setGlobalLimit(qint64(GlobalScrollbackMemoryMB) * 1024 * 1024);
+    std::printf("%d MB per stream, %d B chunks; allocations counted %s\n", size / (1024 * 1024), chunkBytes,
+                AllocationCounter::countsMalloc() ? "at malloc" : "at operator new only");
+
+    benchmarkStream("plain text", plainText(size), chunkBytes, render);
+    benchmarkStream("ls --color", colorListing(size), chunkBytes, render);
+    benchmarkStream("vim redraws", vimRedraws(size), chunkBytes, render);
+    benchmarkStream("htop frames", htopFrames(size), chunkBytes, render);
+    benchmarkStream("UTF-8 CJK mix", cjkMix(size), chunkBytes, render);
+    benchmarkStream("malformed escapes", malformedEscapes(size), chunkBytes, render);
+    QByteArray log = logFlood(size);
+    for (int ruleCount : {0, 1, 50})
+        benchmarkStream(QByteArray("log, " + QByteArray::number(ruleCount) + " rules").constData(), log, chunkBytes,
+                        render, highlighter(ruleCount));
+
+    for (const QString &fileName : parser.positionalArguments())
+        benchmarkRecording(fileName, render);
+    return 0;
+}
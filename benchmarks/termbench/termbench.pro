@@ -0,0 +1,38 @@
+# Terminal throughput benchmark: qmake && make && ./termbench [recording.cast ...]
+# Runs on the offscreen platform unless QT_QPA_PLATFORM is set.
+TEMPLATE = app
+TARGET = termbench
+QT += widgets
+CONFIG += console c++11 release
+CONFIG -= app_bundle
+
+INCLUDEPATH += $$PWD/../..
+
+SOURCES += \
+    main.cpp \
+    allocationcounter.cpp \
+    $$PWD/../../terminaldecoder.cpp \
+    $$PWD/../../terminalhighlighter.cpp \
+    $$PWD/../../terminalpredictor.cpp \
+    $$PWD/../../terminalreplay.cpp \
+    $$PWD/../../terminalscreen.cpp \
+    $$PWD/../../terminalscrollback.cpp \
+    $$PWD/../../terminalsearch.cpp \
+    $$PWD/../../terminalview.cpp \
+    $$PWD/../../vtparser.cpp
+
+HEADERS += \
+    allocationcounter.h \
+    $$PWD/../../terminaldecoder.h \
+    $$PWD/../../terminalhighlighter.h \
+    $$PWD/../../terminalpredictor.h \
+    $$PWD/../../terminalreplay.h \
+    $$PWD/../../terminalscreen.h \
+    $$PWD/../../terminalscrollback.h \
+    $$PWD/../../terminalsearch.h \
+    $$PWD/../../terminalview.h \
+    $$PWD/../../vtparser.h
+
+unix|mingw {
+    QMAKE_CXXFLAGS_RELEASE += -O2
+}
@@ -0,0 +1,95 @@
+// Measures VTParser throughput on canned streams. The handler only counts what it is
+// given, so the numbers are the parser's own cost.
+
+#include "vtparser.h"
+#include <chrono>
+#include <algorithm>
+#include <cstdio>
+#include <string>
+
+namespace {
+
+struct CountingHandler : VTParserHandler
+{
+    long long printed = 0;
+    long long controls = 0;
+    long long sequences = 0;
+
+    void vtPrint(const char *, int length) override { printed += length; }
+    void vtExecute(unsigned char) override { ++controls; }
+    void vtEscDispatch(const VTSequence &, char) override { ++sequences; }
+    void vtCsiDispatch(const VTSequence &, char) override { ++sequences; }
+    void vtOscDispatch(const char *, int) override { ++sequences; }
+};
+
+std::string plainText()
+{
+    std::string line = "The quick brown fox jumps over the lazy dog; 0123456789 ABCDEFGHIJKLMNOPQRSTUVWXYZ\r\n";
+    std::string text;
+    while (text.size() < 16 * 1024 * 1024) {
+        text += line;
+    }
+    return text;
+}
+
+std::string colorListing()
+{
+    std::string line = "drwxr-xr-x 2 user user 4096 Jan  1 12:00 \x1b[01;34mdirectory\x1b[0m  "
+                       "\x1b[01;32mscript.sh\x1b[0m  \x1b[01;31marchive.tar.gz\x1b[0m  plain.txt\r\n";
+    std::string text;
+    while (text.size() < 16 * 1024 * 1024) {
+        text += line;
+    }
+    return text;
+}
+
+std::string cursorHeavy()
+{
+    std::string frame;
+    for (int row = 1; row <= 50; ++row) {
+        frame += "\x1b[" + std::to_string(row) + ";1H\x1b[38;5;" + std::to_string(row % 256) + "m";
+        frame += "  PID USER      PR  NI    VIRT    RES  %CPU\x1b[K";
+    }
+    std::string text;
+    while (text.size() < 16 * 1024 * 1024) {
+        text += frame;
+    }
+    return text;
+}
+
+void run(const char *name, const std::string &stream, int chunkSize)
+{
+    CountingHandler handler;
+    VTParser parser(&handler);
+
+    const int rounds = 8;
+    auto start = std::chrono::steady_clock::now();
+    for (int round = 0; round < rounds; ++round) {
+        for (size_t offset = 0; offset < stream.size(); offset += chunkSize) {
+            int length = static_cast<int>(std::min<size_t>(chunkSize, stream.size() - offset));
+            parser.feed(stream.data() + offset, length);
+        }
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    double megabytes = stream.size() * static_cast<double>(rounds) / (1024.0 * 1024.0);
+    std::printf("%-14s %6d B chunks  %9.1f MB/s  (%lld printed, %lld sequences)\n",
+                name, chunkSize, megabytes / elapsed.count(), handler.printed, handler.sequences);
+}
+
+} // namespace
+
+int main()
+{
+    const std::string plain = plainText();
+    const std::string color = colorListing();
+    const std::string cursor = cursorHeavy();
+
+    // 4 KB matches SSHClient::readChannel's read size; 64 KB is a drained read burst
+    for (int chunkSize : {4096, 65536}) {
+        run("plain text", plain, chunkSize);
+        run("ls --color", color, chunkSize);
+        run("cursor moves", cursor, chunkSize);
+    }
+    return 0;
+}
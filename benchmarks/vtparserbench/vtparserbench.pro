@@ -0,0 +1,18 @@
+# Parser microbenchmark: qmake && make && ./vtparserbench
+TEMPLATE = app
+TARGET = vtparserbench
+CONFIG += console c++11 release
+CONFIG -= qt app_bundle
+
+INCLUDEPATH += $$PWD/../..
+
+SOURCES += \
+    main.cpp \
+    $$PWD/../../vtparser.cpp
+
+HEADERS += \
+    $$PWD/../../vtparser.h
+
+unix|mingw {
+    QMAKE_CXXFLAGS_RELEASE += -O2
+}
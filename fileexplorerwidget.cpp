@@ -15,10 +15,22 @@
 #include <QDateTime>
 #include <QProgressBar>
 #include <QToolButton>
+#include <QDialog>
+#include <QDialogButtonBox>
+#include <QFormLayout>
+#include <QComboBox>
+#include <QCheckBox>
+#include <QSpinBox>
+#include <QSettings>
+#include <QFileDialog>
+#include <QJsonArray>
+#include <QJsonDocument>
 
-FileExplorerWidget::FileExplorerWidget(QWidget *parent) : QWidget(parent), connected(false), isLocalDragSource(false), nextTaskId(1), currentTaskId(-1)
+FileExplorerWidget::FileExplorerWidget(QWidget *parent) : QWidget(parent), connected(false), sftpPort(22), isLocalDragSource(false), nextTaskId(1), currentTaskId(-1), transferRateLimit(0)
 {
     ftpClient = new FTPClient(this);
+    ftpClient->setSessionBucket(&sessionBucket);
+    applyBandwidthLimits();
     
     // 连接FTP客户端信号
     connect(ftpClient, &FTPClient::connected, this, &FileExplorerWidget::onSftpConnected);
@@ -27,6 +39,8 @@ FileExplorerWidget::FileExplorerWidget(QWidget *parent) : QWidget(parent), conne
     connect(ftpClient, &FTPClient::directoryListed, this, &FileExplorerWidget::onDirectoryListed);
     connect(ftpClient, &FTPClient::transferProgress, this, &FileExplorerWidget::onTransferProgress);
     connect(ftpClient, &FTPClient::transferCompleted, this, &FileExplorerWidget::onTransferCompleted);
+    connect(ftpClient, &FTPClient::transferVerified, this, &FileExplorerWidget::onTransferVerified);
+    connect(ftpClient, &FTPClient::transferStats, this, &FileExplorerWidget::onTransferStats);
     
     setupUI();
     
@@ -40,6 +54,19 @@ FileExplorerWidget::FileExplorerWidget(QWidget *parent) : QWidget(parent), conne
     setAcceptDrops(true);
 }
 
+FileExplorerWidget::~FileExplorerWidget()
+{
+    // 同步任务的线程仍在使用 sessionBucket：先全部取消并等待结束，再让成员析构
+    for (SyncJob *job : syncJobs) {
+        job->cancel();
+    }
+    for (SyncJob *job : syncJobs) {
+        job->wait();
+        delete job;
+    }
+    syncJobs.clear();
+}
+
 void FileExplorerWidget::setupUI()
 {
     QVBoxLayout *mainLayout = new QVBoxLayout(this);
@@ -235,8 +262,28 @@ void FileExplorerWidget::setupTransferPanel()
     clearButton->setToolTip(tr("Clear Completed Transfers"));
     connect(clearButton, &QToolButton::clicked, this, &FileExplorerWidget::clearCompletedTransfers);
     
+    // 传输完成后与服务器端 sha256sum 校验
+    QSettings settings;
+    verifyCheckBox = new QCheckBox(tr("Verify"), transferHeader);
+    verifyCheckBox->setToolTip(tr("Verify transfers with SHA-256 checksums"));
+    verifyCheckBox->setStyleSheet("QCheckBox { color: white; }");
+    verifyCheckBox->setChecked(settings.value("Transfers/Verify", false).toBool());
+    ftpClient->setVerifyTransfers(verifyCheckBox->isChecked());
+    connect(verifyCheckBox, &QCheckBox::toggled, this, [this](bool checked) {
+        ftpClient->setVerifyTransfers(checked);
+        QSettings settings;
+        settings.setValue("Transfers/Verify", checked);
+    });
+    
+    QToolButton *limitsButton = new QToolButton(transferHeader);
+    limitsButton->setIcon(QIcon(":/icons/settings.svg"));
+    limitsButton->setToolTip(tr("Bandwidth Limits"));
+    connect(limitsButton, &QToolButton::clicked, this, &FileExplorerWidget::editBandwidthLimits);
+    
     headerLayout->addWidget(transferLabel);
     headerLayout->addStretch();
+    headerLayout->addWidget(verifyCheckBox);
+    headerLayout->addWidget(limitsButton);
     headerLayout->addWidget(clearButton);
     
     transferHeader->setStyleSheet("background-color: #2D2D30;");
@@ -245,6 +292,12 @@ void FileExplorerWidget::setupTransferPanel()
     transferList = new QListWidget(transferWidget);
     transferList->setStyleSheet("QListWidget { background-color: #1E1E1E; color: #DCDCDC; }");
     
+    // 进度信号可能非常频繁，列表项按固定帧率刷新
+    transferRefreshTimer = new QTimer(this);
+    transferRefreshTimer->setInterval(100);
+    connect(transferRefreshTimer, &QTimer::timeout, this, &FileExplorerWidget::flushTransferUpdates);
+    transferRefreshTimer->start();
+    
     // 设置上下文菜单
     transferList->setContextMenuPolicy(Qt::CustomContextMenu);
     connect(transferList, &QListWidget::customContextMenuRequested, this, [this](const QPoint &pos) {
@@ -253,6 +306,21 @@ void FileExplorerWidget::setupTransferPanel()
             QMenu menu(this);
             QAction *cancelAction = menu.addAction(tr("Cancel"));
             connect(cancelAction, &QAction::triggered, this, &FileExplorerWidget::cancelTransfer);
+            
+            // 同步任务可以直接重新运行，只会传输有变化的文件
+            int taskId = item->data(Qt::UserRole).toInt();
+            if (transferTasks.contains(taskId) && transferTasks[taskId].type == TransferTask::Sync) {
+                QAction *rerunAction = menu.addAction(tr("Run Sync Again"));
+                rerunAction->setEnabled(transferTasks[taskId].completed);
+                connect(rerunAction, &QAction::triggered, this, [this, taskId]() {
+                    runSyncTask(taskId);
+                });
+            }
+            
+            menu.addSeparator();
+            QAction *exportAction = menu.addAction(tr("Export Statistics..."));
+            connect(exportAction, &QAction::triggered, this, &FileExplorerWidget::exportTransferStatistics);
+            
             menu.exec(transferList->viewport()->mapToGlobal(pos));
         }
     });
@@ -281,10 +349,21 @@ void FileExplorerWidget::setupToolbar()
     
     QAction *refreshAction = toolBar->addAction(QIcon(":/icons/refresh.svg"), tr("Refresh"));
     connect(refreshAction, &QAction::triggered, this, &FileExplorerWidget::refreshView);
+    
+    toolBar->addSeparator();
+    
+    QAction *syncAction = toolBar->addAction(QIcon(":/icons/ftp.svg"), tr("Sync"));
+    syncAction->setToolTip(tr("Synchronize the current local folder with the current remote directory"));
+    connect(syncAction, &QAction::triggered, this, &FileExplorerWidget::startSync);
 }
 
 void FileExplorerWidget::connectToSftp(const QString &host, int port, const QString &username, const QString &password)
 {
+    sftpHost = host;
+    sftpPort = port;
+    sftpUsername = username;
+    sftpPassword = password;
+    
     // 连接到SFTP服务器（异步操作，不会阻塞UI）
     QMetaObject::invokeMethod(this, [=]() {
         emit sftpStatusChanged(false, tr("Connecting to %1...").arg(host));
@@ -602,6 +681,163 @@ void FileExplorerWidget::refreshView()
     ftpClient->listDirectory(currentRemotePath);
 }
 
+void FileExplorerWidget::startSync()
+{
+    if (!connected) {
+        QMessageBox::warning(this, tr("Sync"), tr("Not connected to SFTP server"));
+        return;
+    }
+    
+    QString localRoot = localFileModel->filePath(localFileView->rootIndex());
+    
+    QDialog dialog(this);
+    dialog.setWindowTitle(tr("Sync"));
+    QFormLayout *formLayout = new QFormLayout(&dialog);
+    
+    formLayout->addRow(tr("Local folder:"), new QLabel(localRoot, &dialog));
+    formLayout->addRow(tr("Remote directory:"), new QLabel(currentRemotePath, &dialog));
+    
+    QComboBox *directionCombo = new QComboBox(&dialog);
+    directionCombo->addItem(tr("Local to remote (mirror)"), SyncJob::LocalToRemote);
+    directionCombo->addItem(tr("Remote to local (mirror)"), SyncJob::RemoteToLocal);
+    directionCombo->addItem(tr("Two-way (newer wins)"), SyncJob::TwoWay);
+    formLayout->addRow(tr("Direction:"), directionCombo);
+    
+    QCheckBox *deleteCheck = new QCheckBox(tr("Delete files missing from the source"), &dialog);
+    formLayout->addRow("", deleteCheck);
+    connect(directionCombo, QOverload<int>::of(&QComboBox::currentIndexChanged), deleteCheck, [=](int) {
+        // 双向同步无法区分"已删除"和"新建"，不提供删除
+        bool oneWay = directionCombo->currentData().toInt() != SyncJob::TwoWay;
+        deleteCheck->setEnabled(oneWay);
+        if (!oneWay) deleteCheck->setChecked(false);
+    });
+    
+    QDialogButtonBox *buttons = new QDialogButtonBox(QDialogButtonBox::Ok | QDialogButtonBox::Cancel, &dialog);
+    connect(buttons, &QDialogButtonBox::accepted, &dialog, &QDialog::accept);
+    connect(buttons, &QDialogButtonBox::rejected, &dialog, &QDialog::reject);
+    formLayout->addRow(buttons);
+    
+    if (dialog.exec() != QDialog::Accepted) {
+        return;
+    }
+    
+    if (deleteCheck->isChecked() &&
+        QMessageBox::question(this, tr("Confirm Sync"),
+                              tr("Files that do not exist on the source side will be deleted. Continue?"),
+                              QMessageBox::Yes | QMessageBox::No) != QMessageBox::Yes) {
+        return;
+    }
+    
+    int taskId = addTransferTask(localRoot, currentRemotePath, TransferTask::Sync);
+    transferTasks[taskId].syncDirection = directionCombo->currentData().toInt();
+    transferTasks[taskId].syncDeleteExtraneous = deleteCheck->isChecked();
+    
+    runSyncTask(taskId);
+}
+
+// 带宽上限以 KB/s 保存，0 表示不限速
+void FileExplorerWidget::applyBandwidthLimits()
+{
+    QSettings settings;
+    BandwidthLimiter::globalBucket()->setRate(settings.value("Transfers/GlobalLimit", 0).toLongLong() * 1024);
+    sessionBucket.setRate(settings.value("Transfers/SessionLimit", 0).toLongLong() * 1024);
+    transferRateLimit = settings.value("Transfers/TransferLimit", 0).toLongLong() * 1024;
+    ftpClient->setTransferRateLimit(transferRateLimit);
+}
+
+void FileExplorerWidget::editBandwidthLimits()
+{
+    QSettings settings;
+    QDialog dialog(this);
+    dialog.setWindowTitle(tr("Bandwidth Limits"));
+    QFormLayout *formLayout = new QFormLayout(&dialog);
+    
+    auto createLimitBox = [&dialog, &settings](const QString &key) {
+        QSpinBox *spinBox = new QSpinBox(&dialog);
+        spinBox->setRange(0, 10000000);
+        spinBox->setSuffix(tr(" KB/s"));
+        spinBox->setSpecialValueText(tr("Unlimited"));
+        spinBox->setValue(settings.value(key, 0).toInt());
+        return spinBox;
+    };
+    
+    QSpinBox *globalBox = createLimitBox("Transfers/GlobalLimit");
+    QSpinBox *sessionBox = createLimitBox("Transfers/SessionLimit");
+    QSpinBox *transferBox = createLimitBox("Transfers/TransferLimit");
+    formLayout->addRow(tr("All sessions:"), globalBox);
+    formLayout->addRow(tr("Per session:"), sessionBox);
+    formLayout->addRow(tr("Per transfer:"), transferBox);
+    
+    QDialogButtonBox *buttons = new QDialogButtonBox(QDialogButtonBox::Ok | QDialogButtonBox::Cancel, &dialog);
+    connect(buttons, &QDialogButtonBox::accepted, &dialog, &QDialog::accept);
+    connect(buttons, &QDialogButtonBox::rejected, &dialog, &QDialog::reject);
+    formLayout->addRow(buttons);
+    
+    if (dialog.exec() != QDialog::Accepted) {
+        return;
+    }
+    
+    settings.setValue("Transfers/GlobalLimit", globalBox->value());
+    settings.setValue("Transfers/SessionLimit", sessionBox->value());
+    settings.setValue("Transfers/TransferLimit", transferBox->value());
+    applyBandwidthLimits();
+}
+
+void FileExplorerWidget::runSyncTask(int taskId)
+{
+    if (!transferTasks.contains(taskId) || syncJobs.contains(taskId)) {
+        return;
+    }
+    
+    TransferTask &task = transferTasks[taskId];
+    task.completed = false;
+    task.error = false;
+    task.errorMessage.clear();
+    task.transferred = 0;
+    task.fileSize = 0;
+    task.progress = 0;
+    task.filesTransferred = 0;
+    task.filesTotal = 0;
+    task.metrics = TransferMetrics();
+    updateTransferListItem(taskId);
+    
+    // 同步任务使用独立的SFTP会话并行传输，不占用当前的传输队列
+    SyncJob *job = new SyncJob(this);
+    job->setConnectionParams(sftpHost, sftpPort, sftpUsername, sftpPassword);
+    job->setRoots(task.localPath, task.remotePath);
+    job->setDirection(static_cast<SyncJob::Direction>(task.syncDirection));
+    job->setDeleteExtraneous(task.syncDeleteExtraneous);
+    job->setVerifyTransfers(verifyCheckBox->isChecked());
+    job->setTransferRateLimit(transferRateLimit);
+    job->setSessionBucket(&sessionBucket);
+    syncJobs[taskId] = job;
+    
+    connect(job, &SyncJob::syncProgress, this, [this, taskId](qint64 bytesDone, qint64 bytesTotal, int actionsDone, int actionsTotal) {
+        if (!transferTasks.contains(taskId)) return;
+        transferTasks[taskId].filesTransferred = actionsDone;
+        transferTasks[taskId].filesTotal = actionsTotal;
+        updateTransferProgress(taskId, bytesDone, bytesTotal);
+    });
+    connect(job, &SyncJob::syncFinished, this, [this, taskId, job](bool success, const QString &message) {
+        syncJobs.remove(taskId);
+        job->wait();
+        job->deleteLater();
+        
+        if (transferTasks.contains(taskId)) {
+            if (success) {
+                transferTasks[taskId].progress = 100;
+            }
+            completeTransferTask(taskId, success, message);
+        }
+        
+        if (connected) {
+            ftpClient->listDirectory(currentRemotePath);
+        }
+    });
+    
+    job->start();
+}
+
 // 新增: 处理本地路径输入
 void FileExplorerWidget::onLocalPathEntered()
 {
@@ -971,11 +1207,21 @@ int FileExplorerWidget::addTransferTask(const QString &localPath, const QString
     task.completed = false;
     task.error = false;
     task.taskId = nextTaskId++;
+    task.verifyState = TransferTask::NotVerified;
+    task.syncDirection = SyncJob::LocalToRemote;
+    task.syncDeleteExtraneous = false;
+    task.filesTransferred = 0;
+    task.filesTotal = 0;
     
     // 设置文件名和大小
-    QFileInfo fileInfo(type == TransferTask::Upload ? localPath : QFileInfo(remotePath).fileName());
-    task.fileName = fileInfo.fileName();
-    task.fileSize = type == TransferTask::Upload ? fileInfo.size() : 0;
+    if (type == TransferTask::Sync) {
+        task.fileName = tr("Sync %1 - %2").arg(QFileInfo(localPath).fileName(), remotePath);
+        task.fileSize = 0;
+    } else {
+        QFileInfo fileInfo(type == TransferTask::Upload ? localPath : QFileInfo(remotePath).fileName());
+        task.fileName = fileInfo.fileName();
+        task.fileSize = type == TransferTask::Upload ? fileInfo.size() : 0;
+    }
     
     // 添加到任务映射
     transferTasks[task.taskId] = task;
@@ -983,6 +1229,7 @@ int FileExplorerWidget::addTransferTask(const QString &localPath, const QString
     // 创建并添加列表项
     QListWidgetItem *item = new QListWidgetItem(transferList);
     item->setData(Qt::UserRole, task.taskId);
+    transferItems[task.taskId] = item;
     
     // 设置自定义小部件
     QWidget *taskWidget = new QWidget(transferList);
@@ -995,7 +1242,9 @@ int FileExplorerWidget::addTransferTask(const QString &localPath, const QString
     infoLayout->setContentsMargins(0, 0, 0, 0);
     
     QLabel *typeIcon = new QLabel(infoWidget);
-    typeIcon->setPixmap(QIcon(type == TransferTask::Upload ? ":/icons/upload.svg" : ":/icons/download.svg").pixmap(16, 16));
+    QString iconPath = type == TransferTask::Upload ? ":/icons/upload.svg" :
+                       type == TransferTask::Download ? ":/icons/download.svg" : ":/icons/ftp.svg";
+    typeIcon->setPixmap(QIcon(iconPath).pixmap(16, 16));
     
     QLabel *nameLabel = new QLabel(task.fileName, infoWidget);
     nameLabel->setStyleSheet("QLabel { color: white; }");
@@ -1041,56 +1290,144 @@ void FileExplorerWidget::updateTransferProgress(int taskId, qint64 transferred,
     task.transferred = transferred;
     task.fileSize = total;
     task.progress = total > 0 ? (int)(transferred * 100 / total) : 0;
+    task.metrics.recordProgress(transferred, total);
     
-    updateTransferListItem(taskId);
+    dirtyTransfers.insert(taskId);
+}
+
+void FileExplorerWidget::flushTransferUpdates()
+{
+    for (int taskId : dirtyTransfers) {
+        updateTransferListItem(taskId);
+    }
+    dirtyTransfers.clear();
+}
+
+void FileExplorerWidget::onTransferStats(double rttMs, double windowFill, qint64 networkMs, qint64 localIoMs)
+{
+    if (currentTaskId == -1 || !transferTasks.contains(currentTaskId))
+        return;
+    
+    transferTasks[currentTaskId].metrics.recordLink(rttMs, windowFill, networkMs, localIoMs);
+    dirtyTransfers.insert(currentTaskId);
+}
+
+void FileExplorerWidget::exportTransferStatistics()
+{
+    QString fileName = QFileDialog::getSaveFileName(this, tr("Export Transfer Statistics"),
+                                                    QDir::homePath() + "/transfers.csv",
+                                                    tr("CSV Files (*.csv);;JSON Files (*.json)"));
+    if (fileName.isEmpty())
+        return;
+    
+    QByteArray content;
+    if (fileName.endsWith(".json", Qt::CaseInsensitive)) {
+        QJsonArray tasks;
+        for (const TransferTask &task : transferTasks) {
+            QJsonObject object = task.metrics.toJson();
+            object["task"] = task.taskId;
+            object["name"] = task.fileName;
+            object["type"] = task.type == TransferTask::Upload ? "upload" :
+                             task.type == TransferTask::Download ? "download" : "sync";
+            object["completed"] = task.completed;
+            object["error"] = task.error;
+            tasks.append(object);
+        }
+        content = QJsonDocument(tasks).toJson();
+    } else {
+        QString csv = TransferMetrics::csvHeader();
+        for (const TransferTask &task : transferTasks) {
+            csv += task.metrics.toCsvRows(task.taskId, task.fileName);
+        }
+        content = csv.toUtf8();
+    }
+    
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate) || file.write(content) != content.size()) {
+        QMessageBox::warning(this, tr("Export Transfer Statistics"), tr("Failed to write %1").arg(fileName));
+    }
 }
 
 // 新增：更新传输列表项
 void FileExplorerWidget::updateTransferListItem(int taskId)
 {
-    if (!transferTasks.contains(taskId))
+    if (!transferTasks.contains(taskId) || !transferItems.contains(taskId))
         return;
     
     const TransferTask &task = transferTasks[taskId];
+    const TransferMetrics &metrics = task.metrics;
     
-    // 查找对应的列表项
-    for (int i = 0; i < transferList->count(); ++i) {
-        QListWidgetItem *item = transferList->item(i);
-        if (item->data(Qt::UserRole).toInt() == taskId) {
-            // 获取进度条和状态标签
-            QWidget *taskWidget = transferList->itemWidget(item);
-            QProgressBar *progressBar = taskWidget->findChild<QProgressBar*>("progressBar");
-            QLabel *statusLabel = taskWidget->findChild<QLabel*>("statusLabel");
-            
-            if (progressBar && statusLabel) {
-                // 更新进度
-                progressBar->setValue(task.progress);
-                
-                // 更新状态文本
-                QString statusText;
-                if (task.completed) {
-                    if (task.error) {
-                        statusText = tr("Error: %1").arg(task.errorMessage);
-                        statusLabel->setStyleSheet("QLabel { color: #FF4040; }");
-                    } else {
-                        statusText = tr("Completed");
-                        statusLabel->setStyleSheet("QLabel { color: #40C040; }");
-                    }
-                } else if (task.taskId == currentTaskId) {
-                    // 计算传输速率和剩余时间
-                    double mbTransferred = task.transferred / (1024.0 * 1024.0);
-                    statusText = tr("Transferring: %1 MB").arg(mbTransferred, 0, 'f', 2);
-                    statusLabel->setStyleSheet("QLabel { color: #4A86E8; }");
-                } else {
-                    statusText = tr("Queued");
-                    statusLabel->setStyleSheet("QLabel { color: #8E8E8E; }");
-                }
-                
-                statusLabel->setText(statusText);
-            }
-            
-            break;
+    // 获取进度条和状态标签
+    QWidget *taskWidget = transferList->itemWidget(transferItems[taskId]);
+    if (!taskWidget)
+        return;
+    QProgressBar *progressBar = taskWidget->findChild<QProgressBar*>("progressBar");
+    QLabel *statusLabel = taskWidget->findChild<QLabel*>("statusLabel");
+    
+    if (!progressBar || !statusLabel)
+        return;
+    
+    // 更新进度
+    progressBar->setValue(task.progress);
+    
+    // 更新状态文本
+    QString statusText;
+    if (task.completed) {
+        if (task.error) {
+            statusText = tr("Error: %1").arg(task.errorMessage);
+            statusLabel->setStyleSheet("QLabel { color: #FF4040; }");
+        } else if (task.type == TransferTask::Sync) {
+            statusText = tr("Synced: %1").arg(task.errorMessage);
+            statusLabel->setStyleSheet("QLabel { color: #40C040; }");
+        } else if (task.verifyState == TransferTask::Verified) {
+            statusText = tr("Completed (SHA-256 verified)");
+            statusLabel->setStyleSheet("QLabel { color: #40C040; }");
+        } else if (task.verifyState == TransferTask::VerifyUnavailable) {
+            statusText = tr("Completed (not verified: no checksum tool on server)");
+            statusLabel->setStyleSheet("QLabel { color: #E0A030; }");
+        } else {
+            statusText = tr("Completed");
+            statusLabel->setStyleSheet("QLabel { color: #40C040; }");
+        }
+    } else if (task.type == TransferTask::Sync) {
+        if (task.filesTotal > 0) {
+            statusText = tr("Syncing: %1/%2 items, %3").arg(task.filesTransferred).arg(task.filesTotal)
+                         .arg(TransferMetrics::formatRate(metrics.currentRate()));
+        } else {
+            statusText = tr("Comparing...");
+        }
+        statusLabel->setStyleSheet("QLabel { color: #4A86E8; }");
+    } else if (task.taskId == currentTaskId) {
+        // 计算传输速率和剩余时间
+        double mbTransferred = task.transferred / (1024.0 * 1024.0);
+        statusText = tr("Transferring: %1 MB, %2, ETA %3").arg(mbTransferred, 0, 'f', 2)
+                     .arg(TransferMetrics::formatRate(metrics.currentRate()))
+                     .arg(TransferMetrics::formatDuration(metrics.etaSeconds()));
+        statusLabel->setStyleSheet("QLabel { color: #4A86E8; }");
+    } else {
+        statusText = tr("Queued");
+        statusLabel->setStyleSheet("QLabel { color: #8E8E8E; }");
+    }
+    
+    statusLabel->setText(statusText);
+    
+    // 详细指标放在提示中：网络时间占比高说明瓶颈在链路或远端磁盘，本地 I/O 占比高说明在本机
+    if (metrics.isStarted()) {
+        QString details = tr("Average: %1\nElapsed: %2")
+                          .arg(TransferMetrics::formatRate(metrics.averageRate()))
+                          .arg(TransferMetrics::formatDuration(metrics.elapsedMs() / 1000));
+        if (metrics.rttMs() >= 0) {
+            details += tr("\nRound trip (loaded): %1 ms").arg(metrics.rttMs(), 0, 'f', 1);
+        }
+        if (metrics.windowFill() >= 0) {
+            details += tr("\nSSH window in use: %1%").arg(metrics.windowFill() * 100, 0, 'f', 0);
+        }
+        if (metrics.networkMs() > 0 || metrics.localIoMs() > 0) {
+            details += tr("\nWaiting on network: %1 s\nWaiting on local disk: %2 s")
+                       .arg(metrics.networkMs() / 1000.0, 0, 'f', 1)
+                       .arg(metrics.localIoMs() / 1000.0, 0, 'f', 1);
         }
+        taskWidget->setToolTip(details);
     }
 }
 
@@ -1101,9 +1438,15 @@ void FileExplorerWidget::completeTransferTask(int taskId, bool success, const QS
         return;
     
     TransferTask &task = transferTasks[taskId];
+    // 校验失败时任务已经带着具体原因结束，不要被后续的通用错误覆盖
+    if (task.completed)
+        return;
+    
     task.completed = true;
     task.error = !success;
     task.errorMessage = errorMessage;
+    task.metrics.finish();
+    dirtyTransfers.remove(taskId);
     
     // complete upload, refresh remote dir
     if (success && task.type == TransferTask::Upload) {
@@ -1120,7 +1463,8 @@ void FileExplorerWidget::processNextTransfer()
     int nextTaskId = -1;
     
     for (auto it = transferTasks.begin(); it != transferTasks.end(); ++it) {
-        if (!it.value().completed) {
+        // 同步任务由各自的 SyncJob 执行
+        if (!it.value().completed && it.value().type != TransferTask::Sync) {
             nextTaskId = it.key();
             break;
         }
@@ -1166,6 +1510,23 @@ void FileExplorerWidget::onTransferCompleted()
     }
 }
 
+void FileExplorerWidget::onTransferVerified(const QString &localHash, const QString &remoteHash)
+{
+    if (currentTaskId == -1 || !transferTasks.contains(currentTaskId))
+        return;
+    
+    TransferTask &task = transferTasks[currentTaskId];
+    if (remoteHash.isEmpty()) {
+        task.verifyState = TransferTask::VerifyUnavailable;
+    } else if (localHash == remoteHash) {
+        task.verifyState = TransferTask::Verified;
+    } else {
+        task.verifyState = TransferTask::VerifyMismatch;
+        completeTransferTask(currentTaskId, false, tr("Checksum mismatch (local %1, remote %2)")
+                             .arg(localHash.left(12), remoteHash.left(12)));
+    }
+}
+
 void FileExplorerWidget::clearCompletedTransfers()
 {
     QList<int> tasksToRemove;
@@ -1177,14 +1538,7 @@ void FileExplorerWidget::clearCompletedTransfers()
     }
     
     for (int taskId : tasksToRemove) {
-        for (int i = 0; i < transferList->count(); ++i) {
-            QListWidgetItem *item = transferList->item(i);
-            if (item->data(Qt::UserRole).toInt() == taskId) {
-                delete transferList->takeItem(i);
-                break;
-            }
-        }
-        
+        delete transferItems.take(taskId);
         transferTasks.remove(taskId);
     }
 }
@@ -1201,6 +1555,12 @@ void FileExplorerWidget::cancelTransfer()
     if (!transferTasks.contains(taskId))
         return;
     
+    // 同步任务：通知 SyncJob 停止，完成后会自行更新状态
+    if (syncJobs.contains(taskId)) {
+        syncJobs[taskId]->cancel();
+        return;
+    }
+    
     // 如果是当前正在传输的任务，取消它
     if (taskId == currentTaskId) {
         // 目前libssh2不支持直接取消传输
@@ -19,10 +19,16 @@
 #include <QListWidget>
 #include <QProgressBar>
 #include <QMap>
+#include <QCheckBox>
+#include <QSet>
+#include <QTimer>
 #include "ftpclient.h"
+#include "syncjob.h"
+#include "transfermetrics.h"
 
 struct TransferTask {
-    enum Type { Upload, Download };
+    enum Type { Upload, Download, Sync };
+    enum VerifyState { NotVerified, Verified, VerifyUnavailable, VerifyMismatch };
     
     QString localPath;
     QString remotePath;
@@ -35,6 +41,14 @@ struct TransferTask {
     bool error;
     QString errorMessage;
     int taskId;
+    VerifyState verifyState;
+    TransferMetrics metrics;
+    
+    // Sync tasks only
+    int syncDirection;
+    bool syncDeleteExtraneous;
+    int filesTransferred;
+    int filesTotal;
 };
 
 class FileExplorerWidget : public QWidget
@@ -42,6 +56,7 @@ class FileExplorerWidget : public QWidget
     Q_OBJECT
 public:
     explicit FileExplorerWidget(QWidget *parent = nullptr);
+    ~FileExplorerWidget();
 
     void connectToSftp(const QString &host, int port, const QString &username, const QString &password);
     void showExplorer();
@@ -63,6 +78,8 @@ private slots:
     void createDirectory();
     void deleteItem();
     void refreshView();
+    void startSync();
+    void editBandwidthLimits();
     void onRemoteDoubleClicked(const QModelIndex &index);
     void onDirectoryListed(const QStringList &entries);
     void onSftpError(const QString &errorMessage);
@@ -85,6 +102,10 @@ private slots:
     
     void onTransferProgress(qint64 bytesSent, qint64 bytesTotal);
     void onTransferCompleted();
+    void onTransferVerified(const QString &localHash, const QString &remoteHash);
+    void onTransferStats(double rttMs, double windowFill, qint64 networkMs, qint64 localIoMs);
+    void flushTransferUpdates();
+    void exportTransferStatistics();
     void clearCompletedTransfers();
     void cancelTransfer();
 
@@ -102,6 +123,12 @@ private:
     QString currentRemotePath;
     bool connected;
     
+    // Kept so sync jobs can open their own sessions
+    QString sftpHost;
+    int sftpPort;
+    QString sftpUsername;
+    QString sftpPassword;
+    
     QString dragSourcePath;
     bool isLocalDragSource;
     
@@ -110,9 +137,18 @@ private:
     QSplitter *mainSplitter;
     QWidget *transferWidget;
     QListWidget *transferList;
+    QCheckBox *verifyCheckBox;
     QMap<int, TransferTask> transferTasks;
+    QMap<int, QListWidgetItem*> transferItems;
+    QSet<int> dirtyTransfers;
+    QTimer *transferRefreshTimer;
     int nextTaskId;
     int currentTaskId;
+    QMap<int, SyncJob*> syncJobs;
+    
+    // 本会话所有传输（含同步任务）共享的带宽上限
+    TokenBucket sessionBucket;
+    qint64 transferRateLimit;
     
     void setupUI();
     void setupToolbar();
@@ -130,6 +166,8 @@ private:
     void completeTransferTask(int taskId, bool success = true, const QString &errorMessage = QString());
     void updateTransferListItem(int taskId);
     void processNextTransfer();
+    void runSyncTask(int taskId);
+    void applyBandwidthLimits();
 };
 
 #endif // FILEEXPLORERWIDGET_H 
@@ -5,6 +5,10 @@
 #include <QFileInfo>
 #include <QThread>
 #include <QCoreApplication>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QCryptographicHash>
+#include <QElapsedTimer>
 
 #ifdef _WIN32
 #include <winsock2.h>
@@ -15,11 +19,29 @@
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <netdb.h>
+#include <netinet/tcp.h>
+#include <netinet/ip.h>
+#endif
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <cerrno>
 #endif
 
 #include <libssh2.h>
 #include <libssh2_sftp.h>
 
+// libssh2_init/libssh2_exit are not thread safe, and sync jobs create clients on worker threads
+static QMutex g_libssh2InitMutex;
+
+// Transfers hand libssh2 large buffers so it can pipeline SFTP requests;
+// uploads map the local file in windows of kMapWindowSize
+static const qint64 kTransferChunkSize = 256 * 1024;
+static const qint64 kMapWindowSize = 64 * 1024 * 1024;
+
+static const qint64 kStatsIntervalMs = 500;
+
 class FTPClientPrivate {
 public:
     LIBSSH2_SESSION *session;
@@ -31,7 +53,7 @@ public:
     bool wsaInitialized;
 };
 
-FTPClient::FTPClient(QObject *parent) : QObject(parent), m_connected(false), m_session(nullptr)
+FTPClient::FTPClient(QObject *parent) : QObject(parent), m_connected(false), m_verifyTransfers(false), m_sessionBucket(nullptr), m_session(nullptr)
 {
     d = new FTPClientPrivate;
     d->session = nullptr;
@@ -67,6 +89,7 @@ bool FTPClient::initLibssh2()
     d->wsaInitialized = true;
 #endif
 
+    QMutexLocker locker(&g_libssh2InitMutex);
     if (libssh2_init(0) != 0) {
         emit error("libssh2 initialization failed");
         return false;
@@ -77,7 +100,10 @@ bool FTPClient::initLibssh2()
 
 void FTPClient::cleanupLibssh2()
 {
-    libssh2_exit();
+    {
+        QMutexLocker locker(&g_libssh2InitMutex);
+        libssh2_exit();
+    }
     
 #ifdef _WIN32
     if (d->wsaInitialized) {
@@ -121,6 +147,12 @@ bool FTPClient::connect(const QString &host, int port, const QString &username,
     }
 #endif
     
+#ifndef _WIN32
+    // Bulk traffic: let routers that honour TOS favour the interactive shell connection
+    int tos = IPTOS_THROUGHPUT;
+    setsockopt(d->sock, IPPROTO_IP, IP_TOS, &tos, sizeof(tos));
+#endif
+    
     // Connect to server
     if (::connect(d->sock, (struct sockaddr*)(&sin), sizeof(struct sockaddr_in)) != 0) {
         emit error("Failed to connect to host");
@@ -227,6 +259,116 @@ bool FTPClient::isConnected() const
     return m_connected;
 }
 
+void FTPClient::setVerifyTransfers(bool enabled)
+{
+    m_verifyTransfers = enabled;
+}
+
+bool FTPClient::verifyTransfers() const
+{
+    return m_verifyTransfers;
+}
+
+void FTPClient::setTransferRateLimit(qint64 bytesPerSecond)
+{
+    m_transferBucket.setRate(bytesPerSecond);
+}
+
+void FTPClient::setSessionBucket(TokenBucket *bucket)
+{
+    m_sessionBucket = bucket;
+}
+
+QList<TokenBucket*> FTPClient::rateBuckets()
+{
+    return QList<TokenBucket*>() << &m_transferBucket << m_sessionBucket << BandwidthLimiter::globalBucket();
+}
+
+void FTPClient::reportTransferStats(void *handle, bool upload, qint64 networkNs, qint64 localIoNs)
+{
+    // An fstat on the open handle is a minimal round trip; it queues behind any
+    // outstanding transfer requests, so it shows the latency the transfer sees
+    LIBSSH2_SFTP_ATTRIBUTES attrs;
+    QElapsedTimer rttTimer;
+    rttTimer.start();
+    double rttMs = libssh2_sftp_fstat(static_cast<LIBSSH2_SFTP_HANDLE *>(handle), &attrs) == 0
+                   ? rttTimer.nsecsElapsed() / 1e6 : -1;
+    
+    double windowFill = -1;
+    LIBSSH2_CHANNEL *channel = libssh2_sftp_get_channel(d->sftp_session);
+    if (channel) {
+        unsigned long initialWindow = 0;
+        unsigned long window;
+        if (upload) {
+            window = libssh2_channel_window_write_ex(channel, &initialWindow);
+        } else {
+            window = libssh2_channel_window_read_ex(channel, nullptr, &initialWindow);
+        }
+        if (initialWindow > 0) {
+            windowFill = 1.0 - qMin(1.0, static_cast<double>(window) / initialWindow);
+        }
+    }
+    
+    emit transferStats(rttMs, windowFill, networkNs / 1000000, localIoNs / 1000000);
+}
+
+void *FTPClient::startRemoteChecksum(const QString &remotePath)
+{
+    LIBSSH2_CHANNEL *channel = libssh2_channel_open_session(d->session);
+    if (!channel) {
+        return nullptr;
+    }
+    
+    // sha256sum on Linux, shasum on BSD/macOS
+    QString quotedPath = "'" + QString(remotePath).replace("'", "'\\''") + "'";
+    QString command = QString("sha256sum -- %1 2>/dev/null || shasum -a 256 -- %1 2>/dev/null").arg(quotedPath);
+    
+    if (libssh2_channel_exec(channel, command.toUtf8().constData()) != 0) {
+        libssh2_channel_free(channel);
+        return nullptr;
+    }
+    
+    return channel;
+}
+
+QString FTPClient::finishRemoteChecksum(void *channelHandle)
+{
+    LIBSSH2_CHANNEL *channel = static_cast<LIBSSH2_CHANNEL *>(channelHandle);
+    if (!channel) {
+        return QString();
+    }
+    
+    QByteArray output;
+    char buffer[256];
+    ssize_t bytesRead;
+    while ((bytesRead = libssh2_channel_read(channel, buffer, sizeof(buffer))) > 0) {
+        output.append(buffer, bytesRead);
+    }
+    
+    libssh2_channel_close(channel);
+    libssh2_channel_wait_closed(channel);
+    libssh2_channel_free(channel);
+    
+    // Output is "<hex digest>  <path>"
+    QByteArray digest = output.trimmed().split(' ').value(0).toLower();
+    if (digest.size() != 64) {
+        return QString();
+    }
+    return QString::fromLatin1(digest);
+}
+
+bool FTPClient::checkTransferHashes(const QString &localHash, const QString &remoteHash, const QString &remotePath)
+{
+    emit transferVerified(localHash, remoteHash);
+    
+    // An empty remote hash means the server has no sha256sum; that is not a failure
+    if (!remoteHash.isEmpty() && localHash != remoteHash) {
+        emit error("Checksum mismatch: " + remotePath);
+        return false;
+    }
+    return true;
+}
+
 bool FTPClient::uploadFile(const QString &localPath, const QString &remotePath)
 {
     if (!m_connected || !d->sftp_session) {
@@ -236,7 +378,7 @@ bool FTPClient::uploadFile(const QString &localPath, const QString &remotePath)
     
     // Open local file
     QFile localFile(localPath);
-    if (!localFile.open(QIODevice::ReadOnly)) {
+    if (!localFile.open(QIODevice::ReadOnly | QIODevice::Unbuffered)) {
         emit error("Failed to open local file: " + localPath);
         return false;
     }
@@ -244,6 +386,10 @@ bool FTPClient::uploadFile(const QString &localPath, const QString &remotePath)
     // Get file size
     qint64 fileSize = localFile.size();
     
+#ifdef __linux__
+    posix_fadvise(localFile.handle(), 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+    
     // Create remote file
     LIBSSH2_SFTP_HANDLE *sftp_handle = libssh2_sftp_open(d->sftp_session, remotePath.toStdString().c_str(),
                                                         LIBSSH2_FXF_WRITE | LIBSSH2_FXF_CREAT | LIBSSH2_FXF_TRUNC,
@@ -256,48 +402,109 @@ bool FTPClient::uploadFile(const QString &localPath, const QString &remotePath)
         return false;
     }
     
-    // Upload file data
-    char buffer[8192];
+    // Upload file data straight out of a mapping of the local file. Large writes let
+    // libssh2 keep several SFTP write requests in flight; the local hash is computed
+    // from the same memory, so verification does not need a second pass over the file
+    QByteArray fallbackBuffer;
     qint64 totalSent = 0;
-    
-    while (!localFile.atEnd()) {
-        qint64 bytesRead = localFile.read(buffer, sizeof(buffer));
-        if (bytesRead < 0) {
+    QCryptographicHash localHash(QCryptographicHash::Sha256);
+    
+    QElapsedTimer statsTimer;
+    QElapsedTimer phaseTimer;
+    qint64 networkNs = 0;
+    qint64 localIoNs = 0;
+    statsTimer.start();
+    
+    while (totalSent < fileSize) {
+        phaseTimer.start();
+        qint64 windowSize = qMin(kMapWindowSize, fileSize - totalSent);
+        uchar *mapped = localFile.map(totalSent, windowSize);
+        const char *window = reinterpret_cast<const char *>(mapped);
+        
+        if (mapped) {
+#ifdef __linux__
+            madvise(mapped, static_cast<size_t>(windowSize), MADV_SEQUENTIAL);
+#endif
+        } else {
+            // Some files (e.g. on certain network filesystems) cannot be mapped
+            fallbackBuffer.resize(static_cast<int>(kTransferChunkSize));
+            localFile.seek(totalSent);
+            windowSize = localFile.read(fallbackBuffer.data(), kTransferChunkSize);
+            window = fallbackBuffer.constData();
+        }
+        
+        localIoNs += phaseTimer.nsecsElapsed();
+        
+        if (windowSize <= 0) {
             emit error("Failed to read from local file");
             libssh2_sftp_close(sftp_handle);
             localFile.close();
             return false;
         }
         
-        char *ptr = buffer;
-        ssize_t bytesWritten;
-        do {
-            bytesWritten = libssh2_sftp_write(sftp_handle, ptr, bytesRead);
-            if (bytesWritten < 0) {
-                emit error("Failed to write to remote file");
-                libssh2_sftp_close(sftp_handle);
-                localFile.close();
-                return false;
-            }
+        qint64 windowSent = 0;
+        while (windowSent < windowSize) {
+            qint64 chunkSize = qMin(BandwidthLimiter::chunkSizeFor(kTransferChunkSize, rateBuckets()),
+                                    windowSize - windowSent);
+            const char *ptr = window + windowSent;
             
-            ptr += bytesWritten;
-            bytesRead -= bytesWritten;
-            totalSent += bytesWritten;
+            BandwidthLimiter::throttle(chunkSize, rateBuckets());
             
-            // Send progress signal
-            emit transferProgress(totalSent, fileSize);
-            
-            // Allow event loop to process
-            QThread::msleep(1);
-            QCoreApplication::processEvents();
+            if (m_verifyTransfers) {
+                localHash.addData(ptr, static_cast<int>(chunkSize));
+            }
             
-        } while (bytesRead > 0);
+            ssize_t bytesWritten;
+            do {
+                phaseTimer.start();
+                bytesWritten = libssh2_sftp_write(sftp_handle, ptr, static_cast<size_t>(chunkSize));
+                networkNs += phaseTimer.nsecsElapsed();
+                if (bytesWritten < 0) {
+                    emit error("Failed to write to remote file");
+                    if (mapped) {
+                        localFile.unmap(mapped);
+                    }
+                    libssh2_sftp_close(sftp_handle);
+                    localFile.close();
+                    return false;
+                }
+                
+                ptr += bytesWritten;
+                chunkSize -= bytesWritten;
+                windowSent += bytesWritten;
+                totalSent += bytesWritten;
+                
+                // Send progress signal
+                emit transferProgress(totalSent, fileSize);
+                
+                if (statsTimer.elapsed() >= kStatsIntervalMs) {
+                    reportTransferStats(sftp_handle, true, networkNs, localIoNs);
+                    statsTimer.restart();
+                }
+                
+                // Allow event loop to process
+                QCoreApplication::processEvents();
+                
+            } while (chunkSize > 0);
+        }
+        
+        if (mapped) {
+            localFile.unmap(mapped);
+        }
     }
     
     // Close files
     libssh2_sftp_close(sftp_handle);
     localFile.close();
     
+    // The remote file is only complete now, so it has to be hashed afterwards
+    if (m_verifyTransfers) {
+        QString remoteHash = finishRemoteChecksum(startRemoteChecksum(remotePath));
+        if (!checkTransferHashes(QString::fromLatin1(localHash.result().toHex()), remoteHash, remotePath)) {
+            return false;
+        }
+    }
+    
     emit transferCompleted();
     return true;
 }
@@ -325,54 +532,123 @@ bool FTPClient::downloadFile(const QString &remotePath, const QString &localPath
         libssh2_sftp_close(sftp_handle);
         return false;
     }
+    qint64 fileSize = static_cast<qint64>(attrs.filesize);
     
     // Create local file
     QFile localFile(localPath);
-    if (!localFile.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+    if (!localFile.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Unbuffered)) {
         emit error("Failed to create local file: " + localPath);
         libssh2_sftp_close(sftp_handle);
         return false;
     }
     
-    // Download file data
-    char buffer[8192];
-    qint64 totalReceived = 0;
+#ifdef __linux__
+    // Reserve the whole file up front: the filesystem can lay it out contiguously,
+    // and a full disk is reported now instead of halfway through the transfer
+    if (fileSize > 0 && posix_fallocate(localFile.handle(), 0, fileSize) == ENOSPC) {
+        emit error("Not enough disk space for " + localPath);
+        libssh2_sftp_close(sftp_handle);
+        localFile.close();
+        localFile.remove();
+        return false;
+    }
+#endif
     
-    while (totalReceived < static_cast<qint64>(attrs.filesize)) {
-        ssize_t bytesRead = libssh2_sftp_read(sftp_handle, buffer, sizeof(buffer));
-        if (bytesRead < 0) {
-            emit error("Failed to read from remote file");
-            libssh2_sftp_close(sftp_handle);
-            localFile.close();
-            return false;
+    // For downloads the remote file is already complete, so the server hashes it
+    // on its own channel while we stream; the result is collected at the end
+    void *checksumChannel = m_verifyTransfers ? startRemoteChecksum(remotePath) : nullptr;
+    QCryptographicHash localHash(QCryptographicHash::Sha256);
+    
+    // Download file data. libssh2 pipelines read requests for large buffers and hands
+    // the data back in order, so each filled chunk goes to disk in a single write
+    QByteArray buffer(static_cast<int>(kTransferChunkSize), Qt::Uninitialized);
+    qint64 totalReceived = 0;
+    bool eof = false;
+    
+    QElapsedTimer statsTimer;
+    QElapsedTimer phaseTimer;
+    qint64 networkNs = 0;
+    qint64 localIoNs = 0;
+    statsTimer.start();
+    
+    while (!eof && totalReceived < fileSize) {
+        qint64 filled = 0;
+        while (filled < kTransferChunkSize && totalReceived + filled < fileSize) {
+            qint64 request = qMin(BandwidthLimiter::chunkSizeFor(kTransferChunkSize, rateBuckets()),
+                                  kTransferChunkSize - filled);
+            phaseTimer.start();
+            ssize_t bytesRead = libssh2_sftp_read(sftp_handle, buffer.data() + filled,
+                                                  static_cast<size_t>(request));
+            networkNs += phaseTimer.nsecsElapsed();
+            if (bytesRead < 0) {
+                emit error("Failed to read from remote file");
+                finishRemoteChecksum(checksumChannel);
+                libssh2_sftp_close(sftp_handle);
+                localFile.resize(totalReceived);
+                localFile.close();
+                return false;
+            }
+            
+            if (bytesRead == 0) {
+                eof = true;
+                break;
+            }
+            
+            filled += bytesRead;
+            BandwidthLimiter::throttle(bytesRead, rateBuckets());
+            
+            // Send progress signal
+            emit transferProgress(totalReceived + filled, fileSize);
+            
+            if (statsTimer.elapsed() >= kStatsIntervalMs) {
+                reportTransferStats(sftp_handle, false, networkNs, localIoNs);
+                statsTimer.restart();
+            }
+            
+            // Allow event loop to process
+            QCoreApplication::processEvents();
+        }
+        
+        if (filled == 0) {
+            break;
         }
         
-        if (bytesRead == 0) {
-            break; // EOF
+        if (m_verifyTransfers) {
+            localHash.addData(buffer.constData(), static_cast<int>(filled));
         }
         
-        qint64 bytesWritten = localFile.write(buffer, bytesRead);
-        if (bytesWritten != bytesRead) {
+        phaseTimer.start();
+        qint64 bytesWritten = localFile.write(buffer.constData(), filled);
+        localIoNs += phaseTimer.nsecsElapsed();
+        if (bytesWritten != filled) {
             emit error("Failed to write to local file");
+            finishRemoteChecksum(checksumChannel);
             libssh2_sftp_close(sftp_handle);
+            localFile.resize(totalReceived);
             localFile.close();
             return false;
         }
         
-        totalReceived += bytesRead;
-        
-        // Send progress signal
-        emit transferProgress(totalReceived, static_cast<qint64>(attrs.filesize));
-        
-        // Allow event loop to process
-        QThread::msleep(1);
-        QCoreApplication::processEvents();
+        totalReceived += filled;
+    }
+    
+    // The file was preallocated to the advertised size; trim it if the remote
+    // file turned out to be shorter
+    if (localFile.size() != totalReceived) {
+        localFile.resize(totalReceived);
     }
     
     // Close files
     libssh2_sftp_close(sftp_handle);
     localFile.close();
     
+    if (m_verifyTransfers) {
+        QString remoteHash = finishRemoteChecksum(checksumChannel);
+        if (!checkTransferHashes(QString::fromLatin1(localHash.result().toHex()), remoteHash, remotePath)) {
+            return false;
+        }
+    }
+    
     emit transferCompleted();
     return true;
 }
@@ -452,6 +728,104 @@ bool FTPClient::listDirectory(const QString &remotePath)
     return true;
 }
 
+bool FTPClient::listDirectoryRecursive(const QString &remotePath, QList<SftpEntry> &entries)
+{
+    if (!m_connected || !d->sftp_session) {
+        emit error("Not connected to SFTP server");
+        return false;
+    }
+    
+    QString root = remotePath;
+    while (root.length() > 1 && root.endsWith("/")) {
+        root.chop(1);
+    }
+    
+    // Walk the tree breadth-first; the attributes returned by readdir already
+    // carry size and mtime, so no per-file stat round trip is needed
+    QStringList pendingDirs;
+    pendingDirs << QString();
+    
+    while (!pendingDirs.isEmpty()) {
+        QString relativeDir = pendingDirs.takeFirst();
+        QString absoluteDir = root;
+        if (!relativeDir.isEmpty()) {
+            if (!absoluteDir.endsWith("/")) absoluteDir += "/";
+            absoluteDir += relativeDir;
+        }
+        
+        LIBSSH2_SFTP_HANDLE *sftp_handle = libssh2_sftp_opendir(d->sftp_session, absoluteDir.toStdString().c_str());
+        if (!sftp_handle) {
+            emit error("Failed to open directory: " + absoluteDir);
+            return false;
+        }
+        
+        // libssh2 skips a name that does not fit, so leave room for any name a server sends
+        QByteArray buffer(64 * 1024, Qt::Uninitialized);
+        LIBSSH2_SFTP_ATTRIBUTES attrs;
+        
+        while (true) {
+            int rc = libssh2_sftp_readdir(sftp_handle, buffer.data(), buffer.size(), &attrs);
+            if (rc == 0) {
+                break; // EOF
+            }
+            if (rc < 0) {
+                // A truncated listing would make the sync plan delete or re-send everything after it
+                libssh2_sftp_closedir(sftp_handle);
+                emit error("Failed to list directory: " + absoluteDir);
+                return false;
+            }
+            
+            QString name = QString::fromUtf8(buffer.constData(), rc);
+            if (name == "." || name == "..") {
+                continue;
+            }
+            
+            // Symlinks are not followed, and entries without a mode cannot be classified
+            if (!(attrs.flags & LIBSSH2_SFTP_ATTR_PERMISSIONS) || LIBSSH2_SFTP_S_ISLNK(attrs.permissions)) {
+                continue;
+            }
+            
+            SftpEntry entry;
+            entry.path = relativeDir.isEmpty() ? name : relativeDir + "/" + name;
+            entry.isDirectory = LIBSSH2_SFTP_S_ISDIR(attrs.permissions);
+            entry.size = entry.isDirectory ? 0 : static_cast<qint64>(attrs.filesize);
+            entry.mtime = static_cast<qint64>(attrs.mtime);
+            entries.append(entry);
+            
+            if (entry.isDirectory) {
+                pendingDirs.append(entry.path);
+            }
+        }
+        
+        libssh2_sftp_closedir(sftp_handle);
+    }
+    
+    return true;
+}
+
+bool FTPClient::setModificationTime(const QString &remotePath, qint64 mtime)
+{
+    if (!m_connected || !d->sftp_session) {
+        emit error("Not connected to SFTP server");
+        return false;
+    }
+    
+    LIBSSH2_SFTP_ATTRIBUTES attrs;
+    memset(&attrs, 0, sizeof(attrs));
+    attrs.flags = LIBSSH2_SFTP_ATTR_ACMODTIME;
+    attrs.atime = static_cast<unsigned long>(mtime);
+    attrs.mtime = static_cast<unsigned long>(mtime);
+    
+    int rc = libssh2_sftp_setstat(d->sftp_session, remotePath.toStdString().c_str(), &attrs);
+    
+    if (rc != 0) {
+        emit error("Failed to set modification time: " + remotePath);
+        return false;
+    }
+    
+    return true;
+}
+
 bool FTPClient::createDirectory(const QString &remotePath)
 {
     if (!m_connected || !d->sftp_session) {
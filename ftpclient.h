@@ -4,10 +4,20 @@
 #include <QObject>
 #include <QString>
 #include <QFile>
+#include <QList>
+#include "bandwidthlimiter.h"
 
 // Forward declaration of private class
 class FTPClientPrivate;
 
+// One entry of a recursive remote listing; path is relative to the listed root
+struct SftpEntry {
+    QString path;
+    qint64 size;
+    qint64 mtime;
+    bool isDirectory;
+};
+
 class FTPClient : public QObject
 {
     Q_OBJECT
@@ -19,9 +29,20 @@ public:
     void disconnect();
     bool isConnected() const;
     
+    // When enabled, uploads and downloads are checked against sha256sum on the server
+    void setVerifyTransfers(bool enabled);
+    bool verifyTransfers() const;
+    
+    // Bandwidth caps in bytes per second (0 = unlimited). Transfers are also charged to
+    // the session bucket, which several clients may share, and to the global bucket.
+    void setTransferRateLimit(qint64 bytesPerSecond);
+    void setSessionBucket(TokenBucket *bucket);
+    
     bool uploadFile(const QString &localPath, const QString &remotePath);
     bool downloadFile(const QString &remotePath, const QString &localPath);
     bool listDirectory(const QString &remotePath);
+    bool listDirectoryRecursive(const QString &remotePath, QList<SftpEntry> &entries);
+    bool setModificationTime(const QString &remotePath, qint64 mtime);
     bool createDirectory(const QString &remotePath);
     bool removeFile(const QString &remotePath);
     bool removeDirectory(const QString &remotePath);
@@ -33,14 +54,27 @@ signals:
     void transferProgress(qint64 bytesSent, qint64 bytesTotal);
     void directoryListed(const QStringList &entries);
     void transferCompleted();
+    void transferVerified(const QString &localHash, const QString &remoteHash);
+    // Emitted about twice a second during transfers: round trip of a small request queued
+    // behind the transfer (-1 if not measured), SSH window fill (0..1), and cumulative
+    // time spent waiting on the SFTP channel and on the local disk
+    void transferStats(double rttMs, double windowFill, qint64 networkMs, qint64 localIoMs);
 
 private:
     bool m_connected;
+    bool m_verifyTransfers;
+    TokenBucket m_transferBucket;
+    TokenBucket *m_sessionBucket;
     void *m_session; // Keep for backward compatibility
     FTPClientPrivate *d;
     
     bool initLibssh2();
     void cleanupLibssh2();
+    void *startRemoteChecksum(const QString &remotePath);
+    QString finishRemoteChecksum(void *channel);
+    bool checkTransferHashes(const QString &localHash, const QString &remoteHash, const QString &remotePath);
+    QList<TokenBucket*> rateBuckets();
+    void reportTransferStats(void *handle, bool upload, qint64 networkNs, qint64 localIoNs);
 };
 
 #endif // FTPCLIENT_H 
\ No newline at end of file
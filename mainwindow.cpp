@@ -10,6 +10,7 @@
 #include "sessionmanagerdialog.h"
 #include <QApplication>
 #include <QStyle>
+#include <QTabBar>
 #include <QDebug>
 
 MainWindow::MainWindow(QWidget *parent)
@@ -43,6 +44,12 @@ MainWindow::MainWindow(QWidget *parent)
     mainSplitter->setSizes(QList<int>() << 200 << width() - 200);
 
     connect(tabWidget, &QTabWidget::tabCloseRequested, this, &MainWindow::closeSession);
+    // 切换到标签页时清除提醒标记
+    connect(tabWidget, &QTabWidget::currentChanged, this, [this](int index) {
+        if (index >= 0) {
+            tabWidget->tabBar()->setTabTextColor(index, QColor());
+        }
+    });
     connect(sessionTreeWidget, &QTreeWidget::itemDoubleClicked, this, &MainWindow::onSessionItemDoubleClicked);
     
 
@@ -165,6 +172,7 @@ void MainWindow::createNewTab(const SessionInfo &session)
     
     // Connect to SSH server
     terminal->connectToSession(session);
+    watchHighlightAlerts(terminal);
     
     // 连接文件浏览器的状态改变信号
     connect(fileExplorer, &FileExplorerWidget::sftpStatusChanged, this, [=](bool /*connected*/, const QString &message) {
@@ -172,6 +180,23 @@ void MainWindow::createNewTab(const SessionInfo &session)
     });
 }
 
+// 后台标签页命中提醒规则：标签文字变色，状态栏显示命中的内容
+void MainWindow::watchHighlightAlerts(TerminalWidget *terminal)
+{
+    connect(terminal, &TerminalWidget::highlightAlert, this, [this, terminal](const QString &text) {
+        for (int i = 0; i < tabWidget->count(); ++i) {
+            QWidget *page = tabWidget->widget(i);
+            if (page == terminal || page->isAncestorOf(terminal)) {
+                if (i != tabWidget->currentIndex()) {
+                    tabWidget->tabBar()->setTabTextColor(i, QColor(Qt::red));
+                }
+                statusBar()->showMessage(tr("%1: %2").arg(tabWidget->tabText(i), text), 10000);
+                break;
+            }
+        }
+    });
+}
+
 void MainWindow::closeSession(int index)
 {
     // In a real implementation, we would disconnect from the server first
@@ -302,6 +327,7 @@ void MainWindow::connectToSession(const QString &host, int port, const QString &
     
     // 连接到会话
     terminal->connectToSession(sessionInfo);
+    watchHighlightAlerts(terminal);
     
     // Add to tab widget
     int index = tabWidget->addTab(terminal, host);
@@ -333,6 +359,7 @@ void MainWindow::connectToSessionWithKey(const QString &host, int port, const QS
     
     // 连接到会话
     terminal->connectToSession(sessionInfo);
+    watchHighlightAlerts(terminal);
     
     // Add to tab widget
     int index = tabWidget->addTab(terminal, host);
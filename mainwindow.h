@@ -52,6 +52,7 @@ private:
     void setupMenus();
     void setupToolbar();
     void createNewTab(const SessionInfo &session);
+    void watchHighlightAlerts(TerminalWidget *terminal);
     void populateSessionTree();
 };
 #endif // MAINWINDOW_H 
\ No newline at end of file
@@ -3,6 +3,7 @@
 #include <QHostAddress>
 #include <QNetworkProxy>
 #include <QTimer>
+#include <QThread>
 
 // 禁用 gethostbyname 弃用警告
 #define _WINSOCK_DEPRECATED_NO_WARNINGS
@@ -16,12 +17,28 @@
 #include <arpa/inet.h>
 #include <unistd.h>
 #include <netdb.h>
+#include <netinet/tcp.h>
+#include <netinet/ip.h>
 #endif
 
+#include "bandwidthlimiter.h"
+
+// 交互式 shell：关闭 Nagle，并标记为低延迟流量
+static void setInteractiveSocketOptions(SOCKET sock)
+{
+    int flag = 1;
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char *>(&flag), sizeof(flag));
+#ifndef Q_OS_WIN
+    int tos = IPTOS_LOWDELAY;
+    setsockopt(sock, IPPROTO_IP, IP_TOS, &tos, sizeof(tos));
+#endif
+}
+
 SSHClient::SSHClient(QObject *parent)
     : QObject(parent), m_connected(false), m_session(nullptr), 
       m_socketDescriptor(INVALID_SOCKET), m_wsaInitialized(false),
-      m_channel(nullptr), m_shellActive(false)
+      m_channel(nullptr), m_shellActive(false), m_readNotifier(nullptr), m_pollTimer(nullptr),
+      m_pendingWrite(0), m_writeNotifier(nullptr)
 {
     initLibssh2();
 }
@@ -145,6 +162,8 @@ bool SSHClient::connect(const QString &host, int port, const QString &username,
         return false;
     }
     
+    setInteractiveSocketOptions(m_socketDescriptor);
+    
     // Create session
     m_session = libssh2_session_init();
     if (!m_session) {
@@ -231,6 +250,8 @@ bool SSHClient::connectWithKey(const QString &host, int port, const QString &use
         return false;
     }
     
+    setInteractiveSocketOptions(m_socketDescriptor);
+    
     // Create session
     m_session = libssh2_session_init();
     if (!m_session) {
@@ -301,6 +322,32 @@ void SSHClient::disconnect()
         return;
     }
     
+    // 从界面线程调用时等待会话线程完成断开
+    if (QThread::currentThread() != thread() && thread()->isRunning()) {
+        QMetaObject::invokeMethod(this, [this]() { disconnect(); }, Qt::BlockingQueuedConnection);
+        return;
+    }
+    
+    if (m_readNotifier) {
+        m_readNotifier->setEnabled(false);
+        m_readNotifier->deleteLater();
+        m_readNotifier = nullptr;
+    }
+    
+    if (m_pollTimer) {
+        m_pollTimer->stop();
+        m_pollTimer->deleteLater();
+        m_pollTimer = nullptr;
+    }
+
+    if (m_writeNotifier) {
+        m_writeNotifier->setEnabled(false);
+        m_writeNotifier->deleteLater();
+        m_writeNotifier = nullptr;
+    }
+    m_writeQueue.clear();
+    m_pendingWrite.storeRelease(0);
+    
     if (m_channel) {
         libssh2_channel_free(m_channel);
         m_channel = nullptr;
@@ -393,8 +440,16 @@ bool SSHClient::executeCommand(const QString &command)
     return true;
 }
 
-bool SSHClient::startShell()
+bool SSHClient::startShell(const QString &terminalType, int columns, int rows)
 {
+    // 套接字通知器必须在会话线程中创建
+    if (QThread::currentThread() != thread() && thread()->isRunning()) {
+        QMetaObject::invokeMethod(this, [this, terminalType, columns, rows]() {
+            startShell(terminalType, columns, rows);
+        }, Qt::QueuedConnection);
+        return m_connected;
+    }
+    
     if (!m_connected || !m_session) {
         emit error("Not connected to server");
         return false;
@@ -414,8 +469,10 @@ bool SSHClient::startShell()
         return false;
     }
     
-    // Request a pseudo-terminal (PTY)
-    if (libssh2_channel_request_pty(m_channel, "xterm") != 0) {
+    // Request a pseudo-terminal (PTY) with the terminal's real size
+    QByteArray term = terminalType.isEmpty() ? QByteArray("xterm") : terminalType.toLatin1();
+    if (libssh2_channel_request_pty_ex(m_channel, term.constData(), static_cast<unsigned int>(term.size()),
+                                       nullptr, 0, columns, rows, 0, 0) != 0) {
         emit error("Failed to request PTY");
         libssh2_channel_free(m_channel);
         m_channel = nullptr;
@@ -435,48 +492,152 @@ bool SSHClient::startShell()
     
     m_shellActive = true;
     
-    // Start a timer to periodically read from the channel
-    QTimer *timer = new QTimer(this);
-    QObject::connect(timer, &QTimer::timeout, this, &SSHClient::readChannel);
-    timer->start(100); // Check every 100ms
+    // 套接字一有数据就读取；定时器兜底处理 libssh2 内部已缓存、套接字不再触发的数据
+    m_readNotifier = new QSocketNotifier(m_socketDescriptor, QSocketNotifier::Read, this);
+    QObject::connect(m_readNotifier, &QSocketNotifier::activated, this, &SSHClient::readChannel);
+    
+    m_pollTimer = new QTimer(this);
+    QObject::connect(m_pollTimer, &QTimer::timeout, this, &SSHClient::readChannel);
+    m_pollTimer->start(100); // Check every 100ms
+
+    // 套接字发送缓冲区满时，等它可写再继续写队列
+    m_writeNotifier = new QSocketNotifier(m_socketDescriptor, QSocketNotifier::Write, this);
+    m_writeNotifier->setEnabled(false);
+    QObject::connect(m_writeNotifier, &QSocketNotifier::activated, this, &SSHClient::flushWrites);
     
     return true;
 }
 
 bool SSHClient::sendData(const QByteArray &data)
 {
+    // 界面线程的写入排队到会话线程，按调用顺序发送
+    if (QThread::currentThread() != thread() && thread()->isRunning()) {
+        if (!m_connected) {
+            return false;
+        }
+        // 排队时即计入，调用方据此控制发送速度
+        m_pendingWrite.fetchAndAddOrdered(data.size());
+        QMetaObject::invokeMethod(this, [this, data]() {
+            m_pendingWrite.fetchAndSubOrdered(data.size());
+            sendData(data);
+        }, Qt::QueuedConnection);
+        return true;
+    }
+    
     if (!m_connected || !m_session || !m_channel || !m_shellActive) {
         emit error("Shell not active");
         return false;
     }
     
-    ssize_t bytesWritten = libssh2_channel_write(m_channel, data.constData(), data.size());
-    if (bytesWritten < 0) {
-        emit error(QString("Failed to send data: %1").arg(bytesWritten));
-        return false;
+    // 小块写入来自键盘输入，让并行的 SFTP 传输暂时让路
+    if (data.size() <= 64) {
+        BandwidthLimiter::noteInteractiveActivity();
     }
     
+    // 通道是非阻塞的，一次可能只写入一部分；其余留在队列中稍后补写，保证不丢数据
+    m_writeQueue.append(data);
+    m_pendingWrite.fetchAndAddOrdered(data.size());
+    flushWrites();
     return true;
 }
 
+void SSHClient::resizePty(int columns, int rows)
+{
+    if (QThread::currentThread() != thread() && thread()->isRunning()) {
+        QMetaObject::invokeMethod(this, [this, columns, rows]() { resizePty(columns, rows); }, Qt::QueuedConnection);
+        return;
+    }
+    
+    if (!m_channel || !m_shellActive) {
+        return;
+    }
+    
+    // 通道是非阻塞的，请求未发完时等待套接字后重试
+    int rc;
+    while ((rc = libssh2_channel_request_pty_size(m_channel, columns, rows)) == LIBSSH2_ERROR_EAGAIN) {
+        waitSocket(100);
+    }
+    if (rc != 0) {
+        emit error(QString("Failed to resize PTY: %1").arg(rc));
+    }
+}
+
+void SSHClient::flushWrites()
+{
+    if (!m_channel || !m_shellActive) {
+        return;
+    }
+    
+    qint64 written = 0;
+    while (written < m_writeQueue.size()) {
+        ssize_t rc = libssh2_channel_write(m_channel, m_writeQueue.constData() + written, m_writeQueue.size() - written);
+        if (rc == LIBSSH2_ERROR_EAGAIN) {
+            break;
+        }
+        if (rc < 0) {
+            emit error(QString("Failed to send data: %1").arg(rc));
+            written = m_writeQueue.size();
+            break;
+        }
+        written += rc;
+    }
+    
+    if (written > 0) {
+        m_writeQueue.remove(0, static_cast<int>(written));
+        m_pendingWrite.fetchAndSubOrdered(static_cast<int>(written));
+        emit dataWritten();
+    }
+    
+    // 套接字写满时等待可写通知；远端窗口已满时窗口调整包随读取处理，readChannel 会再次补写
+    if (m_writeNotifier) {
+        bool blockedOnSocket = !m_writeQueue.isEmpty()
+                               && (libssh2_session_block_directions(m_session) & LIBSSH2_SESSION_BLOCK_OUTBOUND);
+        m_writeNotifier->setEnabled(blockedOnSocket);
+    }
+}
+
 void SSHClient::readChannel()
 {
     if (!m_connected || !m_session || !m_channel || !m_shellActive) {
         return;
     }
     
-    char buffer[4096];
-    ssize_t bytesRead;
+    // 一次读空通道（直到 EAGAIN），合并为一个数据块发出；
+    // 单次最多读取 kReadBudget 字节，剩余部分在下一轮事件循环继续，界面保持响应
+    const int kReadBudget = 256 * 1024;
+    char buffer[32768];
+    ssize_t bytesRead = 0;
+    QByteArray received;
     
-    // Read from the channel
-    bytesRead = libssh2_channel_read(m_channel, buffer, sizeof(buffer));
-    if (bytesRead > 0) {
-        emit dataReceived(QByteArray(buffer, bytesRead));
-    } else if (bytesRead < 0 && bytesRead != LIBSSH2_ERROR_EAGAIN) {
+    while (received.size() < kReadBudget) {
+        bytesRead = libssh2_channel_read(m_channel, buffer, sizeof(buffer));
+        if (bytesRead <= 0) {
+            break;
+        }
+        received.append(buffer, static_cast<int>(bytesRead));
+    }
+    
+    if (bytesRead < 0 && bytesRead != LIBSSH2_ERROR_EAGAIN) {
         // Error reading from channel
         emit error(QString("Error reading from channel: %1").arg(bytesRead));
     }
     
+    if (!received.isEmpty()) {
+        emit dataReceived(received);
+        if (received.size() >= kReadBudget) {
+            QTimer::singleShot(0, this, &SSHClient::readChannel);
+        }
+    }
+    
+    if (!m_channel) {
+        return;     // 数据处理过程中连接已断开
+    }
+    
+    // 读取时已处理远端的窗口调整，之前因窗口已满未写完的数据可以继续写
+    if (!m_writeQueue.isEmpty()) {
+        flushWrites();
+    }
+    
     // Check if the channel is EOF
     if (libssh2_channel_eof(m_channel)) {
         emit error("Remote host has closed the connection");
@@ -6,6 +6,13 @@
 #include <QByteArray>
 #include <libssh2.h>
 #include <QTcpSocket>
+#include <QSocketNotifier>
+#include <QAtomicInt>
+
+class QTimer;
+
+// shell 会话运行在 SSHConnectionThread 的事件循环中。其他线程调用 startShell、sendData
+// 和 disconnect 时会转到该线程执行，libssh2 会话始终只被一个线程使用。
 
 class SSHClient : public QObject
 {
@@ -20,22 +27,35 @@ public:
     bool isConnected() const;
 
     bool executeCommand(const QString &command);
-    bool startShell();
+    // 终端类型和初始尺寸随 PTY 请求发送
+    bool startShell(const QString &terminalType = QStringLiteral("xterm"), int columns = 80, int rows = 24);
+    // 通知远端终端窗口尺寸变化（SIGWINCH）
+    void resizePty(int columns, int rows);
     bool sendData(const QByteArray &data);
+    // 已交给 sendData 但尚未写入通道的字节数，任何线程均可读取
+    int pendingWriteBytes() const { return m_pendingWrite.loadAcquire(); }
 
 signals:
     void connected();
     void disconnected();
     void error(const QString &errorMessage);
     void dataReceived(const QByteArray &data);
+    // 写队列中有数据写入了通道
+    void dataWritten();
 
 private:
-    bool m_connected;
+    QAtomicInt m_connected;           // 界面线程通过 isConnected() 读取
     LIBSSH2_SESSION *m_session;
     SOCKET m_socketDescriptor;
     bool m_wsaInitialized;  // 跟踪 WSA 是否已初始化
     LIBSSH2_CHANNEL *m_channel;
     bool m_shellActive;
+    QSocketNotifier *m_readNotifier;  // 套接字可读时立即读取 shell 输出
+    QTimer *m_pollTimer;
+    // 通道窗口或套接字缓冲区已满时未写完的数据，按顺序补写
+    QByteArray m_writeQueue;
+    QAtomicInt m_pendingWrite;
+    QSocketNotifier *m_writeNotifier;
     
     bool initLibssh2();
     void cleanupLibssh2();
@@ -45,6 +65,7 @@ private:
     bool authenticateWithKey(const QString &username, const QString &privateKeyFile, const QString &passphrase);
     bool waitSocket(int timeout_ms);
     void readChannel();
+    void flushWrites();
 
 };
 
@@ -5,6 +5,9 @@ SSHConnectionThread::SSHConnectionThread(QObject *parent)
 {
     m_sshClient = new SSHClient();
     
+    // 连接建立后会话的读写都在本线程进行，界面线程只负责显示
+    m_sshClient->moveToThread(this);
+    
     // 连接信号以便在线程中转发
     connect(m_sshClient, &SSHClient::connected, this, &SSHConnectionThread::connectionEstablished);
     connect(m_sshClient, &SSHClient::error, this, &SSHConnectionThread::connectionFailed);
@@ -13,10 +16,7 @@ SSHConnectionThread::SSHConnectionThread(QObject *parent)
 SSHConnectionThread::~SSHConnectionThread()
 {
     // 确保线程停止
-    if (isRunning()) {
-        terminate();
-        wait();
-    }
+    stop();
     
     // 清理资源
     if (m_sshClient) {
@@ -61,5 +61,26 @@ void SSHConnectionThread::run()
     // 如果连接失败但没有发出错误信号，发出一个通用错误
     if (!success && !m_sshClient->isConnected()) {
         emit connectionFailed("Failed to establish SSH connection");
+        return;
+    }
+    
+    // 运行事件循环处理 shell 的读写，直到 stop()
+    exec();
+    
+    // 通知器和定时器属于本线程，在这里释放
+    m_sshClient->disconnect();
+}
+
+void SSHConnectionThread::stop()
+{
+    if (!isRunning()) {
+        return;
+    }
+    
+    quit();
+    if (!wait(3000)) {
+        // 仍阻塞在连接或认证中
+        terminate();
+        wait();
     }
 } 
\ No newline at end of file
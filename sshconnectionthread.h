@@ -17,6 +17,8 @@ public:
     void setKeyConnectionParams(const QString &host, int port, const QString &username, 
                                const QString &privateKeyFile, const QString &passphrase);
     SSHClient* getSSHClient() const { return m_sshClient; }
+    // 结束会话线程的事件循环；连接仍在建立时超时后强制结束
+    void stop();
 
 signals:
     void connectionEstablished();
@@ -0,0 +1,426 @@
+#include "syncjob.h"
+#include <QDir>
+#include <QDirIterator>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QHash>
+#include <QSet>
+#include <QMutexLocker>
+#include <algorithm>
+
+// FAT and some SFTP servers only keep 2 second resolution
+static const qint64 kMtimeTolerance = 2;
+
+// Each worker owns its own SFTP session so transfers really run side by side
+class SyncWorker : public QThread
+{
+public:
+    explicit SyncWorker(SyncJob *job) : m_job(job) {}
+
+protected:
+    void run() override
+    {
+        FTPClient client;
+        QString lastError;
+        QObject::connect(&client, &FTPClient::error, [&lastError](const QString &message) {
+            lastError = message;
+        });
+
+        if (!client.connect(m_job->m_host, m_job->m_port, m_job->m_username, m_job->m_password)) {
+            // Let the remaining workers drain the queue
+            return;
+        }
+        client.setVerifyTransfers(m_job->m_verifyTransfers);
+        client.setTransferRateLimit(m_job->m_transferRateLimit);
+        client.setSessionBucket(m_job->m_sessionBucket);
+
+        qint64 reported = 0;
+        QObject::connect(&client, &FTPClient::transferProgress, [this, &reported](qint64 bytesSent, qint64) {
+            m_job->addTransferredBytes(bytesSent - reported);
+            reported = bytesSent;
+        });
+
+        SyncAction action;
+        while (m_job->takeNextTransfer(action)) {
+            reported = 0;
+            lastError.clear();
+
+            QString localPath = m_job->localPath(action.path);
+            QString remotePath = m_job->remotePath(action.path);
+            bool ok;
+
+            if (action.type == SyncAction::Upload) {
+                ok = client.uploadFile(localPath, remotePath);
+                // Carry the local mtime over so the next run sees the file as unchanged
+                if (ok) {
+                    client.setModificationTime(remotePath, action.mtime);
+                }
+            } else {
+                ok = client.downloadFile(remotePath, localPath);
+                if (ok) {
+                    QFile localFile(localPath);
+                    if (localFile.open(QIODevice::ReadWrite)) {
+                        localFile.setFileTime(QDateTime::fromSecsSinceEpoch(action.mtime), QFileDevice::FileModificationTime);
+                    }
+                }
+            }
+
+            // Account for bytes the progress signal did not cover (e.g. empty files)
+            if (ok && action.size > reported) {
+                m_job->addTransferredBytes(action.size - reported);
+            }
+
+            m_job->completeAction(ok, lastError);
+        }
+
+        client.disconnect();
+    }
+
+private:
+    SyncJob *m_job;
+};
+
+SyncJob::SyncJob(QObject *parent)
+    : QThread(parent), m_port(22), m_direction(LocalToRemote), m_deleteExtraneous(false),
+      m_parallelTransfers(3), m_verifyTransfers(false),
+      m_transferRateLimit(0), m_sessionBucket(nullptr), m_cancelled(0), m_bytesTotal(0), m_bytesDone(0),
+      m_actionsTotal(0), m_actionsDone(0), m_failures(0)
+{
+}
+
+SyncJob::~SyncJob()
+{
+    cancel();
+    wait();
+}
+
+void SyncJob::setConnectionParams(const QString &host, int port, const QString &username, const QString &password)
+{
+    m_host = host;
+    m_port = port;
+    m_username = username;
+    m_password = password;
+}
+
+void SyncJob::setRoots(const QString &localRoot, const QString &remoteRoot)
+{
+    m_localRoot = localRoot;
+    m_remoteRoot = remoteRoot;
+}
+
+void SyncJob::setDirection(Direction direction)
+{
+    m_direction = direction;
+}
+
+void SyncJob::setDeleteExtraneous(bool enabled)
+{
+    m_deleteExtraneous = enabled;
+}
+
+void SyncJob::setParallelTransfers(int count)
+{
+    m_parallelTransfers = qMax(1, count);
+}
+
+void SyncJob::setVerifyTransfers(bool enabled)
+{
+    m_verifyTransfers = enabled;
+}
+
+void SyncJob::setTransferRateLimit(qint64 bytesPerSecond)
+{
+    m_transferRateLimit = bytesPerSecond;
+}
+
+void SyncJob::setSessionBucket(TokenBucket *bucket)
+{
+    m_sessionBucket = bucket;
+}
+
+void SyncJob::cancel()
+{
+    m_cancelled.storeRelease(1);
+}
+
+QString SyncJob::localPath(const QString &relativePath) const
+{
+    return QDir(m_localRoot).filePath(relativePath);
+}
+
+QString SyncJob::remotePath(const QString &relativePath) const
+{
+    QString path = m_remoteRoot;
+    if (!path.endsWith("/")) path += "/";
+    return path + relativePath;
+}
+
+QList<SftpEntry> SyncJob::scanLocalTree(const QString &localRoot)
+{
+    QList<SftpEntry> entries;
+    QDir root(localRoot);
+
+    QDirIterator it(localRoot, QDir::AllEntries | QDir::NoDotAndDotDot | QDir::Hidden | QDir::NoSymLinks,
+                    QDirIterator::Subdirectories);
+    while (it.hasNext()) {
+        it.next();
+        QFileInfo info = it.fileInfo();
+
+        SftpEntry entry;
+        entry.path = root.relativeFilePath(info.filePath());
+        entry.isDirectory = info.isDir();
+        entry.size = entry.isDirectory ? 0 : info.size();
+        entry.mtime = info.lastModified().toSecsSinceEpoch();
+        entries.append(entry);
+    }
+
+    return entries;
+}
+
+QList<SyncAction> SyncJob::computePlan(const QList<SftpEntry> &localEntries, const QList<SftpEntry> &remoteEntries,
+                                       Direction direction, bool deleteExtraneous)
+{
+    QHash<QString, SftpEntry> remoteByPath;
+    for (const SftpEntry &entry : remoteEntries) {
+        remoteByPath.insert(entry.path, entry);
+    }
+
+    QSet<QString> localPaths;
+    QList<SyncAction> directories;
+    QList<SyncAction> transfers;
+    QList<SyncAction> deletions;
+
+    // Deleting only makes sense for one-way mirrors: in two-way mode a missing
+    // file cannot be told apart from a newly created one without a history
+    bool mayDelete = deleteExtraneous && direction != TwoWay;
+
+    for (const SftpEntry &local : localEntries) {
+        localPaths.insert(local.path);
+        auto remoteIt = remoteByPath.constFind(local.path);
+        bool existsRemotely = remoteIt != remoteByPath.constEnd();
+
+        SyncAction action;
+        action.path = local.path;
+        action.size = local.size;
+        action.mtime = local.mtime;
+        action.isDirectory = local.isDirectory;
+
+        if (existsRemotely && remoteIt->isDirectory != local.isDirectory) {
+            // A file on one side and a directory on the other needs a human decision
+            continue;
+        }
+
+        if (!existsRemotely) {
+            if (direction != RemoteToLocal) {
+                action.type = local.isDirectory ? SyncAction::MakeRemoteDirectory : SyncAction::Upload;
+                (local.isDirectory ? directories : transfers).append(action);
+            } else if (mayDelete) {
+                action.type = SyncAction::DeleteLocal;
+                deletions.append(action);
+            }
+            continue;
+        }
+
+        if (local.isDirectory) {
+            continue;
+        }
+
+        const SftpEntry &remote = *remoteIt;
+        bool sameSize = remote.size == local.size;
+        bool sameTime = qAbs(remote.mtime - local.mtime) <= kMtimeTolerance;
+        if (sameSize && sameTime) {
+            continue;
+        }
+
+        bool upload = direction == LocalToRemote ||
+                      (direction == TwoWay && local.mtime > remote.mtime);
+        if (upload) {
+            action.type = SyncAction::Upload;
+        } else {
+            action.type = SyncAction::Download;
+            action.size = remote.size;
+            action.mtime = remote.mtime;
+        }
+        transfers.append(action);
+    }
+
+    for (const SftpEntry &remote : remoteEntries) {
+        if (localPaths.contains(remote.path)) {
+            continue;
+        }
+
+        SyncAction action;
+        action.path = remote.path;
+        action.size = remote.size;
+        action.mtime = remote.mtime;
+        action.isDirectory = remote.isDirectory;
+
+        if (direction != LocalToRemote) {
+            action.type = remote.isDirectory ? SyncAction::MakeLocalDirectory : SyncAction::Download;
+            (remote.isDirectory ? directories : transfers).append(action);
+        } else if (mayDelete) {
+            action.type = SyncAction::DeleteRemote;
+            deletions.append(action);
+        }
+    }
+
+    // Parents before children when creating, children before parents when deleting
+    std::sort(directories.begin(), directories.end(), [](const SyncAction &a, const SyncAction &b) {
+        return a.path < b.path;
+    });
+    std::sort(deletions.begin(), deletions.end(), [](const SyncAction &a, const SyncAction &b) {
+        return a.path.length() > b.path.length();
+    });
+    // Start the largest files first so parallel workers finish at about the same time
+    std::sort(transfers.begin(), transfers.end(), [](const SyncAction &a, const SyncAction &b) {
+        return a.size > b.size;
+    });
+
+    return directories + transfers + deletions;
+}
+
+bool SyncJob::takeNextTransfer(SyncAction &action)
+{
+    QMutexLocker locker(&m_mutex);
+    if (m_cancelled.loadAcquire() || m_pendingTransfers.isEmpty()) {
+        return false;
+    }
+    action = m_pendingTransfers.takeFirst();
+    return true;
+}
+
+void SyncJob::addTransferredBytes(qint64 bytes)
+{
+    QMutexLocker locker(&m_mutex);
+    m_bytesDone += bytes;
+    
+    // Workers report every few KB; the UI only needs a handful of updates per second
+    if (m_progressTimer.isValid() && m_progressTimer.elapsed() < 100) {
+        return;
+    }
+    m_progressTimer.restart();
+    emit syncProgress(m_bytesDone, m_bytesTotal, m_actionsDone, m_actionsTotal);
+}
+
+void SyncJob::completeAction(bool success, const QString &errorMessage)
+{
+    QMutexLocker locker(&m_mutex);
+    m_actionsDone++;
+    if (!success) {
+        m_failures++;
+        if (!errorMessage.isEmpty()) {
+            m_lastError = errorMessage;
+        }
+    }
+    emit syncProgress(m_bytesDone, m_bytesTotal, m_actionsDone, m_actionsTotal);
+}
+
+void SyncJob::run()
+{
+    m_bytesDone = 0;
+    m_actionsDone = 0;
+    m_failures = 0;
+    m_lastError.clear();
+
+    FTPClient client;
+    QString lastError;
+    QObject::connect(&client, &FTPClient::error, [&lastError](const QString &message) {
+        lastError = message;
+    });
+
+    if (!client.connect(m_host, m_port, m_username, m_password)) {
+        emit syncFinished(false, lastError.isEmpty() ? tr("Failed to connect to %1").arg(m_host) : lastError);
+        return;
+    }
+
+    QList<SftpEntry> remoteEntries;
+    if (!client.listDirectoryRecursive(m_remoteRoot, remoteEntries)) {
+        // A missing remote root is fine when we are about to populate it; a listing that
+        // failed part way through is not
+        if (m_direction == RemoteToLocal || !remoteEntries.isEmpty() || !client.createDirectory(m_remoteRoot)) {
+            emit syncFinished(false, lastError);
+            client.disconnect();
+            return;
+        }
+        remoteEntries.clear();
+    }
+
+    QDir().mkpath(m_localRoot);
+    QList<SftpEntry> localEntries = scanLocalTree(m_localRoot);
+
+    QList<SyncAction> plan = computePlan(localEntries, remoteEntries, m_direction, m_deleteExtraneous);
+
+    QList<SyncAction> deletions;
+    m_bytesTotal = 0;
+    m_actionsTotal = plan.size();
+    for (const SyncAction &action : plan) {
+        if (action.type == SyncAction::Upload || action.type == SyncAction::Download) {
+            m_pendingTransfers.append(action);
+            m_bytesTotal += action.size;
+        } else if (action.type == SyncAction::DeleteLocal || action.type == SyncAction::DeleteRemote) {
+            deletions.append(action);
+        }
+    }
+
+    emit planReady(m_actionsTotal, m_bytesTotal);
+
+    // Directories first, over the planning session
+    for (const SyncAction &action : plan) {
+        if (m_cancelled.loadAcquire()) break;
+        if (action.type == SyncAction::MakeRemoteDirectory) {
+            lastError.clear();
+            completeAction(client.createDirectory(remotePath(action.path)), lastError);
+        } else if (action.type == SyncAction::MakeLocalDirectory) {
+            completeAction(QDir().mkpath(localPath(action.path)), tr("Failed to create directory: %1").arg(action.path));
+        }
+    }
+
+    // Transfers, spread over parallel sessions
+    int workerCount = qMin(m_parallelTransfers, m_pendingTransfers.size());
+    QList<SyncWorker *> workers;
+    for (int i = 0; i < workerCount; ++i) {
+        SyncWorker *worker = new SyncWorker(this);
+        workers.append(worker);
+        worker->start();
+    }
+    for (SyncWorker *worker : workers) {
+        worker->wait();
+        delete worker;
+    }
+
+    // Whatever is still queued could not be transferred (cancelled or no session)
+    {
+        QMutexLocker locker(&m_mutex);
+        if (!m_pendingTransfers.isEmpty() && !m_cancelled.loadAcquire()) {
+            m_failures += m_pendingTransfers.size();
+            m_lastError = tr("Could not open transfer sessions");
+        }
+        m_pendingTransfers.clear();
+    }
+
+    // Deletions last, so a failed transfer never leaves us with less than we started
+    for (const SyncAction &action : deletions) {
+        if (m_cancelled.loadAcquire() || m_failures > 0) break;
+        lastError.clear();
+        bool ok;
+        if (action.type == SyncAction::DeleteRemote) {
+            ok = action.isDirectory ? client.removeDirectory(remotePath(action.path))
+                                    : client.removeFile(remotePath(action.path));
+        } else {
+            ok = action.isDirectory ? QDir().rmdir(localPath(action.path))
+                                    : QFile::remove(localPath(action.path));
+            if (!ok) lastError = tr("Failed to delete %1").arg(action.path);
+        }
+        completeAction(ok, lastError);
+    }
+
+    client.disconnect();
+
+    if (m_cancelled.loadAcquire()) {
+        emit syncFinished(false, tr("Canceled by user"));
+    } else if (m_failures > 0) {
+        emit syncFinished(false, tr("%1 of %2 actions failed: %3").arg(m_failures).arg(m_actionsTotal).arg(m_lastError));
+    } else {
+        emit syncFinished(true, tr("%1 actions, %2 bytes").arg(m_actionsTotal).arg(m_bytesTotal));
+    }
+}
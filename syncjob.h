@@ -0,0 +1,91 @@
+#ifndef SYNCJOB_H
+#define SYNCJOB_H
+
+#include <QThread>
+#include <QMutex>
+#include <QList>
+#include <QString>
+#include <QAtomicInt>
+#include <QElapsedTimer>
+#include "ftpclient.h"
+
+// A single step of a sync plan; path is relative to the sync roots
+struct SyncAction {
+    enum Type { MakeRemoteDirectory, MakeLocalDirectory, Upload, Download, DeleteRemote, DeleteLocal };
+
+    Type type;
+    QString path;
+    qint64 size;
+    qint64 mtime;
+    bool isDirectory;
+};
+
+class SyncWorker;
+
+class SyncJob : public QThread
+{
+    Q_OBJECT
+
+public:
+    enum Direction { LocalToRemote, RemoteToLocal, TwoWay };
+
+    explicit SyncJob(QObject *parent = nullptr);
+    ~SyncJob();
+
+    void setConnectionParams(const QString &host, int port, const QString &username, const QString &password);
+    void setRoots(const QString &localRoot, const QString &remoteRoot);
+    void setDirection(Direction direction);
+    void setDeleteExtraneous(bool enabled);
+    void setParallelTransfers(int count);
+    void setVerifyTransfers(bool enabled);
+    void setTransferRateLimit(qint64 bytesPerSecond);
+    void setSessionBucket(TokenBucket *bucket);
+    void cancel();
+
+    static QList<SftpEntry> scanLocalTree(const QString &localRoot);
+    static QList<SyncAction> computePlan(const QList<SftpEntry> &localEntries, const QList<SftpEntry> &remoteEntries,
+                                         Direction direction, bool deleteExtraneous);
+
+signals:
+    void planReady(int actionCount, qint64 bytesTotal);
+    void syncProgress(qint64 bytesDone, qint64 bytesTotal, int actionsDone, int actionsTotal);
+    void syncFinished(bool success, const QString &message);
+
+protected:
+    void run() override;
+
+private:
+    friend class SyncWorker;
+
+    QString m_host;
+    int m_port;
+    QString m_username;
+    QString m_password;
+    QString m_localRoot;
+    QString m_remoteRoot;
+    Direction m_direction;
+    bool m_deleteExtraneous;
+    int m_parallelTransfers;
+    bool m_verifyTransfers;
+    qint64 m_transferRateLimit;
+    TokenBucket *m_sessionBucket;
+
+    QAtomicInt m_cancelled;
+    QMutex m_mutex;
+    QList<SyncAction> m_pendingTransfers;
+    qint64 m_bytesTotal;
+    qint64 m_bytesDone;
+    int m_actionsTotal;
+    int m_actionsDone;
+    int m_failures;
+    QString m_lastError;
+    QElapsedTimer m_progressTimer;
+
+    QString localPath(const QString &relativePath) const;
+    QString remotePath(const QString &relativePath) const;
+    bool takeNextTransfer(SyncAction &action);
+    void addTransferredBytes(qint64 bytes);
+    void completeAction(bool success, const QString &errorMessage = QString());
+};
+
+#endif // SYNCJOB_H
@@ -0,0 +1,199 @@
+#include "terminaldecoder.h"
+#include <QTextCodec>
+#include <QTextDecoder>
+#include <QtAlgorithms>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define TERMINALDECODER_SSE2
+#endif
+
+namespace {
+
+// Windows-1252 0x80-0x9F; undefined positions map to themselves like Windows does
+const quint16 g_windows1252[32] = {
+    0x20AC, 0x0081, 0x201A, 0x0192, 0x201E, 0x2026, 0x2020, 0x2021,
+    0x02C6, 0x2030, 0x0160, 0x2039, 0x0152, 0x008D, 0x017D, 0x008F,
+    0x0090, 0x2018, 0x2019, 0x201C, 0x201D, 0x2022, 0x2013, 0x2014,
+    0x02DC, 0x2122, 0x0161, 0x203A, 0x0153, 0x009D, 0x017E, 0x0178
+};
+
+} // namespace
+
+TerminalDecoder::TerminalDecoder()
+    : m_encoding(Utf8)
+    , m_codec(nullptr)
+    , m_codepoint(0)
+    , m_remaining(0)
+    , m_minimum(0)
+{
+}
+
+TerminalDecoder::~TerminalDecoder()
+{
+}
+
+bool TerminalDecoder::setEncoding(const QString &name)
+{
+    QByteArray key = name.trimmed().toLatin1().toLower();
+    m_codec = nullptr;
+    m_codecDecoder.reset();
+    bool known = true;
+
+    if (key.isEmpty() || key == "utf-8" || key == "utf8") {
+        m_encoding = Utf8;
+    } else if (key == "iso-8859-1" || key == "latin1" || key == "latin-1") {
+        m_encoding = Latin1;
+    } else if (key == "windows-1252" || key == "cp1252") {
+        m_encoding = Windows1252;
+    } else {
+        m_codec = QTextCodec::codecForName(key);
+        if (m_codec) {
+            m_encoding = Codec;
+            m_codecDecoder.reset(m_codec->makeDecoder());
+        } else {
+            m_encoding = Utf8;
+            known = false;
+        }
+    }
+
+    m_remaining = 0;
+    return known;
+}
+
+QString TerminalDecoder::encodingName() const
+{
+    switch (m_encoding) {
+    case Latin1:
+        return QStringLiteral("ISO-8859-1");
+    case Windows1252:
+        return QStringLiteral("Windows-1252");
+    case Codec:
+        return QString::fromLatin1(m_codec->name());
+    default:
+        return QStringLiteral("UTF-8");
+    }
+}
+
+void TerminalDecoder::reset()
+{
+    m_remaining = 0;
+    if (m_codec)
+        m_codecDecoder.reset(m_codec->makeDecoder());
+}
+
+int TerminalDecoder::decode(const char *data, int length, quint32 *output)
+{
+    const unsigned char *bytes = reinterpret_cast<const unsigned char *>(data);
+
+    switch (m_encoding) {
+    case Utf8:
+        return decodeUtf8(bytes, length, output);
+    case Latin1:
+        for (int i = 0; i < length; ++i)
+            output[i] = bytes[i];
+        return length;
+    case Windows1252:
+        for (int i = 0; i < length; ++i) {
+            unsigned char byte = bytes[i];
+            output[i] = (byte >= 0x80 && byte < 0xA0) ? g_windows1252[byte - 0x80] : byte;
+        }
+        return length;
+    case Codec:
+        break;
+    }
+
+    // The codec keeps its own state between calls; each byte yields at most one
+    // character, so the UCS-4 result fits the output buffer
+    QString text = m_codecDecoder->toUnicode(data, length);
+    int count = 0;
+    for (int i = 0; i < text.size() && count <= length; ++i) {
+        uint codepoint = text.at(i).unicode();
+        if (QChar::isHighSurrogate(codepoint) && i + 1 < text.size() && text.at(i + 1).isLowSurrogate()) {
+            codepoint = QChar::surrogateToUcs4(text.at(i), text.at(i + 1));
+            ++i;
+        }
+        output[count++] = codepoint;
+    }
+    return count;
+}
+
+int TerminalDecoder::decodeUtf8(const unsigned char *data, int length, quint32 *output)
+{
+    int count = 0;
+    int i = 0;
+
+    while (i < length) {
+        unsigned char byte = data[i];
+
+        if (m_remaining == 0) {
+            // Most text is ASCII; copy whole runs without looking at the state machine
+            if (byte < 0x80) {
+                int run = asciiPrefix(reinterpret_cast<const char *>(data + i), length - i);
+                for (int k = 0; k < run; ++k)
+                    output[count++] = data[i + k];
+                i += run;
+                continue;
+            }
+            ++i;
+            if (byte >= 0xC2 && byte < 0xE0) {
+                m_codepoint = byte & 0x1F;
+                m_remaining = 1;
+                m_minimum = 0x80;
+            } else if (byte >= 0xE0 && byte < 0xF0) {
+                m_codepoint = byte & 0x0F;
+                m_remaining = 2;
+                m_minimum = 0x800;
+            } else if (byte >= 0xF0 && byte < 0xF5) {
+                m_codepoint = byte & 0x07;
+                m_remaining = 3;
+                m_minimum = 0x10000;
+            } else {
+                output[count++] = 0xFFFD;
+            }
+            continue;
+        }
+
+        if (byte >= 0x80 && byte < 0xC0) {
+            ++i;
+            m_codepoint = (m_codepoint << 6) | (byte & 0x3F);
+            if (--m_remaining == 0) {
+                quint32 codepoint = m_codepoint;
+                if (codepoint < m_minimum || codepoint > 0x10FFFF || (codepoint >= 0xD800 && codepoint <= 0xDFFF))
+                    codepoint = 0xFFFD;
+                output[count++] = codepoint;
+            }
+            continue;
+        }
+
+        // The sequence was cut short; the byte that interrupted it starts afresh
+        m_remaining = 0;
+        output[count++] = 0xFFFD;
+    }
+    return count;
+}
+
+int TerminalDecoder::asciiPrefix(const char *data, int length)
+{
+    int i = 0;
+
+#ifdef TERMINALDECODER_SSE2
+    for (; i + 16 <= length; i += 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+        int mask = _mm_movemask_epi8(chunk);
+        if (mask != 0)
+            return i + int(qCountTrailingZeroBits(quint32(mask)));
+    }
+#endif
+
+    for (; i + 8 <= length; i += 8) {
+        quint64 word;
+        std::memcpy(&word, data + i, sizeof(word));
+        if (word & Q_UINT64_C(0x8080808080808080))
+            break;
+    }
+    while (i < length && static_cast<unsigned char>(data[i]) < 0x80)
+        ++i;
+    return i;
+}
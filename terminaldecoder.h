@@ -0,0 +1,60 @@
+#ifndef TERMINALDECODER_H
+#define TERMINALDECODER_H
+
+#include <QString>
+#include <QScopedPointer>
+
+class QTextCodec;
+class QTextDecoder;
+
+// Stateful decoder for the printable text the VT parser hands over. Sequences split
+// across SSH reads are carried over to the next call instead of turning into
+// replacement characters. UTF-8, ISO-8859-1 and Windows-1252 are decoded here; any other
+// encoding Qt knows (GBK, Shift_JIS, KOI8-R, ...) goes through a QTextDecoder.
+class TerminalDecoder
+{
+public:
+    enum Encoding {
+        Utf8,
+        Latin1,
+        Windows1252,
+        Codec
+    };
+
+    TerminalDecoder();
+    ~TerminalDecoder();
+
+    // Unknown names fall back to UTF-8 and return false
+    bool setEncoding(const QString &name);
+    Encoding encoding() const { return m_encoding; }
+    QString encodingName() const;
+    void reset();
+
+    // True when ASCII bytes may be taken as characters without calling decode(): the
+    // encoding is ASCII-compatible and no multi-byte sequence is in progress
+    bool asciiPassthrough() const { return m_encoding != Codec && m_remaining == 0; }
+
+    // Decodes length bytes; output must have room for length + 1 codepoints. Bytes of an
+    // incomplete sequence at the end are kept for the next call. Returns the number of
+    // codepoints written.
+    int decode(const char *data, int length, quint32 *output);
+
+    // Length of the leading run of bytes below 0x80, checked 16 (SSE2) or 8 bytes at a time
+    static int asciiPrefix(const char *data, int length);
+
+private:
+    Encoding m_encoding;
+    QTextCodec *m_codec;
+    QScopedPointer<QTextDecoder> m_codecDecoder;
+
+    // UTF-8 sequence in progress
+    quint32 m_codepoint;
+    int m_remaining;
+    quint32 m_minimum;      // smallest codepoint the sequence may encode (no overlongs)
+
+    int decodeUtf8(const unsigned char *data, int length, quint32 *output);
+
+    Q_DISABLE_COPY(TerminalDecoder)
+};
+
+#endif // TERMINALDECODER_H
@@ -0,0 +1,850 @@
+#include "terminalhighlighter.h"
+#include <QHash>
+#include <QBitArray>
+#include <algorithm>
+#include <iterator>
+
+namespace {
+
+const quint32 MaxCodepoint = 0x10FFFF;
+// Limits on what a set of rules may compile to
+const int MaxRepeat = 100;
+const int MaxNfaStates = 20000;
+const int MaxDfaStates = 4000;
+
+struct Range
+{
+    quint32 first;
+    quint32 last;
+};
+
+struct Node
+{
+    enum Type { Set, Concatenation, Alternation, Repeat };
+
+    Type type;
+    QVector<Range> ranges;      // Set
+    int set;                    // Set: index of its class bits in the NFA
+    QVector<int> children;      // indices into the node list
+    int min;                    // Repeat; max -1 is unbounded
+    int max;
+};
+
+void addCaseVariants(QVector<Range> &ranges)
+{
+    int count = ranges.size();
+    for (int i = 0; i < count; ++i) {
+        Range range = ranges.at(i);
+        quint32 first = qMax<quint32>(range.first, 'a');
+        quint32 last = qMin<quint32>(range.last, 'z');
+        if (first <= last)
+            ranges.append(Range{first - 32, last - 32});
+        first = qMax<quint32>(range.first, 'A');
+        last = qMin<quint32>(range.last, 'Z');
+        if (first <= last)
+            ranges.append(Range{first + 32, last + 32});
+    }
+}
+
+QVector<Range> complement(QVector<Range> ranges)
+{
+    std::sort(ranges.begin(), ranges.end(), [](const Range &a, const Range &b) { return a.first < b.first; });
+    QVector<Range> result;
+    quint32 next = 0;
+    for (const Range &range : ranges) {
+        if (range.first > next)
+            result.append(Range{next, range.first - 1});
+        next = qMax(next, range.last + 1);
+    }
+    if (next <= MaxCodepoint)
+        result.append(Range{next, MaxCodepoint});
+    return result;
+}
+
+int hexValue(uint c)
+{
+    if (c >= '0' && c <= '9')
+        return int(c - '0');
+    if (c >= 'a' && c <= 'f')
+        return int(c - 'a' + 10);
+    if (c >= 'A' && c <= 'F')
+        return int(c - 'A' + 10);
+    return -1;
+}
+
+// Recursive descent over the supported subset. Nodes go into a list shared by all rules.
+class RegexParser
+{
+    Q_DECLARE_TR_FUNCTIONS(TerminalHighlighter)
+
+public:
+    RegexParser(const QVector<uint> &pattern, bool caseSensitive, QVector<Node> &nodes)
+        : m_pattern(pattern), m_caseSensitive(caseSensitive), m_nodes(nodes), m_position(0), m_anchored(false) {}
+
+    // Index of the root node, or -1 with error set
+    int parse(QString *error);
+    bool isAnchored() const { return m_anchored; }
+
+private:
+    const QVector<uint> &m_pattern;
+    bool m_caseSensitive;
+    QVector<Node> &m_nodes;
+    int m_position;
+    bool m_anchored;
+    QString m_error;
+
+    bool atEnd() const { return m_position >= m_pattern.size(); }
+    uint peek() const { return m_pattern.at(m_position); }
+    int fail(const QString &error);
+    int addNode(Node::Type type);
+    int addSet(QVector<Range> ranges);
+    int parseAlternation();
+    int parseConcatenation();
+    int parseRepeat();
+    int parseAtom();
+    bool parseClass(QVector<Range> &ranges);
+    bool parseEscape(QVector<Range> &ranges);
+    bool parseNumber(int &value);
+};
+
+int RegexParser::parse(QString *error)
+{
+    if (!atEnd() && peek() == '^') {
+        m_anchored = true;
+        ++m_position;
+    }
+    int root = parseAlternation();
+    // Alternatives only stop early at a ')'
+    if (root >= 0 && !atEnd())
+        root = fail(tr("unmatched )"));
+    if (root < 0)
+        *error = m_error;
+    return root;
+}
+
+int RegexParser::fail(const QString &error)
+{
+    if (m_error.isEmpty())
+        m_error = error;
+    return -1;
+}
+
+int RegexParser::addNode(Node::Type type)
+{
+    Node node;
+    node.type = type;
+    node.set = -1;
+    node.min = 0;
+    node.max = 0;
+    m_nodes.append(node);
+    return m_nodes.size() - 1;
+}
+
+int RegexParser::addSet(QVector<Range> ranges)
+{
+    if (!m_caseSensitive)
+        addCaseVariants(ranges);
+    int index = addNode(Node::Set);
+    m_nodes[index].ranges = ranges;
+    return index;
+}
+
+int RegexParser::parseAlternation()
+{
+    int first = parseConcatenation();
+    if (first < 0 || atEnd() || peek() != '|')
+        return first;
+
+    int index = addNode(Node::Alternation);
+    m_nodes[index].children.append(first);
+    while (!atEnd() && peek() == '|') {
+        ++m_position;
+        int next = parseConcatenation();
+        if (next < 0)
+            return -1;
+        m_nodes[index].children.append(next);
+    }
+    return index;
+}
+
+int RegexParser::parseConcatenation()
+{
+    int index = addNode(Node::Concatenation);
+    while (!atEnd() && peek() != '|' && peek() != ')') {
+        int item = parseRepeat();
+        if (item < 0)
+            return -1;
+        m_nodes[index].children.append(item);
+    }
+    return index;
+}
+
+int RegexParser::parseRepeat()
+{
+    int atom = parseAtom();
+    while (atom >= 0 && !atEnd()) {
+        int min;
+        int max;
+        uint c = peek();
+        if (c == '*') {
+            min = 0;
+            max = -1;
+        } else if (c == '+') {
+            min = 1;
+            max = -1;
+        } else if (c == '?') {
+            min = 0;
+            max = 1;
+        } else if (c == '{') {
+            ++m_position;
+            if (!parseNumber(min))
+                return fail(tr("invalid {} quantifier"));
+            max = min;
+            if (!atEnd() && peek() == ',') {
+                ++m_position;
+                max = -1;
+                if (!atEnd() && peek() != '}' && !parseNumber(max))
+                    return fail(tr("invalid {} quantifier"));
+            }
+            if (atEnd() || peek() != '}')
+                return fail(tr("invalid {} quantifier"));
+            if (min > MaxRepeat || max > MaxRepeat || (max >= 0 && max < min))
+                return fail(tr("repeat counts must be in order and at most %1").arg(MaxRepeat));
+        } else {
+            break;
+        }
+        ++m_position;
+        // Lazy and possessive forms match the same text, which is all that matters here
+        if (!atEnd() && (peek() == '?' || peek() == '+'))
+            ++m_position;
+
+        int index = addNode(Node::Repeat);
+        m_nodes[index].children.append(atom);
+        m_nodes[index].min = min;
+        m_nodes[index].max = max;
+        atom = index;
+    }
+    return atom;
+}
+
+bool RegexParser::parseNumber(int &value)
+{
+    int start = m_position;
+    value = 0;
+    while (!atEnd() && peek() >= '0' && peek() <= '9' && value <= MaxRepeat) {
+        value = value * 10 + int(peek() - '0');
+        ++m_position;
+    }
+    return m_position > start;
+}
+
+int RegexParser::parseAtom()
+{
+    uint c = peek();
+    ++m_position;
+    switch (c) {
+    case '(': {
+        if (!atEnd() && peek() == '?') {
+            // Lookaround and the like have no DFA equivalent
+            if (m_position + 1 >= m_pattern.size() || m_pattern.at(m_position + 1) != ':')
+                return fail(tr("only (?: ) groups are supported"));
+            m_position += 2;
+        }
+        int inner = parseAlternation();
+        if (inner < 0)
+            return -1;
+        if (atEnd())
+            return fail(tr("missing )"));
+        ++m_position;
+        return inner;
+    }
+    case '[': {
+        QVector<Range> ranges;
+        if (!parseClass(ranges))
+            return -1;
+        return addSet(ranges);
+    }
+    case '\\': {
+        QVector<Range> ranges;
+        if (!parseEscape(ranges))
+            return -1;
+        return addSet(ranges);
+    }
+    case '.':
+        return addSet(QVector<Range>{Range{0, MaxCodepoint}});
+    case '^':
+        return fail(tr("^ is only supported at the start"));
+    case '$':
+        return fail(tr("$ is not supported"));
+    case '*':
+    case '+':
+    case '?':
+        return fail(tr("nothing to repeat"));
+    default:
+        return addSet(QVector<Range>{Range{c, c}});
+    }
+}
+
+bool RegexParser::parseClass(QVector<Range> &ranges)
+{
+    bool negated = !atEnd() && peek() == '^';
+    if (negated)
+        ++m_position;
+
+    QVector<Range> items;
+    bool first = true;
+    for (;;) {
+        if (atEnd()) {
+            fail(tr("missing ]"));
+            return false;
+        }
+        uint c = peek();
+        // A ']' right after the '[' is an ordinary character
+        if (c == ']' && !first) {
+            ++m_position;
+            break;
+        }
+        first = false;
+        ++m_position;
+
+        quint32 low = c;
+        if (c == '\\') {
+            QVector<Range> escaped;
+            if (!parseEscape(escaped))
+                return false;
+            // \d and the like cannot start a range
+            if (escaped.size() != 1 || escaped.at(0).first != escaped.at(0).last) {
+                items += escaped;
+                continue;
+            }
+            low = escaped.at(0).first;
+        } else if (c == '[' && !atEnd() && peek() == ':') {
+            fail(tr("POSIX classes are not supported"));
+            return false;
+        }
+
+        quint32 high = low;
+        if (m_position + 1 < m_pattern.size() && peek() == '-' && m_pattern.at(m_position + 1) != ']') {
+            m_position += 1;
+            high = peek();
+            ++m_position;
+            if (high == '\\') {
+                QVector<Range> escaped;
+                if (!parseEscape(escaped))
+                    return false;
+                if (escaped.size() != 1 || escaped.at(0).first != escaped.at(0).last) {
+                    fail(tr("invalid range in [ ]"));
+                    return false;
+                }
+                high = escaped.at(0).first;
+            }
+            if (high < low) {
+                fail(tr("invalid range in [ ]"));
+                return false;
+            }
+        }
+        items.append(Range{low, high});
+    }
+
+    // Before negating, so [^a] also excludes A when case is ignored
+    if (!m_caseSensitive)
+        addCaseVariants(items);
+    ranges += negated ? complement(items) : items;
+    return true;
+}
+
+bool RegexParser::parseEscape(QVector<Range> &ranges)
+{
+    static const QVector<Range> digits{Range{'0', '9'}};
+    static const QVector<Range> word{Range{'0', '9'}, Range{'A', 'Z'}, Range{'_', '_'}, Range{'a', 'z'}};
+    static const QVector<Range> space{Range{'\t', '\r'}, Range{' ', ' '}};
+
+    if (atEnd()) {
+        fail(tr("\\ at the end"));
+        return false;
+    }
+    uint c = peek();
+    ++m_position;
+    switch (c) {
+    case 'd':
+        ranges += digits;
+        return true;
+    case 'D':
+        ranges += complement(digits);
+        return true;
+    case 'w':
+        ranges += word;
+        return true;
+    case 'W':
+        ranges += complement(word);
+        return true;
+    case 's':
+        ranges += space;
+        return true;
+    case 'S':
+        ranges += complement(space);
+        return true;
+    case 't':
+        ranges.append(Range{'\t', '\t'});
+        return true;
+    case 'x': {
+        // \xHH or \x{H...}
+        bool braced = !atEnd() && peek() == '{';
+        if (braced)
+            ++m_position;
+        quint32 value = 0;
+        int length = 0;
+        while (!atEnd() && length < (braced ? 6 : 2) && hexValue(peek()) >= 0) {
+            value = value * 16 + quint32(hexValue(peek()));
+            ++length;
+            ++m_position;
+        }
+        if (length == 0 || value > MaxCodepoint || (braced && (atEnd() || peek() != '}'))) {
+            fail(tr("invalid \\x escape"));
+            return false;
+        }
+        if (braced)
+            ++m_position;
+        ranges.append(Range{value, value});
+        return true;
+    }
+    default:
+        // Back references, \b, \p and the rest have no DFA equivalent
+        if ((c >= '0' && c <= '9') || (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z')) {
+            fail(tr("\\%1 is not supported").arg(QChar(c)));
+            return false;
+        }
+        ranges.append(Range{c, c});
+        return true;
+    }
+}
+
+struct NfaState
+{
+    int set;                    // class bits to move on, or -1 for epsilon moves only
+    int target;                 // where that move goes
+    QVector<int> epsilons;
+    int rule;                   // accepting for this rule, or -1
+};
+
+struct Nfa
+{
+    QVector<NfaState> states;
+    QVector<QBitArray> sets;
+
+    int addState()
+    {
+        NfaState state;
+        state.set = -1;
+        state.target = -1;
+        state.rule = -1;
+        states.append(state);
+        return states.size() - 1;
+    }
+
+    bool isFull() const { return states.size() > MaxNfaStates; }
+
+    // Thompson construction: adds the moves for node starting at from and returns the
+    // state where they end
+    int build(const QVector<Node> &nodes, int index, int from)
+    {
+        if (isFull())
+            return from;
+
+        const Node &node = nodes.at(index);
+        switch (node.type) {
+        case Node::Set: {
+            int move = addState();
+            int to = addState();
+            states[from].epsilons.append(move);
+            states[move].set = node.set;
+            states[move].target = to;
+            return to;
+        }
+        case Node::Concatenation: {
+            int current = from;
+            for (int child : node.children)
+                current = build(nodes, child, current);
+            return current;
+        }
+        case Node::Alternation: {
+            int to = addState();
+            for (int child : node.children) {
+                int end = build(nodes, child, from);
+                states[end].epsilons.append(to);
+            }
+            return to;
+        }
+        case Node::Repeat: {
+            int child = node.children.at(0);
+            int current = from;
+            for (int i = 0; i < node.min; ++i)
+                current = build(nodes, child, current);
+            if (node.max < 0) {
+                int loop = addState();
+                states[current].epsilons.append(loop);
+                int end = build(nodes, child, loop);
+                states[end].epsilons.append(loop);
+                return loop;
+            }
+            for (int i = node.min; i < node.max; ++i) {
+                int to = addState();
+                states[current].epsilons.append(to);
+                int end = build(nodes, child, current);
+                states[end].epsilons.append(to);
+                current = to;
+            }
+            return current;
+        }
+        }
+        return from;
+    }
+};
+
+// The states reachable over epsilon moves, reduced to those that matter to the DFA
+// (ones with a move on a character and accepting ones), sorted
+QVector<int> epsilonClosure(const Nfa &nfa, QVector<int> stack, QVector<int> &visited, int stamp)
+{
+    QVector<int> result;
+    while (!stack.isEmpty()) {
+        int state = stack.takeLast();
+        if (visited.at(state) == stamp)
+            continue;
+        visited[state] = stamp;
+        const NfaState &nfaState = nfa.states.at(state);
+        if (nfaState.set >= 0 || nfaState.rule >= 0)
+            result.append(state);
+        for (int next : nfaState.epsilons) {
+            if (visited.at(next) != stamp)
+                stack.append(next);
+        }
+    }
+    std::sort(result.begin(), result.end());
+    return result;
+}
+
+// Subset construction over all regular expressions at once. Every step enters the start
+// states of the unanchored rules again, so matches are found wherever they start.
+bool buildDfa(const Nfa &nfa, const QVector<int> &anchoredStarts, const QVector<int> &unanchoredStarts,
+              int classCount, QVector<int> &next, QVector<int> &acceptBegin,
+              QVector<TerminalHighlighter::Match> &accepts, int &lineStart, int &midLine)
+{
+    QVector<int> visited(nfa.states.size(), 0);
+    int stamp = 0;
+    const QVector<int> unanchored = epsilonClosure(nfa, unanchoredStarts, visited, ++stamp);
+    const QVector<int> all = epsilonClosure(nfa, anchoredStarts + unanchoredStarts, visited, ++stamp);
+
+    QHash<QVector<int>, int> ids;
+    QVector<QVector<int>> subsets;
+    auto stateFor = [&ids, &subsets](const QVector<int> &subset) {
+        QHash<QVector<int>, int>::const_iterator it = ids.constFind(subset);
+        if (it != ids.constEnd())
+            return it.value();
+        subsets.append(subset);
+        ids.insert(subset, subsets.size() - 1);
+        return subsets.size() - 1;
+    };
+    lineStart = stateFor(all);
+    midLine = stateFor(unanchored);
+
+    next.clear();
+    for (int index = 0; index < subsets.size(); ++index) {
+        if (subsets.size() > MaxDfaStates)
+            return false;
+        const QVector<int> subset = subsets.at(index);
+        next.resize((index + 1) * classCount);
+        for (int characterClass = 0; characterClass < classCount; ++characterClass) {
+            QVector<int> moved;
+            for (int state : subset) {
+                const NfaState &nfaState = nfa.states.at(state);
+                if (nfaState.set >= 0 && nfa.sets.at(nfaState.set).testBit(characterClass))
+                    moved.append(nfaState.target);
+            }
+            QVector<int> reached = epsilonClosure(nfa, moved, visited, ++stamp);
+            QVector<int> merged;
+            std::set_union(reached.constBegin(), reached.constEnd(), unanchored.constBegin(), unanchored.constEnd(),
+                           std::back_inserter(merged));
+            next[index * classCount + characterClass] = stateFor(merged);
+        }
+    }
+
+    acceptBegin.clear();
+    accepts.clear();
+    for (const QVector<int> &subset : subsets) {
+        acceptBegin.append(accepts.size());
+        for (int state : subset) {
+            if (nfa.states.at(state).rule >= 0)
+                accepts.append(TerminalHighlighter::Match{nfa.states.at(state).rule, -1});
+        }
+    }
+    acceptBegin.append(accepts.size());
+    return true;
+}
+
+// A trie of the patterns whose missing moves are filled in from the failure links, so
+// that every state has a move for every class
+void buildAhoCorasick(const QVector<QVector<int>> &patterns, const QVector<int> &rules, int classCount,
+                      QVector<int> &next, QVector<int> &acceptBegin, QVector<TerminalHighlighter::Match> &accepts)
+{
+    next.fill(-1, classCount);
+    QVector<QVector<TerminalHighlighter::Match>> outputs(1);
+    for (int i = 0; i < patterns.size(); ++i) {
+        int node = 0;
+        for (int characterClass : patterns.at(i)) {
+            int child = next.at(node * classCount + characterClass);
+            if (child < 0) {
+                child = outputs.size();
+                outputs.append(QVector<TerminalHighlighter::Match>());
+                next.insert(next.size(), classCount, -1);
+                next[node * classCount + characterClass] = child;
+            }
+            node = child;
+        }
+        outputs[node].append(TerminalHighlighter::Match{rules.at(i), patterns.at(i).size()});
+    }
+
+    // Breadth first, so a state's failure target is complete before the state is
+    QVector<int> failure(outputs.size(), 0);
+    QVector<int> queue;
+    for (int characterClass = 0; characterClass < classCount; ++characterClass) {
+        int child = next.at(characterClass);
+        if (child < 0)
+            next[characterClass] = 0;
+        else
+            queue.append(child);
+    }
+    for (int head = 0; head < queue.size(); ++head) {
+        int node = queue.at(head);
+        outputs[node] += outputs.at(failure.at(node));
+        for (int characterClass = 0; characterClass < classCount; ++characterClass) {
+            int child = next.at(node * classCount + characterClass);
+            int fallback = next.at(failure.at(node) * classCount + characterClass);
+            if (child < 0) {
+                next[node * classCount + characterClass] = fallback;
+            } else {
+                failure[child] = fallback;
+                queue.append(child);
+            }
+        }
+    }
+
+    acceptBegin.clear();
+    accepts.clear();
+    for (const QVector<TerminalHighlighter::Match> &output : outputs) {
+        acceptBegin.append(accepts.size());
+        accepts += output;
+    }
+    acceptBegin.append(accepts.size());
+}
+
+} // namespace
+
+TerminalHighlighter::TerminalHighlighter()
+    : m_classCount(0x80)
+    , m_regexLineStart(0)
+    , m_regexMidLine(0)
+{
+}
+
+QString TerminalHighlighter::compile(const QVector<TerminalHighlightRule> &rules)
+{
+    *this = TerminalHighlighter();
+
+    // Parse the regular expressions and collect the literals
+    QVector<Node> nodes;
+    QVector<int> roots(rules.size(), -1);
+    QVector<bool> anchored(rules.size(), false);
+    QVector<QVector<uint>> literals(rules.size());
+    for (int i = 0; i < rules.size(); ++i) {
+        const TerminalHighlightRule &rule = rules.at(i);
+        QVector<uint> pattern = rule.pattern.toUcs4();
+        if (pattern.isEmpty())
+            return tr("Rule %1: the pattern is empty").arg(i + 1);
+        if (rule.regex) {
+            RegexParser parser(pattern, rule.caseSensitive, nodes);
+            QString error;
+            roots[i] = parser.parse(&error);
+            if (roots[i] < 0)
+                return tr("Rule %1 (%2): %3").arg(i + 1).arg(rule.pattern, error);
+            anchored[i] = parser.isAnchored();
+        } else {
+            if (!rule.caseSensitive) {
+                for (uint &c : pattern) {
+                    if (c >= 'A' && c <= 'Z')
+                        c += 32;
+                }
+            }
+            literals[i] = pattern;
+        }
+    }
+
+    // Character classes: every ASCII character is its own; above ASCII, codepoints no
+    // pattern tells apart share one, so the tables stay narrow
+    QVector<quint32> starts;
+    starts.append(0x80);
+    auto addBoundaries = [&starts](quint32 first, quint32 last) {
+        if (last < 0x80)
+            return;
+        starts.append(qMax<quint32>(first, 0x80));
+        if (last < MaxCodepoint)
+            starts.append(last + 1);
+    };
+    for (const Node &node : nodes) {
+        for (const Range &range : node.ranges)
+            addBoundaries(range.first, range.last);
+    }
+    for (const QVector<uint> &literal : literals) {
+        for (uint c : literal)
+            addBoundaries(c, c);
+    }
+    std::sort(starts.begin(), starts.end());
+    starts.erase(std::unique(starts.begin(), starts.end()), starts.end());
+    m_classStarts = starts;
+    m_classCount = 0x80 + starts.size();
+
+    // The classes each set of a regular expression contains; classes never straddle a
+    // range boundary, so testing one codepoint of a class is enough
+    Nfa nfa;
+    for (Node &node : nodes) {
+        if (node.type != Node::Set)
+            continue;
+        QBitArray bits(m_classCount);
+        for (int characterClass = 0; characterClass < m_classCount; ++characterClass) {
+            quint32 codepoint = characterClass < 0x80 ? quint32(characterClass) : m_classStarts.at(characterClass - 0x80);
+            for (const Range &range : node.ranges) {
+                if (range.first <= codepoint && codepoint <= range.last) {
+                    bits.setBit(characterClass);
+                    break;
+                }
+            }
+        }
+        node.set = nfa.sets.size();
+        nfa.sets.append(bits);
+    }
+
+    QVector<int> ruleStarts(rules.size(), -1);
+    QVector<int> anchoredStarts;
+    QVector<int> unanchoredStarts;
+    for (int i = 0; i < rules.size(); ++i) {
+        if (roots.at(i) < 0)
+            continue;
+        int start = nfa.addState();
+        int end = nfa.build(nodes, roots.at(i), start);
+        if (nfa.isFull()) {
+            *this = TerminalHighlighter();
+            return tr("The regular expressions are too complex");
+        }
+        nfa.states[end].rule = i;
+        ruleStarts[i] = start;
+        if (anchored.at(i))
+            anchoredStarts.append(start);
+        else
+            unanchoredStarts.append(start);
+    }
+
+    // A pattern that matches nothing at all would match everywhere
+    QVector<int> visited(nfa.states.size(), 0);
+    for (int i = 0; i < rules.size(); ++i) {
+        if (ruleStarts.at(i) < 0)
+            continue;
+        for (int state : epsilonClosure(nfa, QVector<int>{ruleStarts.at(i)}, visited, i + 1)) {
+            if (nfa.states.at(state).rule == i) {
+                *this = TerminalHighlighter();
+                return tr("Rule %1 (%2): matches empty text").arg(i + 1).arg(rules.at(i).pattern);
+            }
+        }
+    }
+
+    if (!anchoredStarts.isEmpty() || !unanchoredStarts.isEmpty()) {
+        m_regex.classCount = m_classCount;
+        if (!buildDfa(nfa, anchoredStarts, unanchoredStarts, m_classCount, m_regex.next, m_regex.acceptBegin,
+                      m_regex.accepts, m_regexLineStart, m_regexMidLine)) {
+            *this = TerminalHighlighter();
+            return tr("The regular expressions are too complex");
+        }
+    }
+
+    QVector<QVector<int>> exactPatterns;
+    QVector<int> exactRules;
+    QVector<QVector<int>> foldedPatterns;
+    QVector<int> foldedRules;
+    m_tails.resize(rules.size());
+    for (int i = 0; i < rules.size(); ++i) {
+        const TerminalHighlightRule &rule = rules.at(i);
+        if (rule.regex) {
+            m_tails[i] = QRegularExpression("(?:" + rule.pattern + ")\\z", rule.caseSensitive
+                                            ? QRegularExpression::NoPatternOption
+                                            : QRegularExpression::CaseInsensitiveOption);
+            continue;
+        }
+        QVector<int> classes;
+        for (uint c : literals.at(i))
+            classes.append(characterClass(c));
+        if (rule.caseSensitive) {
+            exactPatterns.append(classes);
+            exactRules.append(i);
+        } else {
+            foldedPatterns.append(classes);
+            foldedRules.append(i);
+        }
+    }
+    if (!exactPatterns.isEmpty()) {
+        m_exact.classCount = m_classCount;
+        buildAhoCorasick(exactPatterns, exactRules, m_classCount, m_exact.next, m_exact.acceptBegin, m_exact.accepts);
+    }
+    if (!foldedPatterns.isEmpty()) {
+        m_folded.classCount = m_classCount;
+        buildAhoCorasick(foldedPatterns, foldedRules, m_classCount, m_folded.next, m_folded.acceptBegin, m_folded.accepts);
+    }
+
+    m_rules = rules;
+    return QString();
+}
+
+TerminalHighlighter::State TerminalHighlighter::initialState(bool lineStart) const
+{
+    State state;
+    state.exact = 0;
+    state.folded = 0;
+    state.regex = lineStart ? m_regexLineStart : m_regexMidLine;
+    return state;
+}
+
+int TerminalHighlighter::characterClass(quint32 codepoint) const
+{
+    if (codepoint < 0x80)
+        return int(codepoint);
+    return 0x80 + int(std::upper_bound(m_classStarts.constBegin(), m_classStarts.constEnd(), codepoint)
+                      - m_classStarts.constBegin()) - 1;
+}
+
+int TerminalHighlighter::advance(const Automaton &automaton, int state, int characterClass, QVector<Match> &matches)
+{
+    int target = automaton.next.constData()[state * automaton.classCount + characterClass];
+    const int *acceptBegin = automaton.acceptBegin.constData();
+    for (int i = acceptBegin[target]; i < acceptBegin[target + 1]; ++i)
+        matches.append(automaton.accepts.at(i));
+    return target;
+}
+
+void TerminalHighlighter::step(State &state, quint32 codepoint, QVector<Match> &matches) const
+{
+    int characterClass = this->characterClass(codepoint);
+    if (!m_exact.isEmpty())
+        state.exact = advance(m_exact, state.exact, characterClass, matches);
+    // ASCII classes are the codepoints themselves
+    if (!m_folded.isEmpty())
+        state.folded = advance(m_folded, state.folded, codepoint >= 'A' && codepoint <= 'Z' ? characterClass + 32 : characterClass, matches);
+    if (!m_regex.isEmpty())
+        state.regex = advance(m_regex, state.regex, characterClass, matches);
+}
+
+int TerminalHighlighter::regexMatchStart(int rule, const QVector<quint32> &text, int end) const
+{
+    QString subject = QString::fromUcs4(text.constData(), end);
+    QRegularExpressionMatch match = m_tails.at(rule).match(subject);
+    if (!match.hasMatch())
+        return -1;
+    // Offsets are in UTF-16 code units
+    return subject.leftRef(match.capturedStart()).toUcs4().size();
+}
@@ -0,0 +1,100 @@
+#ifndef TERMINALHIGHLIGHTER_H
+#define TERMINALHIGHLIGHTER_H
+
+#include <QVector>
+#include <QString>
+#include <QRegularExpression>
+#include <QCoreApplication>
+
+// Output matching a rule's pattern is recoloured as it is printed. Colours use the
+// encoding of TerminalAttributes; KeepColor leaves the character's own colour.
+struct TerminalHighlightRule
+{
+    enum : quint32 { KeepColor = 0xFFFFFFFF };
+
+    QString pattern;
+    bool regex;
+    bool caseSensitive;
+    quint32 foreground;
+    quint32 background;
+    bool bold;
+    bool alert;             // matches are also reported, e.g. to flag a background tab
+
+    TerminalHighlightRule()
+        : regex(false), caseSensitive(true)
+        , foreground(KeepColor), background(KeepColor)
+        , bold(false), alert(false) {}
+};
+
+// All rules compiled into at most three automata that run side by side over the printed
+// characters, one table lookup each per character however many rules there are:
+// Aho-Corasick machines for the literal patterns (one for the case-sensitive ones, one
+// over ASCII-lowercased input for the others) and one DFA for all regular expressions.
+//
+// Regular expressions are limited to what compiles to a DFA: literals, ".", classes
+// ([...], \d \w \s and their negations, ASCII only), groups, alternation, the quantifiers
+// * + ? {n,m} and a leading ^ for the start of a line. The DFA only tells where a match
+// ends; its start is then found with QRegularExpression, for that one rule.
+//
+// Compiled rules are never modified, so one instance is shared by all screens.
+class TerminalHighlighter
+{
+    Q_DECLARE_TR_FUNCTIONS(TerminalHighlighter)
+
+public:
+    struct Match
+    {
+        int rule;
+        int length;         // in characters; -1 for regular expressions
+    };
+
+    struct State
+    {
+        int exact;
+        int folded;
+        int regex;
+    };
+
+    TerminalHighlighter();
+
+    // Returns an empty string on success, otherwise what is wrong with which rule
+    QString compile(const QVector<TerminalHighlightRule> &rules);
+
+    int ruleCount() const { return m_rules.size(); }
+    const TerminalHighlightRule &rule(int index) const { return m_rules.at(index); }
+
+    // lineStart: the next character is the first of its line
+    State initialState(bool lineStart) const;
+    // Advances over one character and appends the matches ending with it
+    void step(State &state, quint32 codepoint, QVector<Match> &matches) const;
+    // Index of the first character of the leftmost match of regular expression rule
+    // that ends just before text[end], or -1
+    int regexMatchStart(int rule, const QVector<quint32> &text, int end) const;
+
+private:
+    struct Automaton
+    {
+        int classCount;
+        QVector<int> next;          // [state * classCount + class]
+        QVector<int> acceptBegin;   // matches of state s: accepts[acceptBegin[s], acceptBegin[s + 1])
+        QVector<Match> accepts;
+
+        Automaton() : classCount(0) {}
+        bool isEmpty() const { return next.isEmpty(); }
+    };
+
+    QVector<TerminalHighlightRule> m_rules;
+    QVector<quint32> m_classStarts;     // first codepoint of each class above ASCII
+    int m_classCount;
+    Automaton m_exact;
+    Automaton m_folded;
+    Automaton m_regex;
+    int m_regexLineStart;
+    int m_regexMidLine;
+    QVector<QRegularExpression> m_tails;    // per rule: the expression anchored at the end
+
+    int characterClass(quint32 codepoint) const;
+    static int advance(const Automaton &automaton, int state, int characterClass, QVector<Match> &matches);
+};
+
+#endif // TERMINALHIGHLIGHTER_H
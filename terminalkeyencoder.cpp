@@ -0,0 +1,102 @@
+#include "terminalkeyencoder.h"
+
+namespace {
+
+// xterm's modifier parameter: 1 + Shift(1) + Alt(2) + Ctrl(4); 1 means none
+int modifierParameter(Qt::KeyboardModifiers modifiers)
+{
+    int parameter = 1;
+    if (modifiers & Qt::ShiftModifier)
+        parameter += 1;
+    if (modifiers & Qt::AltModifier)
+        parameter += 2;
+    if (modifiers & Qt::ControlModifier)
+        parameter += 4;
+    return parameter;
+}
+
+// Cursor keys and F1-F4: CSI/SS3 <final>, or CSI 1;<modifiers> <final>
+QByteArray cursorKey(char final, int parameter, bool application)
+{
+    if (parameter > 1)
+        return "\x1b[1;" + QByteArray::number(parameter) + final;
+    return QByteArray(application ? "\x1bO" : "\x1b[") + final;
+}
+
+// Editing keys and F5-F12: CSI <code> ~, or CSI <code>;<modifiers> ~
+QByteArray tildeKey(int code, int parameter)
+{
+    QByteArray sequence = "\x1b[" + QByteArray::number(code);
+    if (parameter > 1)
+        sequence += ';' + QByteArray::number(parameter);
+    return sequence + '~';
+}
+
+} // namespace
+
+QByteArray TerminalKeyEncoder::encode(int key, Qt::KeyboardModifiers modifiers, bool applicationCursorKeys)
+{
+    int parameter = modifierParameter(modifiers);
+    bool control = modifiers & Qt::ControlModifier;
+    QByteArray escape = (modifiers & Qt::AltModifier) ? QByteArray(1, '\x1b') : QByteArray();
+
+    switch (key) {
+    case Qt::Key_Up: return cursorKey('A', parameter, applicationCursorKeys);
+    case Qt::Key_Down: return cursorKey('B', parameter, applicationCursorKeys);
+    case Qt::Key_Right: return cursorKey('C', parameter, applicationCursorKeys);
+    case Qt::Key_Left: return cursorKey('D', parameter, applicationCursorKeys);
+    case Qt::Key_Home: return cursorKey('H', parameter, applicationCursorKeys);
+    case Qt::Key_End: return cursorKey('F', parameter, applicationCursorKeys);
+    case Qt::Key_F1: return cursorKey('P', parameter, true);
+    case Qt::Key_F2: return cursorKey('Q', parameter, true);
+    case Qt::Key_F3: return cursorKey('R', parameter, true);
+    case Qt::Key_F4: return cursorKey('S', parameter, true);
+    case Qt::Key_Insert: return tildeKey(2, parameter);
+    case Qt::Key_Delete: return tildeKey(3, parameter);
+    case Qt::Key_PageUp: return tildeKey(5, parameter);
+    case Qt::Key_PageDown: return tildeKey(6, parameter);
+    case Qt::Key_F5: return tildeKey(15, parameter);
+    case Qt::Key_F6: return tildeKey(17, parameter);
+    case Qt::Key_F7: return tildeKey(18, parameter);
+    case Qt::Key_F8: return tildeKey(19, parameter);
+    case Qt::Key_F9: return tildeKey(20, parameter);
+    case Qt::Key_F10: return tildeKey(21, parameter);
+    case Qt::Key_F11: return tildeKey(23, parameter);
+    case Qt::Key_F12: return tildeKey(24, parameter);
+    case Qt::Key_Backtab: return "\x1b[Z";
+    case Qt::Key_Tab: return escape + '\t';
+    case Qt::Key_Return:
+    case Qt::Key_Enter: return escape + '\r';
+    case Qt::Key_Escape: return "\x1b";
+    // Ctrl+Backspace erases a word in most shells, like on a PC console
+    case Qt::Key_Backspace: return escape + (control ? '\x08' : '\x7f');
+    default:
+        break;
+    }
+
+    if (control) {
+        if (key >= Qt::Key_A && key <= Qt::Key_Z)
+            return escape + char(key - Qt::Key_A + 1);
+        switch (key) {
+        case Qt::Key_Space:
+        case Qt::Key_At:
+        case Qt::Key_2: return escape + '\0';
+        case Qt::Key_BracketLeft:
+        case Qt::Key_3: return escape + '\x1b';
+        case Qt::Key_Backslash:
+        case Qt::Key_4: return escape + '\x1c';
+        case Qt::Key_BracketRight:
+        case Qt::Key_5: return escape + '\x1d';
+        case Qt::Key_AsciiCircum:
+        case Qt::Key_6: return escape + '\x1e';
+        case Qt::Key_Underscore:
+        case Qt::Key_Minus:
+        case Qt::Key_7: return escape + '\x1f';
+        case Qt::Key_Question:
+        case Qt::Key_8: return escape + '\x7f';
+        default:
+            break;
+        }
+    }
+    return QByteArray();
+}
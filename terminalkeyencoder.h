@@ -0,0 +1,17 @@
+#ifndef TERMINALKEYENCODER_H
+#define TERMINALKEYENCODER_H
+
+#include <QByteArray>
+#include <Qt>
+
+// The byte sequences xterm sends for keys that are not plain text: cursor and editing
+// keys (in normal or application cursor mode, with xterm's modifier parameters), function
+// keys, and control characters for Ctrl combinations.
+class TerminalKeyEncoder
+{
+public:
+    // Returns an empty array when the key should be sent as the text it produces
+    static QByteArray encode(int key, Qt::KeyboardModifiers modifiers, bool applicationCursorKeys);
+};
+
+#endif // TERMINALKEYENCODER_H
@@ -0,0 +1,417 @@
+#include "terminallogger.h"
+#include <QDir>
+#include <QDateTime>
+#include <QTextCodec>
+#include <QMutexLocker>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
+
+namespace {
+
+// How often the writer wakes up; everything queued in between goes out in one write
+const int FlushIntervalMs = 200;
+// Output allowed to wait for the writer before it is dropped
+const int MaxPendingBytes = 32 * 1024 * 1024;
+// Logs are written continuously, so favour speed as the spill file does
+const int CompressionLevel = 1;
+
+struct Crc32Table
+{
+    quint32 entries[256];
+
+    Crc32Table()
+    {
+        for (quint32 i = 0; i < 256; ++i) {
+            quint32 crc = i;
+            for (int bit = 0; bit < 8; ++bit)
+                crc = (crc & 1) ? (crc >> 1) ^ 0xEDB88320u : crc >> 1;
+            entries[i] = crc;
+        }
+    }
+};
+
+quint32 crc32(const QByteArray &data)
+{
+    static const Crc32Table table;
+    quint32 crc = 0xFFFFFFFFu;
+    for (char byte : data)
+        crc = table.entries[(crc ^ uchar(byte)) & 0xFF] ^ (crc >> 8);
+    return crc ^ 0xFFFFFFFFu;
+}
+
+void appendUInt32(QByteArray &data, quint32 value)
+{
+    for (int shift = 0; shift < 32; shift += 8)
+        data.append(char((value >> shift) & 0xFF));
+}
+
+// qCompress gives a 4-byte size, a 2-byte zlib header, the deflate stream and a 4-byte
+// Adler-32; a gzip member wraps the same deflate stream in its own header and trailer
+QByteArray gzipMember(const QByteArray &data)
+{
+    static const char header[10] = { '\x1f', '\x8b', 8, 0, 0, 0, 0, 0, 0, '\xff' };
+    QByteArray zlib = qCompress(data, CompressionLevel);
+    QByteArray member(header, sizeof(header));
+    member.append(zlib.constData() + 6, zlib.size() - 10);
+    appendUInt32(member, crc32(data));
+    appendUInt32(member, quint32(data.size()));
+    return member;
+}
+
+} // namespace
+
+TerminalLogger::TerminalLogger(QObject *parent)
+    : QThread(parent)
+    , m_format(PlainText)
+    , m_timestamps(true)
+    , m_maxFileBytes(0)
+    , m_maxFileSeconds(0)
+    , m_compressed(false)
+    , m_codec(nullptr)
+    , m_columns(80)
+    , m_rows(24)
+    , m_queue(nullptr)
+    , m_pendingBytes(0)
+    , m_droppedBytes(0)
+    , m_active(0)
+    , m_stopping(false)
+    , m_fileBytes(0)
+    , m_filterState(Ground)
+    , m_atLineStart(true)
+    , m_decoder(nullptr)
+    , m_inputDecoder(nullptr)
+    , m_startTime(0)
+{
+}
+
+TerminalLogger::~TerminalLogger()
+{
+    stop();
+    deleteQueue();
+}
+
+void TerminalLogger::setRotation(qint64 maxFileBytes, int maxFileSeconds)
+{
+    m_maxFileBytes = maxFileBytes;
+    m_maxFileSeconds = maxFileSeconds;
+}
+
+void TerminalLogger::setTerminal(int columns, int rows, const QString &terminalType)
+{
+    m_columns = columns;
+    m_rows = rows;
+    m_terminalType = terminalType;
+}
+
+void TerminalLogger::startLogging()
+{
+    stop();
+    // Chunks pushed by a producer that raced with the last stop()
+    deleteQueue();
+    m_pendingBytes.storeRelaxed(0);
+    m_droppedBytes.storeRelaxed(0);
+    m_stopping = false;
+    m_startTime = QDateTime::currentMSecsSinceEpoch();
+    m_active.storeRelease(1);
+    start(QThread::LowPriority);
+}
+
+void TerminalLogger::stop()
+{
+    m_active.storeRelease(0);
+    {
+        QMutexLocker locker(&m_wakeMutex);
+        m_stopping = true;
+        m_wakeUp.wakeAll();
+    }
+    wait();
+}
+
+void TerminalLogger::enqueue(const QByteArray &data)
+{
+    push(data, 'o');
+}
+
+void TerminalLogger::enqueueInput(const QByteArray &data)
+{
+    if (m_format == Asciicast)
+        push(data, 'i');
+}
+
+void TerminalLogger::recordResize(int columns, int rows)
+{
+    if (m_format == Asciicast)
+        push(QByteArray::number(columns) + 'x' + QByteArray::number(rows), 'r');
+}
+
+void TerminalLogger::push(const QByteArray &data, char type)
+{
+    if (data.isEmpty() || !isLogging())
+        return;
+
+    int size = data.size();
+    if (m_pendingBytes.fetchAndAddRelaxed(size) + size > MaxPendingBytes) {
+        m_pendingBytes.fetchAndAddRelaxed(-size);
+        m_droppedBytes.fetchAndAddRelaxed(size);
+        return;
+    }
+
+    Chunk *chunk = new Chunk{data, QDateTime::currentMSecsSinceEpoch(), type, nullptr};
+    Chunk *head = m_queue.loadRelaxed();
+    do {
+        chunk->next = head;
+    } while (!m_queue.testAndSetRelease(head, chunk, head));
+}
+
+void TerminalLogger::run()
+{
+    m_filterState = Ground;
+    m_atLineStart = true;
+    m_batch.clear();
+    m_decoder = nullptr;
+    m_inputDecoder = nullptr;
+    if (m_format == Asciicast) {
+        // Event data are JSON strings, so recordings are always UTF-8
+        QTextCodec *codec = m_codec ? m_codec : QTextCodec::codecForName("UTF-8");
+        m_decoder = codec->makeDecoder();
+        m_inputDecoder = codec->makeDecoder();
+    } else if (m_format == PlainText && m_codec) {
+        m_decoder = m_codec->makeDecoder();
+    }
+
+    bool ok = openFile();
+    while (ok) {
+        bool stopping;
+        {
+            QMutexLocker locker(&m_wakeMutex);
+            if (!m_stopping)
+                m_wakeUp.wait(&m_wakeMutex, FlushIntervalMs);
+            stopping = m_stopping;
+        }
+        ok = writePending();
+        if (stopping)
+            break;
+    }
+
+    // After an error the reason has been reported; stop taking output
+    if (!ok)
+        m_active.storeRelease(0);
+    m_file.close();
+    delete m_decoder;
+    m_decoder = nullptr;
+    delete m_inputDecoder;
+    m_inputDecoder = nullptr;
+}
+
+bool TerminalLogger::openFile()
+{
+    QString fileName = m_fileName;
+    if (fileName.isEmpty()) {
+        QDir dir(m_directory);
+        if (!dir.mkpath(QStringLiteral("."))) {
+            emit logError(tr("Cannot create %1").arg(m_directory));
+            return false;
+        }
+
+        QString stamp = QDateTime::currentDateTime().toString(QStringLiteral("yyyyMMdd-HHmmss"));
+        QString suffix = m_compressed ? QStringLiteral(".log.gz") : QStringLiteral(".log");
+        fileName = dir.filePath(m_baseName + QLatin1Char('-') + stamp + suffix);
+        // Rotation can happen more than once a second
+        for (int i = 2; QFile::exists(fileName); ++i)
+            fileName = dir.filePath(QStringLiteral("%1-%2-%3%4").arg(m_baseName, stamp).arg(i).arg(suffix));
+    }
+
+    m_file.setFileName(fileName);
+    if (!m_file.open(QIODevice::WriteOnly)) {
+        emit logError(tr("Cannot open %1: %2").arg(fileName, m_file.errorString()));
+        return false;
+    }
+    m_fileBytes = 0;
+    m_fileAge.start();
+
+    if (m_format == Asciicast) {
+        QJsonObject environment;
+        environment.insert("TERM", m_terminalType);
+        QJsonObject header;
+        header.insert("version", 2);
+        header.insert("width", m_columns);
+        header.insert("height", m_rows);
+        header.insert("timestamp", m_startTime / 1000);
+        header.insert("env", environment);
+        QByteArray line = QJsonDocument(header).toJson(QJsonDocument::Compact) + '\n';
+        if (m_file.write(line) != line.size()) {
+            emit logError(tr("Cannot write %1: %2").arg(fileName, m_file.errorString()));
+            return false;
+        }
+        m_fileBytes += line.size();
+    }
+
+    emit fileOpened(fileName);
+    return true;
+}
+
+bool TerminalLogger::writePending()
+{
+    // Take the whole list in one exchange and put it back into arrival order
+    Chunk *chunk = m_queue.fetchAndStoreAcquire(nullptr);
+    Chunk *ordered = nullptr;
+    while (chunk) {
+        Chunk *next = chunk->next;
+        chunk->next = ordered;
+        ordered = chunk;
+        chunk = next;
+    }
+
+    while (ordered) {
+        appendChunk(*ordered);
+        m_pendingBytes.fetchAndAddRelaxed(-ordered->data.size());
+        Chunk *next = ordered->next;
+        delete ordered;
+        ordered = next;
+    }
+
+    // Dropped while the queue was full, i.e. after what was just taken
+    int dropped = m_droppedBytes.fetchAndStoreRelaxed(0);
+    if (dropped > 0 && m_format == Asciicast) {
+        Chunk marker{QByteArray::number(dropped) + " bytes not recorded", QDateTime::currentMSecsSinceEpoch(), 'm', nullptr};
+        appendEvent(marker);
+    } else if (dropped > 0) {
+        m_batch += "\n[" + QByteArray::number(dropped) + " bytes of output not logged]\n";
+        m_atLineStart = true;
+    }
+
+    if (m_batch.isEmpty())
+        return true;
+
+    // A recording has to stay in one file to be played back
+    bool rotate = m_fileName.isEmpty() && m_format != Asciicast;
+    bool full = m_maxFileBytes > 0 && m_fileBytes >= m_maxFileBytes;
+    bool old = m_maxFileSeconds > 0 && m_fileAge.elapsed() >= qint64(m_maxFileSeconds) * 1000;
+    if (rotate && (full || old)) {
+        m_file.close();
+        if (!openFile())
+            return false;
+    }
+
+    QByteArray data = (m_compressed && m_format != Asciicast) ? gzipMember(m_batch) : m_batch;
+    m_batch.clear();
+    if (m_file.write(data) != data.size() || !m_file.flush()) {
+        emit logError(tr("Cannot write %1: %2").arg(m_file.fileName(), m_file.errorString()));
+        return false;
+    }
+    m_fileBytes += data.size();
+    return true;
+}
+
+void TerminalLogger::appendChunk(const Chunk &chunk)
+{
+    if (m_format == Asciicast) {
+        appendEvent(chunk);
+        return;
+    }
+    if (chunk.type != 'o')
+        return;
+
+    QByteArray text = m_format == PlainText ? plainText(chunk.data) : chunk.data;
+    if (!m_timestamps) {
+        m_batch += text;
+        return;
+    }
+
+    // Lines take the time their first output arrived
+    QByteArray stamp = '[' + QDateTime::fromMSecsSinceEpoch(chunk.time).toString(QStringLiteral("yyyy-MM-dd HH:mm:ss.zzz")).toLatin1() + "] ";
+    int start = 0;
+    while (start < text.size()) {
+        if (m_atLineStart) {
+            m_batch += stamp;
+            m_atLineStart = false;
+        }
+        int newline = text.indexOf('\n', start);
+        int end = newline < 0 ? text.size() : newline + 1;
+        m_batch.append(text.constData() + start, end - start);
+        if (newline >= 0)
+            m_atLineStart = true;
+        start = end;
+    }
+}
+
+void TerminalLogger::appendEvent(const Chunk &chunk)
+{
+    QString text;
+    if (chunk.type == 'o')
+        text = m_decoder->toUnicode(chunk.data);
+    else if (chunk.type == 'i')
+        text = m_inputDecoder->toUnicode(chunk.data);
+    else
+        text = QString::fromUtf8(chunk.data);
+    // The start of a multi-byte character; it goes out with the next chunk
+    if (text.isEmpty())
+        return;
+
+    QJsonArray event;
+    event.append(double(qMax<qint64>(0, chunk.time - m_startTime)) / 1000.0);
+    event.append(QString(QLatin1Char(chunk.type)));
+    event.append(text);
+    m_batch += QJsonDocument(event).toJson(QJsonDocument::Compact);
+    m_batch += '\n';
+}
+
+QByteArray TerminalLogger::plainText(const QByteArray &data)
+{
+    QByteArray text;
+    text.reserve(data.size());
+    for (char ch : data) {
+        uchar byte = uchar(ch);
+        switch (m_filterState) {
+        case Ground:
+            if (byte == 0x1B)
+                m_filterState = Escape;
+            // Carriage returns, backspaces and bells have no meaning in a text file
+            else if ((byte >= 0x20 && byte != 0x7F) || byte == '\n' || byte == '\t')
+                text.append(ch);
+            break;
+        case Escape:
+            if (byte == '[')
+                m_filterState = ControlSequence;
+            else if (byte == ']' || byte == 'P' || byte == 'X' || byte == '^' || byte == '_')
+                m_filterState = ControlString;
+            else if (byte >= 0x20 && byte <= 0x2F)
+                m_filterState = EscapeIntermediate;
+            else
+                m_filterState = Ground;
+            break;
+        case EscapeIntermediate:
+            if (byte < 0x20 || byte > 0x2F)
+                m_filterState = Ground;
+            break;
+        case ControlSequence:
+            if (byte >= 0x40 && byte <= 0x7E)
+                m_filterState = Ground;
+            break;
+        case ControlString:
+            if (byte == 0x07)
+                m_filterState = Ground;
+            else if (byte == 0x1B)
+                m_filterState = ControlStringEscape;
+            break;
+        case ControlStringEscape:
+            m_filterState = byte == '\\' ? Ground : ControlString;
+            break;
+        }
+    }
+
+    if (m_decoder)
+        return m_decoder->toUnicode(text).toUtf8();
+    return text;
+}
+
+void TerminalLogger::deleteQueue()
+{
+    Chunk *chunk = m_queue.fetchAndStoreAcquire(nullptr);
+    while (chunk) {
+        Chunk *next = chunk->next;
+        delete chunk;
+        chunk = next;
+    }
+}
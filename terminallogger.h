@@ -0,0 +1,144 @@
+#ifndef TERMINALLOGGER_H
+#define TERMINALLOGGER_H
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QAtomicInt>
+#include <QAtomicPointer>
+#include <QElapsedTimer>
+#include <QByteArray>
+#include <QString>
+#include <QFile>
+
+class QTextCodec;
+class QTextDecoder;
+
+// Writes a session's output to disk on a thread of its own. The SSH session thread hands
+// over each chunk with enqueue(), which only pushes it onto a lock-free list and never
+// waits: not for the disk, not for the writer and not for the GUI. The writer wakes a few
+// times a second, takes the whole list at once and writes it with a single call.
+//
+// The log holds either the raw output or plain text (escape sequences and control
+// characters removed, decoded to UTF-8), optionally with a timestamp at the start of every
+// line. A new file is started when the current one reaches a size or age limit. Compressed
+// logs are gzip files made of one member per write, which zcat and zless read as one.
+//
+// In Asciicast format the file is an asciicast v2 recording instead: a JSON header, then
+// one timed event per chunk of output, input or terminal resize.
+//
+// If the writer falls too far behind, output is dropped rather than buffered without
+// bound, and the log says how much is missing.
+class TerminalLogger : public QThread
+{
+    Q_OBJECT
+
+public:
+    enum Format {
+        PlainText,
+        RawOutput,
+        Asciicast
+    };
+
+    explicit TerminalLogger(QObject *parent = nullptr);
+    ~TerminalLogger();
+
+    // Take effect at the next startLogging()
+    void setDirectory(const QString &directory) { m_directory = directory; }
+    // File names are <baseName>-<date>-<time>.log, plus .gz when compressed
+    void setBaseName(const QString &baseName) { m_baseName = baseName; }
+    // Writes to this file instead of generated names in the directory, without rotation
+    void setFileName(const QString &fileName) { m_fileName = fileName; }
+    void setFormat(Format format) { m_format = format; }
+    void setTimestamps(bool enabled) { m_timestamps = enabled; }
+    // 0 means no limit
+    void setRotation(qint64 maxFileBytes, int maxFileSeconds);
+    void setCompressed(bool enabled) { m_compressed = enabled; }
+    // Encoding of the output for plain-text logs and recordings; nullptr means UTF-8
+    void setCodec(QTextCodec *codec) { m_codec = codec; }
+    // For the asciicast header
+    void setTerminal(int columns, int rows, const QString &terminalType);
+
+    // Opens a new file and starts accepting output
+    void startLogging();
+    // Writes what is queued, closes the file and waits for the writer to finish
+    void stop();
+    bool isLogging() const { return m_active.loadAcquire() != 0; }
+
+public slots:
+    // Thread-safe and lock-free; output arriving while not logging is ignored
+    void enqueue(const QByteArray &data);
+    // Only recorded in Asciicast format
+    void enqueueInput(const QByteArray &data);
+    void recordResize(int columns, int rows);
+
+signals:
+    void fileOpened(const QString &fileName);
+    void logError(const QString &message);
+
+protected:
+    void run() override;
+
+private:
+    enum FilterState {
+        Ground,
+        Escape,
+        EscapeIntermediate,
+        ControlSequence,
+        ControlString,      // OSC, DCS, SOS, PM, APC: ends with BEL or ESC backslash
+        ControlStringEscape
+    };
+
+    // Newest first; the writer reverses the list it takes
+    struct Chunk
+    {
+        QByteArray data;
+        qint64 time;
+        char type;          // asciicast event type: 'o' output, 'i' input, 'r' resize
+        Chunk *next;
+    };
+
+    QString m_directory;
+    QString m_baseName;
+    QString m_fileName;
+    Format m_format;
+    bool m_timestamps;
+    qint64 m_maxFileBytes;
+    int m_maxFileSeconds;
+    bool m_compressed;
+    QTextCodec *m_codec;
+    int m_columns;
+    int m_rows;
+    QString m_terminalType;
+
+    QAtomicPointer<Chunk> m_queue;
+    QAtomicInt m_pendingBytes;
+    QAtomicInt m_droppedBytes;
+    QAtomicInt m_active;
+
+    // Only for waking the writer early when logging stops
+    QMutex m_wakeMutex;
+    QWaitCondition m_wakeUp;
+    bool m_stopping;
+
+    // Writer thread state
+    QFile m_file;
+    qint64 m_fileBytes;
+    QElapsedTimer m_fileAge;
+    QByteArray m_batch;
+    FilterState m_filterState;
+    bool m_atLineStart;
+    QTextDecoder *m_decoder;
+    QTextDecoder *m_inputDecoder;
+    qint64 m_startTime;     // recording time 0, in ms since the epoch
+
+    bool openFile();
+    bool writePending();
+    void push(const QByteArray &data, char type);
+    void appendChunk(const Chunk &chunk);
+    void appendEvent(const Chunk &chunk);
+    QByteArray plainText(const QByteArray &data);
+    void deleteQueue();
+};
+
+#endif // TERMINALLOGGER_H
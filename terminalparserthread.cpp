@@ -0,0 +1,97 @@
+#include "terminalparserthread.h"
+#include "terminalscreen.h"
+
+namespace {
+
+// The GUI waits at most for one slice when it wants to paint
+const int ParseSliceBytes = 16 * 1024;
+// Output allowed to wait for the parser before enqueue() blocks
+const int MaxPendingBytes = 4 * 1024 * 1024;
+const int RecentOutputBytes = 1024;
+
+} // namespace
+
+TerminalParserThread::TerminalParserThread(TerminalScreen *screen, QObject *parent)
+    : QThread(parent)
+    , m_screen(screen)
+    , m_detector(nullptr)
+    , m_stopping(false)
+    , m_passthrough(0)
+    , m_changePending(0)
+{
+}
+
+TerminalParserThread::~TerminalParserThread()
+{
+    stop();
+}
+
+void TerminalParserThread::enqueue(const QByteArray &data)
+{
+    QMutexLocker locker(&m_queueMutex);
+    while (m_pending.size() >= MaxPendingBytes && !m_stopping && isRunning())
+        m_spaceAvailable.wait(&m_queueMutex);
+    if (m_stopping)
+        return;
+
+    m_pending.append(data);
+    m_dataAvailable.wakeOne();
+}
+
+void TerminalParserThread::setPassthrough(bool enabled)
+{
+    m_passthrough.storeRelease(enabled ? 1 : 0);
+    if (!enabled) {
+        QMutexLocker locker(&m_queueMutex);
+        // Output seen during the diversion must not trigger it again
+        m_recentOutput.clear();
+    }
+}
+
+void TerminalParserThread::stop()
+{
+    {
+        QMutexLocker locker(&m_queueMutex);
+        m_stopping = true;
+        m_dataAvailable.wakeAll();
+        m_spaceAvailable.wakeAll();
+    }
+    wait();
+}
+
+void TerminalParserThread::run()
+{
+    for (;;) {
+        QByteArray data;
+        {
+            QMutexLocker locker(&m_queueMutex);
+            while (m_pending.isEmpty() && !m_stopping)
+                m_dataAvailable.wait(&m_queueMutex);
+            if (m_stopping)
+                return;
+            data.swap(m_pending);
+            m_spaceAvailable.wakeAll();
+
+            if (m_detector && !isPassthrough()) {
+                m_recentOutput.append(data.right(RecentOutputBytes));
+                m_recentOutput = m_recentOutput.right(RecentOutputBytes);
+                if (m_detector(m_recentOutput))
+                    m_passthrough.storeRelease(1);
+            }
+        }
+
+        if (isPassthrough()) {
+            emit rawDataReceived(data);
+            continue;
+        }
+
+        // Short lock holds: the GUI can paint between slices of a large burst
+        for (int offset = 0; offset < data.size(); offset += ParseSliceBytes) {
+            QMutexLocker screenLocker(m_screen->mutex());
+            m_screen->feed(data.constData() + offset, qMin(ParseSliceBytes, data.size() - offset));
+        }
+
+        if (m_changePending.testAndSetOrdered(0, 1))
+            emit screenChanged();
+    }
+}
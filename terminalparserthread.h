@@ -0,0 +1,65 @@
+#ifndef TERMINALPARSERTHREAD_H
+#define TERMINALPARSERTHREAD_H
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QAtomicInt>
+#include <QByteArray>
+
+class TerminalScreen;
+
+// Feeds terminal output into a TerminalScreen on a thread of its own, so parsing a flood
+// of output never runs on the GUI thread. The SSH session thread queues raw bytes with
+// enqueue(); the screen is changed under its mutex in short slices, and the GUI thread
+// takes the same mutex only to read the screen for painting.
+//
+// Output can be diverted before it reaches the parser: once the detector recognises
+// something (a ZMODEM request) the thread switches to passthrough and hands the bytes to
+// the GUI as rawDataReceived() until passthrough is turned off again.
+class TerminalParserThread : public QThread
+{
+    Q_OBJECT
+
+public:
+    typedef bool (*PassthroughDetector)(const QByteArray &recentOutput);
+
+    explicit TerminalParserThread(TerminalScreen *screen, QObject *parent = nullptr);
+    ~TerminalParserThread();
+
+    // Thread-safe. Blocks while too much output is waiting, which stops the session
+    // thread reading from the socket and lets SSH flow control slow the sender down.
+    void enqueue(const QByteArray &data);
+
+    void setPassthroughDetector(PassthroughDetector detector) { m_detector = detector; }
+    void setPassthrough(bool enabled);
+    bool isPassthrough() const { return m_passthrough.loadAcquire() != 0; }
+
+    // screenChanged() is emitted once until the GUI calls this before painting
+    void acknowledgeScreenChange() { m_changePending.storeRelease(0); }
+
+    void stop();
+
+signals:
+    void screenChanged();
+    void rawDataReceived(const QByteArray &data);
+
+protected:
+    void run() override;
+
+private:
+    TerminalScreen *m_screen;
+    PassthroughDetector m_detector;
+
+    QMutex m_queueMutex;
+    QWaitCondition m_dataAvailable;
+    QWaitCondition m_spaceAvailable;
+    QByteArray m_pending;
+    bool m_stopping;
+
+    QByteArray m_recentOutput;      // tail of the output, for the detector
+    QAtomicInt m_passthrough;
+    QAtomicInt m_changePending;
+};
+
+#endif // TERMINALPARSERTHREAD_H
@@ -0,0 +1,139 @@
+#include "terminalpredictor.h"
+#include "terminalscreen.h"
+#include <QRegularExpression>
+
+namespace {
+
+// After a wrong guess the link is probably doing something we do not understand
+// (remote line editing, a program that does not echo); stay quiet for a while
+const int MissBackoffMs = 2000;
+
+} // namespace
+
+TerminalPredictor::TerminalPredictor()
+    : m_enabled(false)
+    , m_holding(false)
+{
+}
+
+void TerminalPredictor::setEnabled(bool enabled)
+{
+    m_enabled = enabled;
+    if (!enabled)
+        clear();
+}
+
+bool TerminalPredictor::canPredict(const TerminalScreen &screen) const
+{
+    if (!m_enabled || m_holding || screen.isAlternateScreen())
+        return false;
+    if (m_lastMiss.isValid() && m_lastMiss.elapsed() < MissBackoffMs)
+        return false;
+    return !isPasswordPrompt(screen);
+}
+
+bool TerminalPredictor::predict(const TerminalScreen &screen, const QString &text)
+{
+    if (text.isEmpty() || !canPredict(screen))
+        return false;
+
+    int row = screen.cursorRow();
+    int column = screen.cursorColumn();
+    if (!m_cells.isEmpty()) {
+        const TerminalPredictedCell &last = m_cells.constLast();
+        row = last.row;
+        column = last.column + TerminalScreen::charWidth(last.codepoint);
+    }
+
+    bool predicted = false;
+    const QVector<uint> codepoints = text.toUcs4();
+    for (uint codepoint : codepoints) {
+        int width = TerminalScreen::charWidth(codepoint);
+        if (codepoint < ' ' || width == 0)
+            break;
+        if (column + width > screen.columns()) {
+            row++;
+            column = 0;
+        }
+        // Echo that would scroll the screen is left to the server
+        if (row >= screen.rows())
+            break;
+
+        m_cells.append(TerminalPredictedCell{row, column, codepoint});
+        column += width;
+        predicted = true;
+    }
+    return predicted;
+}
+
+bool TerminalPredictor::reconcile(const TerminalScreen &screen)
+{
+    if (m_cells.isEmpty()) {
+        m_holding = false;
+        return false;
+    }
+    if (screen.isAlternateScreen()) {
+        clear();
+        return true;
+    }
+
+    int scrolled = screen.scrolledLines();
+    int cursorRow = screen.cursorRow();
+    int cursorColumn = screen.cursorColumn();
+
+    for (TerminalPredictedCell &cell : m_cells)
+        cell.row -= scrolled;
+
+    // Predictions are made in order, so the confirmed ones are always at the front
+    int confirmed = 0;
+    for (const TerminalPredictedCell &cell : qAsConst(m_cells)) {
+        if (cell.row < 0) {
+            // Scrolled out of the screen: the server got there, whatever it wrote
+            ++confirmed;
+            continue;
+        }
+        if (cell.row >= screen.rows())
+            break;
+
+        bool passed = cursorRow > cell.row || (cursorRow == cell.row && cursorColumn > cell.column);
+        if (!passed)
+            break;
+
+        const TerminalLine &line = screen.screenLine(cell.row);
+        if (cell.column >= line.cells.size() || line.cells.at(cell.column).codepoint != cell.codepoint) {
+            m_cells.clear();
+            m_lastMiss.start();
+            return true;
+        }
+        ++confirmed;
+    }
+
+    if (confirmed == 0)
+        return scrolled > 0;
+    m_cells.remove(0, confirmed);
+    return true;
+}
+
+void TerminalPredictor::clear()
+{
+    m_cells.clear();
+    m_holding = false;
+}
+
+bool TerminalPredictor::retractLast()
+{
+    if (m_cells.isEmpty() || m_holding)
+        return false;
+    m_cells.removeLast();
+    return true;
+}
+
+bool TerminalPredictor::isPasswordPrompt(const TerminalScreen &screen)
+{
+    // Latin keywords, or 密码 / 口令, up to a (full-width) colon at the cursor
+    static const QRegularExpression prompt(
+        QStringLiteral("(\\b(password|passphrase|passcode|pin\\b)|\\x{5BC6}\\x{7801}|\\x{53E3}\\x{4EE4})[^:\\x{FF1A}]*[:\\x{FF1A}]\\s*$"),
+        QRegularExpression::CaseInsensitiveOption);
+    const TerminalLine &line = screen.screenLine(screen.cursorRow());
+    return prompt.match(TerminalScreen::lineText(line, 0, screen.cursorColumn())).hasMatch();
+}
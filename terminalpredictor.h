@@ -0,0 +1,63 @@
+#ifndef TERMINALPREDICTOR_H
+#define TERMINALPREDICTOR_H
+
+#include <QVector>
+#include <QString>
+#include <QElapsedTimer>
+
+class TerminalScreen;
+
+// A character shown before the server has echoed it, at a row of the screen
+struct TerminalPredictedCell
+{
+    int row;
+    int column;
+    quint32 codepoint;
+};
+
+// Speculative local echo for slow links, in the spirit of mosh. Typed text is predicted to
+// appear at the cursor; once the server's cursor has moved past a predicted cell, the cell
+// is compared with what the server actually wrote there and the prediction is either
+// confirmed (and dropped, the screen now shows the real character) or all outstanding
+// predictions are rolled back. Predictions are not made in full-screen applications, at
+// password prompts, or for a while after a wrong guess.
+//
+// All calls must be made with the screen's mutex held.
+class TerminalPredictor
+{
+public:
+    TerminalPredictor();
+
+    void setEnabled(bool enabled);
+    bool isEnabled() const { return m_enabled; }
+
+    // Predicts text to be echoed after the cursor (or after the previous predictions).
+    // Returns false if nothing was predicted.
+    bool predict(const TerminalScreen &screen, const QString &text);
+    // Checks the predictions against new output; must run before the screen's damage is
+    // cleared, since full-screen scrolls move them. Returns true if they changed.
+    bool reconcile(const TerminalScreen &screen);
+    void clear();
+
+    // Backspace over a predicted character takes the prediction back
+    bool retractLast();
+    // A key whose effect cannot be guessed (cursor keys, Tab, Enter) was sent: predict
+    // nothing more until the server has answered and the outstanding cells are resolved
+    void holdUntilOutput() { m_holding = true; }
+
+    bool hasPredictions() const { return !m_cells.isEmpty(); }
+    const QVector<TerminalPredictedCell> &cells() const { return m_cells; }
+
+    // Heuristic: the text before the cursor asks for a password or passphrase
+    static bool isPasswordPrompt(const TerminalScreen &screen);
+
+private:
+    bool m_enabled;
+    bool m_holding;
+    QVector<TerminalPredictedCell> m_cells;
+    QElapsedTimer m_lastMiss;
+
+    bool canPredict(const TerminalScreen &screen) const;
+};
+
+#endif // TERMINALPREDICTOR_H
@@ -0,0 +1,257 @@
+#include "terminalreplay.h"
+#include <QFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <QStringList>
+#include <QMutexLocker>
+#include <algorithm>
+
+namespace {
+
+// A keyframe is taken after this much recording time or output, whichever comes first
+const qint64 KeyframeIntervalMs = 5000;
+const qint64 KeyframeBytes = 1024 * 1024;
+// Output fed per event loop pass when playing as fast as possible, so the view still
+// repaints and the controls respond
+const int MaxSliceBytes = 256 * 1024;
+// Longest wait between two passes; the position display moves on during long pauses
+const int MaxWaitMs = 250;
+
+} // namespace
+
+TerminalReplay::TerminalReplay(TerminalScreen *screen, QObject *parent)
+    : QObject(parent)
+    , m_screen(screen)
+    , m_columns(80)
+    , m_rows(24)
+    , m_outputBytes(0)
+    , m_bytesSinceKeyframe(0)
+    , m_next(0)
+    , m_position(0)
+    , m_speed(1.0)
+    , m_playing(false)
+    , m_clockBase(0)
+{
+    m_timer.setSingleShot(true);
+    m_timer.setTimerType(Qt::PreciseTimer);
+    connect(&m_timer, &QTimer::timeout, this, &TerminalReplay::tick);
+}
+
+QString TerminalReplay::load(const QString &fileName)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly))
+        return file.errorString();
+
+    QJsonParseError parseError;
+    QJsonObject header = QJsonDocument::fromJson(file.readLine(), &parseError).object();
+    if (parseError.error != QJsonParseError::NoError || header.value("version").toInt() != 2)
+        return tr("Not an asciicast v2 recording");
+    m_columns = qMax(1, header.value("width").toInt(80));
+    m_rows = qMax(1, header.value("height").toInt(24));
+    // Pauses longer than this are shortened, as asciinema does
+    qint64 idleLimit = qint64(header.value("idle_time_limit").toDouble(0) * 1000);
+
+    m_events.clear();
+    m_outputBytes = 0;
+    qint64 lastRecorded = 0;
+    qint64 time = 0;
+    int lineNumber = 1;
+    while (!file.atEnd()) {
+        QByteArray line = file.readLine();
+        ++lineNumber;
+        if (line.trimmed().isEmpty())
+            continue;
+        QJsonArray fields = QJsonDocument::fromJson(line, &parseError).array();
+        if (parseError.error != QJsonParseError::NoError || fields.size() < 3)
+            return tr("Line %1 is not an event").arg(lineNumber);
+
+        qint64 recorded = qint64(fields.at(0).toDouble() * 1000);
+        qint64 gap = qMax<qint64>(0, recorded - lastRecorded);
+        time += idleLimit > 0 ? qMin(gap, idleLimit) : gap;
+        lastRecorded = recorded;
+
+        QString type = fields.at(1).toString();
+        Event event;
+        event.time = time;
+        event.columns = 0;
+        event.rows = 0;
+        if (type == QLatin1String("o")) {
+            event.type = 'o';
+            event.data = fields.at(2).toString().toUtf8();
+            m_outputBytes += event.data.size();
+        } else if (type == QLatin1String("r")) {
+            // "<columns>x<rows>"
+            QStringList size = fields.at(2).toString().split(QLatin1Char('x'));
+            event.type = 'r';
+            event.columns = size.value(0).toInt();
+            event.rows = size.value(1).toInt();
+            if (event.columns <= 0 || event.rows <= 0)
+                continue;
+        } else {
+            continue;
+        }
+        m_events.append(event);
+    }
+
+    rewind();
+    return QString();
+}
+
+void TerminalReplay::rewind()
+{
+    m_timer.stop();
+    m_playing = false;
+    {
+        QMutexLocker locker(m_screen->mutex());
+        // asciicast output is always UTF-8, whatever the tab was last connected with
+        m_screen->setEncoding("UTF-8");
+        m_screen->reset();
+        m_screen->clearScrollback();
+        m_screen->resize(m_columns, m_rows);
+
+        Keyframe start;
+        start.event = 0;
+        start.time = 0;
+        start.state = m_screen->keyframe();
+        m_keyframes.clear();
+        m_keyframes.append(start);
+    }
+    m_bytesSinceKeyframe = 0;
+    m_next = 0;
+    m_position = 0;
+    emit screenChanged();
+    emit positionChanged(m_position);
+}
+
+void TerminalReplay::setSpeed(double speed)
+{
+    m_speed = qMax(0.0, speed);
+    restartClock();
+    if (m_playing)
+        m_timer.start(0);
+}
+
+void TerminalReplay::play()
+{
+    if (m_next >= m_events.size())
+        seek(0);
+    m_playing = true;
+    restartClock();
+    m_timer.start(0);
+}
+
+void TerminalReplay::pause()
+{
+    m_playing = false;
+    m_timer.stop();
+}
+
+void TerminalReplay::seek(qint64 time)
+{
+    time = qBound<qint64>(0, time, duration());
+    if (time < m_position) {
+        // Keyframes are taken in event order, so their times ascend as well
+        auto it = std::upper_bound(m_keyframes.constBegin(), m_keyframes.constEnd(), time,
+                                   [](qint64 value, const Keyframe &keyframe) { return value < keyframe.time; });
+        const Keyframe &keyframe = *(it - 1);
+        {
+            QMutexLocker locker(m_screen->mutex());
+            m_screen->restoreKeyframe(*keyframe.state);
+        }
+        m_next = keyframe.event;
+        m_position = keyframe.time;
+        m_bytesSinceKeyframe = 0;
+    }
+    feedUntil(time);
+    restartClock();
+    if (m_playing)
+        m_timer.start(0);
+}
+
+void TerminalReplay::feedUntil(qint64 time)
+{
+    feedEvents(time, -1);
+}
+
+void TerminalReplay::restartClock()
+{
+    m_clockBase = m_position;
+    m_clock.start();
+}
+
+void TerminalReplay::tick()
+{
+    if (!m_playing)
+        return;
+
+    if (m_speed <= 0)
+        feedEvents(duration(), MaxSliceBytes);
+    else
+        feedEvents(qMin(duration(), m_clockBase + qint64(m_clock.elapsed() * m_speed)), -1);
+
+    if (m_next >= m_events.size()) {
+        m_playing = false;
+        emit finished();
+        return;
+    }
+    if (m_speed <= 0) {
+        m_timer.start(0);
+        return;
+    }
+    qint64 wait = qint64((m_events.at(m_next).time - m_position) / m_speed);
+    m_timer.start(int(qBound<qint64>(0, wait, MaxWaitMs)));
+}
+
+bool TerminalReplay::feedEvents(qint64 time, int maxBytes)
+{
+    bool changed = false;
+    int fed = 0;
+    {
+        QMutexLocker locker(m_screen->mutex());
+        while (m_next < m_events.size() && (maxBytes < 0 || fed < maxBytes)) {
+            const Event &event = m_events.at(m_next);
+            if (event.time > time)
+                break;
+            if (event.type == 'o') {
+                m_screen->feed(event.data.constData(), event.data.size());
+                fed += event.data.size();
+                m_bytesSinceKeyframe += event.data.size();
+            } else {
+                m_screen->resize(event.columns, event.rows);
+            }
+            ++m_next;
+            m_position = event.time;
+            changed = true;
+            takeKeyframeIfDue(event.time);
+        }
+        // Caught up: the position moves on even where nothing was recorded
+        if (m_next >= m_events.size() || m_events.at(m_next).time > time)
+            m_position = qMax(m_position, qMin(time, duration()));
+    }
+
+    if (changed)
+        emit screenChanged();
+    emit positionChanged(m_position);
+    return changed;
+}
+
+void TerminalReplay::takeKeyframeIfDue(qint64 time)
+{
+    // After a seek backwards the keyframes ahead already exist
+    const Keyframe &last = m_keyframes.constLast();
+    if (m_next <= last.event)
+        return;
+    if (time - last.time < KeyframeIntervalMs && m_bytesSinceKeyframe < KeyframeBytes)
+        return;
+    if (!m_screen->canTakeKeyframe())
+        return;
+
+    Keyframe keyframe;
+    keyframe.event = m_next;
+    keyframe.time = time;
+    keyframe.state = m_screen->keyframe();
+    m_keyframes.append(keyframe);
+    m_bytesSinceKeyframe = 0;
+}
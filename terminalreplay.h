@@ -0,0 +1,102 @@
+#ifndef TERMINALREPLAY_H
+#define TERMINALREPLAY_H
+
+#include <QObject>
+#include <QVector>
+#include <QByteArray>
+#include <QString>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QSharedPointer>
+#include "terminalscreen.h"
+
+// Plays an asciicast v2 recording (as written by TerminalLogger, asciinema and others) into
+// a TerminalScreen at real time, at a multiple of it, or as fast as the screen can take
+// it. While output is fed, the screen state is saved every few seconds of recording time
+// or megabyte of output; seeking backwards restores the last keyframe before the target
+// and replays only the rest, so seeking costs at most one keyframe interval of parsing.
+// The scrollback is not part of a keyframe and only holds what was replayed since.
+//
+// Playing runs on the thread that owns the object and locks the screen's mutex while
+// feeding. With feedUntil() a recording is also a repeatable parser workload.
+class TerminalReplay : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit TerminalReplay(TerminalScreen *screen, QObject *parent = nullptr);
+
+    // Reads the whole recording and resets the screen to its size. Returns an empty
+    // string on success, otherwise what is wrong with the file.
+    QString load(const QString &fileName);
+
+    int columns() const { return m_columns; }
+    int rows() const { return m_rows; }
+    // Milliseconds of recording time
+    qint64 duration() const { return m_events.isEmpty() ? 0 : m_events.constLast().time; }
+    qint64 position() const { return m_position; }
+    qint64 outputBytes() const { return m_outputBytes; }
+
+    // 1.0 is real time; 0 plays as fast as possible
+    void setSpeed(double speed);
+    double speed() const { return m_speed; }
+    bool isPlaying() const { return m_playing; }
+
+    // Feeds everything up to time (ms) at once, without pacing
+    void feedUntil(qint64 time);
+
+public slots:
+    void play();
+    void pause();
+    // Restores the last keyframe at or before time, then feeds up to it
+    void seek(qint64 time);
+
+signals:
+    void screenChanged();
+    void positionChanged(qint64 time);
+    void finished();
+
+private slots:
+    void tick();
+
+private:
+    struct Event
+    {
+        qint64 time;
+        char type;          // 'o' output or 'r' resize; input and markers are not kept
+        int columns;        // for resizes
+        int rows;
+        QByteArray data;    // UTF-8 output
+    };
+
+    struct Keyframe
+    {
+        int event;          // first event not contained in the state
+        qint64 time;
+        QSharedPointer<const TerminalScreen::Keyframe> state;
+    };
+
+    TerminalScreen *m_screen;
+    int m_columns;
+    int m_rows;
+    QVector<Event> m_events;
+    qint64 m_outputBytes;
+
+    QVector<Keyframe> m_keyframes;  // by ascending event
+    qint64 m_bytesSinceKeyframe;
+
+    int m_next;
+    qint64 m_position;
+    double m_speed;
+    bool m_playing;
+    QTimer m_timer;
+    QElapsedTimer m_clock;
+    qint64 m_clockBase;             // position when m_clock was started
+
+    void rewind();
+    void restartClock();
+    bool feedEvents(qint64 time, int maxBytes);
+    void takeKeyframeIfDue(qint64 time);
+};
+
+#endif // TERMINALREPLAY_H
@@ -0,0 +1,1259 @@
+#include "terminalscreen.h"
+#include <QChar>
+#include <QBitArray>
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+// DEC Special Graphics for 0x60-0x7E (ESC ( 0), used by curses for box drawing
+const quint16 g_decGraphics[31] = {
+    0x25C6, 0x2592, 0x2409, 0x240C, 0x240D, 0x240A, 0x00B0, 0x00B1,
+    0x2424, 0x240B, 0x2518, 0x2510, 0x250C, 0x2514, 0x253C, 0x23BA,
+    0x23BB, 0x2500, 0x23BC, 0x23BD, 0x251C, 0x2524, 0x2534, 0x252C,
+    0x2502, 0x2264, 0x2265, 0x03C0, 0x2260, 0x00A3, 0x00B7
+};
+
+// While the attribute table stays full, unused ids are looked for again only after this
+// many new combinations had to fall back to the defaults
+const int ReclaimInterval = 4096;
+
+} // namespace
+
+int TerminalScreen::charWidth(quint32 codepoint)
+{
+    if (codepoint < 0x0300)
+        return 1;
+
+    QChar::Category category = QChar::category(uint(codepoint));
+    if (category == QChar::Mark_NonSpacing || category == QChar::Mark_Enclosing
+        || category == QChar::Other_Format)
+        return 0;
+
+    if ((codepoint >= 0x1100 && codepoint <= 0x115F)
+        || (codepoint >= 0x2E80 && codepoint <= 0x303E)
+        || (codepoint >= 0x3041 && codepoint <= 0x33FF)
+        || (codepoint >= 0x3400 && codepoint <= 0x4DBF)
+        || (codepoint >= 0x4E00 && codepoint <= 0x9FFF)
+        || (codepoint >= 0xA000 && codepoint <= 0xA4CF)
+        || (codepoint >= 0xAC00 && codepoint <= 0xD7A3)
+        || (codepoint >= 0xF900 && codepoint <= 0xFAFF)
+        || (codepoint >= 0xFE30 && codepoint <= 0xFE4F)
+        || (codepoint >= 0xFF00 && codepoint <= 0xFF60)
+        || (codepoint >= 0xFFE0 && codepoint <= 0xFFE6)
+        || (codepoint >= 0x1F300 && codepoint <= 0x1F64F)
+        || (codepoint >= 0x1F900 && codepoint <= 0x1F9FF)
+        || (codepoint >= 0x20000 && codepoint <= 0x3FFFD))
+        return 2;
+
+    return 1;
+}
+
+TerminalScreen::TerminalScreen(int columns, int rows, QObject *parent)
+    : QObject(parent)
+    , m_parser(this)
+    , m_columns(qMax(columns, 1))
+    , m_rows(qMax(rows, 1))
+    , m_alternateActive(false)
+    , m_droppedLines(0)
+    , m_attributeMisses(0)
+    , m_penId(0)
+    , m_eraseId(0)
+    , m_fullyDirty(true)
+    , m_scrolledLines(0)
+{
+    // Index 0 is always the default attribute set, so zero-filled cells are blank
+    m_attributeTable.append(TerminalAttributes());
+    m_attributeIds.insert(TerminalAttributes().key(), 0);
+    m_scrollback.setWidth(m_columns);
+    reset();
+}
+
+void TerminalScreen::feed(const char *data, int length)
+{
+    m_parser.feed(data, length);
+}
+
+void TerminalScreen::writeLocalText(const QString &text, int ansiColor, bool bold)
+{
+    TerminalAttributes previousPen = m_pen;
+    if (ansiColor >= 0)
+        m_pen.foreground = quint32(qBound(0, ansiColor, 255));
+    if (bold)
+        m_pen.flags |= TerminalAttributes::Bold;
+    updatePen();
+
+    QVector<uint> codepoints = text.toUcs4();
+    for (uint codepoint : codepoints) {
+        if (codepoint == '\n') {
+            m_cursorColumn = 0;
+            m_pendingWrap = false;
+            lineFeed();
+        } else if (codepoint == '\r') {
+            m_cursorColumn = 0;
+            m_pendingWrap = false;
+        } else if (codepoint >= 0x20) {
+            printCodepoint(codepoint);
+        }
+    }
+
+    m_pen = previousPen;
+    updatePen();
+}
+
+void TerminalScreen::resize(int columns, int rows)
+{
+    columns = qMax(columns, 1);
+    rows = qMax(rows, 1);
+    if (columns == m_columns && rows == m_rows)
+        return;
+
+    // History is re-wrapped to the new width only as it is read
+    m_scrollback.setWidth(columns);
+
+    for (int s = 0; s < 2; ++s) {
+        QVector<TerminalLine> &lines = m_screens[s];
+
+        for (TerminalLine &line : lines) {
+            line.cells.resize(columns);
+            if (columns > m_columns)
+                std::fill(line.cells.begin() + m_columns, line.cells.end(), TerminalCell{0, 0, 0});
+            // A wide character cut in half at the new right edge becomes a blank
+            if (!line.cells.isEmpty() && (line.cells.last().flags & TerminalCell::WideChar))
+                line.cells.last() = TerminalCell{0, 0, 0};
+        }
+
+        if (rows < m_rows) {
+            // Keep the cursor on screen: drop lines from the top (into the scrollback for
+            // the primary screen) while the cursor is below the new bottom, then from the
+            // bottom
+            bool active = (s == 1) == m_alternateActive;
+            int fromTop = active ? qMin(m_rows - rows, qMax(0, m_cursorRow - (rows - 1))) : 0;
+            for (int i = 0; i < fromTop; ++i) {
+                TerminalLine line = lines.takeFirst();
+                if (s == 0)
+                    m_droppedLines += m_scrollback.append(line);
+            }
+            lines.resize(rows);
+            if (active)
+                m_cursorRow -= fromTop;
+        } else {
+            TerminalLine blank;
+            blank.cells.fill(TerminalCell{0, 0, 0}, columns);
+            while (lines.size() < rows)
+                lines.append(blank);
+        }
+    }
+
+    m_columns = columns;
+    m_rows = rows;
+    m_cursorRow = qBound(0, m_cursorRow, m_rows - 1);
+    m_cursorColumn = qBound(0, m_cursorColumn, m_columns - 1);
+    m_savedCursor.row = qBound(0, m_savedCursor.row, m_rows - 1);
+    m_savedCursor.column = qBound(0, m_savedCursor.column, m_columns - 1);
+    m_pendingWrap = false;
+    m_scrollTop = 0;
+    m_scrollBottom = m_rows - 1;
+    m_highlightRow = -1;
+    resetTabStops();
+    markAllDirty();
+}
+
+void TerminalScreen::reset()
+{
+    m_parser.reset();
+    m_pen = TerminalAttributes();
+    m_penId = 0;
+    m_eraseId = 0;
+
+    m_alternateActive = false;
+    m_screens[0].clear();
+    m_screens[1].clear();
+    for (int i = 0; i < m_rows; ++i) {
+        m_screens[0].append(blankLine());
+        m_screens[1].append(blankLine());
+    }
+
+    m_cursorRow = 0;
+    m_cursorColumn = 0;
+    m_pendingWrap = false;
+    m_scrollTop = 0;
+    m_scrollBottom = m_rows - 1;
+    m_charsets[0] = 'B';
+    m_charsets[1] = '0';
+    m_activeCharset = 0;
+    m_lastPrinted = ' ';
+
+    m_autoWrap = true;
+    m_originMode = false;
+    m_insertMode = false;
+    m_cursorVisible = true;
+    m_applicationCursorKeys = false;
+    m_bracketedPaste = false;
+
+    m_decoder.reset();
+
+    m_scrolledLines = 0;
+    m_highlightRow = -1;
+
+    resetTabStops();
+    saveCursor();
+    markAllDirty();
+}
+
+struct TerminalScreen::Keyframe
+{
+    int columns;
+    int rows;
+    QVector<TerminalLine> screens[2];
+    bool alternateActive;
+    QVector<TerminalAttributes> attributeTable;
+    QHash<quint64, quint16> attributeIds;
+    TerminalAttributes pen;
+    quint16 penId;
+    quint16 eraseId;
+    int cursorRow;
+    int cursorColumn;
+    bool pendingWrap;
+    int scrollTop;
+    int scrollBottom;
+    QVector<bool> tabStops;
+    SavedCursor savedCursor;
+    char charsets[2];
+    int activeCharset;
+    quint32 lastPrinted;
+    bool autoWrap;
+    bool originMode;
+    bool insertMode;
+    bool cursorVisible;
+    bool applicationCursorKeys;
+    bool bracketedPaste;
+};
+
+QSharedPointer<const TerminalScreen::Keyframe> TerminalScreen::keyframe() const
+{
+    // The line vectors are implicitly shared, so this copies no cells until the screen
+    // changes them again
+    QSharedPointer<Keyframe> frame(new Keyframe);
+    frame->columns = m_columns;
+    frame->rows = m_rows;
+    frame->screens[0] = m_screens[0];
+    frame->screens[1] = m_screens[1];
+    frame->alternateActive = m_alternateActive;
+    frame->attributeTable = m_attributeTable;
+    frame->attributeIds = m_attributeIds;
+    frame->pen = m_pen;
+    frame->penId = m_penId;
+    frame->eraseId = m_eraseId;
+    frame->cursorRow = m_cursorRow;
+    frame->cursorColumn = m_cursorColumn;
+    frame->pendingWrap = m_pendingWrap;
+    frame->scrollTop = m_scrollTop;
+    frame->scrollBottom = m_scrollBottom;
+    frame->tabStops = m_tabStops;
+    frame->savedCursor = m_savedCursor;
+    std::copy(m_charsets, m_charsets + 2, frame->charsets);
+    frame->activeCharset = m_activeCharset;
+    frame->lastPrinted = m_lastPrinted;
+    frame->autoWrap = m_autoWrap;
+    frame->originMode = m_originMode;
+    frame->insertMode = m_insertMode;
+    frame->cursorVisible = m_cursorVisible;
+    frame->applicationCursorKeys = m_applicationCursorKeys;
+    frame->bracketedPaste = m_bracketedPaste;
+    return frame;
+}
+
+void TerminalScreen::restoreKeyframe(const Keyframe &frame)
+{
+    m_parser.reset();
+    m_decoder.reset();
+    clearScrollback();
+
+    m_columns = frame.columns;
+    m_rows = frame.rows;
+    m_scrollback.setWidth(m_columns);
+    m_screens[0] = frame.screens[0];
+    m_screens[1] = frame.screens[1];
+    m_alternateActive = frame.alternateActive;
+    m_attributeTable = frame.attributeTable;
+    m_attributeIds = frame.attributeIds;
+    m_freeAttributeIds.clear();
+    m_attributeMisses = 0;
+    m_pen = frame.pen;
+    m_penId = frame.penId;
+    m_eraseId = frame.eraseId;
+    m_cursorRow = frame.cursorRow;
+    m_cursorColumn = frame.cursorColumn;
+    m_pendingWrap = frame.pendingWrap;
+    m_scrollTop = frame.scrollTop;
+    m_scrollBottom = frame.scrollBottom;
+    m_tabStops = frame.tabStops;
+    m_savedCursor = frame.savedCursor;
+    std::copy(frame.charsets, frame.charsets + 2, m_charsets);
+    m_activeCharset = frame.activeCharset;
+    m_lastPrinted = frame.lastPrinted;
+    m_autoWrap = frame.autoWrap;
+    m_originMode = frame.originMode;
+    m_insertMode = frame.insertMode;
+    m_cursorVisible = frame.cursorVisible;
+    m_applicationCursorKeys = frame.applicationCursorKeys;
+    m_bracketedPaste = frame.bracketedPaste;
+    m_highlightRow = -1;
+    markAllDirty();
+}
+
+void TerminalScreen::setHighlighter(const QSharedPointer<const TerminalHighlighter> &highlighter)
+{
+    m_highlighter = highlighter;
+    m_highlightRow = -1;
+}
+
+QString TerminalScreen::takeHighlightAlert()
+{
+    QString alert = m_highlightAlert;
+    m_highlightAlert.clear();
+    return alert;
+}
+
+void TerminalScreen::clearScrollback()
+{
+    m_droppedLines += m_scrollback.size();
+    m_scrollback.clear();
+    markAllDirty();
+}
+
+void TerminalScreen::setScrollbackLimits(int lines, qint64 bytes)
+{
+    int dropped = m_scrollback.setLimits(lines, bytes);
+    if (dropped > 0) {
+        m_droppedLines += dropped;
+        markAllDirty();
+    }
+}
+
+QVector<QByteArray> TerminalScreen::packedScreenLines() const
+{
+    const QVector<TerminalLine> &lines = activeLines();
+    QVector<QByteArray> packed;
+    packed.reserve(lines.size());
+    for (const TerminalLine &line : lines)
+        packed.append(TerminalScrollback::pack(line));
+    return packed;
+}
+
+QString TerminalScreen::lineText(const TerminalLine &line, int from, int to)
+{
+    if (to < 0 || to > line.cells.size())
+        to = line.cells.size();
+
+    QString text;
+    text.reserve(qMax(0, to - from));
+    for (int i = qMax(0, from); i < to; ++i) {
+        const TerminalCell &cell = line.cells.at(i);
+        if (cell.flags & TerminalCell::WideTail)
+            continue;
+        uint codepoint = cell.codepoint ? cell.codepoint : ' ';
+        if (QChar::requiresSurrogates(codepoint)) {
+            text.append(QChar(QChar::highSurrogate(codepoint)));
+            text.append(QChar(QChar::lowSurrogate(codepoint)));
+        } else {
+            text.append(QChar(ushort(codepoint)));
+        }
+    }
+    return text;
+}
+
+int TerminalScreen::takeDroppedLines()
+{
+    int dropped = m_droppedLines;
+    m_droppedLines = 0;
+    return dropped;
+}
+
+void TerminalScreen::clearDamage()
+{
+    for (TerminalLine &line : activeLines())
+        line.dirty = false;
+    m_fullyDirty = false;
+    m_scrolledLines = 0;
+}
+
+TerminalLine TerminalScreen::blankLine() const
+{
+    TerminalLine line;
+    line.cells.fill(TerminalCell{0, m_eraseId, 0}, m_columns);
+    return line;
+}
+
+quint16 TerminalScreen::internAttributes(const TerminalAttributes &attributes)
+{
+    quint64 key = attributes.key();
+    QHash<quint64, quint16>::const_iterator it = m_attributeIds.constFind(key);
+    if (it != m_attributeIds.constEnd())
+        return it.value();
+
+    // Scrollback cells keep their indices, so ids are never renumbered: once the table is
+    // full, ids no cell refers to any more are reused. Until some are found, new
+    // combinations fall back to the default attributes.
+    if (m_freeAttributeIds.isEmpty() && m_attributeTable.size() > 0xFFFF) {
+        if (m_attributeMisses++ % ReclaimInterval != 0)
+            return 0;
+        reclaimAttributes();
+        if (m_freeAttributeIds.isEmpty())
+            return 0;
+    }
+
+    quint16 id;
+    if (!m_freeAttributeIds.isEmpty()) {
+        id = m_freeAttributeIds.takeLast();
+        m_attributeTable[id] = attributes;
+    } else {
+        id = quint16(m_attributeTable.size());
+        m_attributeTable.append(attributes);
+    }
+    m_attributeIds.insert(key, id);
+    return id;
+}
+
+void TerminalScreen::reclaimAttributes()
+{
+    QBitArray used(m_attributeTable.size());
+    used.setBit(0);
+    used.setBit(m_penId);
+    used.setBit(m_eraseId);
+    for (int s = 0; s < 2; ++s) {
+        for (const TerminalLine &line : m_screens[s]) {
+            for (const TerminalCell &cell : line.cells)
+                used.setBit(cell.attribute);
+        }
+    }
+    m_scrollback.markAttributes(used);
+
+    // Lowest ids are handed out first
+    m_freeAttributeIds.clear();
+    for (int id = m_attributeTable.size() - 1; id > 0; --id) {
+        if (!used.testBit(id))
+            m_freeAttributeIds.append(quint16(id));
+    }
+    QHash<quint64, quint16>::iterator it = m_attributeIds.begin();
+    while (it != m_attributeIds.end()) {
+        if (used.testBit(it.value()))
+            ++it;
+        else
+            it = m_attributeIds.erase(it);
+    }
+
+    // Freeing only a few ids would have the next combinations scan everything again
+    m_attributeMisses = m_freeAttributeIds.size() >= ReclaimInterval ? 0 : 1;
+}
+
+void TerminalScreen::updatePen()
+{
+    m_penId = internAttributes(m_pen);
+
+    // Erased cells take the current background colour (xterm's back-colour-erase)
+    TerminalAttributes erase;
+    erase.background = m_pen.background;
+    m_eraseId = internAttributes(erase);
+}
+
+void TerminalScreen::printCodepoint(quint32 codepoint)
+{
+    if (m_charsets[m_activeCharset] == '0' && codepoint >= 0x60 && codepoint <= 0x7E)
+        codepoint = g_decGraphics[codepoint - 0x60];
+
+    int width = charWidth(codepoint);
+    if (width == 0)
+        return;     // combining marks are not stored
+    // A one-column grid cannot hold both halves of a wide character
+    if (width == 2 && m_columns < 2) {
+        codepoint = 0xFFFD;
+        width = 1;
+    }
+
+    QVector<TerminalLine> &lines = activeLines();
+
+    if (m_pendingWrap && m_autoWrap) {
+        lines[m_cursorRow].wrapped = true;
+        m_cursorColumn = 0;
+        lineFeed();
+    }
+    m_pendingWrap = false;
+
+    if (width == 2 && m_cursorColumn == m_columns - 1) {
+        if (!m_autoWrap)
+            return;
+        eraseCells(m_cursorRow, m_cursorColumn, m_columns);
+        lines[m_cursorRow].wrapped = true;
+        m_cursorColumn = 0;
+        lineFeed();
+    }
+
+    if (m_insertMode)
+        insertCells(width);
+
+    TerminalLine &line = lines[m_cursorRow];
+    TerminalCell *cells = line.cells.data();
+    int column = m_cursorColumn;
+
+    // Overwriting half of a wide character blanks the other half
+    if (cells[column].flags & TerminalCell::WideTail && column > 0)
+        cells[column - 1] = TerminalCell{0, cells[column - 1].attribute, 0};
+    int last = column + width - 1;
+    if (cells[last].flags & TerminalCell::WideChar && last + 1 < m_columns)
+        cells[last + 1] = TerminalCell{0, cells[last + 1].attribute, 0};
+
+    if (width == 2) {
+        cells[column] = TerminalCell{codepoint, m_penId, TerminalCell::WideChar};
+        cells[column + 1] = TerminalCell{0, m_penId, TerminalCell::WideTail};
+    } else {
+        cells[column] = TerminalCell{codepoint, m_penId, 0};
+    }
+    line.dirty = true;
+    m_lastPrinted = codepoint;
+    if (m_highlighter)
+        highlightCells(m_cursorRow, column, width);
+
+    m_cursorColumn += width;
+    if (m_cursorColumn >= m_columns) {
+        m_cursorColumn = m_columns - 1;
+        m_pendingWrap = m_autoWrap;
+    }
+}
+
+void TerminalScreen::printAscii(const char *data, int length)
+{
+    // The DEC graphics set and insert mode need the per-character path
+    if (m_charsets[m_activeCharset] == '0' || m_insertMode) {
+        for (int i = 0; i < length; ++i)
+            printCodepoint(static_cast<unsigned char>(data[i]));
+        return;
+    }
+
+    QVector<TerminalLine> &lines = activeLines();
+    int i = 0;
+    while (i < length) {
+        if (m_pendingWrap && m_autoWrap) {
+            lines[m_cursorRow].wrapped = true;
+            m_cursorColumn = 0;
+            lineFeed();
+        }
+        m_pendingWrap = false;
+
+        // Fill as much of the row as the run covers in one go
+        TerminalLine &line = lines[m_cursorRow];
+        TerminalCell *cells = line.cells.data();
+        int column = m_cursorColumn;
+        int count = qMin(length - i, m_columns - column);
+
+        // Overwriting half of a wide character blanks the other half
+        if (cells[column].flags & TerminalCell::WideTail && column > 0)
+            cells[column - 1] = TerminalCell{0, cells[column - 1].attribute, 0};
+        int last = column + count - 1;
+        if (cells[last].flags & TerminalCell::WideChar && last + 1 < m_columns)
+            cells[last + 1] = TerminalCell{0, cells[last + 1].attribute, 0};
+
+        for (int k = 0; k < count; ++k)
+            cells[column + k] = TerminalCell{static_cast<unsigned char>(data[i + k]), m_penId, 0};
+        line.dirty = true;
+        i += count;
+        if (m_highlighter)
+            highlightCells(m_cursorRow, column, count);
+
+        m_cursorColumn += count;
+        if (m_cursorColumn >= m_columns) {
+            m_cursorColumn = m_columns - 1;
+            m_pendingWrap = m_autoWrap;
+            if (!m_autoWrap && i < length) {
+                // Without autowrap the rest overwrites the last column; only the final one stays
+                cells[m_columns - 1].codepoint = static_cast<unsigned char>(data[length - 1]);
+                i = length;
+            }
+        }
+    }
+    m_lastPrinted = static_cast<unsigned char>(data[length - 1]);
+}
+
+void TerminalScreen::highlightCells(int row, int column, int count)
+{
+    if (row != m_highlightRow || column != m_highlightColumn) {
+        m_highlightState = m_highlighter->initialState(column == 0);
+        m_highlightText.clear();
+        m_highlightColumns.clear();
+    }
+    m_highlightRow = row;
+    m_highlightColumn = column + count;
+
+    TerminalLine &line = activeLines()[row];
+    for (int k = column; k < column + count; ++k) {
+        const TerminalCell &cell = line.cells.at(k);
+        if (cell.flags & TerminalCell::WideTail)
+            continue;
+        m_highlightText.append(cell.codepoint);
+        m_highlightColumns.append(k);
+        m_highlightMatches.clear();
+        m_highlighter->step(m_highlightState, cell.codepoint, m_highlightMatches);
+        if (m_highlightMatches.isEmpty())
+            continue;
+
+        int end = m_highlightText.size();
+        int endColumn = k + (cell.flags & TerminalCell::WideChar ? 2 : 1);
+        for (const TerminalHighlighter::Match &match : m_highlightMatches) {
+            // Regular expressions only report where they end
+            int start = match.length >= 0 ? end - match.length
+                                          : m_highlighter->regexMatchStart(match.rule, m_highlightText, end);
+            if (start < 0)
+                continue;
+
+            const TerminalHighlightRule &rule = m_highlighter->rule(match.rule);
+            for (int target = m_highlightColumns.at(start); target < endColumn; ++target) {
+                // A copy: interning may grow the table
+                TerminalAttributes attributes = m_attributeTable.at(line.cells.at(target).attribute);
+                if (rule.foreground != TerminalHighlightRule::KeepColor)
+                    attributes.foreground = rule.foreground;
+                if (rule.background != TerminalHighlightRule::KeepColor)
+                    attributes.background = rule.background;
+                if (rule.bold)
+                    attributes.flags |= TerminalAttributes::Bold;
+                line.cells[target].attribute = internAttributes(attributes);
+            }
+
+            if (rule.alert && m_highlightAlert.isEmpty()) {
+                m_highlightAlert = QString::fromUcs4(m_highlightText.constData() + start, end - start);
+                emit highlightAlert();
+            }
+        }
+    }
+}
+
+void TerminalScreen::lineFeed()
+{
+    if (m_cursorRow == m_scrollBottom)
+        scrollUp(m_scrollTop, m_scrollBottom, 1);
+    else if (m_cursorRow < m_rows - 1)
+        ++m_cursorRow;
+}
+
+void TerminalScreen::reverseIndex()
+{
+    if (m_cursorRow == m_scrollTop)
+        scrollDown(m_scrollTop, m_scrollBottom, 1);
+    else if (m_cursorRow > 0)
+        --m_cursorRow;
+}
+
+void TerminalScreen::scrollUp(int top, int bottom, int count)
+{
+    count = qMin(count, bottom - top + 1);
+    if (count <= 0)
+        return;
+
+    QVector<TerminalLine> &lines = activeLines();
+    bool fullScreen = top == 0 && bottom == m_rows - 1;
+    m_highlightRow = -1;
+
+    for (int i = 0; i < count; ++i) {
+        TerminalLine line = lines.takeAt(top);
+        if (fullScreen && !m_alternateActive)
+            m_droppedLines += m_scrollback.append(line);
+        lines.insert(bottom, blankLine());
+    }
+
+    if (fullScreen) {
+        // Rows keep their own dirty flags as they move, so a view can blit the
+        // scrolled pixels and repaint only what changed
+        m_scrolledLines += count;
+    } else {
+        for (int row = top; row <= bottom; ++row)
+            lines[row].dirty = true;
+    }
+}
+
+void TerminalScreen::scrollDown(int top, int bottom, int count)
+{
+    count = qMin(count, bottom - top + 1);
+    if (count <= 0)
+        return;
+
+    QVector<TerminalLine> &lines = activeLines();
+    m_highlightRow = -1;
+    for (int i = 0; i < count; ++i) {
+        lines.removeAt(bottom);
+        lines.insert(top, blankLine());
+    }
+    for (int row = top; row <= bottom; ++row)
+        lines[row].dirty = true;
+}
+
+void TerminalScreen::eraseCells(int row, int from, int to)
+{
+    TerminalLine &line = activeLines()[row];
+    from = qBound(0, from, m_columns);
+    to = qBound(0, to, m_columns);
+    if (from >= to)
+        return;
+
+    // Don't leave half of a wide character behind at either edge
+    if (from > 0 && (line.cells[from].flags & TerminalCell::WideTail))
+        line.cells[from - 1] = TerminalCell{0, m_eraseId, 0};
+    if (to < m_columns && (line.cells[to].flags & TerminalCell::WideTail))
+        line.cells[to] = TerminalCell{0, m_eraseId, 0};
+
+    std::fill(line.cells.begin() + from, line.cells.begin() + to, TerminalCell{0, m_eraseId, 0});
+    if (to == m_columns)
+        line.wrapped = false;
+    line.dirty = true;
+}
+
+void TerminalScreen::eraseInDisplay(int mode)
+{
+    switch (mode) {
+    case 0:
+        eraseCells(m_cursorRow, m_cursorColumn, m_columns);
+        for (int row = m_cursorRow + 1; row < m_rows; ++row)
+            eraseCells(row, 0, m_columns);
+        break;
+    case 1:
+        for (int row = 0; row < m_cursorRow; ++row)
+            eraseCells(row, 0, m_columns);
+        eraseCells(m_cursorRow, 0, m_cursorColumn + 1);
+        break;
+    case 2:
+        for (int row = 0; row < m_rows; ++row)
+            eraseCells(row, 0, m_columns);
+        break;
+    case 3:
+        clearScrollback();
+        break;
+    }
+}
+
+void TerminalScreen::eraseInLine(int mode)
+{
+    switch (mode) {
+    case 0:
+        eraseCells(m_cursorRow, m_cursorColumn, m_columns);
+        break;
+    case 1:
+        eraseCells(m_cursorRow, 0, m_cursorColumn + 1);
+        break;
+    case 2:
+        eraseCells(m_cursorRow, 0, m_columns);
+        break;
+    }
+}
+
+void TerminalScreen::insertCells(int count)
+{
+    TerminalLine &line = activeLines()[m_cursorRow];
+    count = qMin(count, m_columns - m_cursorColumn);
+    if (count <= 0)
+        return;
+
+    TerminalCell *cells = line.cells.data();
+    std::move_backward(cells + m_cursorColumn, cells + m_columns - count, cells + m_columns);
+    std::fill(cells + m_cursorColumn, cells + m_cursorColumn + count, TerminalCell{0, m_eraseId, 0});
+    if (cells[m_columns - 1].flags & TerminalCell::WideChar)
+        cells[m_columns - 1] = TerminalCell{0, m_eraseId, 0};
+    line.dirty = true;
+}
+
+void TerminalScreen::deleteCells(int count)
+{
+    TerminalLine &line = activeLines()[m_cursorRow];
+    count = qMin(count, m_columns - m_cursorColumn);
+    if (count <= 0)
+        return;
+
+    TerminalCell *cells = line.cells.data();
+    std::move(cells + m_cursorColumn + count, cells + m_columns, cells + m_cursorColumn);
+    std::fill(cells + m_columns - count, cells + m_columns, TerminalCell{0, m_eraseId, 0});
+    if (cells[m_cursorColumn].flags & TerminalCell::WideTail)
+        cells[m_cursorColumn] = TerminalCell{0, m_eraseId, 0};
+    line.dirty = true;
+}
+
+void TerminalScreen::insertLines(int count)
+{
+    if (m_cursorRow < m_scrollTop || m_cursorRow > m_scrollBottom)
+        return;
+    scrollDown(m_cursorRow, m_scrollBottom, count);
+    m_cursorColumn = 0;
+}
+
+void TerminalScreen::deleteLines(int count)
+{
+    if (m_cursorRow < m_scrollTop || m_cursorRow > m_scrollBottom)
+        return;
+
+    // Deleted lines never go to the scrollback, even when the region is the full screen
+    QVector<TerminalLine> &lines = activeLines();
+    count = qMin(count, m_scrollBottom - m_cursorRow + 1);
+    for (int i = 0; i < count; ++i) {
+        lines.removeAt(m_cursorRow);
+        lines.insert(m_scrollBottom, blankLine());
+    }
+    for (int row = m_cursorRow; row <= m_scrollBottom; ++row)
+        lines[row].dirty = true;
+    m_cursorColumn = 0;
+}
+
+void TerminalScreen::moveCursor(int row, int column)
+{
+    int top = m_originMode ? m_scrollTop : 0;
+    int bottom = m_originMode ? m_scrollBottom : m_rows - 1;
+    m_cursorRow = qBound(top, row, bottom);
+    m_cursorColumn = qBound(0, column, m_columns - 1);
+    m_pendingWrap = false;
+}
+
+void TerminalScreen::setMode(const VTSequence &sequence, bool enabled)
+{
+    bool dec = sequence.privateMarker() == '?';
+
+    for (int i = 0; i < sequence.paramCount; ++i) {
+        int mode = sequence.params[i];
+        if (!dec) {
+            if (mode == 4)
+                m_insertMode = enabled;
+            continue;
+        }
+
+        switch (mode) {
+        case 1:
+            m_applicationCursorKeys = enabled;
+            break;
+        case 6:
+            m_originMode = enabled;
+            moveCursor(m_originMode ? m_scrollTop : 0, 0);
+            break;
+        case 7:
+            m_autoWrap = enabled;
+            if (!enabled)
+                m_pendingWrap = false;
+            break;
+        case 25:
+            m_cursorVisible = enabled;
+            activeLines()[m_cursorRow].dirty = true;
+            break;
+        case 47:
+        case 1047:
+            setAlternateScreen(enabled, false);
+            break;
+        case 1048:
+            if (enabled)
+                saveCursor();
+            else
+                restoreCursor();
+            break;
+        case 1049:
+            setAlternateScreen(enabled, true);
+            break;
+        case 2004:
+            m_bracketedPaste = enabled;
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+void TerminalScreen::setAlternateScreen(bool enabled, bool saveCursorState)
+{
+    if (enabled == m_alternateActive)
+        return;
+
+    if (enabled) {
+        if (saveCursorState)
+            saveCursor();
+        m_alternateActive = true;
+        for (int row = 0; row < m_rows; ++row)
+            eraseCells(row, 0, m_columns);
+    } else {
+        m_alternateActive = false;
+        if (saveCursorState)
+            restoreCursor();
+    }
+    m_pendingWrap = false;
+    m_highlightRow = -1;
+    markAllDirty();
+}
+
+void TerminalScreen::saveCursor()
+{
+    m_savedCursor.row = m_cursorRow;
+    m_savedCursor.column = m_cursorColumn;
+    m_savedCursor.pen = m_pen;
+    m_savedCursor.originMode = m_originMode;
+    m_savedCursor.pendingWrap = m_pendingWrap;
+    m_savedCursor.charsets[0] = m_charsets[0];
+    m_savedCursor.charsets[1] = m_charsets[1];
+    m_savedCursor.activeCharset = m_activeCharset;
+}
+
+void TerminalScreen::restoreCursor()
+{
+    m_cursorRow = qBound(0, m_savedCursor.row, m_rows - 1);
+    m_cursorColumn = qBound(0, m_savedCursor.column, m_columns - 1);
+    m_pen = m_savedCursor.pen;
+    m_originMode = m_savedCursor.originMode;
+    m_pendingWrap = m_savedCursor.pendingWrap;
+    m_charsets[0] = m_savedCursor.charsets[0];
+    m_charsets[1] = m_savedCursor.charsets[1];
+    m_activeCharset = m_savedCursor.activeCharset;
+    updatePen();
+}
+
+void TerminalScreen::markAllDirty()
+{
+    for (TerminalLine &line : activeLines())
+        line.dirty = true;
+    m_fullyDirty = true;
+}
+
+void TerminalScreen::resetTabStops()
+{
+    m_tabStops.fill(false, m_columns);
+    for (int column = 8; column < m_columns; column += 8)
+        m_tabStops[column] = true;
+}
+
+void TerminalScreen::applySgr(const VTSequence &sequence)
+{
+    if (sequence.paramCount == 0) {
+        m_pen = TerminalAttributes();
+        updatePen();
+        return;
+    }
+
+    for (int i = 0; i < sequence.paramCount; ++i) {
+        int code = sequence.params[i];
+        if (code < 0)
+            code = 0;
+
+        switch (code) {
+        case 0: m_pen = TerminalAttributes(); break;
+        case 1: m_pen.flags |= TerminalAttributes::Bold; break;
+        case 2: m_pen.flags |= TerminalAttributes::Dim; break;
+        case 3: m_pen.flags |= TerminalAttributes::Italic; break;
+        case 4: m_pen.flags |= TerminalAttributes::Underline; break;
+        case 5: case 6: m_pen.flags |= TerminalAttributes::Blink; break;
+        case 7: m_pen.flags |= TerminalAttributes::Inverse; break;
+        case 8: m_pen.flags |= TerminalAttributes::Concealed; break;
+        case 9: m_pen.flags |= TerminalAttributes::Strikeout; break;
+        case 21: case 22: m_pen.flags &= ~(TerminalAttributes::Bold | TerminalAttributes::Dim); break;
+        case 23: m_pen.flags &= ~TerminalAttributes::Italic; break;
+        case 24: m_pen.flags &= ~TerminalAttributes::Underline; break;
+        case 25: m_pen.flags &= ~TerminalAttributes::Blink; break;
+        case 27: m_pen.flags &= ~TerminalAttributes::Inverse; break;
+        case 28: m_pen.flags &= ~TerminalAttributes::Concealed; break;
+        case 29: m_pen.flags &= ~TerminalAttributes::Strikeout; break;
+        case 39: m_pen.foreground = TerminalAttributes::DefaultColor; break;
+        case 49: m_pen.background = TerminalAttributes::DefaultColor; break;
+        case 38:
+        case 48: {
+            // 38;5;n / 38:5:n select a palette entry, 38;2;r;g;b / 38:2::r:g:b a 24-bit colour
+            quint32 color = TerminalAttributes::DefaultColor;
+            int mode = i + 1 < sequence.paramCount ? sequence.params[i + 1] : -1;
+            if (mode == 5 && i + 2 < sequence.paramCount) {
+                color = quint32(qBound(0, sequence.params[i + 2], 255));
+                i += 2;
+            } else if (mode == 2 && i + 4 < sequence.paramCount) {
+                // Colon form may carry a colour space id before r:g:b
+                int first = i + 2;
+                if (sequence.isSubparam(i + 2) && i + 5 < sequence.paramCount && sequence.isSubparam(i + 5))
+                    first = i + 3;
+                color = TerminalAttributes::rgbColor(qBound(0, sequence.params[first], 255),
+                                                     qBound(0, sequence.params[first + 1], 255),
+                                                     qBound(0, sequence.params[first + 2], 255));
+                i = first + 2;
+            } else {
+                i = sequence.paramCount;
+            }
+            if (code == 38)
+                m_pen.foreground = color;
+            else
+                m_pen.background = color;
+            break;
+        }
+        default:
+            if (code >= 30 && code <= 37)
+                m_pen.foreground = quint32(code - 30);
+            else if (code >= 40 && code <= 47)
+                m_pen.background = quint32(code - 40);
+            else if (code >= 90 && code <= 97)
+                m_pen.foreground = quint32(code - 90 + 8);
+            else if (code >= 100 && code <= 107)
+                m_pen.background = quint32(code - 100 + 8);
+            break;
+        }
+    }
+    updatePen();
+}
+
+void TerminalScreen::vtPrint(const char *data, int length)
+{
+    while (length > 0) {
+        // Runs of ASCII (most output) skip decoding and go straight into the cells
+        if (m_decoder.asciiPassthrough()) {
+            int ascii = TerminalDecoder::asciiPrefix(data, length);
+            if (ascii > 0) {
+                printAscii(data, ascii);
+                data += ascii;
+                length -= ascii;
+                continue;
+            }
+        }
+
+        // Decode up to the next ASCII byte; a sequence cut short there is finished (or
+        // rejected) by the decoder on the next pass
+        int chunk = length;
+        if (m_decoder.encoding() != TerminalDecoder::Codec) {
+            chunk = 1;
+            while (chunk < length && static_cast<unsigned char>(data[chunk]) >= 0x80)
+                ++chunk;
+        }
+
+        if (m_decoded.size() < chunk + 1)
+            m_decoded.resize(chunk + 1);
+        int count = m_decoder.decode(data, chunk, m_decoded.data());
+        for (int i = 0; i < count; ++i) {
+            quint32 codepoint = m_decoded.at(i);
+            // C1 controls (ISO-8859-1 0x80-0x9F) have no glyph
+            if (codepoint >= 0x80 && codepoint < 0xA0)
+                continue;
+            printCodepoint(codepoint);
+        }
+        data += chunk;
+        length -= chunk;
+    }
+}
+
+void TerminalScreen::vtExecute(unsigned char control)
+{
+    switch (control) {
+    case 0x07:  // BEL
+        emit bell();
+        break;
+    case 0x08:  // BS
+        if (m_cursorColumn > 0)
+            --m_cursorColumn;
+        m_pendingWrap = false;
+        break;
+    case 0x09: {    // HT
+        int column = m_cursorColumn + 1;
+        while (column < m_columns - 1 && !m_tabStops[column])
+            ++column;
+        m_cursorColumn = qMin(column, m_columns - 1);
+        m_pendingWrap = false;
+        break;
+    }
+    case 0x0A:  // LF
+    case 0x0B:  // VT
+    case 0x0C:  // FF
+        lineFeed();
+        m_pendingWrap = false;
+        break;
+    case 0x0D:  // CR
+        m_cursorColumn = 0;
+        m_pendingWrap = false;
+        break;
+    case 0x0E:  // SO
+        m_activeCharset = 1;
+        break;
+    case 0x0F:  // SI
+        m_activeCharset = 0;
+        break;
+    default:
+        break;
+    }
+}
+
+void TerminalScreen::vtEscDispatch(const VTSequence &sequence, char final)
+{
+    if (sequence.intermediateCount > 0) {
+        char intermediate = sequence.intermediates[0];
+        if (intermediate == '(' || intermediate == ')') {
+            m_charsets[intermediate == '(' ? 0 : 1] = final;
+        } else if (intermediate == '#' && final == '8') {
+            // DECALN: fill the screen with 'E'
+            for (TerminalLine &line : activeLines()) {
+                line.cells.fill(TerminalCell{'E', 0, 0}, m_columns);
+                line.dirty = true;
+            }
+        }
+        return;
+    }
+
+    switch (final) {
+    case '7':
+        saveCursor();
+        break;
+    case '8':
+        restoreCursor();
+        break;
+    case 'D':   // IND
+        lineFeed();
+        break;
+    case 'E':   // NEL
+        m_cursorColumn = 0;
+        lineFeed();
+        break;
+    case 'H':   // HTS
+        m_tabStops[m_cursorColumn] = true;
+        break;
+    case 'M':   // RI
+        reverseIndex();
+        break;
+    case 'c':   // RIS
+        reset();
+        break;
+    default:
+        break;
+    }
+    m_pendingWrap = false;
+}
+
+void TerminalScreen::vtCsiDispatch(const VTSequence &sequence, char final)
+{
+    char marker = sequence.privateMarker();
+    int n = sequence.param(0, 1);
+
+    switch (final) {
+    case 'A':
+        moveCursor(qMax(m_cursorRow - n, m_cursorRow >= m_scrollTop ? m_scrollTop : 0), m_cursorColumn);
+        break;
+    case 'B':
+        moveCursor(qMin(m_cursorRow + n, m_cursorRow <= m_scrollBottom ? m_scrollBottom : m_rows - 1), m_cursorColumn);
+        break;
+    case 'C':
+        moveCursor(m_cursorRow, m_cursorColumn + n);
+        break;
+    case 'D':
+        moveCursor(m_cursorRow, m_cursorColumn - n);
+        break;
+    case 'E':
+        moveCursor(m_cursorRow + n, 0);
+        break;
+    case 'F':
+        moveCursor(m_cursorRow - n, 0);
+        break;
+    case 'G':
+    case '`':
+        moveCursor(m_cursorRow, n - 1);
+        break;
+    case 'H':
+    case 'f': {
+        int top = m_originMode ? m_scrollTop : 0;
+        moveCursor(top + sequence.param(0, 1) - 1, sequence.param(1, 1) - 1);
+        break;
+    }
+    case 'd': {
+        int top = m_originMode ? m_scrollTop : 0;
+        moveCursor(top + n - 1, m_cursorColumn);
+        break;
+    }
+    case 'J':
+        if (marker == 0 || marker == '?')
+            eraseInDisplay(sequence.param(0, 0));
+        break;
+    case 'K':
+        if (marker == 0 || marker == '?')
+            eraseInLine(sequence.param(0, 0));
+        break;
+    case 'L':
+        insertLines(n);
+        break;
+    case 'M':
+        deleteLines(n);
+        break;
+    case '@':
+        insertCells(n);
+        break;
+    case 'P':
+        deleteCells(n);
+        break;
+    case 'X':
+        eraseCells(m_cursorRow, m_cursorColumn, m_cursorColumn + n);
+        break;
+    case 'S':
+        if (marker == 0)
+            scrollUp(m_scrollTop, m_scrollBottom, n);
+        break;
+    case 'T':
+        if (marker == 0)
+            scrollDown(m_scrollTop, m_scrollBottom, n);
+        break;
+    case 'b':
+        for (int i = 0; i < qMin(n, m_columns * m_rows); ++i)
+            printCodepoint(m_lastPrinted);
+        break;
+    case 'g':
+        if (sequence.param(0, 0) == 3)
+            m_tabStops.fill(false);
+        else if (sequence.param(0, 0) == 0)
+            m_tabStops[m_cursorColumn] = false;
+        break;
+    case 'h':
+        setMode(sequence, true);
+        break;
+    case 'l':
+        setMode(sequence, false);
+        break;
+    case 'm':
+        if (marker == 0)
+            applySgr(sequence);
+        break;
+    case 'n':
+        if (marker == 0 && sequence.param(0, 0) == 5) {
+            emit responseReady(QByteArrayLiteral("\x1b[0n"));
+        } else if (marker == 0 && sequence.param(0, 0) == 6) {
+            int row = m_cursorRow - (m_originMode ? m_scrollTop : 0);
+            emit responseReady(QString("\x1b[%1;%2R").arg(row + 1).arg(m_cursorColumn + 1).toLatin1());
+        }
+        break;
+    case 'c':
+        if (marker == 0 && sequence.param(0, 0) == 0)
+            emit responseReady(QByteArrayLiteral("\x1b[?1;2c"));
+        else if (marker == '>')
+            emit responseReady(QByteArrayLiteral("\x1b[>0;276;0c"));
+        break;
+    case 'r':
+        if (marker == 0) {
+            int top = sequence.param(0, 1) - 1;
+            int bottom = sequence.param(1, m_rows) - 1;
+            if (bottom >= m_rows)
+                bottom = m_rows - 1;
+            if (top < bottom) {
+                m_scrollTop = top;
+                m_scrollBottom = bottom;
+                moveCursor(m_originMode ? m_scrollTop : 0, 0);
+            }
+        }
+        break;
+    case 's':
+        if (marker == 0)
+            saveCursor();
+        break;
+    case 'u':
+        if (marker == 0)
+            restoreCursor();
+        break;
+    default:
+        break;
+    }
+}
+
+void TerminalScreen::vtOscDispatch(const char *data, int length)
+{
+    // OSC 0 / OSC 2: window title
+    const char *separator = static_cast<const char *>(memchr(data, ';', size_t(length)));
+    if (!separator)
+        return;
+
+    QByteArray command(data, int(separator - data));
+    if (command == "0" || command == "2") {
+        emit titleChanged(QString::fromUtf8(separator + 1, int(data + length - separator - 1)));
+    }
+}
@@ -0,0 +1,261 @@
+#ifndef TERMINALSCREEN_H
+#define TERMINALSCREEN_H
+
+#include <QObject>
+#include <QVector>
+#include <QHash>
+#include <QString>
+#include <QByteArray>
+#include <QMutex>
+#include <QSharedPointer>
+#include "vtparser.h"
+#include "terminalscrollback.h"
+#include "terminaldecoder.h"
+#include "terminalhighlighter.h"
+
+// Colours are xterm palette indices (0-255), DefaultColor or a 24-bit RGB value tagged
+// with TrueColor. Each distinct combination is stored once and cells refer to it by a
+// 16-bit id, so colourful output costs no more per cell than plain text.
+struct TerminalAttributes
+{
+    enum Flag {
+        Bold = 0x01,
+        Italic = 0x02,
+        Underline = 0x04,
+        Inverse = 0x08,
+        Dim = 0x10,
+        Strikeout = 0x20,
+        Concealed = 0x40,
+        Blink = 0x80
+    };
+    enum { DefaultColor = 256 };
+    enum : quint32 { TrueColor = 0x01000000 };
+
+    quint32 foreground;
+    quint32 background;
+    quint8 flags;
+
+    TerminalAttributes() : foreground(DefaultColor), background(DefaultColor), flags(0) {}
+    // Colours fit in 25 bits each
+    quint64 key() const { return foreground | (quint64(background) << 25) | (quint64(flags) << 50); }
+
+    static quint32 rgbColor(int red, int green, int blue) { return TrueColor | (quint32(red) << 16) | (quint32(green) << 8) | quint32(blue); }
+    static bool isTrueColor(quint32 color) { return color & TrueColor; }
+};
+
+// One character cell; the attributes live in the screen's interning table
+struct TerminalCell
+{
+    enum Flag {
+        WideChar = 0x01,    // first half of a double-width character
+        WideTail = 0x02     // second half, drawn by the cell before it
+    };
+
+    quint32 codepoint;      // 0 for a blank cell
+    quint16 attribute;
+    quint16 flags;
+};
+
+struct TerminalLine
+{
+    QVector<TerminalCell> cells;
+    bool wrapped;           // continues on the next line (soft wrap)
+    bool dirty;             // changed since the view last painted it
+
+    TerminalLine() : wrapped(false), dirty(true) {}
+};
+
+// Screen model of a VT/xterm terminal: the visible grid, cursor, scroll region, alternate
+// screen and a bounded scrollback. It is fed raw output bytes and records which rows
+// changed, so views only repaint damaged rows.
+//
+// The screen is fed on a parser thread (TerminalParserThread) and read by the GUI: both
+// hold mutex() while they use it. It is recursive so GUI code that already holds it can
+// call helpers that lock it again.
+class TerminalScreen : public QObject, public VTParserHandler
+{
+    Q_OBJECT
+
+public:
+    explicit TerminalScreen(int columns = 80, int rows = 24, QObject *parent = nullptr);
+
+    QRecursiveMutex *mutex() const { return &m_mutex; }
+
+    void feed(const char *data, int length);
+    // Local messages (connection status, ZMODEM progress); '\n' starts a new line.
+    // ansiColor is a palette index, -1 keeps the current colour.
+    void writeLocalText(const QString &text, int ansiColor = -1, bool bold = false);
+
+    // Character encoding of the remote output, e.g. "UTF-8" or "Windows-1252"
+    void setEncoding(const QString &name) { m_decoder.setEncoding(name); }
+
+    void resize(int columns, int rows);
+    void reset();
+    void clearScrollback();
+
+    int columns() const { return m_columns; }
+    int rows() const { return m_rows; }
+
+    // Scrollback lines come first (oldest at 0), then the screen rows. Scrollback lines
+    // are unpacked on access.
+    int scrollbackCount() const { return m_scrollback.size(); }
+    TerminalLine scrollbackLine(int index) const { return m_scrollback.line(index); }
+    const TerminalLine &screenLine(int row) const { return activeLines().at(row); }
+    void setScrollbackLimits(int lines, qint64 bytes);
+    void setScrollbackSpill(bool enabled) { m_scrollback.setSpillEnabled(enabled); }
+    void setScrollbackSearchIndex(bool enabled) { m_scrollback.setTrigramIndexEnabled(enabled); }
+    qint64 scrollbackMemoryUsage() const { return m_scrollback.memoryUsage(); }
+    qint64 scrollbackDiskUsage() const { return m_scrollback.diskUsage(); }
+    void compactScrollback() { m_scrollback.compact(); }
+    // For searching on another thread: the history plus the current screen rows, packed
+    TerminalScrollback::Snapshot scrollbackSnapshot() const { return m_scrollback.snapshot(); }
+    QVector<QByteArray> packedScreenLines() const;
+
+    const TerminalAttributes &attributes(quint16 id) const { return m_attributeTable.at(id); }
+    static QString lineText(const TerminalLine &line, int from = 0, int to = -1);
+    // Display width in cells: 0 for combining marks, 2 for East Asian wide and emoji
+    static int charWidth(quint32 codepoint);
+
+    int cursorRow() const { return m_cursorRow; }
+    int cursorColumn() const { return m_cursorColumn; }
+    bool cursorVisible() const { return m_cursorVisible; }
+    bool isAlternateScreen() const { return m_alternateActive; }
+    bool applicationCursorKeys() const { return m_applicationCursorKeys; }
+    bool bracketedPaste() const { return m_bracketedPaste; }
+
+    // Damage tracking. Full-screen scrolls are counted separately so views can move
+    // pixels instead of repainting; lines dropped from the front of the scrollback
+    // let views keep a scrolled-back position stable.
+    bool isRowDirty(int row) const { return activeLines().at(row).dirty; }
+    bool isFullyDirty() const { return m_fullyDirty; }
+    int scrolledLines() const { return m_scrolledLines; }
+    int takeDroppedLines();
+    void clearDamage();
+
+    // Everything the screen shows (grid, cursor, modes, attributes), for rewinding a
+    // replay; the scrollback is not part of it. Only possible between sequences and
+    // characters of a byte-oriented encoding, see canTakeKeyframe().
+    struct Keyframe;
+    bool canTakeKeyframe() const { return m_parser.isGround() && m_decoder.asciiPassthrough(); }
+    QSharedPointer<const Keyframe> keyframe() const;
+    // Also clears the scrollback
+    void restoreKeyframe(const Keyframe &keyframe);
+
+    // Rules applied to output as it is printed; nullptr turns highlighting off. Already
+    // printed text keeps its colours.
+    void setHighlighter(const QSharedPointer<const TerminalHighlighter> &highlighter);
+    // The text an alert rule matched since the last call, or an empty string
+    QString takeHighlightAlert();
+
+signals:
+    void responseReady(const QByteArray &data);
+    void titleChanged(const QString &title);
+    void bell();
+    // An alert rule matched while no earlier alert was waiting to be taken
+    void highlightAlert();
+
+private:
+    struct SavedCursor
+    {
+        int row;
+        int column;
+        TerminalAttributes pen;
+        bool originMode;
+        bool pendingWrap;
+        char charsets[2];
+        int activeCharset;
+    };
+
+    mutable QRecursiveMutex m_mutex;
+    VTParser m_parser;
+    int m_columns;
+    int m_rows;
+
+    QVector<TerminalLine> m_screens[2];
+    bool m_alternateActive;
+    TerminalScrollback m_scrollback;
+    int m_droppedLines;
+
+    QVector<TerminalAttributes> m_attributeTable;
+    QHash<quint64, quint16> m_attributeIds;
+    QVector<quint16> m_freeAttributeIds;    // ids nothing refers to any more, for reuse
+    int m_attributeMisses;                  // new combinations that found the table full
+
+    TerminalAttributes m_pen;
+    quint16 m_penId;
+    quint16 m_eraseId;
+
+    int m_cursorRow;
+    int m_cursorColumn;
+    bool m_pendingWrap;
+    int m_scrollTop;
+    int m_scrollBottom;
+    QVector<bool> m_tabStops;
+    SavedCursor m_savedCursor;
+    char m_charsets[2];
+    int m_activeCharset;
+    quint32 m_lastPrinted;
+
+    bool m_autoWrap;
+    bool m_originMode;
+    bool m_insertMode;
+    bool m_cursorVisible;
+    bool m_applicationCursorKeys;
+    bool m_bracketedPaste;
+
+    TerminalDecoder m_decoder;
+    QVector<quint32> m_decoded;
+
+    bool m_fullyDirty;
+    int m_scrolledLines;
+
+    // Matching follows the printed text along one row; a cursor jump or scroll restarts it
+    QSharedPointer<const TerminalHighlighter> m_highlighter;
+    TerminalHighlighter::State m_highlightState;
+    int m_highlightRow;             // the next character continues the match here, or -1
+    int m_highlightColumn;
+    QVector<quint32> m_highlightText;   // characters of the row fed so far
+    QVector<int> m_highlightColumns;    // and the column each starts at
+    QVector<TerminalHighlighter::Match> m_highlightMatches;
+    QString m_highlightAlert;
+
+    QVector<TerminalLine> &activeLines() { return m_screens[m_alternateActive ? 1 : 0]; }
+    const QVector<TerminalLine> &activeLines() const { return m_screens[m_alternateActive ? 1 : 0]; }
+    TerminalLine blankLine() const;
+
+    quint16 internAttributes(const TerminalAttributes &attributes);
+    void reclaimAttributes();
+    void updatePen();
+
+    void printCodepoint(quint32 codepoint);
+    void printAscii(const char *data, int length);
+    void highlightCells(int row, int column, int count);
+    void lineFeed();
+    void reverseIndex();
+    void scrollUp(int top, int bottom, int count);
+    void scrollDown(int top, int bottom, int count);
+    void eraseCells(int row, int from, int to);
+    void eraseInDisplay(int mode);
+    void eraseInLine(int mode);
+    void insertCells(int count);
+    void deleteCells(int count);
+    void insertLines(int count);
+    void deleteLines(int count);
+    void moveCursor(int row, int column);
+    void setMode(const VTSequence &sequence, bool enabled);
+    void setAlternateScreen(bool enabled, bool saveCursor);
+    void saveCursor();
+    void restoreCursor();
+    void markAllDirty();
+    void resetTabStops();
+    void applySgr(const VTSequence &sequence);
+
+    // VTParserHandler
+    void vtPrint(const char *data, int length) override;
+    void vtExecute(unsigned char control) override;
+    void vtEscDispatch(const VTSequence &sequence, char final) override;
+    void vtCsiDispatch(const VTSequence &sequence, char final) override;
+    void vtOscDispatch(const char *data, int length) override;
+};
+
+#endif // TERMINALSCREEN_H
@@ -0,0 +1,707 @@
+#include "terminalscrollback.h"
+#include "terminalscreen.h"
+#include <QTemporaryFile>
+#include <QBitArray>
+#include <QDir>
+#include <algorithm>
+
+namespace {
+
+// Bookkeeping cost of a packed line on top of its bytes (array header and ring slot)
+const qint64 LineOverhead = 32;
+const int HeaderSize = 5;       // flags, cell count, run count
+const char WrappedFlag = 0x01;
+const int InitialCapacity = 256;
+const int SpillBlockLines = 1024;
+const int CachedBlocks = 8;
+const int TrigramFilterShift = 32 - 14;     // 2^14 bits = TrigramFilterBytes
+const int MaxLineCells = 0xFFFF;            // the cell count is stored in 16 bits
+
+void appendUInt16(QByteArray &data, quint16 value)
+{
+    data.append(char(value & 0xFF));
+    data.append(char(value >> 8));
+}
+
+quint16 readUInt16(const uchar *data)
+{
+    return quint16(data[0] | (data[1] << 8));
+}
+
+void appendUInt32(QByteArray &data, quint32 value)
+{
+    appendUInt16(data, quint16(value & 0xFFFF));
+    appendUInt16(data, quint16(value >> 16));
+}
+
+quint32 readUInt32(const uchar *data)
+{
+    return quint32(readUInt16(data)) | (quint32(readUInt16(data + 2)) << 16);
+}
+
+// The attribute ids of a packed line's runs
+void appendAttributes(const QByteArray &packed, QVector<quint16> &attributes)
+{
+    if (packed.size() < HeaderSize)
+        return;
+    const uchar *data = reinterpret_cast<const uchar *>(packed.constData());
+    int runCount = readUInt16(data + 3);
+    const uchar *run = data + HeaderSize;
+    for (int i = 0; i < runCount; ++i, run += 4)
+        attributes.append(readUInt16(run + 2));
+}
+
+void appendUtf8(QByteArray &data, quint32 codepoint)
+{
+    if (codepoint < 0x80) {
+        data.append(char(codepoint));
+    } else if (codepoint < 0x800) {
+        data.append(char(0xC0 | (codepoint >> 6)));
+        data.append(char(0x80 | (codepoint & 0x3F)));
+    } else if (codepoint < 0x10000) {
+        data.append(char(0xE0 | (codepoint >> 12)));
+        data.append(char(0x80 | ((codepoint >> 6) & 0x3F)));
+        data.append(char(0x80 | (codepoint & 0x3F)));
+    } else {
+        data.append(char(0xF0 | (codepoint >> 18)));
+        data.append(char(0x80 | ((codepoint >> 12) & 0x3F)));
+        data.append(char(0x80 | ((codepoint >> 6) & 0x3F)));
+        data.append(char(0x80 | (codepoint & 0x3F)));
+    }
+}
+
+uchar foldCase(uchar byte)
+{
+    return (byte >= 'A' && byte <= 'Z') ? byte + ('a' - 'A') : byte;
+}
+
+quint32 trigramBit(quint32 trigram)
+{
+    return (trigram * 2654435761u) >> TrigramFilterShift;
+}
+
+void addTrigrams(QByteArray &filter, const char *text, int length)
+{
+    uchar *bits = reinterpret_cast<uchar *>(filter.data());
+    quint32 window = 0;
+    for (int i = 0; i < length; ++i) {
+        window = ((window << 8) | foldCase(uchar(text[i]))) & 0xFFFFFF;
+        if (i >= 2) {
+            quint32 bit = trigramBit(window);
+            bits[bit >> 3] |= uchar(1 << (bit & 7));
+        }
+    }
+}
+
+// One display row of a logical line. Wide characters cut by the row boundary are shown
+// as blanks on both rows.
+TerminalLine lineSegment(const TerminalLine &line, int index, int width)
+{
+    TerminalLine segment;
+    segment.dirty = false;
+    int cellCount = line.cells.size();
+    int from = index * width;
+    int to = qMin(cellCount, from + width);
+    if (from < to)
+        segment.cells = line.cells.mid(from, to - from);
+    segment.wrapped = index + 1 < TerminalScrollback::rowsFor(cellCount, width) || line.wrapped;
+
+    if (!segment.cells.isEmpty()) {
+        TerminalCell &first = segment.cells.first();
+        if (first.flags & TerminalCell::WideTail)
+            first = TerminalCell{0, first.attribute, 0};
+        TerminalCell &last = segment.cells.last();
+        if ((last.flags & TerminalCell::WideChar) && to == from + width && to < cellCount)
+            last = TerminalCell{0, last.attribute, 0};
+    }
+    return segment;
+}
+
+// Only decodes what appendUtf8 produced, so no validation is needed
+quint32 readUtf8(const uchar *&data)
+{
+    uchar lead = *data++;
+    if (lead < 0x80)
+        return lead;
+    int extra = lead >= 0xF0 ? 3 : lead >= 0xE0 ? 2 : 1;
+    quint32 codepoint = lead & (0x3F >> extra);
+    while (extra-- > 0)
+        codepoint = (codepoint << 6) | (*data++ & 0x3F);
+    return codepoint;
+}
+
+} // namespace
+
+QAtomicInteger<qint64> TerminalScrollback::s_globalBytes(0);
+QAtomicInteger<qint64> TerminalScrollback::s_globalLimit(256LL * 1024 * 1024);
+
+TerminalScrollback::TerminalScrollback(int maxLines, qint64 maxBytes)
+    : m_head(0)
+    , m_count(0)
+    , m_maxLines(qMax(0, maxLines))
+    , m_maxBytes(maxBytes)
+    , m_bytes(0)
+    , m_spillEnabled(false)
+    , m_trigramIndex(true)
+    , m_spillSize(0)
+    , m_spilledLines(0)
+    , m_blockCache(CachedBlocks)
+    , m_width(80)
+    , m_nextRow(0)
+    , m_ringRowsValid(true)
+    , m_spilledRows(0)
+    , m_spilledRowsValid(true)
+    , m_cachedIndex(-1)
+    , m_cachedLine(new TerminalLine)
+{
+}
+
+TerminalScrollback::~TerminalScrollback()
+{
+    s_globalBytes.fetchAndAddRelaxed(-m_bytes);
+}
+
+int TerminalScrollback::setLimits(int maxLines, qint64 maxBytes)
+{
+    m_maxLines = qMax(0, maxLines);
+    m_maxBytes = maxBytes;
+
+    int dropped = 0;
+    while (m_count > m_maxLines) {
+        if (!spillOldest())
+            dropped += dropOldest();
+    }
+    dropped += trim();
+
+    if (m_ring.size() > m_maxLines)
+        reshape(m_maxLines);
+    return dropped;
+}
+
+void TerminalScrollback::setWidth(int columns)
+{
+    columns = qMax(1, columns);
+    if (columns == m_width)
+        return;
+
+    // Nothing is re-wrapped here; row counts are rebuilt when the history is next read
+    m_width = columns;
+    m_ringRowsValid = false;
+    m_spilledRowsValid = false;
+}
+
+int TerminalScrollback::append(const TerminalLine &line)
+{
+    if (m_maxLines == 0)
+        return 0;
+
+    int dropped = 0;
+    if (m_openLine && m_openLine->cells.size() + line.cells.size() > MaxLineCells)
+        dropped += commitOpenLine();    // stays marked as wrapped
+
+    // Soft-wrapped rows are collected and stored as one line once the line ends
+    if (m_openLine) {
+        m_openLine->cells += line.cells;
+        m_openLine->wrapped = line.wrapped;
+    } else {
+        m_openLine.reset(new TerminalLine(line));
+    }
+    if (line.wrapped)
+        return dropped;
+    return dropped + commitOpenLine();
+}
+
+int TerminalScrollback::commitOpenLine()
+{
+    QByteArray packed = pack(*m_openLine);
+    m_openLine.reset();
+    return appendPacked(packed);
+}
+
+int TerminalScrollback::appendPacked(const QByteArray &packed)
+{
+    int dropped = 0;
+    if (m_count == m_maxLines && !spillOldest())
+        dropped += dropOldest();
+    // The ring grows on demand, so a short session doesn't reserve the full limit
+    if (m_count == m_ring.size())
+        reshape(qMin(m_maxLines, qMax(InitialCapacity, m_ring.size() * 2)));
+
+    qint64 lineCost = cost(packed);
+    int slot = (m_head + m_count) % m_ring.size();
+    m_ring[slot] = packed;
+    if (m_ringRowsValid) {
+        m_rowStart[slot] = m_nextRow;
+        m_nextRow += rowsFor(packedCells(packed), m_width);
+    }
+    ++m_count;
+    m_bytes += lineCost;
+    s_globalBytes.fetchAndAddRelaxed(lineCost);
+
+    return dropped + trim();
+}
+
+int TerminalScrollback::size() const
+{
+    ensureRows();
+    int rows = m_spilledRows + ringRows();
+    if (m_openLine)
+        rows += rowsFor(m_openLine->cells.size(), m_width);
+    return rows;
+}
+
+TerminalLine TerminalScrollback::line(int row) const
+{
+    ensureRows();
+
+    if (row < m_spilledRows) {
+        // Last block starting at or before row, then the line within it
+        auto it = std::upper_bound(m_blockStart.constBegin(), m_blockStart.constEnd(), row);
+        int blockIndex = int(it - m_blockStart.constBegin()) - 1;
+        const SpillBlock &block = m_spillBlocks.at(blockIndex);
+        int offset = row - m_blockStart.at(blockIndex);
+        int index = 0;
+        for (; index < block.cellCounts.size() - 1; ++index) {
+            int rows = rowsFor(block.cellCounts.at(index), m_width);
+            if (offset < rows)
+                break;
+            offset -= rows;
+        }
+        return lineSegment(logicalLine(block.firstLine + index), offset, m_width);
+    }
+    row -= m_spilledRows;
+
+    if (row < ringRows()) {
+        // Last ring line starting at or before row
+        qint64 target = m_rowStart.at(m_head) + row;
+        int low = 0;
+        int high = m_count - 1;
+        while (low < high) {
+            int middle = (low + high + 1) / 2;
+            if (m_rowStart.at((m_head + middle) % m_ring.size()) <= target)
+                low = middle;
+            else
+                high = middle - 1;
+        }
+        int offset = int(target - m_rowStart.at((m_head + low) % m_ring.size()));
+        return lineSegment(logicalLine(m_spilledLines + low), offset, m_width);
+    }
+    row -= ringRows();
+
+    if (m_openLine)
+        return lineSegment(*m_openLine, row, m_width);
+    return TerminalLine();
+}
+
+void TerminalScrollback::ensureRows() const
+{
+    if (!m_ringRowsValid) {
+        qint64 next = 0;
+        for (int i = 0; i < m_count; ++i) {
+            int slot = (m_head + i) % m_ring.size();
+            m_rowStart[slot] = next;
+            next += rowsFor(packedCells(m_ring.at(slot)), m_width);
+        }
+        m_nextRow = next;
+        m_ringRowsValid = true;
+    }
+
+    if (!m_spilledRowsValid) {
+        m_blockStart.resize(m_spillBlocks.size());
+        int next = 0;
+        for (int i = 0; i < m_spillBlocks.size(); ++i) {
+            m_blockStart[i] = next;
+            next += blockRows(m_spillBlocks.at(i), m_width);
+        }
+        m_spilledRows = next;
+        m_spilledRowsValid = true;
+    }
+}
+
+int TerminalScrollback::ringRows() const
+{
+    return m_count > 0 ? int(m_nextRow - m_rowStart.at(m_head)) : 0;
+}
+
+const TerminalLine &TerminalScrollback::logicalLine(int index) const
+{
+    if (index != m_cachedIndex) {
+        if (index < m_spilledLines)
+            *m_cachedLine = unpack(spilledLine(index));
+        else
+            *m_cachedLine = unpack(m_ring.at((m_head + index - m_spilledLines) % m_ring.size()));
+        m_cachedIndex = index;
+    }
+    return *m_cachedLine;
+}
+
+void TerminalScrollback::clear()
+{
+    s_globalBytes.fetchAndAddRelaxed(-m_bytes);
+    m_ring.clear();
+    m_rowStart.clear();
+    m_head = 0;
+    m_count = 0;
+    m_bytes = 0;
+    m_openLine.reset();
+    m_nextRow = 0;
+    m_ringRowsValid = true;
+    m_blockStart.clear();
+    m_spilledRows = 0;
+    m_spilledRowsValid = true;
+    m_cachedIndex = -1;
+
+    m_blockCache.clear();
+    m_spillBlocks.clear();
+    m_spillFile.reset();
+    m_spillSize = 0;
+    m_spilledLines = 0;
+}
+
+void TerminalScrollback::setSpillEnabled(bool enabled)
+{
+    // Turning spilling off keeps what is already on disk readable
+    m_spillEnabled = enabled;
+}
+
+TerminalScrollback::Snapshot TerminalScrollback::snapshot() const
+{
+    Snapshot result;
+    result.spillFileName = m_spillFile ? m_spillFile->fileName() : QString();
+    result.spillBlocks = m_spillBlocks;
+    result.spilledLines = m_spilledLines;
+    result.ring = m_ring;
+    result.head = m_head;
+    result.count = m_count;
+    if (m_openLine)
+        result.openLine = pack(*m_openLine);
+    result.width = m_width;
+    result.rows = size();
+    return result;
+}
+
+void TerminalScrollback::setGlobalLimit(qint64 maxBytes)
+{
+    s_globalLimit.storeRelaxed(qMax<qint64>(0, maxBytes));
+}
+
+qint64 TerminalScrollback::globalLimit()
+{
+    return s_globalLimit.loadRelaxed();
+}
+
+qint64 TerminalScrollback::globalMemoryUsage()
+{
+    return s_globalBytes.loadRelaxed();
+}
+
+void TerminalScrollback::markAttributes(QBitArray &used) const
+{
+    for (const SpillBlock &block : m_spillBlocks) {
+        for (quint16 attribute : block.attributes)
+            used.setBit(attribute);
+    }
+
+    QVector<quint16> attributes;
+    for (int i = 0; i < m_count; ++i) {
+        attributes.clear();
+        appendAttributes(m_ring.at((m_head + i) % m_ring.size()), attributes);
+        for (quint16 attribute : attributes)
+            used.setBit(attribute);
+    }
+
+    if (m_openLine) {
+        for (const TerminalCell &cell : m_openLine->cells)
+            used.setBit(cell.attribute);
+    }
+}
+
+void TerminalScrollback::compact()
+{
+    while (m_count > 0 && spillOldest()) {
+    }
+    reshape(m_count);
+    m_blockCache.clear();
+    m_cachedIndex = -1;
+    *m_cachedLine = TerminalLine();
+}
+
+int TerminalScrollback::dropOldest()
+{
+    QByteArray &slot = m_ring[m_head];
+    int rows = rowsFor(packedCells(slot), m_width);
+    qint64 lineCost = cost(slot);
+    slot = QByteArray();
+    m_head = (m_head + 1) % m_ring.size();
+    --m_count;
+    m_bytes -= lineCost;
+    s_globalBytes.fetchAndAddRelaxed(-lineCost);
+    // Ring lines after a spilled history change their index
+    m_cachedIndex = -1;
+    return rows;
+}
+
+bool TerminalScrollback::spillOldest()
+{
+    if (!m_spillEnabled || m_count == 0)
+        return false;
+
+    if (!m_spillFile) {
+        // QTemporaryFile is created readable by the owner only and removed on close
+        m_spillFile.reset(new QTemporaryFile(QDir::tempPath() + "/gshell-scrollback-XXXXXX"));
+        if (!m_spillFile->open()) {
+            m_spillFile.reset();
+            m_spillEnabled = false;
+            return false;
+        }
+    }
+
+    // One block: the oldest lines, each prefixed with its length, compressed together
+    int lineCount = qMin(m_count, SpillBlockLines);
+    QByteArray block;
+    QByteArray trigrams;
+    if (m_trigramIndex)
+        trigrams.fill(0, TrigramFilterBytes);
+    QVector<quint16> cellCounts(lineCount);
+    QVector<quint16> attributes;
+    for (int i = 0; i < lineCount; ++i) {
+        const QByteArray &packed = m_ring.at((m_head + i) % m_ring.size());
+        cellCounts[i] = quint16(packedCells(packed));
+        appendAttributes(packed, attributes);
+        appendUInt32(block, quint32(packed.size()));
+        block.append(packed);
+        if (m_trigramIndex) {
+            int length;
+            const char *text = packedText(packed, &length);
+            addTrigrams(trigrams, text, length);
+        }
+    }
+    std::sort(attributes.begin(), attributes.end());
+    attributes.erase(std::unique(attributes.begin(), attributes.end()), attributes.end());
+    // Spilled history is written far more often than it is read back, so favour speed
+    QByteArray compressed = qCompress(block, 1);
+
+    if (!m_spillFile->seek(m_spillSize)
+        || m_spillFile->write(compressed) != compressed.size()
+        || !m_spillFile->flush()) {
+        // Disk full or the file went away: stop spilling and drop history instead
+        m_spillEnabled = false;
+        return false;
+    }
+
+    SpillBlock spilled;
+    spilled.offset = m_spillSize;
+    spilled.compressedSize = compressed.size();
+    spilled.firstLine = m_spilledLines;
+    spilled.lineCount = lineCount;
+    spilled.trigrams = trigrams;
+    spilled.cellCounts = cellCounts;
+    spilled.attributes = attributes;
+    m_spillBlocks.append(spilled);
+    if (m_spilledRowsValid) {
+        m_blockStart.append(m_spilledRows);
+        m_spilledRows += blockRows(spilled, m_width);
+    }
+    m_spillSize += compressed.size();
+    m_spilledLines += lineCount;
+
+    for (int i = 0; i < lineCount; ++i)
+        dropOldest();
+    return true;
+}
+
+int TerminalScrollback::trim()
+{
+    // The terminal that is adding lines pays for exceeding the global budget
+    int dropped = 0;
+    qint64 limit = s_globalLimit.loadRelaxed();
+    while (m_count > 0 && (m_bytes > m_maxBytes || (limit > 0 && s_globalBytes.loadRelaxed() > limit))) {
+        if (!spillOldest())
+            dropped += dropOldest();
+    }
+    return dropped;
+}
+
+void TerminalScrollback::reshape(int capacity)
+{
+    QVector<QByteArray> ring(capacity);
+    QVector<qint64> rowStart(capacity);
+    for (int i = 0; i < m_count; ++i) {
+        int slot = (m_head + i) % m_ring.size();
+        ring[i] = m_ring.at(slot);
+        rowStart[i] = m_rowStart.at(slot);
+    }
+    m_ring.swap(ring);
+    m_rowStart.swap(rowStart);
+    m_head = 0;
+}
+
+QByteArray TerminalScrollback::spilledLine(int index) const
+{
+    // Last block whose first line is not after index
+    auto it = std::upper_bound(m_spillBlocks.constBegin(), m_spillBlocks.constEnd(), index,
+                               [](int line, const SpillBlock &block) { return line < block.firstLine; });
+    int blockIndex = int(it - m_spillBlocks.constBegin()) - 1;
+    const SpillBlock &block = m_spillBlocks.at(blockIndex);
+
+    QVector<QByteArray> *lines = m_blockCache.object(blockIndex);
+    if (!lines) {
+        lines = new QVector<QByteArray>(readBlock(m_spillFile.data(), block));
+        m_blockCache.insert(blockIndex, lines);
+    }
+
+    return lines->value(index - block.firstLine);
+}
+
+QVector<QByteArray> TerminalScrollback::readBlock(QFile *file, const SpillBlock &block)
+{
+    QByteArray raw;
+    uchar *mapped = file->map(block.offset, block.compressedSize);
+    if (mapped) {
+        raw = qUncompress(mapped, block.compressedSize);
+        file->unmap(mapped);
+    } else if (file->seek(block.offset)) {
+        raw = qUncompress(file->read(block.compressedSize));
+    }
+
+    QVector<QByteArray> lines;
+    lines.reserve(block.lineCount);
+    const uchar *data = reinterpret_cast<const uchar *>(raw.constData());
+    int position = 0;
+    while (position + 4 <= raw.size()) {
+        int length = int(readUInt32(data + position));
+        lines.append(raw.mid(position + 4, length));
+        position += 4 + length;
+    }
+    return lines;
+}
+
+bool TerminalScrollback::mayContain(const SpillBlock &block, const QByteArray &needle)
+{
+    if (block.trigrams.size() != TrigramFilterBytes || needle.size() < 3)
+        return true;
+
+    const uchar *bits = reinterpret_cast<const uchar *>(block.trigrams.constData());
+    quint32 window = 0;
+    for (int i = 0; i < needle.size(); ++i) {
+        window = ((window << 8) | foldCase(uchar(needle.at(i)))) & 0xFFFFFF;
+        if (i >= 2) {
+            quint32 bit = trigramBit(window);
+            if (!(bits[bit >> 3] & (1 << (bit & 7))))
+                return false;
+        }
+    }
+    return true;
+}
+
+const char *TerminalScrollback::packedText(const QByteArray &packed, int *length)
+{
+    if (packed.size() < HeaderSize) {
+        *length = 0;
+        return packed.constData();
+    }
+    int runCount = readUInt16(reinterpret_cast<const uchar *>(packed.constData()) + 3);
+    int offset = qMin(packed.size(), HeaderSize + runCount * 4);
+    *length = packed.size() - offset;
+    return packed.constData() + offset;
+}
+
+int TerminalScrollback::packedCells(const QByteArray &packed)
+{
+    if (packed.size() < HeaderSize)
+        return 0;
+    return readUInt16(reinterpret_cast<const uchar *>(packed.constData()) + 1);
+}
+
+int TerminalScrollback::blockRows(const SpillBlock &block, int width)
+{
+    int rows = 0;
+    for (quint16 cells : block.cellCounts)
+        rows += rowsFor(cells, width);
+    return rows;
+}
+
+qint64 TerminalScrollback::cost(const QByteArray &packed)
+{
+    return packed.capacity() + LineOverhead;
+}
+
+QByteArray TerminalScrollback::pack(const TerminalLine &line)
+{
+    const TerminalCell *cells = line.cells.constData();
+    int count = line.cells.size();
+    while (count > 0 && cells[count - 1].codepoint == 0 && cells[count - 1].attribute == 0)
+        --count;
+
+    int runCount = 0;
+    for (int i = 0; i < count; ++i) {
+        if (i == 0 || cells[i].attribute != cells[i - 1].attribute)
+            ++runCount;
+    }
+
+    QByteArray packed;
+    packed.reserve(HeaderSize + runCount * 4 + count + 8);
+    packed.append(line.wrapped ? WrappedFlag : char(0));
+    appendUInt16(packed, quint16(count));
+    appendUInt16(packed, quint16(runCount));
+
+    // Attribute runs: (length, attribute index) pairs covering all stored cells
+    int runStart = 0;
+    for (int i = 1; i <= count; ++i) {
+        if (i == count || cells[i].attribute != cells[runStart].attribute) {
+            appendUInt16(packed, quint16(i - runStart));
+            appendUInt16(packed, cells[runStart].attribute);
+            runStart = i;
+        }
+    }
+
+    // Text; the second half of a wide character is implied by the width of the first
+    for (int i = 0; i < count; ++i) {
+        if (cells[i].flags & TerminalCell::WideTail)
+            continue;
+        appendUtf8(packed, cells[i].codepoint ? cells[i].codepoint : ' ');
+    }
+
+    packed.squeeze();
+    return packed;
+}
+
+TerminalLine TerminalScrollback::unpack(const QByteArray &packed)
+{
+    TerminalLine line;
+    line.dirty = false;
+    if (packed.size() < HeaderSize)
+        return line;
+
+    const uchar *data = reinterpret_cast<const uchar *>(packed.constData());
+    const uchar *end = data + packed.size();
+    line.wrapped = (data[0] & WrappedFlag) != 0;
+    int count = readUInt16(data + 1);
+    int runCount = readUInt16(data + 3);
+    data += HeaderSize;
+
+    line.cells.fill(TerminalCell{0, 0, 0}, count);
+    TerminalCell *cells = line.cells.data();
+
+    int column = 0;
+    for (int run = 0; run < runCount; ++run, data += 4) {
+        int length = readUInt16(data);
+        quint16 attribute = readUInt16(data + 2);
+        for (int i = 0; i < length && column < count; ++i)
+            cells[column++].attribute = attribute;
+    }
+
+    column = 0;
+    while (column < count && data < end) {
+        quint32 codepoint = readUtf8(data);
+        cells[column].codepoint = codepoint;
+        if (TerminalScreen::charWidth(codepoint) == 2 && column + 1 < count) {
+            cells[column].flags = TerminalCell::WideChar;
+            cells[column + 1].flags = TerminalCell::WideTail;
+            column += 2;
+        } else {
+            ++column;
+        }
+    }
+    return line;
+}
@@ -0,0 +1,179 @@
+#ifndef TERMINALSCROLLBACK_H
+#define TERMINALSCROLLBACK_H
+
+#include <QVector>
+#include <QByteArray>
+#include <QString>
+#include <QAtomicInteger>
+#include <QCache>
+#include <QScopedPointer>
+
+struct TerminalLine;
+class QFile;
+class QBitArray;
+class QTemporaryFile;
+
+// Scrollback history stored as a ring of packed lines. A packed line is a single
+// QByteArray holding a small header, run-length encoded attribute runs and the text as
+// UTF-8, with trailing blank cells dropped, so a typical 80-column line costs well under
+// 100 bytes instead of 8 bytes per cell.
+//
+// Rows the screen soft-wrapped are joined and stored as one logical line. The history is
+// read in display rows at the current width: the cell count of every line is known
+// without unpacking it (spilled blocks keep a list of them), so after a resize the row
+// counts are recomputed from those numbers alone on first use, and a line is only cut
+// into rows of the new width when one of its rows is actually read.
+//
+// The ring is bounded by a logical line count and a byte budget per terminal; all
+// terminals together also share a global byte budget. When spilling is enabled, the oldest lines
+// are then moved out in blocks: compressed and appended to a private temporary file,
+// which is mapped and decompressed again on demand (a few blocks stay cached). History is
+// only dropped when spilling is off or the file cannot be written.
+class TerminalScrollback
+{
+public:
+    enum { DefaultMaxLines = 10000 };
+    enum { TrigramFilterBytes = 2048 };
+    static const qint64 DefaultMaxBytes = 32 * 1024 * 1024;
+
+    // Spilled lines, oldest first; lines in the file precede the ring. The optional
+    // trigram filter is a bloom filter over the case-folded byte trigrams of the block's
+    // text, so a literal search can skip blocks without decompressing them.
+    struct SpillBlock
+    {
+        qint64 offset;
+        int compressedSize;
+        int firstLine;
+        int lineCount;
+        QByteArray trigrams;
+        QVector<quint16> cellCounts;    // per line, to count rows without reading the block
+        QVector<quint16> attributes;    // attribute ids the lines use, sorted
+    };
+
+    // Read-only copy of the history for a search running on another thread. The ring is
+    // implicitly shared and spilled blocks never change once written, so taking one is
+    // cheap; lines added afterwards are not part of it.
+    struct Snapshot
+    {
+        QString spillFileName;
+        QVector<SpillBlock> spillBlocks;
+        int spilledLines;
+        QVector<QByteArray> ring;
+        int head;
+        int count;
+        QByteArray openLine;    // newest line, still being continued; empty if there is none
+        int width;
+        int rows;               // display rows at width
+
+        int lineCount() const { return spilledLines + count + (openLine.isEmpty() ? 0 : 1); }
+        // Index spilledLines is the oldest line still in memory
+        const QByteArray &memoryLine(int index) const { return ring.at((head + index - spilledLines) % ring.size()); }
+    };
+
+    explicit TerminalScrollback(int maxLines = DefaultMaxLines, qint64 maxBytes = DefaultMaxBytes);
+    ~TerminalScrollback();
+
+    // Returns how many display rows were dropped to fit the new limits
+    int setLimits(int maxLines, qint64 maxBytes);
+    int maxLines() const { return m_maxLines; }
+    qint64 maxBytes() const { return m_maxBytes; }
+
+    // Width the history is displayed at; takes effect lazily
+    void setWidth(int columns);
+    int width() const { return m_width; }
+
+    // Returns how many display rows were dropped to stay within the limits
+    int append(const TerminalLine &line);
+    // Display rows at the current width; row 0 is the oldest
+    TerminalLine line(int row) const;
+    int size() const;
+    int lineCount() const { return m_spilledLines + m_count + (m_openLine.isNull() ? 0 : 1); }
+    void clear();
+
+    void setSpillEnabled(bool enabled);
+    bool spillEnabled() const { return m_spillEnabled; }
+    // Applies to blocks spilled from now on
+    void setTrigramIndexEnabled(bool enabled) { m_trigramIndex = enabled; }
+
+    Snapshot snapshot() const;
+    // Moves the lines held in memory to the spill file (when spilling is on) and frees
+    // spare ring capacity and decompressed blocks; for terminals nobody is looking at
+    void compact();
+
+    // Sets the bit of every attribute id the history still refers to, without reading
+    // spilled blocks back
+    void markAttributes(QBitArray &used) const;
+
+    qint64 memoryUsage() const { return m_bytes; }
+    qint64 diskUsage() const { return m_spillSize; }
+
+    // Budget shared by every terminal in the process; 0 means unlimited
+    static void setGlobalLimit(qint64 maxBytes);
+    static qint64 globalLimit();
+    static qint64 globalMemoryUsage();
+
+    static QByteArray pack(const TerminalLine &line);
+    static int packedCells(const QByteArray &packed);
+    // Display rows a line of the given number of cells takes (at least one)
+    static int rowsFor(int cells, int width) { return cells <= width ? 1 : (cells + width - 1) / width; }
+    static int blockRows(const SpillBlock &block, int width);
+    static TerminalLine unpack(const QByteArray &packed);
+    // The UTF-8 text of a packed line, one character per cell (wide characters included)
+    static const char *packedText(const QByteArray &packed, int *length);
+    // Decompresses a spilled block into its packed lines
+    static QVector<QByteArray> readBlock(QFile *file, const SpillBlock &block);
+    // False only if the block cannot contain needle; the filter ignores ASCII case
+    static bool mayContain(const SpillBlock &block, const QByteArray &needle);
+
+private:
+    QVector<QByteArray> m_ring;
+    int m_head;             // slot of the oldest line
+    int m_count;
+    int m_maxLines;
+    qint64 m_maxBytes;
+    qint64 m_bytes;
+
+    bool m_spillEnabled;
+    bool m_trigramIndex;
+    QScopedPointer<QTemporaryFile> m_spillFile;
+    QVector<SpillBlock> m_spillBlocks;
+    qint64 m_spillSize;
+    int m_spilledLines;
+    mutable QCache<int, QVector<QByteArray> > m_blockCache;
+
+    // The newest logical line while the screen keeps wrapping it onto further rows
+    QScopedPointer<TerminalLine> m_openLine;
+
+    // Display rows at m_width, rebuilt on first use after a resize. Ring lines record the
+    // row they start at (from an arbitrary origin), spilled blocks their first row.
+    int m_width;
+    mutable QVector<qint64> m_rowStart;
+    mutable qint64 m_nextRow;
+    mutable bool m_ringRowsValid;
+    mutable QVector<int> m_blockStart;
+    mutable int m_spilledRows;
+    mutable bool m_spilledRowsValid;
+
+    // Consecutive rows of one line are read together while painting
+    mutable int m_cachedIndex;
+    QScopedPointer<TerminalLine> m_cachedLine;
+
+    static QAtomicInteger<qint64> s_globalBytes;
+    static QAtomicInteger<qint64> s_globalLimit;
+
+    int appendPacked(const QByteArray &packed);
+    int commitOpenLine();
+    int dropOldest();
+    bool spillOldest();
+    int trim();
+    void reshape(int capacity);
+    void ensureRows() const;
+    int ringRows() const;
+    QByteArray spilledLine(int index) const;
+    const TerminalLine &logicalLine(int index) const;
+    static qint64 cost(const QByteArray &packed);
+
+    Q_DISABLE_COPY(TerminalScrollback)
+};
+
+#endif // TERMINALSCROLLBACK_H
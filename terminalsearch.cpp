@@ -0,0 +1,290 @@
+#include "terminalsearch.h"
+#include "terminalscreen.h"
+#include <QFile>
+#include <cstring>
+#include <algorithm>
+
+namespace {
+
+// How often results and progress are reported while scanning
+const int FlushIntervalMs = 50;
+const int FlushBatchSize = 4096;
+
+uchar foldCase(uchar byte)
+{
+    return (byte >= 'A' && byte <= 'Z') ? byte + ('a' - 'A') : byte;
+}
+
+bool isAscii(const QByteArray &data)
+{
+    for (char byte : data) {
+        if (uchar(byte) >= 0x80)
+            return false;
+    }
+    return true;
+}
+
+// memchr finds candidates for the first byte (vectorised in any modern libc), memcmp
+// checks the rest
+int findBytes(const char *text, int length, const QByteArray &needle, int from)
+{
+    const int needleLength = needle.size();
+    if (length - from < needleLength)
+        return -1;
+
+    const char first = needle.at(0);
+    const char *position = text + from;
+    const char *last = text + length - needleLength;
+    while (position <= last) {
+        position = static_cast<const char *>(std::memchr(position, first, size_t(last - position + 1)));
+        if (!position)
+            return -1;
+        if (std::memcmp(position + 1, needle.constData() + 1, size_t(needleLength - 1)) == 0)
+            return int(position - text);
+        ++position;
+    }
+    return -1;
+}
+
+// Cells taken by the UTF-8 text in [from, to); mirrors how packed lines are unpacked
+int utf8Cells(const char *text, int from, int to)
+{
+    const uchar *data = reinterpret_cast<const uchar *>(text);
+    int cells = 0;
+    int i = from;
+    while (i < to) {
+        uchar lead = data[i];
+        if (lead < 0x80) {
+            ++cells;
+            ++i;
+            continue;
+        }
+        int extra = lead >= 0xF0 ? 3 : lead >= 0xE0 ? 2 : 1;
+        quint32 codepoint = lead & (0x3F >> extra);
+        for (int k = 1; k <= extra && i + k < to; ++k)
+            codepoint = (codepoint << 6) | (data[i + k] & 0x3F);
+        cells += TerminalScreen::charWidth(codepoint) == 2 ? 2 : 1;
+        i += extra + 1;
+    }
+    return cells;
+}
+
+int utf16Cells(const QString &text, int from, int to)
+{
+    int cells = 0;
+    for (int i = from; i < to; ++i) {
+        uint codepoint = text.at(i).unicode();
+        if (QChar::isHighSurrogate(codepoint) && i + 1 < to) {
+            codepoint = QChar::surrogateToUcs4(text.at(i), text.at(i + 1));
+            ++i;
+        }
+        cells += TerminalScreen::charWidth(codepoint) == 2 ? 2 : 1;
+    }
+    return cells;
+}
+
+} // namespace
+
+TerminalSearch::TerminalSearch(const QString &pattern, Options options,
+                               const TerminalScrollback::Snapshot &history, const QVector<QByteArray> &screenLines,
+                               QObject *parent)
+    : QThread(parent)
+    , m_pattern(pattern)
+    , m_options(options)
+    , m_history(history)
+    , m_screenLines(screenLines)
+    , m_cancelled(0)
+    , m_foldAscii(false)
+    , m_matchCount(0)
+    , m_linesSearched(0)
+{
+    qRegisterMetaType<TerminalSearchMatch>();
+    qRegisterMetaType<QVector<TerminalSearchMatch> >();
+
+    bool caseSensitive = options & CaseSensitive;
+    QByteArray utf8 = pattern.toUtf8();
+    if (options & RegularExpression) {
+        m_regex.setPattern(pattern);
+    } else if (caseSensitive || isAscii(utf8)) {
+        m_needle = utf8;
+        m_foldAscii = !caseSensitive;
+        if (m_foldAscii) {
+            for (int i = 0; i < m_needle.size(); ++i)
+                m_needle[i] = char(foldCase(uchar(m_needle.at(i))));
+        }
+    } else {
+        // Case folding beyond ASCII needs Unicode rules; let the regex engine apply them
+        m_regex.setPattern(QRegularExpression::escape(pattern));
+    }
+    if (!caseSensitive)
+        m_regex.setPatternOptions(QRegularExpression::CaseInsensitiveOption);
+}
+
+TerminalSearch::~TerminalSearch()
+{
+    cancel();
+    wait();
+}
+
+QString TerminalSearch::patternError(const QString &pattern, Options options)
+{
+    if (!(options & RegularExpression))
+        return QString();
+    QRegularExpression regex(pattern);
+    return regex.isValid() ? QString() : regex.errorString();
+}
+
+void TerminalSearch::cancel()
+{
+    m_cancelled.storeRelaxed(1);
+}
+
+void TerminalSearch::run()
+{
+    if (m_pattern.isEmpty()) {
+        emit searchFinished(0, false);
+        return;
+    }
+
+    m_flushTimer.start();
+    const int width = m_history.width;
+    const int lineCount = m_history.lineCount() + m_screenLines.size();
+
+    // Newest first: the screen, then the history still in memory, then the spilled blocks.
+    // History lines are walked upwards from the row below the newest one.
+    for (int row = m_screenLines.size() - 1; row >= 0 && !isCancelled(); --row)
+        searchLine(m_screenLines.at(row), m_history.rows + row, 0);
+
+    int nextRow = m_history.rows;
+    if (!m_history.openLine.isEmpty() && !isCancelled()) {
+        nextRow -= TerminalScrollback::rowsFor(TerminalScrollback::packedCells(m_history.openLine), width);
+        searchLine(m_history.openLine, nextRow, width);
+    }
+
+    const int memoryEnd = m_history.spilledLines + m_history.count;
+    for (int line = memoryEnd - 1; line >= m_history.spilledLines && !isCancelled(); --line) {
+        const QByteArray &packed = m_history.memoryLine(line);
+        nextRow -= TerminalScrollback::rowsFor(TerminalScrollback::packedCells(packed), width);
+        searchLine(packed, nextRow, width);
+    }
+
+    if (!m_history.spillBlocks.isEmpty() && !isCancelled()) {
+        QFile file(m_history.spillFileName);
+        if (file.open(QIODevice::ReadOnly)) {
+            // The filter is built from literal text, so it only helps literal patterns
+            bool useFilter = !m_needle.isEmpty();
+            for (int index = m_history.spillBlocks.size() - 1; index >= 0 && !isCancelled(); --index) {
+                const TerminalScrollback::SpillBlock &block = m_history.spillBlocks.at(index);
+                if (useFilter && !TerminalScrollback::mayContain(block, m_needle)) {
+                    m_linesSearched += block.lineCount;
+                    nextRow -= TerminalScrollback::blockRows(block, width);
+                    continue;
+                }
+                QVector<QByteArray> lines = TerminalScrollback::readBlock(&file, block);
+                for (int i = lines.size() - 1; i >= 0 && !isCancelled(); --i) {
+                    nextRow -= TerminalScrollback::rowsFor(TerminalScrollback::packedCells(lines.at(i)), width);
+                    searchLine(lines.at(i), nextRow, width);
+                }
+            }
+        }
+    }
+
+    flush();
+    emit searchProgress(isCancelled() ? m_linesSearched : lineCount, lineCount);
+    emit searchFinished(m_matchCount, isCancelled());
+}
+
+void TerminalSearch::searchLine(const QByteArray &packed, int firstRow, int width)
+{
+    const int matchesBefore = m_matchCount;
+    int length;
+    const char *text = TerminalScrollback::packedText(packed, &length);
+
+    if (!m_needle.isEmpty()) {
+        const char *haystack = text;
+        if (m_foldAscii) {
+            if (m_folded.size() < length)
+                m_folded.resize(length);
+            char *folded = m_folded.data();
+            for (int i = 0; i < length; ++i)
+                folded[i] = char(foldCase(uchar(text[i])));
+            haystack = folded;
+        }
+
+        int column = 0;
+        int scanned = 0;
+        int position = findBytes(haystack, length, m_needle, 0);
+        while (position >= 0) {
+            column += utf8Cells(text, scanned, position);
+            int matchWidth = utf8Cells(text, position, position + m_needle.size());
+            addMatch(firstRow, width, column, matchWidth);
+            column += matchWidth;
+            scanned = position + m_needle.size();
+            position = findBytes(haystack, length, m_needle, scanned);
+        }
+    } else if (length > 0) {
+        QString string = QString::fromUtf8(text, length);
+        QRegularExpressionMatchIterator matches = m_regex.globalMatch(string);
+        int column = 0;
+        int scanned = 0;
+        while (matches.hasNext()) {
+            QRegularExpressionMatch match = matches.next();
+            if (match.capturedLength() == 0)
+                continue;
+            column += utf16Cells(string, scanned, match.capturedStart());
+            int matchWidth = utf16Cells(string, match.capturedStart(), match.capturedEnd());
+            addMatch(firstRow, width, column, matchWidth);
+            column += matchWidth;
+            scanned = match.capturedEnd();
+        }
+    }
+
+    ++m_linesSearched;
+    if (!m_lineMatches.isEmpty()) {
+        // Rows of a wrapped line were found top to bottom; listeners expect them bottom up
+        std::stable_sort(m_lineMatches.begin(), m_lineMatches.end(),
+                         [](const TerminalSearchMatch &a, const TerminalSearchMatch &b) { return a.line > b.line; });
+        m_batch += m_lineMatches;
+        m_lineMatches.clear();
+        // Report the first match right away so the view can jump to it
+        if (matchesBefore == 0 || m_batch.size() >= FlushBatchSize) {
+            flush();
+            return;
+        }
+    }
+    if ((m_linesSearched & 255) == 0 && m_flushTimer.elapsed() >= FlushIntervalMs)
+        flush();
+}
+
+void TerminalSearch::addMatch(int firstRow, int width, int column, int length)
+{
+    ++m_matchCount;
+    if (m_matchCount > MaxReportedMatches)
+        return;
+
+    // Split at row boundaries when the line is wrapped at width
+    while (length > 0) {
+        TerminalSearchMatch match;
+        match.line = firstRow;
+        match.column = column;
+        match.length = length;
+        if (width > 0) {
+            match.line += column / width;
+            match.column = column % width;
+            match.length = qMin(length, width - match.column);
+        }
+        m_lineMatches.append(match);
+        column += match.length;
+        length -= match.length;
+    }
+}
+
+void TerminalSearch::flush()
+{
+    if (!m_batch.isEmpty()) {
+        emit matchesFound(m_batch);
+        m_batch.clear();
+    }
+    emit searchProgress(m_linesSearched, m_history.lineCount() + m_screenLines.size());
+    m_flushTimer.restart();
+}
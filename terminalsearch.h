@@ -0,0 +1,92 @@
+#ifndef TERMINALSEARCH_H
+#define TERMINALSEARCH_H
+
+#include <QThread>
+#include <QAtomicInt>
+#include <QElapsedTimer>
+#include <QVector>
+#include <QByteArray>
+#include <QString>
+#include <QRegularExpression>
+#include <QMetaType>
+#include "terminalscrollback.h"
+
+// A match in absolute row coordinates (scrollback rows at the history's display width
+// first, then the screen rows) as they were when the search started. Column and length
+// are in cells; a match running over a wrapped row boundary is reported once per row.
+struct TerminalSearchMatch
+{
+    int line;
+    int column;
+    int length;
+};
+
+Q_DECLARE_METATYPE(TerminalSearchMatch)
+
+// Searches a snapshot of the terminal history on a worker thread, newest line first.
+// Matches are streamed in batches (the first one as soon as it is found), so views can
+// highlight and jump to it while older history is still being scanned. Literal patterns
+// are found with memchr/memcmp on the packed UTF-8 text and use the spilled blocks'
+// trigram filters to skip blocks without decompressing them.
+class TerminalSearch : public QThread
+{
+    Q_OBJECT
+
+public:
+    enum Option {
+        CaseSensitive = 0x01,
+        RegularExpression = 0x02
+    };
+    Q_DECLARE_FLAGS(Options, Option)
+
+    // Matches beyond this are counted but not reported
+    enum { MaxReportedMatches = 100000 };
+
+    TerminalSearch(const QString &pattern, Options options,
+                   const TerminalScrollback::Snapshot &history, const QVector<QByteArray> &screenLines,
+                   QObject *parent = nullptr);
+    ~TerminalSearch();
+
+    // Checks a pattern before starting; returns an empty string if it is usable
+    static QString patternError(const QString &pattern, Options options);
+
+    void cancel();
+
+signals:
+    // Lines arrive in descending order, matches within a line in ascending column order
+    void matchesFound(const QVector<TerminalSearchMatch> &matches);
+    void searchProgress(int linesSearched, int lineCount);
+    void searchFinished(int matchCount, bool cancelled);
+
+protected:
+    void run() override;
+
+private:
+    QString m_pattern;
+    Options m_options;
+    TerminalScrollback::Snapshot m_history;
+    QVector<QByteArray> m_screenLines;
+    QAtomicInt m_cancelled;
+
+    // Prepared pattern
+    QByteArray m_needle;            // UTF-8, case-folded when the search ignores ASCII case
+    bool m_foldAscii;
+    QRegularExpression m_regex;     // regex mode and case-insensitive non-ASCII literals
+    QByteArray m_folded;            // scratch buffer for case folding
+
+    QVector<TerminalSearchMatch> m_lineMatches;     // pieces found in the current line
+    QVector<TerminalSearchMatch> m_batch;
+    int m_matchCount;
+    int m_linesSearched;
+    QElapsedTimer m_flushTimer;
+
+    bool isCancelled() const { return m_cancelled.loadRelaxed() != 0; }
+    // A width of 0 means the line is shown on a single row
+    void searchLine(const QByteArray &packed, int firstRow, int width);
+    void addMatch(int firstRow, int width, int column, int length);
+    void flush();
+};
+
+Q_DECLARE_OPERATORS_FOR_FLAGS(TerminalSearch::Options)
+
+#endif // TERMINALSEARCH_H
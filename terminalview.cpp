@@ -0,0 +1,718 @@
+#include "terminalview.h"
+#include "terminalscreen.h"
+#include <QPainter>
+#include <QPaintEvent>
+#include <QScrollBar>
+#include <QFontMetrics>
+#include <QGlyphRun>
+#include <QMouseEvent>
+#include <QMutexLocker>
+#include <algorithm>
+
+namespace {
+
+// xterm defaults for colours 16-255: a 6x6x6 cube followed by a 24-step grey ramp
+QRgb xtermColor(int index)
+{
+    if (index < 232) {
+        static const int levels[6] = { 0, 95, 135, 175, 215, 255 };
+        int cube = index - 16;
+        return qRgb(levels[cube / 36], levels[(cube / 6) % 6], levels[cube % 6]);
+    }
+    int gray = (index - 232) * 10 + 8;
+    return qRgb(gray, gray, gray);
+}
+
+} // namespace
+
+TerminalView::TerminalView(TerminalScreen *screen, QWidget *parent)
+    : QAbstractScrollArea(parent)
+    , m_screen(screen)
+    , m_cachesReleased(false)
+    , m_gridLocked(false)
+    , m_cellWidth(1)
+    , m_cellHeight(1)
+    , m_ascent(0)
+    , m_underlinePos(1)
+    , m_strikeOutPos(0)
+    , m_lineWidth(1)
+    , m_foreground(Qt::lightGray)
+    , m_background(Qt::black)
+    , m_cursorLine(0)
+    , m_cursorColumn(0)
+    , m_cursorLines(1)
+    , m_adjustingScrollBar(false)
+    , m_predictionTop(0)
+    , m_hasSelection(false)
+    , m_selecting(false)
+    , m_currentMatch(-1)
+    , m_searchLineOffset(0)
+{
+    std::fill(m_palette, m_palette + 16, qRgb(0, 0, 0));
+    for (int i = 16; i < 256; ++i)
+        m_palette[i] = xtermColor(i);
+
+    setFrameShape(QFrame::NoFrame);
+    setFocusPolicy(Qt::StrongFocus);
+    setHorizontalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
+    setVerticalScrollBarPolicy(Qt::ScrollBarAlwaysOn);
+    // Every pixel is painted by paintEvent, so Qt need not clear the viewport first
+    viewport()->setAttribute(Qt::WA_OpaquePaintEvent);
+    viewport()->setCursor(Qt::IBeamCursor);
+
+    setTerminalFont(font());
+}
+
+void TerminalView::setTerminalFont(const QFont &font)
+{
+    m_font = font;
+    m_font.setKerning(false);
+    m_font.setStyleHint(QFont::TypeWriter);
+
+    QFontMetrics metrics(m_font);
+    m_cellWidth = qMax(1, metrics.horizontalAdvance(QLatin1Char('M')));
+    m_cellHeight = qMax(1, metrics.height());
+    m_ascent = metrics.ascent();
+    m_underlinePos = metrics.underlinePos();
+    m_strikeOutPos = metrics.strikeOutPos();
+    m_lineWidth = qMax(1, metrics.lineWidth());
+    resetGlyphCaches();
+
+    // Before the first show the viewport has no real size yet; resizeEvent sets the grid
+    if (isVisible())
+        updateGridSize();
+    viewport()->update();
+}
+
+void TerminalView::setDefaultColors(const QColor &foreground, const QColor &background)
+{
+    m_foreground = foreground;
+    m_background = background;
+    viewport()->update();
+}
+
+void TerminalView::setBaseColors(const QVector<QColor> &colors)
+{
+    for (int i = 0; i < qMin(16, colors.size()); ++i)
+        m_palette[i] = colors.at(i).rgb();
+    viewport()->update();
+}
+
+int TerminalView::gridColumns() const
+{
+    return qMax(1, viewport()->width() / m_cellWidth);
+}
+
+int TerminalView::gridRows() const
+{
+    return qMax(1, viewport()->height() / m_cellHeight);
+}
+
+void TerminalView::updateDamage()
+{
+    QMutexLocker locker(m_screen->mutex());
+    QScrollBar *bar = verticalScrollBar();
+    bool atBottom = bar->value() >= bar->maximum();
+    int dropped = m_screen->takeDroppedLines();
+
+    if (dropped > 0 && m_hasSelection) {
+        m_selectionAnchor.ry() -= dropped;
+        m_selectionEnd.ry() -= dropped;
+        if (qMax(m_selectionAnchor.y(), m_selectionEnd.y()) < 0)
+            m_hasSelection = false;
+    }
+    m_searchLineOffset -= dropped;
+    m_predictionTop -= dropped;
+
+    int oldValue = bar->value();
+    m_adjustingScrollBar = true;
+    updateScrollBar();
+    bar->setValue(atBottom ? bar->maximum() : qMax(0, oldValue - dropped));
+    m_adjustingScrollBar = false;
+
+    int rows = m_screen->rows();
+    int scrolled = m_screen->scrolledLines();
+    int screenTop = m_screen->scrollbackCount();
+
+    if (m_screen->isFullyDirty() || (!atBottom && (scrolled > 0 || dropped > 0)) || scrolled >= rows) {
+        viewport()->update();
+    } else {
+        if (scrolled > 0) {
+            // The rows moved up with their content; shift the pixels instead of repainting
+            viewport()->scroll(0, -scrolled * m_cellHeight);
+        }
+        for (int row = 0; row < rows; ++row) {
+            if (m_screen->isRowDirty(row))
+                viewport()->update(lineRect(screenTop + row));
+        }
+
+    }
+
+    updateCursor();
+    m_screen->clearDamage();
+}
+
+void TerminalView::updateCursor()
+{
+    // Old position (its pixels may have moved with a scroll)
+    for (int i = 0; i < m_cursorLines; ++i)
+        viewport()->update(lineRect(m_cursorLine + i));
+
+    if (m_predictions.isEmpty()) {
+        m_cursorLine = m_screen->scrollbackCount() + m_screen->cursorRow();
+        m_cursorColumn = m_screen->cursorColumn();
+    } else {
+        const TerminalPredictedCell &last = m_predictions.constLast();
+        m_cursorLine = m_predictionTop + last.row;
+        m_cursorColumn = qMin(last.column + TerminalScreen::charWidth(last.codepoint), m_screen->columns() - 1);
+    }
+    m_cursorLines = 1 + (m_cursorColumn + m_pendingInput.size()) / m_screen->columns();
+    for (int i = 0; i < m_cursorLines; ++i)
+        viewport()->update(lineRect(m_cursorLine + i));
+}
+
+void TerminalView::setPredictions(const QVector<TerminalPredictedCell> &cells)
+{
+    QMutexLocker locker(m_screen->mutex());
+    if (cells.isEmpty() && m_predictions.isEmpty())
+        return;
+
+    for (const TerminalPredictedCell &cell : qAsConst(m_predictions))
+        viewport()->update(lineRect(m_predictionTop + cell.row));
+    m_predictions = cells;
+    m_predictionTop = m_screen->scrollbackCount();
+    for (const TerminalPredictedCell &cell : qAsConst(m_predictions))
+        viewport()->update(lineRect(m_predictionTop + cell.row));
+    updateCursor();
+}
+
+void TerminalView::scrollToBottom()
+{
+    verticalScrollBar()->setValue(verticalScrollBar()->maximum());
+}
+
+void TerminalView::setPendingInput(const QString &text)
+{
+    if (text == m_pendingInput)
+        return;
+
+    QMutexLocker locker(m_screen->mutex());
+    int oldLines = m_cursorLines;
+    m_pendingInput = text;
+    m_cursorLines = 1 + (m_cursorColumn + m_pendingInput.size()) / m_screen->columns();
+    for (int i = 0; i < qMax(oldLines, m_cursorLines); ++i)
+        viewport()->update(lineRect(m_cursorLine + i));
+}
+
+QString TerminalView::selectedText() const
+{
+    if (!m_hasSelection)
+        return QString();
+
+    QMutexLocker locker(m_screen->mutex());
+    QPoint start, end;
+    selectionRange(start, end);
+
+    QString text;
+    for (int lineIndex = qMax(0, start.y()); lineIndex <= end.y() && lineIndex < totalLines(); ++lineIndex) {
+        TerminalLine line = lineAt(lineIndex);
+        int from = lineIndex == start.y() ? start.x() : 0;
+        int to = lineIndex == end.y() ? end.x() + 1 : line.cells.size();
+
+        QString part = TerminalScreen::lineText(line, from, to);
+        bool softWrapped = line.wrapped && lineIndex != end.y();
+        if (!softWrapped) {
+            int length = part.size();
+            while (length > 0 && part.at(length - 1) == QLatin1Char(' '))
+                --length;
+            part.truncate(length);
+        }
+        text += part;
+        if (lineIndex != end.y() && !softWrapped)
+            text += QLatin1Char('\n');
+    }
+    return text;
+}
+
+void TerminalView::clearSelection()
+{
+    if (m_hasSelection) {
+        m_hasSelection = false;
+        viewport()->update();
+    }
+}
+
+void TerminalView::clearSearchMatches()
+{
+    m_searchMatches.clear();
+    m_currentMatch = -1;
+    m_searchLineOffset = 0;
+    viewport()->update();
+}
+
+void TerminalView::addSearchMatches(const QVector<TerminalSearchMatch> &matches)
+{
+    m_searchMatches += matches;
+    viewport()->update();
+}
+
+void TerminalView::setCurrentSearchMatch(int index)
+{
+    m_currentMatch = (index >= 0 && index < m_searchMatches.size()) ? index : -1;
+    if (m_currentMatch >= 0) {
+        QMutexLocker locker(m_screen->mutex());
+        int line = m_searchMatches.at(m_currentMatch).line + m_searchLineOffset;
+        int first = firstVisibleLine();
+        if (line < first || line >= first + m_screen->rows())
+            verticalScrollBar()->setValue(line - m_screen->rows() / 2);
+    }
+    viewport()->update();
+}
+
+void TerminalView::paintEvent(QPaintEvent *event)
+{
+    // The parser thread waits while the visible rows are painted
+    QMutexLocker locker(m_screen->mutex());
+    if (m_cachesReleased)
+        resetGlyphCaches();
+    QPainter painter(viewport());
+    QRect rect = event->rect();
+    painter.fillRect(rect, m_background);
+
+    int first = firstVisibleLine();
+    int firstRow = rect.top() / m_cellHeight;
+    int lastRow = rect.bottom() / m_cellHeight;
+    int total = totalLines();
+
+    for (int row = firstRow; row <= lastRow; ++row) {
+        int absoluteLine = first + row;
+        if (absoluteLine >= total)
+            break;
+        paintLine(painter, lineAt(absoluteLine), row * m_cellHeight, absoluteLine);
+    }
+
+    if (!m_predictions.isEmpty())
+        paintPredictions(painter);
+    paintCursor(painter);
+}
+
+void TerminalView::resizeEvent(QResizeEvent *event)
+{
+    QAbstractScrollArea::resizeEvent(event);
+    updateGridSize();
+}
+
+void TerminalView::scrollContentsBy(int dx, int dy)
+{
+    Q_UNUSED(dx);
+    Q_UNUSED(dy);
+    if (!m_adjustingScrollBar)
+        viewport()->update();
+}
+
+void TerminalView::mousePressEvent(QMouseEvent *event)
+{
+    if (event->button() == Qt::LeftButton) {
+        QMutexLocker locker(m_screen->mutex());
+        m_selecting = true;
+        m_selectionAnchor = cellAt(event->pos());
+        m_selectionEnd = m_selectionAnchor;
+        if (m_hasSelection) {
+            m_hasSelection = false;
+            viewport()->update();
+        }
+    }
+    QAbstractScrollArea::mousePressEvent(event);
+}
+
+void TerminalView::mouseMoveEvent(QMouseEvent *event)
+{
+    if (m_selecting) {
+        QMutexLocker locker(m_screen->mutex());
+        QPoint cell = cellAt(event->pos());
+        if (cell != m_selectionEnd) {
+            m_selectionEnd = cell;
+            m_hasSelection = m_selectionEnd != m_selectionAnchor;
+            viewport()->update();
+        }
+    }
+}
+
+void TerminalView::mouseReleaseEvent(QMouseEvent *event)
+{
+    if (event->button() == Qt::LeftButton)
+        m_selecting = false;
+    QAbstractScrollArea::mouseReleaseEvent(event);
+}
+
+void TerminalView::mouseDoubleClickEvent(QMouseEvent *event)
+{
+    if (event->button() != Qt::LeftButton)
+        return;
+
+    // Select the word (run of non-blank cells) under the mouse
+    QMutexLocker locker(m_screen->mutex());
+    QPoint cell = cellAt(event->pos());
+    TerminalLine line = lineAt(cell.y());
+    auto isWordCell = [&line](int column) {
+        quint32 codepoint = line.cells.at(column).codepoint;
+        return codepoint != 0 && codepoint != ' ';
+    };
+    if (cell.x() >= line.cells.size() || !isWordCell(cell.x()))
+        return;
+
+    int from = cell.x();
+    int to = cell.x();
+    while (from > 0 && isWordCell(from - 1))
+        --from;
+    while (to + 1 < line.cells.size() && isWordCell(to + 1))
+        ++to;
+
+    m_selectionAnchor = QPoint(from, cell.y());
+    m_selectionEnd = QPoint(to, cell.y());
+    m_hasSelection = true;
+    m_selecting = false;
+    viewport()->update();
+}
+
+void TerminalView::focusInEvent(QFocusEvent *event)
+{
+    QAbstractScrollArea::focusInEvent(event);
+    viewport()->update(lineRect(m_cursorLine));
+}
+
+void TerminalView::focusOutEvent(QFocusEvent *event)
+{
+    QAbstractScrollArea::focusOutEvent(event);
+    viewport()->update(lineRect(m_cursorLine));
+}
+
+bool TerminalView::focusNextPrevChild(bool next)
+{
+    // Tab belongs to the shell (completion), not to focus navigation
+    Q_UNUSED(next);
+    return false;
+}
+
+int TerminalView::totalLines() const
+{
+    return m_screen->scrollbackCount() + m_screen->rows();
+}
+
+int TerminalView::firstVisibleLine() const
+{
+    return verticalScrollBar()->value();
+}
+
+TerminalLine TerminalView::lineAt(int absoluteLine) const
+{
+    int scrollback = m_screen->scrollbackCount();
+    if (absoluteLine < scrollback)
+        return m_screen->scrollbackLine(absoluteLine);
+    return m_screen->screenLine(qMin(absoluteLine - scrollback, m_screen->rows() - 1));
+}
+
+QPoint TerminalView::cellAt(const QPoint &pos) const
+{
+    int column = qBound(0, pos.x() / m_cellWidth, m_screen->columns() - 1);
+    int line = qBound(0, firstVisibleLine() + pos.y() / m_cellHeight, totalLines() - 1);
+    return QPoint(column, line);
+}
+
+QRect TerminalView::lineRect(int absoluteLine) const
+{
+    return QRect(0, (absoluteLine - firstVisibleLine()) * m_cellHeight, viewport()->width(), m_cellHeight);
+}
+
+void TerminalView::updateScrollBar()
+{
+    QScrollBar *bar = verticalScrollBar();
+    bar->setRange(0, m_screen->scrollbackCount());
+    bar->setPageStep(m_screen->rows());
+    bar->setSingleStep(1);
+}
+
+void TerminalView::updateGridSize()
+{
+    if (m_gridLocked)
+        return;
+    int columns = gridColumns();
+    int rows = gridRows();
+    QMutexLocker locker(m_screen->mutex());
+    if (columns == m_screen->columns() && rows == m_screen->rows())
+        return;
+
+    m_screen->resize(columns, rows);
+    // Line positions in the history change with the width
+    m_hasSelection = false;
+    m_searchMatches.clear();
+    m_currentMatch = -1;
+    m_searchLineOffset = 0;
+    m_adjustingScrollBar = true;
+    updateScrollBar();
+    scrollToBottom();
+    m_adjustingScrollBar = false;
+    viewport()->update();
+    locker.unlock();
+
+    emit gridSizeChanged(columns, rows);
+}
+
+void TerminalView::selectionRange(QPoint &start, QPoint &end) const
+{
+    bool anchorFirst = m_selectionAnchor.y() < m_selectionEnd.y()
+                       || (m_selectionAnchor.y() == m_selectionEnd.y() && m_selectionAnchor.x() <= m_selectionEnd.x());
+    start = anchorFirst ? m_selectionAnchor : m_selectionEnd;
+    end = anchorFirst ? m_selectionEnd : m_selectionAnchor;
+}
+
+QColor TerminalView::paletteColor(quint32 color, bool foreground) const
+{
+    if (TerminalAttributes::isTrueColor(color))
+        return QColor(QRgb(color & 0xFFFFFF));
+    if (color >= 256)
+        return foreground ? m_foreground : m_background;
+    return QColor(m_palette[color]);
+}
+
+void TerminalView::releaseCaches()
+{
+    for (GlyphCache &cache : m_glyphCaches) {
+        cache.rawFont = QRawFont();
+        cache.glyphs = QHash<quint32, quint32>();
+    }
+    m_runGlyphs = QVector<quint32>();
+    m_runPositions = QVector<QPointF>();
+    m_cachesReleased = true;
+}
+
+void TerminalView::setGridLocked(bool locked)
+{
+    m_gridLocked = locked;
+    if (!locked)
+        updateGridSize();
+}
+
+void TerminalView::resetGlyphCaches()
+{
+    m_cachesReleased = false;
+    for (int style = 0; style < FontStyleCount; ++style) {
+        QFont font = m_font;
+        font.setBold(style & BoldStyle);
+        font.setItalic(style & ItalicStyle);
+        m_styleFonts[style] = font;
+
+        GlyphCache &cache = m_glyphCaches[style];
+        cache.rawFont = QRawFont::fromFont(font);
+        cache.glyphs.clear();
+
+        // Printable ASCII is looked up once here; everything else on first use
+        std::fill(cache.ascii, cache.ascii + 128, 0u);
+        if (cache.rawFont.isValid()) {
+            QChar chars[95];
+            for (int i = 0; i < 95; ++i)
+                chars[i] = QLatin1Char(char(' ' + i));
+            quint32 indexes[95];
+            int count = 95;
+            if (cache.rawFont.glyphIndexesForChars(chars, 95, indexes, &count) && count == 95)
+                std::copy(indexes, indexes + 95, cache.ascii + ' ');
+        }
+    }
+}
+
+quint32 TerminalView::glyphIndex(GlyphCache &cache, quint32 codepoint)
+{
+    if (codepoint < 128)
+        return cache.ascii[codepoint];
+
+    auto it = cache.glyphs.constFind(codepoint);
+    if (it != cache.glyphs.constEnd())
+        return it.value();
+
+    QVector<quint32> indexes = cache.rawFont.glyphIndexesForString(QString::fromUcs4(&codepoint, 1));
+    quint32 glyph = indexes.size() == 1 ? indexes.first() : 0;
+    cache.glyphs.insert(codepoint, glyph);
+    return glyph;
+}
+
+void TerminalView::drawCells(QPainter &painter, const TerminalCell *cells, int from, int to, quint8 flags, int y)
+{
+    int style = ((flags & TerminalAttributes::Bold) ? BoldStyle : 0) | ((flags & TerminalAttributes::Italic) ? ItalicStyle : 0);
+    GlyphCache &cache = m_glyphCaches[style];
+    bool cached = cache.rawFont.isValid();
+
+    // Every glyph sits at its cell's origin, so the run needs no shaping or layout
+    m_runGlyphs.resize(0);
+    m_runPositions.resize(0);
+    for (int column = from; column < to; ++column) {
+        const TerminalCell &cell = cells[column];
+        if (cell.codepoint <= ' ' || (cell.flags & TerminalCell::WideTail))
+            continue;
+
+        quint32 glyph = cached ? glyphIndex(cache, cell.codepoint) : 0;
+        if (glyph != 0) {
+            m_runGlyphs.append(glyph);
+            m_runPositions.append(QPointF(column * m_cellWidth, 0));
+        } else {
+            painter.setFont(m_styleFonts[style]);
+            painter.drawText(column * m_cellWidth, y + m_ascent, QString::fromUcs4(&cell.codepoint, 1));
+        }
+    }
+
+    if (!m_runGlyphs.isEmpty()) {
+        QGlyphRun run;
+        run.setRawFont(cache.rawFont);
+        run.setGlyphIndexes(m_runGlyphs);
+        run.setPositions(m_runPositions);
+        painter.drawGlyphRun(QPointF(0, y + m_ascent), run);
+    }
+
+    // Drawn separately so that underlined and struck-out blanks show too
+    QColor color = painter.pen().color();
+    int width = (to - from) * m_cellWidth;
+    if (flags & TerminalAttributes::Underline)
+        painter.fillRect(from * m_cellWidth, y + m_ascent + m_underlinePos, width, m_lineWidth, color);
+    if (flags & TerminalAttributes::Strikeout)
+        painter.fillRect(from * m_cellWidth, y + m_ascent - m_strikeOutPos, width, m_lineWidth, color);
+}
+
+void TerminalView::paintLine(QPainter &painter, const TerminalLine &line, int y, int absoluteLine)
+{
+    const int columns = qMin(line.cells.size(), m_screen->columns());
+    const TerminalCell *cells = line.cells.constData();
+    const quint16 layoutFlags = TerminalCell::WideChar | TerminalCell::WideTail;
+
+    // Runs of cells with the same attributes are filled and drawn in one call
+    int column = 0;
+    while (column < columns) {
+        const TerminalCell &cell = cells[column];
+        int end = column + 1;
+        if (cell.flags & TerminalCell::WideChar) {
+            end = qMin(column + 2, columns);
+        } else {
+            while (end < columns && cells[end].attribute == cell.attribute && !(cells[end].flags & layoutFlags))
+                ++end;
+        }
+
+        const TerminalAttributes &attributes = m_screen->attributes(cell.attribute);
+        QColor foreground = paletteColor(attributes.foreground, true);
+        QColor background = paletteColor(attributes.background, false);
+        if (attributes.flags & TerminalAttributes::Inverse)
+            qSwap(foreground, background);
+        if (attributes.flags & TerminalAttributes::Dim)
+            foreground = foreground.darker(150);
+        if (attributes.flags & TerminalAttributes::Concealed)
+            foreground = background;
+
+        QRect runRect(column * m_cellWidth, y, (end - column) * m_cellWidth, m_cellHeight);
+        if (background != m_background)
+            painter.fillRect(runRect, background);
+
+        painter.setPen(foreground);
+        drawCells(painter, cells, column, end, attributes.flags, y);
+
+        column = end;
+    }
+
+    if (m_hasSelection) {
+        QPoint start, end;
+        selectionRange(start, end);
+        if (absoluteLine >= start.y() && absoluteLine <= end.y()) {
+            int from = absoluteLine == start.y() ? start.x() : 0;
+            int to = absoluteLine == end.y() ? end.x() + 1 : m_screen->columns();
+            QColor highlight = palette().color(QPalette::Highlight);
+            highlight.setAlpha(110);
+            painter.fillRect(QRect(from * m_cellWidth, y, (to - from) * m_cellWidth, m_cellHeight), highlight);
+        }
+    }
+
+    if (!m_searchMatches.isEmpty())
+        paintSearchMatches(painter, y, absoluteLine);
+}
+
+void TerminalView::paintSearchMatches(QPainter &painter, int y, int absoluteLine)
+{
+    // Matches are sorted by descending line, so the ones on this line are contiguous
+    int searchLine = absoluteLine - m_searchLineOffset;
+    auto it = std::lower_bound(m_searchMatches.constBegin(), m_searchMatches.constEnd(), searchLine,
+                               [](const TerminalSearchMatch &match, int line) { return match.line > line; });
+
+    for (; it != m_searchMatches.constEnd() && it->line == searchLine; ++it) {
+        bool current = int(it - m_searchMatches.constBegin()) == m_currentMatch;
+        QColor color = current ? QColor(255, 140, 0, 170) : QColor(255, 220, 0, 90);
+        painter.fillRect(QRect(it->column * m_cellWidth, y, it->length * m_cellWidth, m_cellHeight), color);
+    }
+}
+
+void TerminalView::paintPredictions(QPainter &painter)
+{
+    int first = firstVisibleLine();
+    QColor underline = m_foreground;
+    underline.setAlpha(120);
+
+    painter.setFont(m_font);
+    painter.setPen(m_foreground);
+    for (const TerminalPredictedCell &cell : qAsConst(m_predictions)) {
+        int width = TerminalScreen::charWidth(cell.codepoint) * m_cellWidth;
+        QRect rect(cell.column * m_cellWidth, (m_predictionTop + cell.row - first) * m_cellHeight, width, m_cellHeight);
+        if (!rect.intersects(viewport()->rect()))
+            continue;
+        painter.fillRect(rect, m_background);
+        painter.drawText(rect.x(), rect.y() + m_ascent, QString::fromUcs4(&cell.codepoint, 1));
+        // Not confirmed by the server yet
+        painter.fillRect(rect.x(), rect.y() + m_ascent + m_underlinePos, width, m_lineWidth, underline);
+    }
+}
+
+void TerminalView::paintCursor(QPainter &painter)
+{
+    int first = firstVisibleLine();
+    int columns = m_screen->columns();
+    int line = m_cursorLine;
+    int column = m_cursorColumn;
+
+    // Pending line-mode input, wrapped at the right margin like the shell will echo it
+    if (!m_pendingInput.isEmpty()) {
+        painter.setFont(m_font);
+        for (QChar ch : m_pendingInput) {
+            if (column >= columns) {
+                column = 0;
+                ++line;
+            }
+            QRect cell(column * m_cellWidth, (line - first) * m_cellHeight, m_cellWidth, m_cellHeight);
+            painter.fillRect(cell, m_background);
+            painter.setPen(m_foreground);
+            painter.drawText(cell.x(), cell.y() + m_ascent, QString(ch));
+            ++column;
+        }
+        if (column >= columns) {
+            column = 0;
+            ++line;
+        }
+    }
+
+    if (!m_screen->cursorVisible() && m_pendingInput.isEmpty())
+        return;
+
+    QRect cursorRect(column * m_cellWidth, (line - first) * m_cellHeight, m_cellWidth, m_cellHeight);
+    if (!cursorRect.intersects(viewport()->rect()))
+        return;
+
+    if (hasFocus()) {
+        painter.fillRect(cursorRect, m_foreground);
+        // Redraw the character under a block cursor in the background colour
+        int screenRow = line - m_screen->scrollbackCount();
+        if (m_pendingInput.isEmpty() && screenRow >= 0 && screenRow < m_screen->rows()) {
+            const TerminalCell &cell = m_screen->screenLine(screenRow).cells.at(column);
+            if (cell.codepoint > ' ' && !(cell.flags & TerminalCell::WideTail)) {
+                painter.setFont(m_font);
+                painter.setPen(m_background);
+                painter.drawText(cursorRect.x(), cursorRect.y() + m_ascent,
+                                 TerminalScreen::lineText(m_screen->screenLine(screenRow), column, column + 1));
+            }
+        }
+    } else {
+        painter.setPen(m_foreground);
+        painter.drawRect(cursorRect.adjusted(0, 0, -1, -1));
+    }
+}
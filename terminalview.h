@@ -0,0 +1,160 @@
+#ifndef TERMINALVIEW_H
+#define TERMINALVIEW_H
+
+#include <QAbstractScrollArea>
+#include <QFont>
+#include <QRawFont>
+#include <QColor>
+#include <QHash>
+#include <QVector>
+#include <QPoint>
+#include "terminalsearch.h"
+#include "terminalpredictor.h"
+
+class TerminalScreen;
+struct TerminalLine;
+struct TerminalCell;
+
+// Paints a TerminalScreen cell by cell. Only rows the screen reports as damaged are
+// repainted; full-screen scrolls move the existing pixels. Text is drawn as positioned
+// glyph runs from a per-style glyph cache, so painting never goes through text shaping. The vertical scroll bar covers
+// the scrollback, and selections are kept in absolute line numbers so they survive new
+// output.
+class TerminalView : public QAbstractScrollArea
+{
+    Q_OBJECT
+
+public:
+    explicit TerminalView(TerminalScreen *screen, QWidget *parent = nullptr);
+
+    void setTerminalFont(const QFont &font);
+    void setDefaultColors(const QColor &foreground, const QColor &background);
+    // Colours 0-15; the rest of the 256-colour palette is derived
+    void setBaseColors(const QVector<QColor> &colors);
+
+    // Frees the glyph caches while the view is not shown; the next paint rebuilds them
+    void releaseCaches();
+    // While locked the screen keeps its size when the view is resized, e.g. while a
+    // recording made at another size is replayed into it
+    void setGridLocked(bool locked);
+
+    int gridColumns() const;
+    int gridRows() const;
+
+    // Repaints what changed in the screen since the last call
+    void updateDamage();
+    void scrollToBottom();
+
+    // Line-mode input that has not been sent yet, drawn at the cursor
+    void setPendingInput(const QString &text);
+
+    // Speculative echo, drawn underlined over the screen; the cursor follows the last cell
+    void setPredictions(const QVector<TerminalPredictedCell> &cells);
+
+    bool hasSelection() const { return m_hasSelection; }
+    QString selectedText() const;
+    void clearSelection();
+
+    // Search highlights, in the line coordinates the search started with; lines dropped
+    // from the front of the scrollback since then are accounted for here
+    void clearSearchMatches();
+    void addSearchMatches(const QVector<TerminalSearchMatch> &matches);
+    int searchMatchCount() const { return m_searchMatches.size(); }
+    // Highlights one match more strongly and scrolls it into view; -1 for none
+    void setCurrentSearchMatch(int index);
+    int currentSearchMatch() const { return m_currentMatch; }
+
+signals:
+    void gridSizeChanged(int columns, int rows);
+
+protected:
+    void paintEvent(QPaintEvent *event) override;
+    void resizeEvent(QResizeEvent *event) override;
+    void scrollContentsBy(int dx, int dy) override;
+    void mousePressEvent(QMouseEvent *event) override;
+    void mouseMoveEvent(QMouseEvent *event) override;
+    void mouseReleaseEvent(QMouseEvent *event) override;
+    void mouseDoubleClickEvent(QMouseEvent *event) override;
+    void focusInEvent(QFocusEvent *event) override;
+    void focusOutEvent(QFocusEvent *event) override;
+    bool focusNextPrevChild(bool next) override;
+
+private:
+    enum FontStyle {
+        RegularStyle = 0,
+        BoldStyle = 1,
+        ItalicStyle = 2,
+        FontStyleCount = 4
+    };
+
+    // Glyph indexes of one font style. Codepoints the font has no glyph for map to 0 and
+    // are drawn with QPainter::drawText so that Qt can pick a fallback font.
+    struct GlyphCache
+    {
+        QRawFont rawFont;
+        quint32 ascii[128];
+        QHash<quint32, quint32> glyphs;
+    };
+
+    TerminalScreen *m_screen;
+    QFont m_font;
+    QFont m_styleFonts[FontStyleCount];
+    GlyphCache m_glyphCaches[FontStyleCount];
+    bool m_cachesReleased;
+    bool m_gridLocked;
+    int m_cellWidth;
+    int m_cellHeight;
+    int m_ascent;
+    int m_underlinePos;
+    int m_strikeOutPos;
+    int m_lineWidth;
+
+    // Reused between runs to avoid allocating while painting
+    QVector<quint32> m_runGlyphs;
+    QVector<QPointF> m_runPositions;
+
+    QColor m_foreground;
+    QColor m_background;
+    QRgb m_palette[256];
+
+    QString m_pendingInput;
+    int m_cursorLine;           // absolute line of the cursor when last painted
+    int m_cursorColumn;
+    int m_cursorLines;          // rows covered by the cursor and pending input
+    bool m_adjustingScrollBar;
+
+    QVector<TerminalPredictedCell> m_predictions;
+    int m_predictionTop;        // absolute line of screen row 0 for m_predictions
+
+    // Selection in (column, absolute line) coordinates
+    bool m_hasSelection;
+    bool m_selecting;
+    QPoint m_selectionAnchor;
+    QPoint m_selectionEnd;
+
+    // Ordered by descending line, as the search reports them
+    QVector<TerminalSearchMatch> m_searchMatches;
+    int m_currentMatch;
+    int m_searchLineOffset;
+
+    int totalLines() const;
+    int firstVisibleLine() const;
+    TerminalLine lineAt(int absoluteLine) const;
+    QPoint cellAt(const QPoint &pos) const;
+    QRect lineRect(int absoluteLine) const;
+    void updateScrollBar();
+    void updateGridSize();
+    void updateCursor();
+    void selectionRange(QPoint &start, QPoint &end) const;
+
+    QColor paletteColor(quint32 color, bool foreground) const;
+    void resetGlyphCaches();
+    quint32 glyphIndex(GlyphCache &cache, quint32 codepoint);
+    void drawCells(QPainter &painter, const TerminalCell *cells, int from, int to, quint8 flags, int y);
+    void paintLine(QPainter &painter, const TerminalLine &line, int y, int absoluteLine);
+    void paintSearchMatches(QPainter &painter, int y, int absoluteLine);
+    void paintPredictions(QPainter &painter);
+    void paintCursor(QPainter &painter);
+};
+
+#endif // TERMINALVIEW_H
@@ -12,6 +12,7 @@
 #include <QDateTime>
 #include "sshclient.h"
 #include "sshconnectionthread.h"
+#include "terminalkeyencoder.h"
 #include <QApplication>
 #include <QRegularExpression>
 #include <QFileDialog>
@@ -19,6 +20,29 @@
 #include <QPushButton>
 #include <QCryptographicHash>
 #include <QThread>
+#include <QScreen>
+#include <QShowEvent>
+#include <QHideEvent>
+#include <QDialog>
+#include <QDialogButtonBox>
+#include <QFormLayout>
+#include <QSpinBox>
+#include <QLabel>
+#include <QCheckBox>
+#include <QLineEdit>
+#include <QToolButton>
+#include <QHBoxLayout>
+#include <QTextCodec>
+#include <QMutexLocker>
+#include <QProgressDialog>
+#include <QComboBox>
+#include <QStandardPaths>
+#include <QDir>
+#include <QSlider>
+#include <QSignalBlocker>
+#include <QTableWidget>
+#include <QHeaderView>
+#include <climits>
 
 // ZMODEM detection sequences
 #define ZMODEM_DETECT_HEADER "\x18\x2a\x45"
@@ -60,48 +84,160 @@
 #define ZCRCQ           'j'    // CRC next, frame continues, ZACK expected
 #define ZCRCW           'k'    // CRC next, frame ends, ZACK expected
 
-typedef struct {
-    QString colStr;
-    QColor col;
-} ColorMapping;
-
-static const ColorMapping G_colorMappings[] = {
-    {"\033[0m", QColor()}, /* Default color - will be replaced with textColor */
-    {"\033[1m", QColor()}, /* Bold - will be handled specially */
-
-    /* Standard foreground colors */
-    {"\033[30m", Qt::black},
-    {"\033[31m", Qt::red},
-    {"\033[32m", Qt::green},
-    {"\033[33m", Qt::yellow},
-    {"\033[34m", Qt::blue},
-    {"\033[35m", Qt::magenta},
-    {"\033[36m", Qt::cyan},
-    {"\033[37m", Qt::white},
-
-    /* Bright foreground colors */
-    {"\033[90m", QColor(128, 128, 128)}, /* Bright black (gray) */
-    {"\033[91m", QColor(255, 0, 0)},     /* Bright red */
-    {"\033[92m", QColor(0, 255, 0)},     /* Bright green */
-    {"\033[93m", QColor(255, 255, 0)},   /* Bright yellow */
-    {"\033[94m", QColor(0, 0, 255)},     /* Bright blue */
-    {"\033[95m", QColor(255, 0, 255)},   /* Bright magenta */
-    {"\033[96m", QColor(0, 255, 255)},   /* Bright cyan */
-    {"\033[97m", QColor(255, 255, 255)}, /* Bright white */
-
-    /* File type specific colors from 'ls' output */
-    {"\033[01;34m", QColor(0, 0, 255)},      /* Directory - bright blue */
-    {"\033[01;36m", QColor(0, 255, 255)},    /* Symlink - bright cyan */
-    {"\033[01;32m", QColor(0, 255, 0)},      /* Executable - bright green */
-    {"\033[01;35m", QColor(255, 0, 255)},    /* Image file - bright magenta */
-    {"\033[01;31m", QColor(255, 0, 0)}       /* Archive - bright red */
+static QString formatMemory(qint64 bytes)
+{
+    if (bytes < 1024 * 1024) {
+        return QString("%1 KB").arg(bytes / 1024.0, 0, 'f', 1);
+    }
+    return QString("%1 MB").arg(bytes / (1024.0 * 1024.0), 0, 'f', 1);
+}
+
+// 回放进度显示为 分:秒
+static QString formatReplayTime(qint64 ms)
+{
+    qint64 seconds = ms / 1000;
+    return QString("%1:%2").arg(seconds / 60).arg(seconds % 60, 2, 10, QLatin1Char('0'));
+}
+
+// 高亮颜色在配置里保存为 #rrggbb，空字符串表示保留输出本身的颜色
+static quint32 highlightColor(const QString &name)
+{
+    QColor color(name);
+    if (name.isEmpty() || !color.isValid()) {
+        return TerminalHighlightRule::KeepColor;
+    }
+    return TerminalAttributes::rgbColor(color.red(), color.green(), color.blue());
+}
+
+static QString highlightColorName(quint32 color)
+{
+    if (color == TerminalHighlightRule::KeepColor || !TerminalAttributes::isTrueColor(color)) {
+        return QString();
+    }
+    return QColor((color >> 16) & 0xFF, (color >> 8) & 0xFF, color & 0xFF).name();
+}
+
+static QVector<TerminalHighlightRule> defaultHighlightRules()
+{
+    QVector<TerminalHighlightRule> rules;
+    TerminalHighlightRule rule;
+    rule.caseSensitive = false;
+    rule.bold = true;
+
+    rule.pattern = "error";
+    rule.foreground = highlightColor("#ff5f5f");
+    rules.append(rule);
+
+    rule.pattern = "fatal";
+    rule.foreground = highlightColor("#ffffff");
+    rule.background = highlightColor("#af0000");
+    rule.alert = true;
+    rules.append(rule);
+
+    rule.pattern = "warn";
+    rule.foreground = highlightColor("#ffd75f");
+    rule.background = TerminalHighlightRule::KeepColor;
+    rule.alert = false;
+    rules.append(rule);
+
+    // IPv4 地址
+    rule.pattern = "(?:\\d{1,3}\\.){3}\\d{1,3}";
+    rule.regex = true;
+    rule.foreground = highlightColor("#5fd7ff");
+    rule.bold = false;
+    rules.append(rule);
+    return rules;
+}
+
+static QVector<TerminalHighlightRule> loadHighlightRules()
+{
+    QSettings settings;
+    settings.beginGroup("Terminal");
+    if (!settings.contains("HighlightRules/size")) {
+        return defaultHighlightRules();
+    }
+
+    QVector<TerminalHighlightRule> rules;
+    int count = settings.beginReadArray("HighlightRules");
+    for (int i = 0; i < count; ++i) {
+        settings.setArrayIndex(i);
+        TerminalHighlightRule rule;
+        rule.pattern = settings.value("Pattern").toString();
+        rule.regex = settings.value("Regex", false).toBool();
+        rule.caseSensitive = settings.value("CaseSensitive", true).toBool();
+        rule.foreground = highlightColor(settings.value("Foreground").toString());
+        rule.background = highlightColor(settings.value("Background").toString());
+        rule.bold = settings.value("Bold", false).toBool();
+        rule.alert = settings.value("Alert", false).toBool();
+        rules.append(rule);
+    }
+    settings.endArray();
+    settings.endGroup();
+    return rules;
+}
+
+static void saveHighlightRules(const QVector<TerminalHighlightRule> &rules)
+{
+    QSettings settings;
+    settings.beginGroup("Terminal");
+    settings.beginWriteArray("HighlightRules", rules.size());
+    for (int i = 0; i < rules.size(); ++i) {
+        const TerminalHighlightRule &rule = rules.at(i);
+        settings.setArrayIndex(i);
+        settings.setValue("Pattern", rule.pattern);
+        settings.setValue("Regex", rule.regex);
+        settings.setValue("CaseSensitive", rule.caseSensitive);
+        settings.setValue("Foreground", highlightColorName(rule.foreground));
+        settings.setValue("Background", highlightColorName(rule.background));
+        settings.setValue("Bold", rule.bold);
+        settings.setValue("Alert", rule.alert);
+    }
+    settings.endArray();
+    settings.endGroup();
+}
+
+// 规则只编译一次，所有标签页的屏幕共用同一份自动机
+static QSharedPointer<const TerminalHighlighter> g_highlighter;
+static bool g_highlighterLoaded = false;
+
+static QSharedPointer<const TerminalHighlighter> sharedHighlighter()
+{
+    if (!g_highlighterLoaded) {
+        g_highlighterLoaded = true;
+        QVector<TerminalHighlightRule> rules = loadHighlightRules();
+        QSharedPointer<TerminalHighlighter> highlighter(new TerminalHighlighter);
+        // 保存前都检查过；手工改坏的配置不高亮
+        if (!rules.isEmpty() && highlighter->compile(rules).isEmpty()) {
+            g_highlighter = highlighter;
+        }
+    }
+    return g_highlighter;
+}
+
+// 同一标签页连续命中时，隔几秒才再提醒一次
+static const int HighlightAlertIntervalMs = 3000;
+
+// 本地状态消息使用的调色板颜色
+enum {
+    AnsiRed = 9,
+    AnsiGreen = 10,
+    AnsiBlue = 12
 };
 
-#define ARRAY_SIZE(arr) (sizeof(arr) / sizeof((arr)[0]))
+// 粘贴分块：每块一个 SSH 数据包（libssh2 最大 32 KB），未写入的数据不超过一个窗口
+static const int PasteChunkBytes = 32 * 1024;
+static const int PasteWindowBytes = 256 * 1024;
+// 超过此大小显示进度和取消按钮
+static const int LargePasteBytes = 1024 * 1024;
 
 TerminalWidget::TerminalWidget(QWidget *parent) : QWidget(parent),
-    m_connected(false), m_connectionThread(nullptr),
-    historyPosition(-1), m_ansiEscapeMode(true), m_bold(false),
+    m_connected(false), m_remoteCodec(nullptr), m_connectionThread(nullptr),
+    historyPosition(-1),
+    m_searchBar(nullptr), m_searchEdit(nullptr), m_searchCaseBox(nullptr), m_searchRegexBox(nullptr),
+    m_searchStatus(nullptr), m_search(nullptr), m_searchRunning(false), m_searchTotal(0), m_searchPercent(0),
+    m_pasteOffset(0), m_pasteBracketed(false), m_pasteProgress(nullptr), m_sessionLog(nullptr),
+    m_recorder(nullptr), m_replay(nullptr), m_replayBar(nullptr), m_replayPlayButton(nullptr), m_replaySlider(nullptr),
+    m_replayTime(nullptr), m_replaySpeed(nullptr), m_hibernated(false),
     m_zmodemActive(false), m_zmodemUploadStarted(false), m_zmodemErrorCount(0), m_zmodemCancel(false),
     m_zmodemProcessing(false)
 {
@@ -109,11 +245,27 @@ TerminalWidget::TerminalWidget(QWidget *parent) : QWidget(parent),
     terminalFont = QFont("Consolas", 10);
     backgroundColor = QColor("#1E1E1E");
     textColor = QColor("#DCDCDC");
+    scrollbackLines = TerminalScrollback::DefaultMaxLines;
+    scrollbackMemoryMB = 32;
+    scrollbackGlobalMemoryMB = 256;
+    scrollbackSpill = true;
+    scrollbackSearchIndex = true;
+    predictiveEcho = false;
+    localLineEditing = false;
+    hibernateMinutes = 10;
+    sessionLog = false;
+    sessionLogDirectory = QStandardPaths::writableLocation(QStandardPaths::DocumentsLocation) + "/gshell-logs";
+    sessionLogRaw = false;
+    sessionLogTimestamps = true;
+    sessionLogMaxMB = 64;
+    sessionLogRotateHours = 24;
+    sessionLogCompress = false;
+    recordInput = false;
+    highlighting = false;
+    highlightSound = false;
 
     // 初始化 ANSI 颜色
     initAnsiColors();
-    m_currentFgColor = textColor;
-    m_currentBgColor = backgroundColor;
     
     // 清除 ZMODEM 缓冲区
     m_zmodemBuffer.clear();
@@ -125,6 +277,30 @@ TerminalWidget::TerminalWidget(QWidget *parent) : QWidget(parent),
     // Setup ZMODEM timer for timeout handling
     connect(&m_zmodemTimer, &QTimer::timeout, this, &TerminalWidget::zmodemTransferTimeout);
 
+    // 重绘间隔取显示器刷新周期，最高 60 Hz
+    qreal refreshRate = QGuiApplication::primaryScreen() ? QGuiApplication::primaryScreen()->refreshRate() : 60.0;
+    m_renderTimer.setSingleShot(true);
+    m_renderTimer.setInterval(qMax(16, qRound(1000.0 / qMax(refreshRate, 1.0))));
+    connect(&m_renderTimer, &QTimer::timeout, this, &TerminalWidget::renderFrame);
+    m_lastRender.start();
+
+    // 输入停顿后再开始搜索，避免每个按键都重新扫描
+    m_searchTimer.setSingleShot(true);
+    m_searchTimer.setInterval(200);
+    connect(&m_searchTimer, &QTimer::timeout, this, &TerminalWidget::startSearch);
+
+    // 连续按键（粘贴、自动重复、快速输入）在几毫秒内合并发送
+    m_inputFlushTimer.setSingleShot(true);
+    connect(&m_inputFlushTimer, &QTimer::timeout, this, &TerminalWidget::flushInput);
+    m_lastInputFlush.start();
+
+    m_resizeTimer.setSingleShot(true);
+    m_resizeTimer.setInterval(150);
+    connect(&m_resizeTimer, &QTimer::timeout, this, &TerminalWidget::sendWindowSize);
+
+    m_hibernateTimer.setSingleShot(true);
+    connect(&m_hibernateTimer, &QTimer::timeout, this, &TerminalWidget::hibernate);
+
     // 加载保存的设置
     loadSettings();
 
@@ -141,15 +317,15 @@ TerminalWidget::~TerminalWidget()
 {
     saveSettings();
 
-    // 清理连接线程
+    // 清理连接线程；先停止会话线程，之后不会再有数据进入解析线程
     if (m_connectionThread) {
-        if (m_connectionThread->isRunning()) {
-            m_connectionThread->terminate();
-            m_connectionThread->wait();
-        }
+        m_connectionThread->stop();
         delete m_connectionThread;
         m_connectionThread = nullptr;
     }
+    m_parserThread->stop();
+    m_sessionLog->stop();
+    m_recorder->stop();
 }
 
 void TerminalWidget::setupUI()
@@ -157,52 +333,195 @@ void TerminalWidget::setupUI()
     layout = new QVBoxLayout(this);
     layout->setContentsMargins(0, 0, 0, 0);
 
-    terminalOutput = new QTextEdit(this);
-    terminalOutput->setReadOnly(false);
-    terminalOutput->setAcceptRichText(true);
-    terminalOutput->setUndoRedoEnabled(false);
-    terminalOutput->setContextMenuPolicy(Qt::CustomContextMenu);
-    terminalOutput->document()->setDefaultStyleSheet("");
-    
+    // 屏幕模型保存字符网格，视图只重绘有变化的行
+    m_screen = new TerminalScreen(80, 24, this);
+    terminalView = new TerminalView(m_screen, this);
+    applyScrollbackLimits();
+    applyHighlighter();
+    m_predictor.setEnabled(predictiveEcho);
+    // 提醒由解析线程发出，排队到界面线程处理
+    connect(m_screen, &TerminalScreen::highlightAlert, this, &TerminalWidget::handleHighlightAlert);
+
+    // 服务器输出由会话线程直接交给解析线程；检测到 ZMODEM 请求后原始数据转交界面线程
+    m_parserThread = new TerminalParserThread(m_screen, this);
+    m_parserThread->setPassthroughDetector(&TerminalWidget::isZmodemRequest);
+    connect(m_parserThread, &TerminalParserThread::screenChanged, this, &TerminalWidget::handleScreenChanged);
+    connect(m_parserThread, &TerminalParserThread::rawDataReceived, this, &TerminalWidget::handleSSHData);
+    m_parserThread->start();
+
+    // 会话日志在连接建立后按设置启动；出错时停止记录并提示
+    m_sessionLog = new TerminalLogger(this);
+    connect(m_sessionLog, &TerminalLogger::fileOpened, this, [this](const QString &fileName) {
+        m_sessionLogFile = fileName;
+    });
+    connect(m_sessionLog, &TerminalLogger::logError, this, [this](const QString &message) {
+        appendToTerminal(tr("Session log stopped: %1\n").arg(message));
+    });
+    m_recorder = new TerminalLogger(this);
+    m_recorder->setFormat(TerminalLogger::Asciicast);
+    connect(m_recorder, &TerminalLogger::logError, this, [this](const QString &message) {
+        appendToTerminal(tr("Recording stopped: %1\n").arg(message));
+    });
+    terminalView->setContextMenuPolicy(Qt::CustomContextMenu);
+
     // 设置终端样式
     updateTerminalStyle();
 
     // 安装事件过滤器以捕获按键
-    terminalOutput->installEventFilter(this);
+    terminalView->installEventFilter(this);
 
     // 连接自定义上下文菜单
-    connect(terminalOutput, &QTextEdit::customContextMenuRequested, this, &TerminalWidget::showContextMenu);
+    connect(terminalView, &TerminalView::customContextMenuRequested, this, &TerminalWidget::showContextMenu);
+
+    // 网格尺寸变化后预测的位置不再可靠
+    connect(terminalView, &TerminalView::gridSizeChanged, this, &TerminalWidget::clearPredictions);
+    connect(terminalView, &TerminalView::gridSizeChanged, this, [this]() { m_resizeTimer.start(); });
+    // 宽度变化后历史的行号随之改变，搜索结果需要重新计算
+    connect(terminalView, &TerminalView::gridSizeChanged, this, [this]() {
+        if (m_searchBar->isVisible()) {
+            stopSearch();
+            m_searchTimer.start();
+        }
+    });
+
+    // 终端应答（光标位置报告、设备属性）直接回送给服务器
+    connect(m_screen, &TerminalScreen::responseReady, this, [this](const QByteArray &response) {
+        SSHClient *sshClient = m_connectionThread ? m_connectionThread->getSSHClient() : nullptr;
+        if (sshClient && sshClient->isConnected()) {
+            sshClient->sendData(response);
+        }
+    });
 
-    layout->addWidget(terminalOutput);
+    layout->addWidget(terminalView);
+
+    // 搜索栏，默认隐藏
+    m_searchBar = new QWidget(this);
+    QHBoxLayout *searchLayout = new QHBoxLayout(m_searchBar);
+    searchLayout->setContentsMargins(4, 2, 4, 2);
+    m_searchEdit = new QLineEdit(m_searchBar);
+    m_searchEdit->setPlaceholderText(tr("Find in scrollback"));
+    m_searchEdit->installEventFilter(this);
+    m_searchCaseBox = new QCheckBox(tr("Match case"), m_searchBar);
+    m_searchRegexBox = new QCheckBox(tr("Regex"), m_searchBar);
+    QToolButton *previousButton = new QToolButton(m_searchBar);
+    previousButton->setArrowType(Qt::UpArrow);
+    previousButton->setToolTip(tr("Previous match (Enter)"));
+    QToolButton *nextButton = new QToolButton(m_searchBar);
+    nextButton->setArrowType(Qt::DownArrow);
+    nextButton->setToolTip(tr("Next match (Shift+Enter)"));
+    m_searchStatus = new QLabel(m_searchBar);
+    QToolButton *closeButton = new QToolButton(m_searchBar);
+    closeButton->setText(tr("Close"));
+    searchLayout->addWidget(m_searchEdit, 1);
+    searchLayout->addWidget(m_searchCaseBox);
+    searchLayout->addWidget(m_searchRegexBox);
+    searchLayout->addWidget(previousButton);
+    searchLayout->addWidget(nextButton);
+    searchLayout->addWidget(m_searchStatus);
+    searchLayout->addWidget(closeButton);
+    m_searchBar->hide();
+    layout->addWidget(m_searchBar);
+
+    connect(m_searchEdit, &QLineEdit::textChanged, this, [this]() { m_searchTimer.start(); });
+    connect(m_searchCaseBox, &QCheckBox::toggled, this, &TerminalWidget::startSearch);
+    connect(m_searchRegexBox, &QCheckBox::toggled, this, &TerminalWidget::startSearch);
+    connect(previousButton, &QToolButton::clicked, this, &TerminalWidget::findPrevious);
+    connect(nextButton, &QToolButton::clicked, this, &TerminalWidget::findNext);
+    connect(closeButton, &QToolButton::clicked, this, &TerminalWidget::hideSearchBar);
+
+    // 回放控制栏，默认隐藏
+    m_replayBar = new QWidget(this);
+    QHBoxLayout *replayLayout = new QHBoxLayout(m_replayBar);
+    replayLayout->setContentsMargins(4, 2, 4, 2);
+    m_replayPlayButton = new QToolButton(m_replayBar);
+    m_replayPlayButton->setText(tr("Play"));
+    m_replaySlider = new QSlider(Qt::Horizontal, m_replayBar);
+    m_replayTime = new QLabel(m_replayBar);
+    m_replaySpeed = new QComboBox(m_replayBar);
+    m_replaySpeed->addItem(tr("0.5x"), 0.5);
+    m_replaySpeed->addItem(tr("1x"), 1.0);
+    m_replaySpeed->addItem(tr("2x"), 2.0);
+    m_replaySpeed->addItem(tr("4x"), 4.0);
+    m_replaySpeed->addItem(tr("16x"), 16.0);
+    m_replaySpeed->addItem(tr("As fast as possible"), 0.0);
+    m_replaySpeed->setCurrentIndex(1);
+    QToolButton *replayCloseButton = new QToolButton(m_replayBar);
+    replayCloseButton->setText(tr("Close"));
+    replayLayout->addWidget(m_replayPlayButton);
+    replayLayout->addWidget(m_replaySlider, 1);
+    replayLayout->addWidget(m_replayTime);
+    replayLayout->addWidget(m_replaySpeed);
+    replayLayout->addWidget(replayCloseButton);
+    m_replayBar->hide();
+    layout->addWidget(m_replayBar);
+
+    connect(m_replayPlayButton, &QToolButton::clicked, this, &TerminalWidget::toggleReplay);
+    connect(m_replaySlider, &QSlider::valueChanged, this, [this](int value) {
+        if (m_replay) {
+            m_replay->seek(value);
+        }
+    });
+    connect(m_replaySpeed, QOverload<int>::of(&QComboBox::currentIndexChanged), this, [this]() {
+        if (m_replay) {
+            m_replay->setSpeed(m_replaySpeed->currentData().toDouble());
+        }
+    });
+    connect(replayCloseButton, &QToolButton::clicked, this, &TerminalWidget::closeReplay);
 
     // 显示初始提示符
-    QTextCursor cursor = terminalOutput->textCursor();
-    cursor.movePosition(QTextCursor::End);
-    cursor.insertText(m_currentPrompt + " ");
-    terminalOutput->setTextCursor(cursor);
+    appendToTerminal(m_currentPrompt + " ");
 
     // 设置焦点
-    terminalOutput->setFocus();
+    terminalView->setFocus();
 }
 
 void TerminalWidget::updateTerminalStyle()
 {
     // 设置字体
-    terminalOutput->setFont(terminalFont);
+    terminalView->setTerminalFont(terminalFont);
 
     // 设置颜色
-    QString styleSheet = QString(
-                             "QTextEdit { background-color: %1; color: %2; border: none; }"
-                             "QTextEdit::cursor { background-color: %2; }"
-                             ).arg(backgroundColor.name(), textColor.name());
-
-    terminalOutput->setStyleSheet(styleSheet);
+    terminalView->setDefaultColors(textColor, backgroundColor);
+    terminalView->setBaseColors(m_ansiColors);
 }
 
 bool TerminalWidget::eventFilter(QObject *obj, QEvent *event)
 {
-    if (obj == terminalOutput && event->type() == QEvent::KeyPress) {
+    if (obj == m_searchEdit && event->type() == QEvent::KeyPress) {
         QKeyEvent *keyEvent = static_cast<QKeyEvent*>(event);
+        if (keyEvent->key() == Qt::Key_Escape) {
+            hideSearchBar();
+            return true;
+        }
+        if (keyEvent->key() == Qt::Key_Return || keyEvent->key() == Qt::Key_Enter) {
+            // 输入后立即回车时先开始搜索
+            if (m_searchTimer.isActive()) {
+                startSearch();
+            } else if (keyEvent->modifiers() & Qt::ShiftModifier) {
+                findNext();
+            } else {
+                findPrevious();
+            }
+            return true;
+        }
+    }
+
+    if (obj == terminalView && event->type() == QEvent::KeyPress) {
+        QKeyEvent *keyEvent = static_cast<QKeyEvent*>(event);
+
+        // Ctrl+Shift+F 打开搜索栏（Ctrl+F 留给 shell）
+        if (keyEvent->key() == Qt::Key_F && keyEvent->modifiers() == (Qt::ControlModifier | Qt::ShiftModifier)) {
+            showSearchBar();
+            return true;
+        }
+
+        // 回放时空格键暂停或继续，其他按键忽略
+        if (m_replay) {
+            if (keyEvent->key() == Qt::Key_Space) {
+                toggleReplay();
+            }
+            return true;
+        }
 
         // 如果没有连接，忽略按键
         if (!m_connected) {
@@ -213,6 +532,29 @@ bool TerminalWidget::eventFilter(QObject *obj, QEvent *event)
         int key = keyEvent->key();
         Qt::KeyboardModifiers modifiers = keyEvent->modifiers();
 
+        // Shift+PageUp/PageDown 浏览回滚缓冲区
+        if ((modifiers & Qt::ShiftModifier) && (key == Qt::Key_PageUp || key == Qt::Key_PageDown)) {
+            terminalView->verticalScrollBar()->triggerAction(key == Qt::Key_PageUp
+                ? QAbstractSlider::SliderPageStepSub : QAbstractSlider::SliderPageStepAdd);
+            return true;
+        }
+
+        // Ctrl+Shift+C/V 复制粘贴（Ctrl+C 发给远端）
+        if (modifiers == (Qt::ControlModifier | Qt::ShiftModifier) && (key == Qt::Key_C || key == Qt::Key_V)) {
+            if (key == Qt::Key_C) {
+                copySelectedText();
+            } else {
+                pasteClipboard();
+            }
+            return true;
+        }
+
+        // 直接输入模式：按键编码成 xterm 序列发往远端，由远端 shell 编辑行、补全和回显
+        if (!localLineEditing) {
+            sendKey(keyEvent);
+            return true;
+        }
+
         // 处理回车键
         if (key == Qt::Key_Return || key == Qt::Key_Enter) {
             processCommand();
@@ -230,29 +572,31 @@ bool TerminalWidget::eventFilter(QObject *obj, QEvent *event)
 
         // 处理退格键
         if (key == Qt::Key_Backspace) {
-            // 获取当前行文本
-            QTextCursor cursor = terminalOutput->textCursor();
-            cursor.movePosition(QTextCursor::StartOfLine);
-            cursor.movePosition(QTextCursor::EndOfLine, QTextCursor::KeepAnchor);
-            QString currentLine = cursor.selectedText();
-
-            // 检查是否已经在提示符后面
-            if (currentLine == m_currentPrompt ||
-                currentLine == m_currentPrompt + " " ||
-                currentLine.length() <= m_currentPrompt.length() + 1) {
-                return true;
+            if (!m_inputLine.isEmpty()) {
+                setInputLine(m_inputLine.left(m_inputLine.length() - 1));
             }
+            return true;
         }
 
         // 处理 Ctrl+C
         if (key == Qt::Key_C && modifiers == Qt::ControlModifier) {
             SSHClient *sshClient = m_connectionThread ? m_connectionThread->getSSHClient() : nullptr;
             if (sshClient && sshClient->isConnected()) {
-                // 发送 Ctrl+C (ASCII 3)
+                // 发送 Ctrl+C (ASCII 3)，放弃尚未发送的输入
+                setInputLine(QString());
+                clearPredictions();
                 sshClient->sendData(QByteArray(1, 3));
+                recordUserInput(QByteArray(1, 3));
                 return true;
             }
         }
+
+        // 可打印字符追加到输入行
+        QString text = keyEvent->text();
+        if (!text.isEmpty() && text.at(0).isPrint() && !(modifiers & (Qt::ControlModifier | Qt::AltModifier))) {
+            setInputLine(m_inputLine + text);
+            return true;
+        }
     }
 
     return QWidget::eventFilter(obj, event);
@@ -263,10 +607,20 @@ void TerminalWidget::connectToSession(const SessionInfo &sessionInfo)
     if (m_connected) {
         disconnectFromSession();
     }
+    closeReplay();
 
     m_host = sessionInfo.host;
     m_port = sessionInfo.port;
     m_username = sessionInfo.username;
+    m_terminalType = sessionInfo.terminalType.isEmpty() ? QStringLiteral("xterm") : sessionInfo.terminalType;
+
+    // 按会话编码解码服务器输出、编码发送的命令
+    {
+        QMutexLocker locker(m_screen->mutex());
+        m_screen->setEncoding(sessionInfo.encoding);
+    }
+    QTextCodec *codec = QTextCodec::codecForName(sessionInfo.encoding.toLatin1());
+    m_remoteCodec = (codec && codec->mibEnum() != 106) ? codec : nullptr;   // 106 = UTF-8
 
     // 创建连接线程
     m_connectionThread = new SSHConnectionThread(this);
@@ -302,67 +656,122 @@ void TerminalWidget::connectToSession(const SessionInfo &sessionInfo)
     appendToTerminal(tr("Connecting to %1@%2:%3...\n").arg(sessionInfo.username).arg(sessionInfo.host).arg(sessionInfo.port));
 }
 
-void TerminalWidget::processCommand()
+void TerminalWidget::sendKey(QKeyEvent *keyEvent)
 {
-    // 获取当前行文本
-    QTextCursor cursor = terminalOutput->textCursor();
-    cursor.movePosition(QTextCursor::StartOfLine);
-    cursor.movePosition(QTextCursor::EndOfLine, QTextCursor::KeepAnchor);
-    QString currentLine = cursor.selectedText();
+    int key = keyEvent->key();
+    Qt::KeyboardModifiers modifiers = keyEvent->modifiers();
+
+    QMutexLocker locker(m_screen->mutex());
+    QByteArray bytes = TerminalKeyEncoder::encode(key, modifiers, m_screen->applicationCursorKeys());
+    bool predictionsChanged = false;
+
+    if (bytes.isEmpty()) {
+        // 普通文本按会话编码发送；Alt 组合键前加 ESC
+        QString text = keyEvent->text();
+        if (text.isEmpty() || !text.at(0).isPrint()) {
+            return;     // 单独的修饰键等
+        }
+        bytes = encodeForRemote(text);
+        if (modifiers & Qt::AltModifier) {
+            bytes.prepend('\x1b');
+            m_predictor.holdUntilOutput();
+        } else {
+            predictionsChanged = m_predictor.predict(*m_screen, text);
+        }
+    } else if (key == Qt::Key_Backspace && modifiers == Qt::NoModifier) {
+        predictionsChanged = m_predictor.retractLast();
+    } else {
+        // 光标键、Tab、回车等的结果无法预测
+        m_predictor.holdUntilOutput();
+    }
 
-    // 提取命令
-    QString command;
+    if (predictionsChanged) {
+        terminalView->setPredictions(m_predictor.cells());
+    }
+    locker.unlock();
 
-    // 多层次策略提取命令
-    bool commandExtracted = false;
+    terminalView->scrollToBottom();
+    queueInput(bytes);
+}
 
-    QRegExp promptRegex("\\[[^\\]]+@[^\\]]+\\s+[^\\]]+\\][$#]\\s*");
-    if (promptRegex.indexIn(currentLine) >= 0) {
-        QString detectedPrompt = promptRegex.cap(0);
-        int promptIndex = currentLine.indexOf(detectedPrompt);
-        int commandStart = promptIndex + detectedPrompt.length();
-        command = currentLine.mid(commandStart);
+void TerminalWidget::queueInput(const QByteArray &data)
+{
+    m_inputBuffer.append(data);
+    if (m_inputFlushTimer.isActive()) {
+        return;
+    }
 
-        // 更新当前提示符
-        commandExtracted = true;
+    // 空闲后的第一个按键立即发送，紧随其后的按键等到合并间隔结束再一起发送
+    const int coalesceMs = 5;
+    qint64 sinceLast = m_lastInputFlush.elapsed();
+    if (sinceLast >= coalesceMs) {
+        flushInput();
+    } else {
+        m_inputFlushTimer.start(coalesceMs - static_cast<int>(sinceLast));
     }
+}
 
+void TerminalWidget::flushInput()
+{
+    m_inputFlushTimer.stop();
+    m_lastInputFlush.restart();
+    if (m_inputBuffer.isEmpty()) {
+        return;
+    }
 
-    if (!commandExtracted) {
-        command = currentLine.trimmed();
+    SSHClient *sshClient = m_connectionThread ? m_connectionThread->getSSHClient() : nullptr;
+    if (sshClient && sshClient->isConnected()) {
+        sshClient->sendData(m_inputBuffer);
+        recordUserInput(m_inputBuffer);
     }
+    m_inputBuffer.clear();
+}
+
+void TerminalWidget::setLocalLineEditing(bool enabled)
+{
+    localLineEditing = enabled;
+    // 切换模式时丢弃尚未发送的本地输入行
+    setInputLine(QString());
+    historyPosition = -1;
+    saveSettings();
+}
+
+void TerminalWidget::processCommand()
+{
+    // 输入行就是命令；服务器回显后由屏幕模型显示
+    QString command = m_inputLine;
+    setInputLine(QString());
 
     qDebug() << "final command:" << command;
 
+    SSHClient *sshClient = m_connectionThread ? m_connectionThread->getSSHClient() : nullptr;
+
     // 如果命令不为空，处理它
     if (!command.isEmpty()) {
         // 添加到历史记录
         addToHistory(command);
 
-        // 添加换行
-        cursor.movePosition(QTextCursor::End);
-        cursor.insertText("\n");
-        terminalOutput->setTextCursor(cursor);
-
         // 发送命令到服务器
-        SSHClient *sshClient = m_connectionThread ? m_connectionThread->getSSHClient() : nullptr;
         if (sshClient && sshClient->isConnected()) {
             qDebug() << "Send to server command is: " << command;
-            sshClient->sendData(command.toUtf8() + "\n");
+            // 回显到达前命令继续显示在原处（带下划线）
+            QMutexLocker locker(m_screen->mutex());
+            if (m_predictor.predict(*m_screen, command)) {
+                terminalView->setPredictions(m_predictor.cells());
+            }
+            locker.unlock();
+            QByteArray data = encodeForRemote(command) + "\n";
+            sshClient->sendData(data);
+            recordUserInput(data);
         } else {
             qDebug() << "Can not connect to SSH client.";
         }
     } else {
         // 如果是空命令，只发送换行
-        SSHClient *sshClient = m_connectionThread ? m_connectionThread->getSSHClient() : nullptr;
         if (sshClient && sshClient->isConnected()) {
             sshClient->sendData(QByteArray(1, '\n'));
+            recordUserInput(QByteArray(1, '\n'));
         }
-
-        // 添加换行
-        cursor.movePosition(QTextCursor::End);
-        cursor.insertText("\n");
-        terminalOutput->setTextCursor(cursor);
     }
 }
 
@@ -374,33 +783,13 @@ void TerminalWidget::handleCommandHistoryUp()
 
     // 保存当前命令，如果是第一次按上键
     if (historyPosition == -1) {
-        // 获取当前行文本
-        QTextCursor cursor = terminalOutput->textCursor();
-        cursor.movePosition(QTextCursor::StartOfLine);
-        cursor.movePosition(QTextCursor::EndOfLine, QTextCursor::KeepAnchor);
-        QString currentLine = cursor.selectedText();
-
-        // 提取当前命令
-        if (currentLine.startsWith(m_currentPrompt + " ")) {
-            m_savedCommand = currentLine.mid(m_currentPrompt.length() + 1);
-        } else if (currentLine.startsWith(m_currentPrompt)) {
-            m_savedCommand = currentLine.mid(m_currentPrompt.length());
-        } else {
-            m_savedCommand = "";
-        }
+        m_savedCommand = m_inputLine;
     }
 
     // 移动到历史中的上一个命令
     if (historyPosition < commandHistory.size() - 1) {
         historyPosition++;
-
-        // 替换当前行
-        QTextCursor cursor = terminalOutput->textCursor();
-        cursor.movePosition(QTextCursor::StartOfLine);
-        cursor.movePosition(QTextCursor::EndOfLine, QTextCursor::KeepAnchor);
-        cursor.removeSelectedText();
-        cursor.insertText(m_currentPrompt + " " + commandHistory[commandHistory.size() - 1 - historyPosition]);
-        terminalOutput->setTextCursor(cursor);
+        setInputLine(commandHistory[commandHistory.size() - 1 - historyPosition]);
     }
 }
 
@@ -410,29 +799,29 @@ void TerminalWidget::handleCommandHistoryDown()
         return;
     }
 
-    QTextCursor cursor = terminalOutput->textCursor();
-    cursor.movePosition(QTextCursor::StartOfLine);
-    cursor.movePosition(QTextCursor::EndOfLine, QTextCursor::KeepAnchor);
-    cursor.removeSelectedText();
-
     if (historyPosition > 0) {
         historyPosition--;
-        cursor.insertText(m_currentPrompt + " " + commandHistory[commandHistory.size() - 1 - historyPosition]);
+        setInputLine(commandHistory[commandHistory.size() - 1 - historyPosition]);
     } else {
         // 回到保存的命令
         historyPosition = -1;
-        cursor.insertText(m_currentPrompt + " " + m_savedCommand);
+        setInputLine(m_savedCommand);
     }
-
-    terminalOutput->setTextCursor(cursor);
 }
 
 
 void TerminalWidget::handleSSHData(const QByteArray &data)
 {
-    // First check for ZMODEM protocol - but only if not already active
-    if (!m_zmodemActive && !m_zmodemUploadStarted && detectZmodem(data)) {
+    // 只有解析线程转交的原始数据会到这里；转交已结束时排队的数据交还给解析线程
+    if (!m_parserThread->isPassthrough()) {
+        m_parserThread->enqueue(data);
+        return;
+    }
+
+    // First data after the parser thread detected a ZMODEM request
+    if (!m_zmodemActive && !m_zmodemUploadStarted) {
         m_zmodemActive = true; // Set flag immediately to prevent multiple detections
+        m_zmodemBuffer.append(data);
         handleZmodemDetected();
         return;
     }
@@ -450,301 +839,97 @@ void TerminalWidget::handleSSHData(const QByteArray &data)
         return;
     }
     
-    QString text = QString::fromUtf8(data);
-    qDebug() << "Received data from SSH: " << text;
-
-    // 检查是否是命令回显（以命令和\r\n开头）
-    static QString lastCommand = "";
-    static bool expectingOutput = false;
-
-    if (expectingOutput && text.startsWith(lastCommand)) {
-        // Remove just the command part (not requiring \r\n which might be split in packets)
-        text = text.mid(lastCommand.length());
+}
 
-        // If there's a leading \r\n, skip it too
-        if (text.startsWith("\r\n")) {
-            text = text.mid(2);
-        }
+void TerminalWidget::scheduleRender()
+{
+    // 标签页隐藏时不重绘，损坏区域留在屏幕模型中，显示时一次补齐
+    if (!isVisible() || m_renderTimer.isActive()) {
+        return;
+    }
 
-        expectingOutput = false;
+    // 距上一帧已超过一个帧间隔（如键盘回显）则立即绘制，否则等到下一帧
+    qint64 sinceLast = m_lastRender.elapsed();
+    if (sinceLast >= m_renderTimer.interval()) {
+        renderFrame();
+    } else {
+        m_renderTimer.start(m_renderTimer.interval() - static_cast<int>(sinceLast));
     }
-    else if (text.endsWith("\n$ ") || text.endsWith("\n# ")) {
-        // Get the command from the prompt, more reliably
-        QRegularExpression promptRegex("\\[(.*?)\\]# $");
-        QRegularExpressionMatch match = promptRegex.match(text);
+}
 
-        if (match.hasMatch()) {
-            // Don't store the entire text as lastCommand, just the command itself
-            expectingOutput = true;
-            // Extract just the command, not the whole prompt
-            lastCommand = match.captured(1);
-        } else {
-            expectingOutput = false;
-        }
+void TerminalWidget::handleScreenChanged()
+{
+    // 隐藏时不确认：解析线程照常更新屏幕模型，但不再唤醒界面线程，显示时再确认
+    if (!isVisible()) {
+        return;
     }
 
-    QTextCursor cursor = terminalOutput->textCursor();
-    cursor.movePosition(QTextCursor::End);
-
-    QTextCharFormat defaultFormat = cursor.charFormat();
-    QTextCharFormat currentFormat = defaultFormat;
-    QColor textColor = this->textColor;
-    QColor backgroundColor = this->backgroundColor; // 添加默认背景色
-
-    int lastPos = 0;
-
-    // 更完整的ANSI转义序列正则表达式
-    QRegularExpression ansiRegex(
-        // ESC序列的开始
-        "\\x1B"
-        // 后面跟着的可能模式
-        "("
-        // CSI序列 (Control Sequence Introducer) - ESC [
-        "\\["
-        // 参数部分 - 可选的数字序列，用分号分隔
-        "(?:"
-        "[\\d;:=?]+"
-        ")?"
-        // 中间字符 - 可选
-        "(?:"
-        "[ !\"#$%&'()*+,\\-./]+"
-        ")?"
-        // 终止字符 - 一个在 @ 到 ~ 范围内的字符
-        "[@A-Za-z`-~]"
-        "|"
-        // OSC序列 (Operating System Command) - ESC ]
-        "\\]"
-        // 参数和字符串内容
-        "(?:"
-        "\\d+;.*?"
-        ")"
-        // OSC终止 (BEL或ESC\)
-        "(?:"
-        "\\x07|\\x1B\\\\"
-        ")"
-        "|"
-        // 字符集选择和其他简单序列
-        "\\([0-9A-Za-z]"  // 字符集选择
-        "|"
-        // 单字符序列
-        "[A-Za-z<=>]"
-        "|"
-        // 可能的其他控制序列
-        "\\]\\d+;.*?(?:\\x07|\\x1B\\\\)"  // 通用OSC
-        "|"
-        // 任何其他以ESC开始的序列
-        ".[\\x20-\\x7E]*"
-        ")"
-        );
+    // 先确认再绘制：绘制期间解析线程产生的新变化会再次通知
+    m_parserThread->acknowledgeScreenChange();
+    scheduleRender();
+}
 
-    QRegularExpressionMatchIterator it = ansiRegex.globalMatch(text);
+void TerminalWidget::renderFrame()
+{
+    m_renderTimer.stop();
+    m_lastRender.restart();
 
-    while (it.hasNext()) {
-        QRegularExpressionMatch match = it.next();
-        int start = match.capturedStart();
-        int end = match.capturedEnd();
-        QString captured = match.captured(0);
+    // 预测要在视图清除损坏信息之前核对，整屏滚动会移动它们的位置
+    QMutexLocker locker(m_screen->mutex());
+    if (m_predictor.reconcile(*m_screen)) {
+        terminalView->setPredictions(m_predictor.cells());
+    }
+    terminalView->updateDamage();
+}
 
-        // 输出匹配到的ANSI之前的普通文本
-        QString plainText = text.mid(lastPos, start - lastPos);
-        if (!plainText.isEmpty()) {
-            cursor.insertText(plainText, currentFormat);
-        }
+void TerminalWidget::setPredictiveEcho(bool enabled)
+{
+    predictiveEcho = enabled;
+    {
+        QMutexLocker locker(m_screen->mutex());
+        m_predictor.setEnabled(enabled);
+    }
+    terminalView->setPredictions(QVector<TerminalPredictedCell>());
+    saveSettings();
+}
 
-        // 处理特殊的ANSI序列
-        if (captured.startsWith("\x1B[?")) {
-            // 处理私有模式设置，如 \x1B[?25l 隐藏光标
-            lastPos = end;
-            continue;
-        } else if (captured == "\x1B=" || captured == "\x1B>") {
-            // 处理应用键盘模式
-            lastPos = end;
-            continue;
-        } else if (captured == "\x1B[H") {
-            // 光标移动到Home位置
-            // 在简单实现中可以等同于清屏
-            terminalOutput->clear();
-            cursor = terminalOutput->textCursor();
-            lastPos = end;
-            continue;
-        } else if (captured == "\x1B[2J") {
-            // 清屏
-            terminalOutput->clear();
-            cursor = terminalOutput->textCursor();
-            lastPos = end;
-            continue;
-        } else if (captured == "\x1B[K") {
-            // 清除从光标到行尾的内容
-            // 在简化实现中我们忽略这个
-            lastPos = end;
-            continue;
-        } else if (captured.startsWith("\x1B[") && captured.endsWith("m")) {
-            // 处理SGR (Select Graphic Rendition) 参数
-            QString paramPart = captured.mid(2, captured.length() - 3);
-            QStringList codes = paramPart.isEmpty() ? QStringList("0") : paramPart.split(";");
-
-            for (const QString &code : codes) {
-                bool ok;
-                int value = code.toInt(&ok);
-                if (!ok && code.isEmpty()) {
-                    value = 0;  // \x1B[m 等同于 \x1B[0m
-                }
-
-                switch (value) {
-                    case 0: // 重置所有属性
-                        currentFormat = defaultFormat;
-                        textColor = this->textColor;
-                        backgroundColor = this->backgroundColor;
-                        currentFormat.setForeground(textColor);
-                        currentFormat.setBackground(backgroundColor);
-                        currentFormat.setFontWeight(QFont::Normal);
-                        currentFormat.setFontItalic(false);
-                        currentFormat.setFontUnderline(false);
-                        break;
-                    case 1: // 加粗
-                        currentFormat.setFontWeight(QFont::Bold);
-                        break;
-                    case 3: // 斜体
-                        currentFormat.setFontItalic(true);
-                        break;
-                    case 4: // 下划线
-                        currentFormat.setFontUnderline(true);
-                        break;
-                    case 7: // 反显
-                    {
-                        QColor temp = textColor;
-                        textColor = backgroundColor.isValid() ? backgroundColor : this->backgroundColor;
-                        backgroundColor = temp;
-                        currentFormat.setForeground(textColor);
-                        currentFormat.setBackground(backgroundColor);
-                        break;
-                    }
-                    case 22: // 取消加粗
-                        currentFormat.setFontWeight(QFont::Normal);
-                        break;
-                    case 23: // 取消斜体
-                        currentFormat.setFontItalic(false);
-                        break;
-                    case 24: // 取消下划线
-                        currentFormat.setFontUnderline(false);
-                        break;
-                    case 27: // 取消反显
-                    {
-                        QColor temp = backgroundColor;
-                        backgroundColor = textColor;
-                        textColor = temp;
-                        currentFormat.setForeground(textColor);
-                        currentFormat.setBackground(backgroundColor);
-                        break;
-                    }
-                    case 39: // 默认前景色
-                        textColor = this->textColor;
-                        currentFormat.setForeground(textColor);
-                        break;
-                    case 49: // 默认背景色
-                        backgroundColor = this->backgroundColor;
-                        currentFormat.setBackground(backgroundColor);
-                        break;
-
-                        // 标准前景色 (30-37)
-                    case 30: case 31: case 32: case 33: case 34: case 35: case 36: case 37:
-                        textColor = G_colorMappings[value - 30].col;
-                        currentFormat.setForeground(textColor);
-                        break;
-
-                        // 标准背景色 (40-47)
-                    case 40: case 41: case 42: case 43: case 44: case 45: case 46: case 47:
-                        backgroundColor = G_colorMappings[value - 40].col;
-                        currentFormat.setBackground(backgroundColor);
-                        break;
-
-                        // 亮色前景 (90-97)
-                    case 90: case 91: case 92: case 93: case 94: case 95: case 96: case 97:
-                        textColor = G_colorMappings[value - 90 + 8].col; // 亮色索引偏移8
-                        currentFormat.setForeground(textColor);
-                        break;
-
-                        // 亮色背景 (100-107)
-                    case 100: case 101: case 102: case 103: case 104: case 105: case 106: case 107:
-                        backgroundColor = G_colorMappings[value - 100 + 8].col; // 亮色索引偏移8
-                        currentFormat.setBackground(backgroundColor);
-                        break;
-
-                        // 8位颜色支持 (38;5;n 和 48;5;n)
-                    case 38:
-                        if (codes.size() > 2 && codes[1] == "5") {
-                            int colorCode = codes[2].toInt(&ok);
-                            if (ok && colorCode >= 0 && colorCode < 256) {
-                                // 转换8位颜色到RGB
-                                if (colorCode < 16) {
-                                    // 使用基本16色
-                                    textColor = G_colorMappings[colorCode % 16].col;
-                                } else if (colorCode < 232) {
-                                    // 使用6x6x6色彩立方体
-                                    int r = (colorCode - 16) / 36 * 51;
-                                    int g = ((colorCode - 16) % 36) / 6 * 51;
-                                    int b = ((colorCode - 16) % 6) * 51;
-                                    textColor = QColor(r, g, b);
-                                } else {
-                                    // 使用灰度色调
-                                    int gray = (colorCode - 232) * 10 + 8;
-                                    textColor = QColor(gray, gray, gray);
-                                }
-                                currentFormat.setForeground(textColor);
-                            }
-                        }
-                        break;
-                    case 48:
-                        if (codes.size() > 2 && codes[1] == "5") {
-                            int colorCode = codes[2].toInt(&ok);
-                            if (ok && colorCode >= 0 && colorCode < 256) {
-                                // 转换8位颜色到RGB
-                                if (colorCode < 16) {
-                                    // 使用基本16色
-                                    backgroundColor = G_colorMappings[colorCode % 16].col;
-                                } else if (colorCode < 232) {
-                                    // 使用6x6x6色彩立方体
-                                    int r = (colorCode - 16) / 36 * 51;
-                                    int g = ((colorCode - 16) % 36) / 6 * 51;
-                                    int b = ((colorCode - 16) % 6) * 51;
-                                    backgroundColor = QColor(r, g, b);
-                                } else {
-                                    // 使用灰度色调
-                                    int gray = (colorCode - 232) * 10 + 8;
-                                    backgroundColor = QColor(gray, gray, gray);
-                                }
-                                currentFormat.setBackground(backgroundColor);
-                            }
-                        }
-                        break;
-
-                    default:
-                        qDebug() << "Unhandled ANSI code:" << value;
-                        break;
-                }
-            }
-            lastPos = end;
-        } else if (captured.startsWith("\x1B]0;") && captured.endsWith("\x07")) {
-            // 设置终端标题
-            QString title = captured.mid(4, captured.length() - 5);
-            // 如果需要，这里可以发出信号更新窗口标题
-            // emit titleChanged(title);
-            lastPos = end;
-        } else {
-            // 其他未处理的ANSI序列
-            qDebug() << "Unhandled ANSI sequence:" << captured;
-            lastPos = end;
-        }
+void TerminalWidget::clearPredictions()
+{
+    QMutexLocker locker(m_screen->mutex());
+    m_predictor.clear();
+    terminalView->setPredictions(QVector<TerminalPredictedCell>());
+}
+
+void TerminalWidget::showEvent(QShowEvent *event)
+{
+    QWidget::showEvent(event);
+    // 休眠时释放的字形缓存在下次绘制时重建，移入临时文件的历史在滚动到时才读回
+    m_hibernateTimer.stop();
+    m_hibernated = false;
+    m_parserThread->acknowledgeScreenChange();
+    renderFrame();
+}
+
+void TerminalWidget::hideEvent(QHideEvent *event)
+{
+    QWidget::hideEvent(event);
+    if (hibernateMinutes > 0 && !m_hibernated) {
+        m_hibernateTimer.start(hibernateMinutes * 60 * 1000);
     }
+}
 
-    // 处理剩余的普通文本
-    QString remainingText = text.mid(lastPos);
-    if (!remainingText.isEmpty()) {
-        cursor.insertText(remainingText, currentFormat);
+void TerminalWidget::hibernate()
+{
+    if (isVisible() || m_hibernated) {
+        return;
     }
 
-    terminalOutput->setTextCursor(cursor);
-    terminalOutput->ensureCursorVisible();
+    {
+        QMutexLocker locker(m_screen->mutex());
+        m_screen->compactScrollback();
+    }
+    terminalView->releaseCaches();
+    m_hibernated = true;
 }
 
 
@@ -766,13 +951,15 @@ void TerminalWidget::handleSSHDisconnected()
     m_currentPrompt = "> ";
 
     // 显示提示符
-    QTextCursor cursor = terminalOutput->textCursor();
-    cursor.movePosition(QTextCursor::End);
-    cursor.insertText("\n" + m_currentPrompt + " ");
-    terminalOutput->setTextCursor(cursor);
+    appendToTerminal("\n" + m_currentPrompt + " ");
+
+    cancelPaste();
+    m_sessionLog->stop();
+    m_recorder->stop();
 
     // 更新连接状态
     m_connected = false;
+    clearPredictions();
 }
 
 void TerminalWidget::handleSSHConnected()
@@ -790,14 +977,25 @@ void TerminalWidget::handleConnectionEstablished()
     SSHClient *sshClient = m_connectionThread ? m_connectionThread->getSSHClient() : nullptr;
     if (sshClient) {
         // 连接信号
-        connect(sshClient, &SSHClient::dataReceived, this, &TerminalWidget::handleSSHData);
+        // 在会话线程中直接排入解析队列，不经过界面线程
+        connect(sshClient, &SSHClient::dataReceived, m_parserThread, &TerminalParserThread::enqueue, Qt::DirectConnection);
+        connect(sshClient, &SSHClient::dataReceived, m_sessionLog, &TerminalLogger::enqueue, Qt::DirectConnection);
+        connect(sshClient, &SSHClient::dataReceived, m_recorder, &TerminalLogger::enqueue, Qt::DirectConnection);
         connect(sshClient, &SSHClient::error, this, &TerminalWidget::handleSSHError);
         connect(sshClient, &SSHClient::disconnected, this, &TerminalWidget::handleSSHDisconnected);
         connect(sshClient, &SSHClient::connected, this, &TerminalWidget::handleSSHConnected);
-
-        // 启动shell
-        sshClient->startShell();
+        connect(sshClient, &SSHClient::dataWritten, this, &TerminalWidget::pumpPaste);
+
+        // 启动shell，PTY 尺寸取当前字符网格
+        int columns, rows;
+        {
+            QMutexLocker locker(m_screen->mutex());
+            columns = m_screen->columns();
+            rows = m_screen->rows();
+        }
+        sshClient->startShell(m_terminalType, columns, rows);
     }
+    startSessionLog();
 }
 
 void TerminalWidget::handleConnectionFailed(const QString &errorMessage)
@@ -805,10 +1003,7 @@ void TerminalWidget::handleConnectionFailed(const QString &errorMessage)
     appendToTerminal("Connection failed: " + errorMessage + "\n");
 
     // 显示提示符
-    QTextCursor cursor = terminalOutput->textCursor();
-    cursor.movePosition(QTextCursor::End);
-    cursor.insertText("\n" + m_currentPrompt + " ");
-    terminalOutput->setTextCursor(cursor);
+    appendToTerminal("\n" + m_currentPrompt + " ");
 }
 
 void TerminalWidget::disconnectFromSession()
@@ -827,6 +1022,7 @@ void TerminalWidget::disconnectFromSession()
         m_zmodemActive = false;
         m_zmodemUploadStarted = false;
         m_zmodemBuffer.clear();
+        m_parserThread->setPassthrough(false);
     }
 
     // 断开SSH连接
@@ -844,14 +1040,13 @@ void TerminalWidget::disconnectFromSession()
         }
 
         // 停止线程
-        if (m_connectionThread->isRunning()) {
-            m_connectionThread->terminate();
-            m_connectionThread->wait();
-        }
+        m_connectionThread->stop();
 
         delete m_connectionThread;
         m_connectionThread = nullptr;
     }
+    m_sessionLog->stop();
+    m_recorder->stop();
 
     // 更新连接状态
     m_connected = false;
@@ -863,10 +1058,7 @@ void TerminalWidget::disconnectFromSession()
     m_currentPrompt = "> ";
 
     // 显示提示符
-    QTextCursor cursor = terminalOutput->textCursor();
-    cursor.movePosition(QTextCursor::End);
-    cursor.insertText("\n" + m_currentPrompt + " ");
-    terminalOutput->setTextCursor(cursor);
+    appendToTerminal("\n" + m_currentPrompt + " ");
 }
 
 void TerminalWidget::showContextMenu(const QPoint &pos)
@@ -877,18 +1069,48 @@ void TerminalWidget::showContextMenu(const QPoint &pos)
     QAction *pasteAction = menu.addAction(tr("Paste"));
     menu.addSeparator();
     QAction *clearAction = menu.addAction(tr("Clear"));
+    QAction *findAction = menu.addAction(tr("Find...\tCtrl+Shift+F"));
     menu.addSeparator();
     QAction *fontAction = menu.addAction(tr("Change Font..."));
     QAction *bgColorAction = menu.addAction(tr("Change Background Color..."));
     QAction *textColorAction = menu.addAction(tr("Change Text Color..."));
+    menu.addSeparator();
+    QAction *scrollbackAction = menu.addAction(tr("Scrollback Settings..."));
+    QAction *sessionLogAction = menu.addAction(tr("Session Log Settings..."));
+    QAction *highlightAction = menu.addAction(tr("Highlight Rules..."));
+    menu.addSeparator();
+    QAction *recordAction = menu.addAction(m_recorder->isLogging() ? tr("Stop Recording") : tr("Record Session..."));
+    recordAction->setEnabled(m_connected || m_recorder->isLogging());
+    QAction *recordInputAction = menu.addAction(tr("Record Keyboard Input"));
+    recordInputAction->setCheckable(true);
+    recordInputAction->setChecked(recordInput);
+    QAction *replayAction = menu.addAction(tr("Replay Recording..."));
+    replayAction->setEnabled(!m_connected && !m_replay);
+    menu.addSeparator();
+    QAction *lineEditAction = menu.addAction(tr("Local Line Editing"));
+    lineEditAction->setCheckable(true);
+    lineEditAction->setChecked(localLineEditing);
+    QAction *predictAction = menu.addAction(tr("Predictive Echo"));
+    predictAction->setCheckable(true);
+    predictAction->setChecked(predictiveEcho);
+    QString usage;
+    {
+        QMutexLocker locker(m_screen->mutex());
+        usage = tr("Scrollback: %1 lines, %2 in memory, %3 on disk")
+                .arg(m_screen->scrollbackCount())
+                .arg(formatMemory(m_screen->scrollbackMemoryUsage()))
+                .arg(formatMemory(m_screen->scrollbackDiskUsage()));
+    }
+    QAction *usageAction = menu.addAction(usage);
+    usageAction->setEnabled(false);
 
     // 只有在有选中文本时才启用复制
-    copyAction->setEnabled(terminalOutput->textCursor().hasSelection());
+    copyAction->setEnabled(terminalView->hasSelection());
 
     // 只有在有剪贴板内容时才启用粘贴
     pasteAction->setEnabled(!QApplication::clipboard()->text().isEmpty());
 
-    QAction *selectedAction = menu.exec(terminalOutput->mapToGlobal(pos));
+    QAction *selectedAction = menu.exec(terminalView->viewport()->mapToGlobal(pos));
 
     if (selectedAction == copyAction) {
         copySelectedText();
@@ -896,38 +1118,206 @@ void TerminalWidget::showContextMenu(const QPoint &pos)
         pasteClipboard();
     } else if (selectedAction == clearAction) {
         clearTerminal();
+    } else if (selectedAction == findAction) {
+        showSearchBar();
     } else if (selectedAction == fontAction) {
         changeFont();
     } else if (selectedAction == bgColorAction) {
         changeBackgroundColor();
     } else if (selectedAction == textColorAction) {
         changeTextColor();
+    } else if (selectedAction == scrollbackAction) {
+        editScrollbackSettings();
+    } else if (selectedAction == sessionLogAction) {
+        editSessionLogSettings();
+    } else if (selectedAction == highlightAction) {
+        editHighlightRules();
+    } else if (selectedAction == recordAction) {
+        if (m_recorder->isLogging()) {
+            stopRecording();
+        } else {
+            startRecording();
+        }
+    } else if (selectedAction == recordInputAction) {
+        recordInput = recordInputAction->isChecked();
+        saveSettings();
+    } else if (selectedAction == replayAction) {
+        openReplay();
+    } else if (selectedAction == lineEditAction) {
+        setLocalLineEditing(lineEditAction->isChecked());
+    } else if (selectedAction == predictAction) {
+        setPredictiveEcho(predictAction->isChecked());
     }
 }
 
 void TerminalWidget::copySelectedText()
 {
-    terminalOutput->copy();
+    QString text = terminalView->selectedText();
+    if (!text.isEmpty()) {
+        QApplication::clipboard()->setText(text);
+    }
 }
 
 void TerminalWidget::pasteClipboard()
 {
     QString clipboardText = QApplication::clipboard()->text();
-    if (!clipboardText.isEmpty()) {
-        // 将剪贴板内容插入到当前光标位置
-        terminalOutput->insertPlainText(clipboardText);
+    if (clipboardText.isEmpty()) {
+        return;
+    }
+
+    clipboardText.replace("\r\n", "\n");
+
+    if (!localLineEditing) {
+        if (!m_connected) {
+            return;
+        }
+        // 直接输入模式：换行按回车键发送；远端开启括号粘贴时加上标记，避免逐行执行
+        clipboardText.replace('\n', '\r');
+        bool bracketed;
+        {
+            QMutexLocker locker(m_screen->mutex());
+            bracketed = m_screen->bracketedPaste();
+        }
+        if (bracketed) {
+            // 去掉剪贴板中的 ESC：内容里的 ESC[201~ 会提前结束括号粘贴，之后的文本将被当作按键执行
+            clipboardText.remove(QChar(0x1b));
+        }
+        QByteArray data = encodeForRemote(clipboardText);
+        if (bracketed) {
+            data = "\x1b[200~" + data + "\x1b[201~";
+        }
+        terminalView->scrollToBottom();
+
+        if (m_pasteData.isEmpty() && data.size() <= PasteChunkBytes) {
+            queueInput(data);
+            return;
+        }
+
+        // 先发出之前的按键，再按写队列的进度分块发送
+        flushInput();
+        m_pasteData.append(data);
+        m_pasteBracketed = bracketed;
+        if (!m_pasteProgress && m_pasteData.size() > LargePasteBytes) {
+            m_pasteProgress = new QProgressDialog(tr("Pasting..."), tr("Cancel"), 0, m_pasteData.size(), this);
+            m_pasteProgress->setWindowModality(Qt::NonModal);
+            m_pasteProgress->setMinimumDuration(500);
+            m_pasteProgress->setAutoClose(false);
+            m_pasteProgress->setAutoReset(false);
+            connect(m_pasteProgress, &QProgressDialog::canceled, this, &TerminalWidget::cancelPaste);
+        } else if (m_pasteProgress) {
+            m_pasteProgress->setMaximum(m_pasteData.size());
+        }
+        pumpPaste();
+        return;
+    }
+
+    // 多行内容逐行作为命令执行，最后一行留在输入行中
+    QStringList lines = clipboardText.split('\n');
+    for (int i = 0; i < lines.size() - 1; ++i) {
+        setInputLine(m_inputLine + lines.at(i));
+        processCommand();
+    }
+    setInputLine(m_inputLine + lines.last());
+}
+
+void TerminalWidget::sendWindowSize()
+{
+    SSHClient *sshClient = m_connectionThread ? m_connectionThread->getSSHClient() : nullptr;
+    if (!m_connected || !sshClient || !sshClient->isConnected()) {
+        return;
+    }
+
+    int columns, rows;
+    {
+        QMutexLocker locker(m_screen->mutex());
+        columns = m_screen->columns();
+        rows = m_screen->rows();
+    }
+    sshClient->resizePty(columns, rows);
+    m_recorder->recordResize(columns, rows);
+}
+
+void TerminalWidget::pumpPaste()
+{
+    if (m_pasteData.isEmpty()) {
+        return;
+    }
+
+    SSHClient *sshClient = m_connectionThread ? m_connectionThread->getSSHClient() : nullptr;
+    if (!sshClient || !sshClient->isConnected()) {
+        cancelPaste();
+        return;
+    }
+
+    // 未写入通道的数据保持在一个窗口以内：内存不随粘贴大小增长，按键也不会排在几 MB 数据之后
+    while (m_pasteOffset < m_pasteData.size() && sshClient->pendingWriteBytes() < PasteWindowBytes) {
+        int size = qMin(PasteChunkBytes, m_pasteData.size() - m_pasteOffset);
+        QByteArray chunk = m_pasteData.mid(m_pasteOffset, size);
+        sshClient->sendData(chunk);
+        recordUserInput(chunk);
+        m_pasteOffset += size;
+    }
+
+    if (m_pasteProgress) {
+        m_pasteProgress->setValue(m_pasteOffset);
+    }
+
+    if (m_pasteOffset >= m_pasteData.size()) {
+        m_pasteData.clear();
+        m_pasteOffset = 0;
+        if (m_pasteProgress) {
+            m_pasteProgress->deleteLater();
+            m_pasteProgress = nullptr;
+        }
+    }
+}
+
+void TerminalWidget::cancelPaste()
+{
+    if (m_pasteData.isEmpty()) {
+        return;
+    }
+
+    // 已发出开始标记时补发结束标记，远端程序才会退出粘贴状态
+    bool sendEndMarker = m_pasteBracketed && m_pasteOffset > 0 && m_pasteOffset < m_pasteData.size();
+    m_pasteData.clear();
+    m_pasteOffset = 0;
+    if (m_pasteProgress) {
+        m_pasteProgress->deleteLater();
+        m_pasteProgress = nullptr;
+    }
+
+    SSHClient *sshClient = m_connectionThread ? m_connectionThread->getSSHClient() : nullptr;
+    if (sendEndMarker && sshClient && sshClient->isConnected()) {
+        sshClient->sendData("\x1b[201~");
+        recordUserInput("\x1b[201~");
     }
 }
 
 void TerminalWidget::clearTerminal()
 {
-    terminalOutput->clear();
+    // 清除屏幕和回滚缓冲区，光标回到左上角；搜索结果随之失效
+    stopSearch();
+    terminalView->clearSearchMatches();
+    m_searchStatus->clear();
+    {
+        QMutexLocker locker(m_screen->mutex());
+        m_screen->clearScrollback();
+        m_screen->feed("\x1b[2J\x1b[H", 7);
+    }
+    clearPredictions();
+    terminalView->clearSelection();
 
-    // 显示提示符
-    QTextCursor cursor = terminalOutput->textCursor();
-    cursor.movePosition(QTextCursor::End);
-    cursor.insertText(m_currentPrompt + " ");
-    terminalOutput->setTextCursor(cursor);
+    SSHClient *sshClient = m_connectionThread ? m_connectionThread->getSSHClient() : nullptr;
+    if (m_connected && sshClient && sshClient->isConnected()) {
+        // Ctrl+L 让 shell 重新显示提示符
+        sshClient->sendData(QByteArray(1, '\x0c'));
+        recordUserInput(QByteArray(1, '\x0c'));
+        scheduleRender();
+    } else {
+        // 显示提示符
+        appendToTerminal(m_currentPrompt + " ");
+    }
 }
 
 void TerminalWidget::changeFont()
@@ -961,6 +1351,670 @@ void TerminalWidget::changeTextColor()
     }
 }
 
+void TerminalWidget::editScrollbackSettings()
+{
+    QDialog dialog(this);
+    dialog.setWindowTitle(tr("Scrollback Settings"));
+    QFormLayout *formLayout = new QFormLayout(&dialog);
+
+    QSpinBox *linesBox = new QSpinBox(&dialog);
+    linesBox->setRange(0, 10000000);
+    linesBox->setSingleStep(1000);
+    linesBox->setSuffix(tr(" lines"));
+    linesBox->setValue(scrollbackLines);
+
+    QSpinBox *memoryBox = new QSpinBox(&dialog);
+    memoryBox->setRange(1, 65536);
+    memoryBox->setSuffix(tr(" MB"));
+    memoryBox->setValue(scrollbackMemoryMB);
+
+    QSpinBox *globalBox = new QSpinBox(&dialog);
+    globalBox->setRange(0, 65536);
+    globalBox->setSuffix(tr(" MB"));
+    globalBox->setSpecialValueText(tr("Unlimited"));
+    globalBox->setValue(scrollbackGlobalMemoryMB);
+
+    QCheckBox *spillBox = new QCheckBox(tr("Keep older lines compressed in a temporary file"), &dialog);
+    spillBox->setChecked(scrollbackSpill);
+    QCheckBox *indexBox = new QCheckBox(tr("Index those lines for faster search"), &dialog);
+    indexBox->setChecked(scrollbackSearchIndex);
+    indexBox->setEnabled(scrollbackSpill);
+    connect(spillBox, &QCheckBox::toggled, indexBox, &QCheckBox::setEnabled);
+
+    QSpinBox *hibernateBox = new QSpinBox(&dialog);
+    hibernateBox->setRange(0, 24 * 60);
+    hibernateBox->setSuffix(tr(" min"));
+    hibernateBox->setSpecialValueText(tr("Never"));
+    hibernateBox->setValue(hibernateMinutes);
+
+    formLayout->addRow(tr("Lines per tab:"), linesBox);
+    formLayout->addRow(tr("Memory per tab:"), memoryBox);
+    formLayout->addRow(tr("Memory for all tabs:"), globalBox);
+    formLayout->addRow(spillBox);
+    formLayout->addRow(indexBox);
+    formLayout->addRow(tr("Compact hidden tab after:"), hibernateBox);
+    QMutexLocker usageLocker(m_screen->mutex());
+    formLayout->addRow(tr("In use:"), new QLabel(tr("%1 in this tab, %2 in all tabs, %3 on disk")
+                                                 .arg(formatMemory(m_screen->scrollbackMemoryUsage()))
+                                                 .arg(formatMemory(TerminalScrollback::globalMemoryUsage()))
+                                                 .arg(formatMemory(m_screen->scrollbackDiskUsage())), &dialog));
+    usageLocker.unlock();
+
+    QDialogButtonBox *buttons = new QDialogButtonBox(QDialogButtonBox::Ok | QDialogButtonBox::Cancel, &dialog);
+    connect(buttons, &QDialogButtonBox::accepted, &dialog, &QDialog::accept);
+    connect(buttons, &QDialogButtonBox::rejected, &dialog, &QDialog::reject);
+    formLayout->addRow(buttons);
+
+    if (dialog.exec() != QDialog::Accepted) {
+        return;
+    }
+
+    scrollbackLines = linesBox->value();
+    scrollbackMemoryMB = memoryBox->value();
+    scrollbackGlobalMemoryMB = globalBox->value();
+    scrollbackSpill = spillBox->isChecked();
+    scrollbackSearchIndex = indexBox->isChecked();
+    hibernateMinutes = hibernateBox->value();
+    applyScrollbackLimits();
+    saveSettings();
+}
+
+void TerminalWidget::applyScrollbackLimits()
+{
+    TerminalScrollback::setGlobalLimit(qint64(scrollbackGlobalMemoryMB) * 1024 * 1024);
+    {
+        QMutexLocker locker(m_screen->mutex());
+        m_screen->setScrollbackSpill(scrollbackSpill);
+        m_screen->setScrollbackSearchIndex(scrollbackSearchIndex);
+        m_screen->setScrollbackLimits(scrollbackLines, qint64(scrollbackMemoryMB) * 1024 * 1024);
+    }
+    scheduleRender();
+}
+
+void TerminalWidget::editSessionLogSettings()
+{
+    QDialog dialog(this);
+    dialog.setWindowTitle(tr("Session Log Settings"));
+    QFormLayout *formLayout = new QFormLayout(&dialog);
+
+    QCheckBox *enableBox = new QCheckBox(tr("Log the output of sessions to files"), &dialog);
+    enableBox->setChecked(sessionLog);
+
+    QLineEdit *directoryEdit = new QLineEdit(QDir::toNativeSeparators(sessionLogDirectory), &dialog);
+    QToolButton *browseButton = new QToolButton(&dialog);
+    browseButton->setText("...");
+    connect(browseButton, &QToolButton::clicked, &dialog, [this, &dialog, directoryEdit]() {
+        QString directory = QFileDialog::getExistingDirectory(&dialog, tr("Log Directory"), directoryEdit->text());
+        if (!directory.isEmpty()) {
+            directoryEdit->setText(QDir::toNativeSeparators(directory));
+        }
+    });
+    QHBoxLayout *directoryLayout = new QHBoxLayout;
+    directoryLayout->addWidget(directoryEdit);
+    directoryLayout->addWidget(browseButton);
+
+    QComboBox *formatCombo = new QComboBox(&dialog);
+    formatCombo->addItem(tr("Plain text"));
+    formatCombo->addItem(tr("Raw output (with escape sequences)"));
+    formatCombo->setCurrentIndex(sessionLogRaw ? 1 : 0);
+
+    QCheckBox *timestampBox = new QCheckBox(tr("Start each line with a timestamp"), &dialog);
+    timestampBox->setChecked(sessionLogTimestamps);
+
+    QSpinBox *sizeBox = new QSpinBox(&dialog);
+    sizeBox->setRange(0, 65536);
+    sizeBox->setSuffix(tr(" MB"));
+    sizeBox->setSpecialValueText(tr("No limit"));
+    sizeBox->setValue(sessionLogMaxMB);
+
+    QSpinBox *ageBox = new QSpinBox(&dialog);
+    ageBox->setRange(0, 24 * 30);
+    ageBox->setSuffix(tr(" h"));
+    ageBox->setSpecialValueText(tr("Never"));
+    ageBox->setValue(sessionLogRotateHours);
+
+    QCheckBox *compressBox = new QCheckBox(tr("Compress (gzip)"), &dialog);
+    compressBox->setChecked(sessionLogCompress);
+
+    formLayout->addRow(enableBox);
+    formLayout->addRow(tr("Directory:"), directoryLayout);
+    formLayout->addRow(tr("Format:"), formatCombo);
+    formLayout->addRow(timestampBox);
+    formLayout->addRow(tr("New file at:"), sizeBox);
+    formLayout->addRow(tr("New file every:"), ageBox);
+    formLayout->addRow(compressBox);
+    if (m_sessionLog->isLogging() && !m_sessionLogFile.isEmpty()) {
+        formLayout->addRow(tr("Current file:"), new QLabel(QDir::toNativeSeparators(m_sessionLogFile), &dialog));
+    }
+
+    QDialogButtonBox *buttons = new QDialogButtonBox(QDialogButtonBox::Ok | QDialogButtonBox::Cancel, &dialog);
+    connect(buttons, &QDialogButtonBox::accepted, &dialog, &QDialog::accept);
+    connect(buttons, &QDialogButtonBox::rejected, &dialog, &QDialog::reject);
+    formLayout->addRow(buttons);
+
+    if (dialog.exec() != QDialog::Accepted) {
+        return;
+    }
+
+    sessionLog = enableBox->isChecked();
+    sessionLogDirectory = QDir::fromNativeSeparators(directoryEdit->text());
+    sessionLogRaw = formatCombo->currentIndex() == 1;
+    sessionLogTimestamps = timestampBox->isChecked();
+    sessionLogMaxMB = sizeBox->value();
+    sessionLogRotateHours = ageBox->value();
+    sessionLogCompress = compressBox->isChecked();
+    saveSettings();
+    // 正在记录的会话换用新设置，从新文件开始
+    startSessionLog();
+}
+
+void TerminalWidget::startSessionLog()
+{
+    m_sessionLog->stop();
+    m_sessionLogFile.clear();
+    if (!sessionLog || !m_connected) {
+        return;
+    }
+
+    // 文件名取 用户@主机，其他字符替换掉，避免出现路径分隔符
+    QString baseName = QStringLiteral("%1@%2").arg(m_username, m_host);
+    baseName.replace(QRegularExpression(QStringLiteral("[^A-Za-z0-9._@-]")), QStringLiteral("_"));
+    m_sessionLog->setDirectory(sessionLogDirectory);
+    m_sessionLog->setBaseName(baseName);
+    m_sessionLog->setFormat(sessionLogRaw ? TerminalLogger::RawOutput : TerminalLogger::PlainText);
+    m_sessionLog->setTimestamps(sessionLogTimestamps);
+    m_sessionLog->setRotation(qint64(sessionLogMaxMB) * 1024 * 1024, sessionLogRotateHours * 3600);
+    m_sessionLog->setCompressed(sessionLogCompress);
+    m_sessionLog->setCodec(m_remoteCodec);
+    m_sessionLog->startLogging();
+}
+
+void TerminalWidget::editHighlightRules()
+{
+    enum {
+        PatternColumn,
+        RegexColumn,
+        CaseColumn,
+        ForegroundColumn,
+        BackgroundColumn,
+        BoldColumn,
+        AlertColumn,
+        ColumnCount
+    };
+
+    QDialog dialog(this);
+    dialog.setWindowTitle(tr("Highlight Rules"));
+    dialog.resize(720, 360);
+    QVBoxLayout *dialogLayout = new QVBoxLayout(&dialog);
+
+    QCheckBox *enableBox = new QCheckBox(tr("Highlight output matching these rules"), &dialog);
+    enableBox->setChecked(highlighting);
+    QCheckBox *soundBox = new QCheckBox(tr("Beep when an alert rule matches in a background tab"), &dialog);
+    soundBox->setChecked(highlightSound);
+
+    QTableWidget *table = new QTableWidget(0, ColumnCount, &dialog);
+    table->setHorizontalHeaderLabels(QStringList() << tr("Pattern") << tr("Regex") << tr("Match Case")
+                                     << tr("Text") << tr("Background") << tr("Bold") << tr("Alert"));
+    table->horizontalHeader()->setSectionResizeMode(PatternColumn, QHeaderView::Stretch);
+    table->verticalHeader()->setVisible(false);
+    table->setSelectionBehavior(QAbstractItemView::SelectRows);
+    table->setSelectionMode(QAbstractItemView::SingleSelection);
+    table->setToolTip(tr("Double-click a colour to choose it; cancel to keep the output's own colour"));
+
+    // 颜色名保存在 UserRole 中，格子以该颜色填充
+    auto setColorItem = [](QTableWidgetItem *item, const QString &name) {
+        item->setData(Qt::UserRole, name);
+        item->setText(name.isEmpty() ? tr("Keep") : QString());
+        item->setBackground(name.isEmpty() ? QBrush() : QBrush(QColor(name)));
+    };
+    auto checkItem = [](bool checked) {
+        QTableWidgetItem *item = new QTableWidgetItem;
+        item->setFlags(Qt::ItemIsEnabled | Qt::ItemIsUserCheckable | Qt::ItemIsSelectable);
+        item->setCheckState(checked ? Qt::Checked : Qt::Unchecked);
+        return item;
+    };
+    auto addRow = [table, setColorItem, checkItem](const TerminalHighlightRule &rule) {
+        int row = table->rowCount();
+        table->insertRow(row);
+        table->setItem(row, PatternColumn, new QTableWidgetItem(rule.pattern));
+        table->setItem(row, RegexColumn, checkItem(rule.regex));
+        table->setItem(row, CaseColumn, checkItem(rule.caseSensitive));
+        for (int column : {ForegroundColumn, BackgroundColumn}) {
+            QTableWidgetItem *item = new QTableWidgetItem;
+            item->setFlags(Qt::ItemIsEnabled | Qt::ItemIsSelectable);
+            setColorItem(item, highlightColorName(column == ForegroundColumn ? rule.foreground : rule.background));
+            table->setItem(row, column, item);
+        }
+        table->setItem(row, BoldColumn, checkItem(rule.bold));
+        table->setItem(row, AlertColumn, checkItem(rule.alert));
+    };
+    for (const TerminalHighlightRule &rule : loadHighlightRules()) {
+        addRow(rule);
+    }
+
+    connect(table, &QTableWidget::cellDoubleClicked, &dialog, [&dialog, table, setColorItem](int row, int column) {
+        if (column != ForegroundColumn && column != BackgroundColumn) {
+            return;
+        }
+        QTableWidgetItem *item = table->item(row, column);
+        QColor color = QColorDialog::getColor(QColor(item->data(Qt::UserRole).toString()), &dialog);
+        setColorItem(item, color.isValid() ? color.name() : QString());
+    });
+
+    QPushButton *addButton = new QPushButton(tr("Add"), &dialog);
+    QPushButton *removeButton = new QPushButton(tr("Remove"), &dialog);
+    connect(addButton, &QPushButton::clicked, &dialog, [table, addRow]() {
+        addRow(TerminalHighlightRule());
+        int row = table->rowCount() - 1;
+        table->setCurrentCell(row, PatternColumn);
+        table->editItem(table->item(row, PatternColumn));
+    });
+    connect(removeButton, &QPushButton::clicked, &dialog, [table]() {
+        if (table->currentRow() >= 0) {
+            table->removeRow(table->currentRow());
+        }
+    });
+    QHBoxLayout *rowButtons = new QHBoxLayout;
+    rowButtons->addWidget(addButton);
+    rowButtons->addWidget(removeButton);
+    rowButtons->addStretch();
+
+    // 模式为空的行忽略
+    QVector<TerminalHighlightRule> rules;
+    auto collectRules = [table, &rules]() {
+        rules.clear();
+        for (int row = 0; row < table->rowCount(); ++row) {
+            TerminalHighlightRule rule;
+            rule.pattern = table->item(row, PatternColumn)->text();
+            if (rule.pattern.isEmpty()) {
+                continue;
+            }
+            rule.regex = table->item(row, RegexColumn)->checkState() == Qt::Checked;
+            rule.caseSensitive = table->item(row, CaseColumn)->checkState() == Qt::Checked;
+            rule.foreground = highlightColor(table->item(row, ForegroundColumn)->data(Qt::UserRole).toString());
+            rule.background = highlightColor(table->item(row, BackgroundColumn)->data(Qt::UserRole).toString());
+            rule.bold = table->item(row, BoldColumn)->checkState() == Qt::Checked;
+            rule.alert = table->item(row, AlertColumn)->checkState() == Qt::Checked;
+            rules.append(rule);
+        }
+    };
+
+    // 编译通过才关闭对话框，否则指出哪条规则有问题
+    QSharedPointer<TerminalHighlighter> highlighter(new TerminalHighlighter);
+    QDialogButtonBox *buttons = new QDialogButtonBox(QDialogButtonBox::Ok | QDialogButtonBox::Cancel, &dialog);
+    connect(buttons, &QDialogButtonBox::accepted, &dialog, [&dialog, collectRules, &rules, highlighter]() {
+        collectRules();
+        QString error = highlighter->compile(rules);
+        if (!error.isEmpty()) {
+            QMessageBox::warning(&dialog, tr("Highlight Rules"), error);
+            return;
+        }
+        dialog.accept();
+    });
+    connect(buttons, &QDialogButtonBox::rejected, &dialog, &QDialog::reject);
+
+    dialogLayout->addWidget(enableBox);
+    dialogLayout->addWidget(table);
+    dialogLayout->addLayout(rowButtons);
+    dialogLayout->addWidget(soundBox);
+    dialogLayout->addWidget(buttons);
+
+    if (dialog.exec() != QDialog::Accepted) {
+        return;
+    }
+
+    saveHighlightRules(rules);
+    g_highlighter.reset();
+    if (!rules.isEmpty()) {
+        g_highlighter = highlighter;
+    }
+    g_highlighterLoaded = true;
+    highlighting = enableBox->isChecked();
+    highlightSound = soundBox->isChecked();
+    saveSettings();
+
+    // 其他标签页立即换用新规则
+    for (QWidget *widget : QApplication::allWidgets()) {
+        TerminalWidget *terminal = qobject_cast<TerminalWidget *>(widget);
+        if (terminal) {
+            terminal->highlighting = highlighting;
+            terminal->highlightSound = highlightSound;
+            terminal->applyHighlighter();
+        }
+    }
+}
+
+void TerminalWidget::applyHighlighter()
+{
+    // 没有规则或已关闭时不设置，打印路径上没有任何额外开销
+    QSharedPointer<const TerminalHighlighter> highlighter;
+    if (highlighting) {
+        highlighter = sharedHighlighter();
+    }
+    QMutexLocker locker(m_screen->mutex());
+    m_screen->setHighlighter(highlighter);
+}
+
+void TerminalWidget::handleHighlightAlert()
+{
+    QString text;
+    {
+        QMutexLocker locker(m_screen->mutex());
+        text = m_screen->takeHighlightAlert();
+    }
+    if (text.isEmpty()) {
+        return;
+    }
+
+    // 用户正看着这个标签页时不提醒
+    if (isVisible() && window()->isActiveWindow()) {
+        return;
+    }
+    if (m_lastHighlightAlert.isValid() && m_lastHighlightAlert.elapsed() < HighlightAlertIntervalMs) {
+        return;
+    }
+    m_lastHighlightAlert.restart();
+
+    QApplication::alert(window());
+    if (highlightSound) {
+        QApplication::beep();
+    }
+    emit highlightAlert(text);
+}
+
+void TerminalWidget::recordUserInput(const QByteArray &data)
+{
+    if (recordInput) {
+        m_recorder->enqueueInput(data);
+    }
+}
+
+void TerminalWidget::startRecording()
+{
+    if (!m_connected) {
+        return;
+    }
+
+    QString baseName = QStringLiteral("%1@%2").arg(m_username, m_host);
+    baseName.replace(QRegularExpression(QStringLiteral("[^A-Za-z0-9._@-]")), QStringLiteral("_"));
+    QString suggested = QDir(sessionLogDirectory).filePath(baseName + QLatin1Char('-')
+        + QDateTime::currentDateTime().toString(QStringLiteral("yyyyMMdd-HHmmss")) + QStringLiteral(".cast"));
+    QString fileName = QFileDialog::getSaveFileName(this, tr("Record Session"), suggested,
+                                                    tr("Asciicast recordings (*.cast)"));
+    if (fileName.isEmpty() || !m_connected) {
+        return;
+    }
+
+    // 头部记录当前网格尺寸，之后的尺寸变化随 sendWindowSize 记为事件
+    int columns, rows;
+    {
+        QMutexLocker locker(m_screen->mutex());
+        columns = m_screen->columns();
+        rows = m_screen->rows();
+    }
+    m_recorder->setFileName(fileName);
+    m_recorder->setTerminal(columns, rows, m_terminalType);
+    m_recorder->setCodec(m_remoteCodec);
+    m_recorder->startLogging();
+}
+
+void TerminalWidget::stopRecording()
+{
+    m_recorder->stop();
+}
+
+void TerminalWidget::openReplay()
+{
+    if (m_connected || m_replay) {
+        return;
+    }
+
+    QString fileName = QFileDialog::getOpenFileName(this, tr("Replay Recording"), sessionLogDirectory,
+                                                    tr("Asciicast recordings (*.cast);;All files (*)"));
+    if (fileName.isEmpty()) {
+        return;
+    }
+
+    // 回放期间网格保持录制时的尺寸，不随窗口变化
+    hideSearchBar();
+    terminalView->clearSelection();
+    terminalView->setGridLocked(true);
+    m_replay = new TerminalReplay(m_screen, this);
+    QString error = m_replay->load(fileName);
+    if (!error.isEmpty()) {
+        delete m_replay;
+        m_replay = nullptr;
+        terminalView->setGridLocked(false);
+        QMessageBox::warning(this, tr("Replay Recording"),
+                             tr("Cannot replay %1: %2").arg(QDir::toNativeSeparators(fileName), error));
+        return;
+    }
+
+    connect(m_replay, &TerminalReplay::screenChanged, this, &TerminalWidget::scheduleRender);
+    connect(m_replay, &TerminalReplay::positionChanged, this, &TerminalWidget::handleReplayPosition);
+    connect(m_replay, &TerminalReplay::finished, this, [this]() { handleReplayPosition(m_replay->position()); });
+    {
+        QSignalBlocker blocker(m_replaySlider);
+        m_replaySlider->setRange(0, int(qMin<qint64>(m_replay->duration(), INT_MAX)));
+        m_replaySlider->setPageStep(10 * 1000);
+    }
+    m_replay->setSpeed(m_replaySpeed->currentData().toDouble());
+    m_replayBar->show();
+    m_replay->play();
+    handleReplayPosition(m_replay->position());
+    scheduleRender();
+}
+
+void TerminalWidget::closeReplay()
+{
+    if (!m_replay) {
+        return;
+    }
+
+    delete m_replay;
+    m_replay = nullptr;
+    m_replayBar->hide();
+
+    // 回到空白终端，网格恢复为视图尺寸
+    {
+        QMutexLocker locker(m_screen->mutex());
+        m_screen->reset();
+        m_screen->clearScrollback();
+    }
+    terminalView->clearSelection();
+    terminalView->setGridLocked(false);
+    appendToTerminal(m_currentPrompt + " ");
+    scheduleRender();
+    terminalView->setFocus();
+}
+
+void TerminalWidget::toggleReplay()
+{
+    if (!m_replay) {
+        return;
+    }
+
+    if (m_replay->isPlaying()) {
+        m_replay->pause();
+    } else {
+        m_replay->play();
+    }
+    handleReplayPosition(m_replay->position());
+}
+
+void TerminalWidget::handleReplayPosition(qint64 time)
+{
+    if (!m_replay) {
+        return;
+    }
+
+    // 拖动滑块时不回写位置，避免与用户的拖动相互干扰
+    if (!m_replaySlider->isSliderDown()) {
+        QSignalBlocker blocker(m_replaySlider);
+        m_replaySlider->setValue(int(qMin<qint64>(time, INT_MAX)));
+    }
+    m_replayTime->setText(formatReplayTime(time) + " / " + formatReplayTime(m_replay->duration()));
+    m_replayPlayButton->setText(m_replay->isPlaying() ? tr("Pause") : tr("Play"));
+}
+
+void TerminalWidget::showSearchBar()
+{
+    m_searchBar->show();
+    // 有选中文本时用它作为搜索内容
+    if (terminalView->hasSelection()) {
+        QString selected = terminalView->selectedText();
+        if (!selected.contains('\n')) {
+            m_searchEdit->setText(selected);
+        }
+    }
+    m_searchEdit->setFocus();
+    m_searchEdit->selectAll();
+}
+
+void TerminalWidget::hideSearchBar()
+{
+    m_searchTimer.stop();
+    stopSearch();
+    terminalView->clearSearchMatches();
+    m_searchStatus->clear();
+    m_searchBar->hide();
+    terminalView->setFocus();
+}
+
+void TerminalWidget::startSearch()
+{
+    m_searchTimer.stop();
+    stopSearch();
+
+    // 先绘制待处理的输出，使视图已知的丢弃行数与快照一致；
+    // 持锁到取得快照为止，期间解析线程不会再改动屏幕
+    QMutexLocker locker(m_screen->mutex());
+    renderFrame();
+    terminalView->clearSearchMatches();
+    m_searchTotal = 0;
+    m_searchPercent = 0;
+
+    QString pattern = m_searchEdit->text();
+    TerminalSearch::Options options;
+    if (m_searchCaseBox->isChecked()) {
+        options |= TerminalSearch::CaseSensitive;
+    }
+    if (m_searchRegexBox->isChecked()) {
+        options |= TerminalSearch::RegularExpression;
+    }
+
+    if (pattern.isEmpty()) {
+        m_searchStatus->clear();
+        return;
+    }
+    QString error = TerminalSearch::patternError(pattern, options);
+    if (!error.isEmpty()) {
+        m_searchStatus->setText(tr("Invalid pattern: %1").arg(error));
+        return;
+    }
+
+    m_search = new TerminalSearch(pattern, options, m_screen->scrollbackSnapshot(), m_screen->packedScreenLines(), this);
+    locker.unlock();
+    connect(m_search, &TerminalSearch::matchesFound, this, &TerminalWidget::handleSearchMatches);
+    connect(m_search, &TerminalSearch::searchProgress, this, &TerminalWidget::handleSearchProgress);
+    connect(m_search, &TerminalSearch::searchFinished, this, &TerminalWidget::handleSearchFinished);
+    m_searchRunning = true;
+    updateSearchStatus();
+    m_search->start(QThread::LowPriority);
+}
+
+void TerminalWidget::stopSearch()
+{
+    if (!m_search) {
+        return;
+    }
+
+    // 线程结束后自行删除，不阻塞界面
+    disconnect(m_search, nullptr, this, nullptr);
+    m_search->cancel();
+    connect(m_search, &QThread::finished, m_search, &QObject::deleteLater);
+    if (m_search->isFinished()) {
+        m_search->deleteLater();
+    }
+    m_search = nullptr;
+    m_searchRunning = false;
+}
+
+void TerminalWidget::findPrevious()
+{
+    // 结果按从新到旧排列，向上查找即下标加一
+    int count = terminalView->searchMatchCount();
+    if (count > 0) {
+        terminalView->setCurrentSearchMatch((terminalView->currentSearchMatch() + 1) % count);
+        updateSearchStatus();
+    }
+}
+
+void TerminalWidget::findNext()
+{
+    int count = terminalView->searchMatchCount();
+    if (count > 0) {
+        terminalView->setCurrentSearchMatch((terminalView->currentSearchMatch() - 1 + count) % count);
+        updateSearchStatus();
+    }
+}
+
+void TerminalWidget::handleSearchMatches(const QVector<TerminalSearchMatch> &matches)
+{
+    // 已取消的搜索可能还有排队的结果
+    if (sender() != m_search) {
+        return;
+    }
+
+    bool first = terminalView->searchMatchCount() == 0;
+    terminalView->addSearchMatches(matches);
+    if (first) {
+        // 第一个结果到达就跳转过去，其余结果继续在后台查找
+        terminalView->setCurrentSearchMatch(0);
+    }
+    updateSearchStatus();
+}
+
+void TerminalWidget::handleSearchProgress(int linesSearched, int lineCount)
+{
+    if (sender() != m_search) {
+        return;
+    }
+
+    m_searchPercent = lineCount > 0 ? int(qint64(linesSearched) * 100 / lineCount) : 100;
+    updateSearchStatus();
+}
+
+void TerminalWidget::handleSearchFinished(int matchCount, bool cancelled)
+{
+    Q_UNUSED(cancelled);
+    if (sender() != m_search) {
+        return;
+    }
+
+    m_searchRunning = false;
+    m_searchTotal = matchCount;
+    updateSearchStatus();
+}
+
+void TerminalWidget::updateSearchStatus()
+{
+    int found = terminalView->searchMatchCount();
+    int current = terminalView->currentSearchMatch() + 1;
+
+    if (m_searchRunning) {
+        m_searchStatus->setText(tr("%1 of %2+ (searching %3%)").arg(current).arg(found).arg(m_searchPercent));
+    } else if (m_searchEdit->text().isEmpty()) {
+        m_searchStatus->clear();
+    } else if (m_searchTotal == 0) {
+        m_searchStatus->setText(tr("No matches"));
+    } else if (m_searchTotal > found) {
+        m_searchStatus->setText(tr("%1 of %2 (first %3 highlighted)").arg(current).arg(m_searchTotal).arg(found));
+    } else {
+        m_searchStatus->setText(tr("%1 of %2").arg(current).arg(m_searchTotal));
+    }
+}
+
 void TerminalWidget::saveSettings()
 {
     QSettings settings;
@@ -969,6 +2023,24 @@ void TerminalWidget::saveSettings()
     settings.setValue("FontSize", terminalFont.pointSize());
     settings.setValue("BackgroundColor", backgroundColor.name());
     settings.setValue("TextColor", textColor.name());
+    settings.setValue("ScrollbackLines", scrollbackLines);
+    settings.setValue("ScrollbackMemoryMB", scrollbackMemoryMB);
+    settings.setValue("ScrollbackGlobalMemoryMB", scrollbackGlobalMemoryMB);
+    settings.setValue("ScrollbackSpill", scrollbackSpill);
+    settings.setValue("ScrollbackSearchIndex", scrollbackSearchIndex);
+    settings.setValue("PredictiveEcho", predictiveEcho);
+    settings.setValue("LocalLineEditing", localLineEditing);
+    settings.setValue("HibernateMinutes", hibernateMinutes);
+    settings.setValue("SessionLog", sessionLog);
+    settings.setValue("SessionLogDirectory", sessionLogDirectory);
+    settings.setValue("SessionLogRaw", sessionLogRaw);
+    settings.setValue("SessionLogTimestamps", sessionLogTimestamps);
+    settings.setValue("SessionLogMaxMB", sessionLogMaxMB);
+    settings.setValue("SessionLogRotateHours", sessionLogRotateHours);
+    settings.setValue("SessionLogCompress", sessionLogCompress);
+    settings.setValue("RecordInput", recordInput);
+    settings.setValue("Highlighting", highlighting);
+    settings.setValue("HighlightSound", highlightSound);
     settings.endGroup();
 }
 
@@ -983,6 +2055,24 @@ void TerminalWidget::loadSettings()
 
     backgroundColor = QColor(settings.value("BackgroundColor", backgroundColor.name()).toString());
     textColor = QColor(settings.value("TextColor", textColor.name()).toString());
+    scrollbackLines = settings.value("ScrollbackLines", scrollbackLines).toInt();
+    scrollbackMemoryMB = settings.value("ScrollbackMemoryMB", scrollbackMemoryMB).toInt();
+    scrollbackGlobalMemoryMB = settings.value("ScrollbackGlobalMemoryMB", scrollbackGlobalMemoryMB).toInt();
+    scrollbackSpill = settings.value("ScrollbackSpill", scrollbackSpill).toBool();
+    scrollbackSearchIndex = settings.value("ScrollbackSearchIndex", scrollbackSearchIndex).toBool();
+    predictiveEcho = settings.value("PredictiveEcho", predictiveEcho).toBool();
+    localLineEditing = settings.value("LocalLineEditing", localLineEditing).toBool();
+    hibernateMinutes = settings.value("HibernateMinutes", hibernateMinutes).toInt();
+    sessionLog = settings.value("SessionLog", sessionLog).toBool();
+    sessionLogDirectory = settings.value("SessionLogDirectory", sessionLogDirectory).toString();
+    sessionLogRaw = settings.value("SessionLogRaw", sessionLogRaw).toBool();
+    sessionLogTimestamps = settings.value("SessionLogTimestamps", sessionLogTimestamps).toBool();
+    sessionLogMaxMB = settings.value("SessionLogMaxMB", sessionLogMaxMB).toInt();
+    sessionLogRotateHours = settings.value("SessionLogRotateHours", sessionLogRotateHours).toInt();
+    sessionLogCompress = settings.value("SessionLogCompress", sessionLogCompress).toBool();
+    recordInput = settings.value("RecordInput", recordInput).toBool();
+    highlighting = settings.value("Highlighting", highlighting).toBool();
+    highlightSound = settings.value("HighlightSound", highlightSound).toBool();
 
     settings.endGroup();
 }
@@ -1004,39 +2094,33 @@ void TerminalWidget::addToHistory(const QString &command)
     historyPosition = -1;
 }
 
-void TerminalWidget::appendToTerminal(const QString &processedText)
+void TerminalWidget::appendToTerminal(const QString &processedText, int ansiColor, bool bold)
 {
-    QTextCursor cursor = terminalOutput->textCursor();
-
-    // Store current position
-    int currentPosition = cursor.position();
-
-    // Move cursor to end for appending
-    cursor.movePosition(QTextCursor::End);
-
-    // Insert text with current formatting
-    QTextCharFormat format;
-    format.setForeground(m_currentFgColor);
-    format.setBackground(m_currentBgColor);
-    if (m_bold) {
-        format.setFontWeight(QFont::Bold);
-    } else {
-        format.setFontWeight(QFont::Normal);
+    // 本地消息（连接状态、ZMODEM 进度）直接写入屏幕模型，不经过服务器
+    {
+        QMutexLocker locker(m_screen->mutex());
+        m_screen->writeLocalText(processedText, ansiColor, bold);
     }
-    cursor.insertText(processedText, format);
+    scheduleRender();
+    terminalView->scrollToBottom();
+}
 
-    // Restore cursor if it was in the editing area
-    if (currentPosition > terminalOutput->document()->characterCount() - processedText.length()) {
-        cursor.movePosition(QTextCursor::End);
-        terminalOutput->setTextCursor(cursor);
-    }
+void TerminalWidget::setInputLine(const QString &text)
+{
+    m_inputLine = text;
+    terminalView->setPendingInput(m_inputLine);
+    terminalView->scrollToBottom();
+}
 
-    // Ensure the cursor is visible
-    terminalOutput->ensureCursorVisible();
+QByteArray TerminalWidget::encodeForRemote(const QString &text) const
+{
+    return m_remoteCodec ? m_remoteCodec->fromUnicode(text) : text.toUtf8();
 }
 
 void TerminalWidget::initAnsiColors()
 {
+    m_ansiColors.resize(16);
+
     // Standard ANSI colors
     m_ansiColors[0] = QColor(0, 0, 0);         // Black
     m_ansiColors[1] = QColor(170, 0, 0);       // Red
@@ -1058,23 +2142,11 @@ void TerminalWidget::initAnsiColors()
     m_ansiColors[15] = QColor(255, 255, 255);  // Bright White
 }
 
-bool TerminalWidget::detectZmodem(const QByteArray &data)
+// Runs on the parser thread over the last 1 KB of output, so it must not touch members
+bool TerminalWidget::isZmodemRequest(const QByteArray &recentOutput)
 {
-    // If already in ZMODEM mode, don't need to detect again
-    if (m_zmodemActive || m_zmodemUploadStarted) {
-        return true;
-    }
-
-    // Add data to buffer for detection
-    m_zmodemBuffer.append(data);
-    
-    // Keep buffer at a reasonable size
-    if (m_zmodemBuffer.size() > 1024) {
-        m_zmodemBuffer = m_zmodemBuffer.right(1024);
-    }
-    
     // Convert to string for text-based detection
-    QString bufferText = QString::fromUtf8(m_zmodemBuffer);
+    QString bufferText = QString::fromUtf8(recentOutput);
     
     // First check: exact match for "rz" command at the end of a prompt
     if (bufferText.contains(QRegularExpression("[$#>]\\s*rz\\s*[\\r\\n]"))) {
@@ -1101,7 +2173,7 @@ bool TerminalWidget::detectZmodem(const QByteArray &data)
     zmodemHeader.append(ZDLE);
     zmodemHeader.append(ZBIN);
     
-    if (m_zmodemBuffer.contains(zmodemHeader)) {
+    if (recentOutput.contains(zmodemHeader)) {
         qDebug() << "ZMODEM detected: header sequence found";
         return true;
     }
@@ -1124,18 +2196,9 @@ void TerminalWidget::handleZmodemDetected()
     qDebug() << "ZMODEM protocol detected, initiating file transfer";
     
     // Show status message
-    QTextCursor cursor = terminalOutput->textCursor();
-    cursor.movePosition(QTextCursor::End);
-    
-    QTextCharFormat format;
-    format.setForeground(Qt::blue);
-    format.setFontWeight(QFont::Bold);
-    
-    cursor.insertText("\n\n", format);
-    cursor.insertText("*** ZMODEM file transfer request detected ***\n", format);
-    cursor.insertText("    Opening file selection dialog...\n", format);
-    
-    terminalOutput->setTextCursor(cursor);
+    appendToTerminal("\n\n", AnsiBlue, true);
+    appendToTerminal("*** ZMODEM file transfer request detected ***\n", AnsiBlue, true);
+    appendToTerminal("    Opening file selection dialog...\n", AnsiBlue, true);
     
     // Make sure UI is updated
     QApplication::processEvents();
@@ -1158,12 +2221,7 @@ void TerminalWidget::startZmodemUpload()
     
     if (fileName.isEmpty()) {
         // User cancelled the dialog
-        QTextCursor cursor = terminalOutput->textCursor();
-        cursor.movePosition(QTextCursor::End);
-        QTextCharFormat format;
-        format.setForeground(Qt::red);
-        cursor.insertText("\nFile transfer cancelled. No file selected.\n", format);
-        terminalOutput->setTextCursor(cursor);
+        appendToTerminal("\nFile transfer cancelled. No file selected.\n", AnsiRed);
         
         // Cancel ZMODEM transfer
         sendZmodemCancel();
@@ -1175,12 +2233,7 @@ void TerminalWidget::startZmodemUpload()
     m_zmodemFile.setFileName(fileName);
     
     if (!m_zmodemFile.open(QIODevice::ReadOnly)) {
-        QTextCursor cursor = terminalOutput->textCursor();
-        cursor.movePosition(QTextCursor::End);
-        QTextCharFormat format;
-        format.setForeground(Qt::red);
-        cursor.insertText("\nFailed to open file: " + fileName + "\n", format);
-        terminalOutput->setTextCursor(cursor);
+        appendToTerminal("\nFailed to open file: " + fileName + "\n", AnsiRed);
         
         // Cancel ZMODEM transfer
         sendZmodemCancel();
@@ -1198,28 +2251,16 @@ void TerminalWidget::startZmodemUpload()
     QFileInfo fileInfo(fileName);
     QString baseName = fileInfo.fileName();
     
-    QTextCursor cursor = terminalOutput->textCursor();
-    cursor.movePosition(QTextCursor::End);
-    
-    QTextCharFormat format;
-    format.setForeground(Qt::blue);
-    
-    cursor.insertText("\n", format);
-    cursor.insertText("=== ZMODEM File Transfer ===\n", format);
-    cursor.insertText("File: " + baseName + "\n", format);
-    cursor.insertText("Size: " + QString::number(m_zmodemFileSize) + " bytes\n", format);
-    cursor.insertText("Status: Starting transfer...\n\n", format);
-    terminalOutput->setTextCursor(cursor);
+    appendToTerminal("\n", AnsiBlue);
+    appendToTerminal("=== ZMODEM File Transfer ===\n", AnsiBlue);
+    appendToTerminal("File: " + baseName + "\n", AnsiBlue);
+    appendToTerminal("Size: " + QString::number(m_zmodemFileSize) + " bytes\n", AnsiBlue);
+    appendToTerminal("Status: Starting transfer...\n\n", AnsiBlue);
     
     // Start ZMODEM transfer - if it fails, handle the error
     if (!startZmodemFileTransfer()) {
         // Handle initialization failure
-        QTextCursor cursor = terminalOutput->textCursor();
-        cursor.movePosition(QTextCursor::End);
-        QTextCharFormat errorFormat;
-        errorFormat.setForeground(Qt::red);
-        cursor.insertText("Failed to initialize ZMODEM transfer.\n", errorFormat);
-        terminalOutput->setTextCursor(cursor);
+        appendToTerminal("Failed to initialize ZMODEM transfer.\n", AnsiRed);
         
         // Close file and cleanup
         m_zmodemFile.close();
@@ -1566,12 +2607,7 @@ void TerminalWidget::sendZmodemCancel()
     resetZmodemState();
     
     // Display cancellation message
-    QTextCursor cursor = terminalOutput->textCursor();
-    cursor.movePosition(QTextCursor::End);
-    QTextCharFormat format;
-    format.setForeground(Qt::red);
-    cursor.insertText("\nZMODEM transfer cancelled.\n", format);
-    terminalOutput->setTextCursor(cursor);
+    appendToTerminal("\nZMODEM transfer cancelled.\n", AnsiRed);
     
     // Send a newline to restore the prompt, but do it after a short delay
     QTimer::singleShot(1000, [sshClient]() {
@@ -1589,6 +2625,7 @@ void TerminalWidget::resetZmodemState()
     m_zmodemBuffer.clear();
     m_zmodemCancel = false;
     m_zmodemProcessing = false;
+    m_parserThread->setPassthrough(false);
     
     // Close file if open
     if (m_zmodemFile.isOpen()) {
@@ -1607,12 +2644,7 @@ void TerminalWidget::zmodemTransferTimeout()
         // Too many timeouts, cancel transfer
         sendZmodemCancel();
         
-        QTextCursor cursor = terminalOutput->textCursor();
-        cursor.movePosition(QTextCursor::End);
-        QTextCharFormat format;
-        format.setForeground(Qt::red);
-        cursor.insertText("\nZMODEM transfer timed out.\n", format);
-        terminalOutput->setTextCursor(cursor);
+        appendToTerminal("\nZMODEM transfer timed out.\n", AnsiRed);
     } else {
         // Try to continue transfer
         uploadNextZmodemPacket();
@@ -1630,21 +2662,12 @@ void TerminalWidget::completeZmodemTransfer(bool success)
     }
     
     // Display completion message
-    QTextCursor cursor = terminalOutput->textCursor();
-    cursor.movePosition(QTextCursor::End);
-    
     if (success) {
-        QTextCharFormat format;
-        format.setForeground(Qt::green);
-        cursor.insertText("\nZMODEM file transfer completed successfully!\n", format);
+        appendToTerminal("\nZMODEM file transfer completed successfully!\n", AnsiGreen);
     } else {
-        QTextCharFormat format;
-        format.setForeground(Qt::red);
-        cursor.insertText("\nZMODEM file transfer failed.\n", format);
+        appendToTerminal("\nZMODEM file transfer failed.\n", AnsiRed);
     }
     
-    terminalOutput->setTextCursor(cursor);
-    
     // Get SSHClient
     SSHClient *sshClient = m_connectionThread ? m_connectionThread->getSSHClient() : nullptr;
     
@@ -1675,12 +2698,7 @@ void TerminalWidget::completeZmodemTransfer(bool success)
         gentleCancel.append('\x18');  // One more for good measure
         sshClient->sendData(gentleCancel);
         
-        cursor = terminalOutput->textCursor();
-        cursor.movePosition(QTextCursor::End);
-        QTextCharFormat infoFormat;
-        infoFormat.setForeground(Qt::blue);
-        cursor.insertText("\nSending termination sequence to end ZMODEM session...\n", infoFormat);
-        terminalOutput->setTextCursor(cursor);
+        appendToTerminal("\nSending termination sequence to end ZMODEM session...\n", AnsiBlue);
     }
     
     // Reset ZMODEM state
@@ -1695,19 +2713,9 @@ void TerminalWidget::completeZmodemTransfer(bool success)
             QThread::msleep(100);
             sshClient->sendData(QByteArray(1, '\n'));
             
-            QTextCursor cursor = terminalOutput->textCursor();
-            cursor.movePosition(QTextCursor::End);
-            QTextCharFormat infoFormat;
-            infoFormat.setForeground(Qt::blue);
-            cursor.insertText("\nZMODEM session terminated, returning to shell.\n", infoFormat);
-            terminalOutput->setTextCursor(cursor);
+            appendToTerminal("\nZMODEM session terminated, returning to shell.\n", AnsiBlue);
         } else if (!m_connected) {
-            QTextCursor cursor = terminalOutput->textCursor();
-            cursor.movePosition(QTextCursor::End);
-            QTextCharFormat format;
-            format.setForeground(Qt::blue);
-            cursor.insertText("\nConnection lost after transfer. You may need to reconnect.\n", format);
-            terminalOutput->setTextCursor(cursor);
+            appendToTerminal("\nConnection lost after transfer. You may need to reconnect.\n", AnsiBlue);
         }
     });
 }
@@ -1717,52 +2725,18 @@ void TerminalWidget::updateZmodemProgress(qint64 sent, qint64 total)
     // Calculate percentage
     int percentage = (total > 0) ? static_cast<int>((sent * 100) / total) : 0;
     
-    // Create progress bar text
-    QTextCursor cursor = terminalOutput->textCursor();
+    // Create progress bar
+    const int totalSteps = 20;
+    int completedSteps = (totalSteps * percentage) / 100;
     
-    // Find the last line with "Progress:"
-    QString currentText = terminalOutput->toPlainText();
-    int progressPos = currentText.lastIndexOf("Progress: [");
-    
-    if (progressPos >= 0) {
-        // Replace existing progress bar
-        cursor.setPosition(progressPos);
-        cursor.movePosition(QTextCursor::EndOfLine, QTextCursor::KeepAnchor);
-        
-        // Create progress bar
-        const int totalSteps = 20;
-        int completedSteps = (totalSteps * percentage) / 100;
-        
-        QString progressBar = "Progress: [";
-        for (int i = 0; i < totalSteps; i++) {
-            progressBar += (i < completedSteps) ? "■" : "□";
-        }
-        progressBar += QString("] %1%").arg(percentage);
-        
-        // Set progress bar text
-        QTextCharFormat format;
-        format.setForeground(Qt::blue);
-        cursor.insertText(progressBar, format);
-    } else {
-        // Create new progress bar
-        cursor.movePosition(QTextCursor::End);
-        
-        const int totalSteps = 20;
-        int completedSteps = (totalSteps * percentage) / 100;
-        
-        QString progressBar = "Progress: [";
-        for (int i = 0; i < totalSteps; i++) {
-            progressBar += (i < completedSteps) ? "■" : "□";
-        }
-        progressBar += QString("] %1%").arg(percentage);
-        
-        // Set progress bar text
-        QTextCharFormat format;
-        format.setForeground(Qt::blue);
-        cursor.insertText(progressBar + "\n", format);
+    QString progressBar = "Progress: [";
+    for (int i = 0; i < totalSteps; i++) {
+        progressBar += (i < completedSteps) ? "■" : "□";
     }
+    progressBar += QString("] %1%").arg(percentage);
     
-    terminalOutput->setTextCursor(cursor);
+    // Carriage return rewrites the same line in place on every update
+    appendToTerminal("\r" + progressBar, AnsiBlue);
     
     // Process events to update UI
     QApplication::processEvents();
@@ -1826,10 +2800,7 @@ void TerminalWidget::processZmodemResponse()
             // Send newline
             sshClient->sendData(QByteArray(1, '\n'));
             
-            QTextCursor cursor = terminalOutput->textCursor();
-            cursor.movePosition(QTextCursor::End);
-            cursor.insertText("\n");
-            terminalOutput->setTextCursor(cursor);
+            appendToTerminal("\n");
         }
     }
     
@@ -2,19 +2,35 @@
 #define TERMINALWIDGET_H
 
 #include <QWidget>
-#include <QTextEdit>
 #include <QVBoxLayout>
 #include <QMenu>
 #include <QStringList>
 #include <QSettings>
 #include <QFontDialog>
 #include <QColorDialog>
-#include <QMap>
 #include <QFile>
 #include <QTimer>
+#include <QElapsedTimer>
 #include "sessioninfo.h"
+#include "terminalscreen.h"
+#include "terminalview.h"
+#include "terminalsearch.h"
+#include "terminalparserthread.h"
+#include "terminalpredictor.h"
+#include "terminallogger.h"
+#include "terminalreplay.h"
+#include "terminalhighlighter.h"
 
 class SSHConnectionThread;
+class QLineEdit;
+class QCheckBox;
+class QLabel;
+class QTextCodec;
+class QKeyEvent;
+class QProgressDialog;
+class QToolButton;
+class QSlider;
+class QComboBox;
 
 // ZMODEM protocol control characters and states
 #define ZPAD            '*'    // Padding character
@@ -71,6 +87,14 @@ public:
     bool isConnected() const { return m_connected; }
     bool eventFilter(QObject *obj, QEvent *event) override;
 
+signals:
+    // 后台标签页的输出命中提醒规则；text 为命中的文字
+    void highlightAlert(const QString &text);
+
+protected:
+    void showEvent(QShowEvent *event) override;
+    void hideEvent(QHideEvent *event) override;
+
 public slots:
     void handleSSHData(const QByteArray &data);
     void handleSSHError(const QString &error);
@@ -87,9 +111,40 @@ private slots:
     void changeFont();
     void changeBackgroundColor();
     void changeTextColor();
+    void editScrollbackSettings();
+    void editSessionLogSettings();
+    void editHighlightRules();
+    void handleHighlightAlert();
     void processCommand();
     void handleCommandHistoryUp();
     void handleCommandHistoryDown();
+    void renderFrame();
+    void handleScreenChanged();
+    void hibernate();
+    void setPredictiveEcho(bool enabled);
+    void setLocalLineEditing(bool enabled);
+    void flushInput();
+    void pumpPaste();
+    void sendWindowSize();
+    void cancelPaste();
+
+    // 会话录制与回放（asciicast v2）
+    void startRecording();
+    void stopRecording();
+    void openReplay();
+    void closeReplay();
+    void toggleReplay();
+    void handleReplayPosition(qint64 time);
+
+    // 回滚缓冲区搜索
+    void showSearchBar();
+    void hideSearchBar();
+    void startSearch();
+    void findPrevious();
+    void findNext();
+    void handleSearchMatches(const QVector<TerminalSearchMatch> &matches);
+    void handleSearchProgress(int linesSearched, int lineCount);
+    void handleSearchFinished(int matchCount, bool cancelled);
     
     // ZMODEM specific slots
     void startZmodemUpload();
@@ -98,16 +153,46 @@ private slots:
 
 private:
     QVBoxLayout *layout;
-    QTextEdit *terminalOutput;
+    TerminalScreen *m_screen;
+    TerminalView *terminalView;
+    // 解析线程：服务器输出在这里更新屏幕模型，界面线程只负责绘制
+    TerminalParserThread *m_parserThread;
 
     QFont terminalFont;
     QColor backgroundColor;
     QColor textColor;
 
+    // 回滚缓冲区上限（行数、每个标签页和所有标签页的内存）
+    int scrollbackLines;
+    int scrollbackMemoryMB;
+    int scrollbackGlobalMemoryMB;
+    bool scrollbackSpill;       // 超出内存上限的历史压缩后写入临时文件
+    bool scrollbackSearchIndex; // 为写入临时文件的历史块建立三元组索引，加快搜索
+    bool predictiveEcho;        // 高延迟链路上先行显示输入，待服务器回显确认
+    bool localLineEditing;      // 在本地编辑整行、回车后发送；关闭时按键直接发往远端伪终端
+    int hibernateMinutes;       // 标签页隐藏多久后释放绘制缓存、历史移出内存；0 表示从不
+
+    // 会话日志：服务器输出由后台线程写入文件，按大小或时间轮换
+    bool sessionLog;
+    QString sessionLogDirectory;
+    bool sessionLogRaw;         // 原样记录输出；否则去掉控制序列，保存为 UTF-8 文本
+    bool sessionLogTimestamps;  // 每行前加时间戳
+    int sessionLogMaxMB;        // 单个文件上限；0 表示不限
+    int sessionLogRotateHours;  // 每隔多久换新文件；0 表示不换
+    bool sessionLogCompress;    // 写成 gzip 文件
+
+    // 高亮规则：输出打印时按规则着色；规则本身由所有标签页共用
+    bool highlighting;
+    bool highlightSound;        // 后台标签页命中提醒规则时响铃
+    QElapsedTimer m_lastHighlightAlert;
+
     bool m_connected;
     QString m_host;
     int m_port;
     QString m_username;
+    QString m_terminalType;     // PTY 请求中的 TERM
+    // 会话编码；为 nullptr 时使用 UTF-8
+    QTextCodec *m_remoteCodec;
 
     SSHConnectionThread *m_connectionThread;
 
@@ -117,14 +202,64 @@ private:
     
     // 当前提示符
     QString m_currentPrompt;
+    // 行模式输入：按回车前在本地编辑，显示在光标处
+    QString m_inputLine;
+
+    // 直接输入模式：几毫秒内的按键合并成一个 SSH 数据包
+    QByteArray m_inputBuffer;
+    QTimer m_inputFlushTimer;
+    QElapsedTimer m_lastInputFlush;
+
+    // 大段粘贴分块发送：写队列低于上限时才继续，进度可见、可取消
+    QByteArray m_pasteData;
+    int m_pasteOffset;
+    bool m_pasteBracketed;
+    QProgressDialog *m_pasteProgress;
+
+    // 会话线程直接把输出交给日志线程，不经过界面线程和解析线程
+    TerminalLogger *m_sessionLog;
+    QString m_sessionLogFile;
+
+    // 录制：同样由会话线程直接交给后台线程写入 .cast 文件
+    TerminalLogger *m_recorder;
+    bool recordInput;           // 同时录制键盘输入；可能含有密码，默认关闭
+
+    // 回放：未连接时把录制文件播放到本标签页，回放期间网格保持录制时的尺寸
+    TerminalReplay *m_replay;
+    QWidget *m_replayBar;
+    QToolButton *m_replayPlayButton;
+    QSlider *m_replaySlider;
+    QLabel *m_replayTime;
+    QComboBox *m_replaySpeed;
+
+    // 预测回显：已发送但服务器尚未回显的输入
+    TerminalPredictor m_predictor;
+
+    // ANSI 基本 16 色
+    QVector<QColor> m_ansiColors;
+
+    // 拖动窗口或分隔条时合并尺寸变化，停下后再通知远端
+    QTimer m_resizeTimer;
+
+    // 重绘合并：数据到达即更新屏幕模型，重绘每个显示帧最多一次
+    QTimer m_renderTimer;
+    QElapsedTimer m_lastRender;
+
+    // 隐藏的标签页不绘制；隐藏较久后进入休眠，释放缓存，再次显示时按需重建
+    QTimer m_hibernateTimer;
+    bool m_hibernated;
 
-    // ANSI 转义序列处理
-    bool m_ansiEscapeMode;
-    QString m_ansiEscapeBuffer;
-    QMap<int, QColor> m_ansiColors;
-    QColor m_currentFgColor;
-    QColor m_currentBgColor;
-    bool m_bold;
+    // 搜索栏：后台线程扫描回滚缓冲区，结果分批高亮
+    QWidget *m_searchBar;
+    QLineEdit *m_searchEdit;
+    QCheckBox *m_searchCaseBox;
+    QCheckBox *m_searchRegexBox;
+    QLabel *m_searchStatus;
+    TerminalSearch *m_search;
+    QTimer m_searchTimer;
+    bool m_searchRunning;
+    int m_searchTotal;
+    int m_searchPercent;
 
     // ZMODEM protocol support
     bool m_zmodemActive;
@@ -145,14 +280,26 @@ private:
     
     void setupUI();
     void updateTerminalStyle();
-    void appendToTerminal(const QString &text);
+    void appendToTerminal(const QString &text, int ansiColor = -1, bool bold = false);
+    void setInputLine(const QString &text);
+    void clearPredictions();
+    void sendKey(QKeyEvent *keyEvent);
+    void queueInput(const QByteArray &data);
+    QByteArray encodeForRemote(const QString &text) const;
+    void scheduleRender();
     void saveSettings();
     void loadSettings();
+    void applyScrollbackLimits();
+    void startSessionLog();
+    void applyHighlighter();
+    void recordUserInput(const QByteArray &data);
+    void stopSearch();
+    void updateSearchStatus();
     void addToHistory(const QString &command);
     void initAnsiColors();
     
     // ZMODEM methods
-    bool detectZmodem(const QByteArray &data);
+    static bool isZmodemRequest(const QByteArray &recentOutput);
     void handleZmodemDetected();
     bool startZmodemFileTransfer();
     QByteArray createZmodemHeader(int frameType, quint32 pos = 0);
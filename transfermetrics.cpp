@@ -0,0 +1,199 @@
+#include "transfermetrics.h"
+#include <QJsonArray>
+#include <QtMath>
+
+static const qint64 kSampleIntervalMs = 250;
+
+// Updates closer together than this are merged, so the rate is not computed from a
+// handful of bytes; the smoothing time constant is a few seconds
+static const qint64 kMinRateIntervalMs = 50;
+static const double kRateTimeConstantMs = 2000.0;
+
+TransferMetrics::TransferMetrics()
+    : m_finishedMs(-1), m_transferred(0), m_total(0), m_lastBytes(0), m_lastUpdateMs(0),
+      m_lastSampleMs(-kSampleIntervalMs), m_rate(0), m_rttMs(-1), m_windowFill(-1),
+      m_networkMs(0), m_localIoMs(0)
+{
+}
+
+void TransferMetrics::recordProgress(qint64 transferred, qint64 total)
+{
+    if (!m_timer.isValid()) {
+        m_timer.start();
+    }
+    
+    qint64 now = m_timer.elapsed();
+    m_transferred = transferred;
+    m_total = total;
+    
+    qint64 interval = now - m_lastUpdateMs;
+    if (interval >= kMinRateIntervalMs) {
+        double instant = (transferred - m_lastBytes) * 1000.0 / interval;
+        if (m_lastUpdateMs == 0 && m_rate == 0) {
+            m_rate = instant;
+        } else {
+            double alpha = 1.0 - qExp(-interval / kRateTimeConstantMs);
+            m_rate += alpha * (instant - m_rate);
+        }
+        m_lastBytes = transferred;
+        m_lastUpdateMs = now;
+    }
+    
+    if (now - m_lastSampleMs >= kSampleIntervalMs) {
+        addSample(now);
+    }
+}
+
+void TransferMetrics::recordLink(double rttMs, double windowFill, qint64 networkMs, qint64 localIoMs)
+{
+    if (rttMs >= 0) {
+        m_rttMs = rttMs;
+    }
+    if (windowFill >= 0) {
+        m_windowFill = windowFill;
+    }
+    m_networkMs = networkMs;
+    m_localIoMs = localIoMs;
+}
+
+void TransferMetrics::finish()
+{
+    if (m_timer.isValid() && m_finishedMs < 0) {
+        m_finishedMs = m_timer.elapsed();
+        addSample(m_finishedMs);
+    }
+}
+
+bool TransferMetrics::isStarted() const
+{
+    return m_timer.isValid();
+}
+
+qint64 TransferMetrics::elapsedMs() const
+{
+    if (!m_timer.isValid()) {
+        return 0;
+    }
+    return m_finishedMs >= 0 ? m_finishedMs : m_timer.elapsed();
+}
+
+double TransferMetrics::currentRate() const
+{
+    return m_finishedMs >= 0 ? 0 : m_rate;
+}
+
+double TransferMetrics::averageRate() const
+{
+    qint64 elapsed = elapsedMs();
+    return elapsed > 0 ? m_transferred * 1000.0 / elapsed : 0;
+}
+
+// -1 if unknown
+qint64 TransferMetrics::etaSeconds() const
+{
+    double rate = m_rate > 0 ? m_rate : averageRate();
+    if (m_finishedMs >= 0 || m_total <= 0 || rate <= 0) {
+        return -1;
+    }
+    return static_cast<qint64>(qMax<qint64>(0, m_total - m_transferred) / rate);
+}
+
+double TransferMetrics::rttMs() const
+{
+    return m_rttMs;
+}
+
+double TransferMetrics::windowFill() const
+{
+    return m_windowFill;
+}
+
+qint64 TransferMetrics::networkMs() const
+{
+    return m_networkMs;
+}
+
+qint64 TransferMetrics::localIoMs() const
+{
+    return m_localIoMs;
+}
+
+const QVector<TransferSample> &TransferMetrics::samples() const
+{
+    return m_samples;
+}
+
+void TransferMetrics::addSample(qint64 now)
+{
+    TransferSample sample;
+    sample.elapsedMs = now;
+    sample.bytes = m_transferred;
+    sample.rate = m_rate;
+    sample.rttMs = m_rttMs;
+    sample.windowFill = m_windowFill;
+    m_samples.append(sample);
+    m_lastSampleMs = now;
+}
+
+QJsonObject TransferMetrics::toJson() const
+{
+    QJsonObject object;
+    object["elapsedMs"] = elapsedMs();
+    object["bytes"] = m_transferred;
+    object["totalBytes"] = m_total;
+    object["averageRate"] = averageRate();
+    object["networkMs"] = m_networkMs;
+    object["localIoMs"] = m_localIoMs;
+    
+    QJsonArray samples;
+    for (const TransferSample &sample : m_samples) {
+        QJsonObject entry;
+        entry["t"] = sample.elapsedMs;
+        entry["bytes"] = sample.bytes;
+        entry["rate"] = sample.rate;
+        entry["rttMs"] = sample.rttMs;
+        entry["windowFill"] = sample.windowFill;
+        samples.append(entry);
+    }
+    object["samples"] = samples;
+    return object;
+}
+
+QString TransferMetrics::csvHeader()
+{
+    return "task,name,elapsed_ms,bytes,rate_bps,rtt_ms,window_fill\n";
+}
+
+QString TransferMetrics::toCsvRows(int taskId, const QString &name) const
+{
+    QString quotedName = "\"" + QString(name).replace("\"", "\"\"") + "\"";
+    QString rows;
+    for (const TransferSample &sample : m_samples) {
+        // Multi-arg form, so a '%' in the file name cannot be taken for a placeholder
+        rows += QString("%1,%2,%3,%4,%5,%6,%7\n")
+                .arg(QString::number(taskId), quotedName, QString::number(sample.elapsedMs),
+                     QString::number(sample.bytes), QString::number(sample.rate, 'f', 0),
+                     QString::number(sample.rttMs, 'f', 1), QString::number(sample.windowFill, 'f', 3));
+    }
+    return rows;
+}
+
+QString TransferMetrics::formatRate(double bytesPerSecond)
+{
+    if (bytesPerSecond >= 1024.0 * 1024.0) {
+        return QString("%1 MB/s").arg(bytesPerSecond / (1024.0 * 1024.0), 0, 'f', 1);
+    }
+    return QString("%1 KB/s").arg(bytesPerSecond / 1024.0, 0, 'f', 0);
+}
+
+QString TransferMetrics::formatDuration(qint64 seconds)
+{
+    if (seconds < 0) {
+        return "--:--";
+    }
+    if (seconds >= 3600) {
+        return QString("%1:%2:%3").arg(seconds / 3600).arg((seconds / 60) % 60, 2, 10, QChar('0'))
+                                  .arg(seconds % 60, 2, 10, QChar('0'));
+    }
+    return QString("%1:%2").arg(seconds / 60).arg(seconds % 60, 2, 10, QChar('0'));
+}
@@ -0,0 +1,67 @@
+#ifndef TRANSFERMETRICS_H
+#define TRANSFERMETRICS_H
+
+#include <QVector>
+#include <QElapsedTimer>
+#include <QString>
+#include <QJsonObject>
+
+// One telemetry sample of a running transfer
+struct TransferSample {
+    qint64 elapsedMs;
+    qint64 bytes;
+    double rate;        // smoothed bytes/s at this point
+    double rttMs;       // -1 if not measured yet
+    double windowFill;  // 0..1, -1 if not measured yet
+};
+
+// Throughput statistics for one transfer task. Progress updates can arrive far more
+// often than samples are kept; samples are stored at most every 250 ms.
+class TransferMetrics
+{
+public:
+    TransferMetrics();
+
+    void recordProgress(qint64 transferred, qint64 total);
+    // Link statistics reported by the transfer engine. networkMs and localIoMs are
+    // the cumulative time spent waiting on the SFTP channel and on the local disk.
+    void recordLink(double rttMs, double windowFill, qint64 networkMs, qint64 localIoMs);
+    void finish();
+
+    bool isStarted() const;
+    qint64 elapsedMs() const;
+    double currentRate() const;
+    double averageRate() const;
+    qint64 etaSeconds() const;
+    double rttMs() const;
+    double windowFill() const;
+    qint64 networkMs() const;
+    qint64 localIoMs() const;
+    const QVector<TransferSample> &samples() const;
+
+    QJsonObject toJson() const;
+    static QString csvHeader();
+    QString toCsvRows(int taskId, const QString &name) const;
+
+    static QString formatRate(double bytesPerSecond);
+    static QString formatDuration(qint64 seconds);
+
+private:
+    QElapsedTimer m_timer;
+    qint64 m_finishedMs;
+    qint64 m_transferred;
+    qint64 m_total;
+    qint64 m_lastBytes;
+    qint64 m_lastUpdateMs;
+    qint64 m_lastSampleMs;
+    double m_rate;
+    double m_rttMs;
+    double m_windowFill;
+    qint64 m_networkMs;
+    qint64 m_localIoMs;
+    QVector<TransferSample> m_samples;
+
+    void addSample(qint64 now);
+};
+
+#endif // TRANSFERMETRICS_H
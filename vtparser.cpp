@@ -0,0 +1,428 @@
+#include "vtparser.h"
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define VTPARSER_HAVE_SSE2
+#endif
+
+namespace {
+
+enum State {
+    Ground,
+    Escape,
+    EscapeIntermediate,
+    CsiEntry,
+    CsiParam,
+    CsiIntermediate,
+    CsiIgnore,
+    DcsEntry,
+    DcsParam,
+    DcsIntermediate,
+    DcsPassthrough,
+    DcsIgnore,
+    OscString,
+    SosPmApcString,
+    StateCount
+};
+
+enum Action {
+    None,
+    Ignore,
+    Print,
+    Execute,
+    Clear,
+    Collect,
+    Param,
+    EscDispatch,
+    CsiDispatch,
+    Hook,
+    Put,
+    Unhook,
+    OscStart,
+    OscPut,
+    OscEnd
+};
+
+// Each entry packs the transition action (high nibble) and the next state (low nibble)
+struct TransitionTable
+{
+    unsigned char entries[StateCount][256];
+
+    TransitionTable()
+    {
+        for (int state = 0; state < StateCount; ++state) {
+            // Stay in the state and do nothing unless a rule below says otherwise
+            for (int byte = 0; byte < 256; ++byte) {
+                set(state, byte, byte, None, state);
+            }
+
+            // "Anywhere" transitions
+            set(state, 0x18, 0x18, Execute, Ground);
+            set(state, 0x1A, 0x1A, Execute, Ground);
+            set(state, 0x1B, 0x1B, None, Escape);
+        }
+
+        // Ground
+        set(Ground, 0x00, 0x17, Execute, Ground);
+        set(Ground, 0x19, 0x19, Execute, Ground);
+        set(Ground, 0x1C, 0x1F, Execute, Ground);
+        set(Ground, 0x20, 0x7E, Print, Ground);
+        set(Ground, 0x7F, 0x7F, Ignore, Ground);
+        set(Ground, 0x80, 0xFF, Print, Ground);
+
+        // Escape
+        executeC0(Escape);
+        set(Escape, 0x7F, 0x7F, Ignore, Escape);
+        set(Escape, 0x20, 0x2F, Collect, EscapeIntermediate);
+        set(Escape, 0x30, 0x4F, EscDispatch, Ground);
+        set(Escape, 0x51, 0x57, EscDispatch, Ground);
+        set(Escape, 0x59, 0x5A, EscDispatch, Ground);
+        set(Escape, 0x5C, 0x5C, EscDispatch, Ground);
+        set(Escape, 0x60, 0x7E, EscDispatch, Ground);
+        set(Escape, 0x50, 0x50, None, DcsEntry);
+        set(Escape, 0x58, 0x58, None, SosPmApcString);
+        set(Escape, 0x5E, 0x5F, None, SosPmApcString);
+        set(Escape, 0x5B, 0x5B, None, CsiEntry);
+        set(Escape, 0x5D, 0x5D, None, OscString);
+
+        // Escape intermediate
+        executeC0(EscapeIntermediate);
+        set(EscapeIntermediate, 0x20, 0x2F, Collect, EscapeIntermediate);
+        set(EscapeIntermediate, 0x7F, 0x7F, Ignore, EscapeIntermediate);
+        set(EscapeIntermediate, 0x30, 0x7E, EscDispatch, Ground);
+
+        // CSI entry
+        executeC0(CsiEntry);
+        set(CsiEntry, 0x7F, 0x7F, Ignore, CsiEntry);
+        set(CsiEntry, 0x20, 0x2F, Collect, CsiIntermediate);
+        set(CsiEntry, 0x30, 0x39, Param, CsiParam);
+        set(CsiEntry, 0x3A, 0x3B, Param, CsiParam);
+        set(CsiEntry, 0x3C, 0x3F, Collect, CsiParam);
+        set(CsiEntry, 0x40, 0x7E, CsiDispatch, Ground);
+
+        // CSI param
+        executeC0(CsiParam);
+        set(CsiParam, 0x7F, 0x7F, Ignore, CsiParam);
+        set(CsiParam, 0x30, 0x39, Param, CsiParam);
+        set(CsiParam, 0x3A, 0x3B, Param, CsiParam);
+        set(CsiParam, 0x3C, 0x3F, None, CsiIgnore);
+        set(CsiParam, 0x20, 0x2F, Collect, CsiIntermediate);
+        set(CsiParam, 0x40, 0x7E, CsiDispatch, Ground);
+
+        // CSI intermediate
+        executeC0(CsiIntermediate);
+        set(CsiIntermediate, 0x7F, 0x7F, Ignore, CsiIntermediate);
+        set(CsiIntermediate, 0x20, 0x2F, Collect, CsiIntermediate);
+        set(CsiIntermediate, 0x30, 0x3F, None, CsiIgnore);
+        set(CsiIntermediate, 0x40, 0x7E, CsiDispatch, Ground);
+
+        // CSI ignore
+        executeC0(CsiIgnore);
+        set(CsiIgnore, 0x20, 0x3F, Ignore, CsiIgnore);
+        set(CsiIgnore, 0x7F, 0x7F, Ignore, CsiIgnore);
+        set(CsiIgnore, 0x40, 0x7E, None, Ground);
+
+        // DCS entry
+        set(DcsEntry, 0x00, 0x17, Ignore, DcsEntry);
+        set(DcsEntry, 0x19, 0x19, Ignore, DcsEntry);
+        set(DcsEntry, 0x1C, 0x1F, Ignore, DcsEntry);
+        set(DcsEntry, 0x7F, 0x7F, Ignore, DcsEntry);
+        set(DcsEntry, 0x20, 0x2F, Collect, DcsIntermediate);
+        set(DcsEntry, 0x30, 0x39, Param, DcsParam);
+        set(DcsEntry, 0x3A, 0x3B, Param, DcsParam);
+        set(DcsEntry, 0x3C, 0x3F, Collect, DcsParam);
+        set(DcsEntry, 0x40, 0x7E, None, DcsPassthrough);
+
+        // DCS param
+        set(DcsParam, 0x00, 0x17, Ignore, DcsParam);
+        set(DcsParam, 0x19, 0x19, Ignore, DcsParam);
+        set(DcsParam, 0x1C, 0x1F, Ignore, DcsParam);
+        set(DcsParam, 0x7F, 0x7F, Ignore, DcsParam);
+        set(DcsParam, 0x30, 0x39, Param, DcsParam);
+        set(DcsParam, 0x3A, 0x3B, Param, DcsParam);
+        set(DcsParam, 0x3C, 0x3F, None, DcsIgnore);
+        set(DcsParam, 0x20, 0x2F, Collect, DcsIntermediate);
+        set(DcsParam, 0x40, 0x7E, None, DcsPassthrough);
+
+        // DCS intermediate
+        set(DcsIntermediate, 0x00, 0x17, Ignore, DcsIntermediate);
+        set(DcsIntermediate, 0x19, 0x19, Ignore, DcsIntermediate);
+        set(DcsIntermediate, 0x1C, 0x1F, Ignore, DcsIntermediate);
+        set(DcsIntermediate, 0x7F, 0x7F, Ignore, DcsIntermediate);
+        set(DcsIntermediate, 0x20, 0x2F, Collect, DcsIntermediate);
+        set(DcsIntermediate, 0x30, 0x3F, None, DcsIgnore);
+        set(DcsIntermediate, 0x40, 0x7E, None, DcsPassthrough);
+
+        // DCS passthrough
+        set(DcsPassthrough, 0x00, 0x17, Put, DcsPassthrough);
+        set(DcsPassthrough, 0x19, 0x19, Put, DcsPassthrough);
+        set(DcsPassthrough, 0x1C, 0x1F, Put, DcsPassthrough);
+        set(DcsPassthrough, 0x20, 0x7E, Put, DcsPassthrough);
+        set(DcsPassthrough, 0x7F, 0x7F, Ignore, DcsPassthrough);
+        set(DcsPassthrough, 0x80, 0xFF, Put, DcsPassthrough);
+
+        // DCS ignore and SOS/PM/APC strings swallow everything until ST
+        set(DcsIgnore, 0x00, 0x17, Ignore, DcsIgnore);
+        set(DcsIgnore, 0x19, 0x19, Ignore, DcsIgnore);
+        set(DcsIgnore, 0x1C, 0xFF, Ignore, DcsIgnore);
+        set(SosPmApcString, 0x00, 0x17, Ignore, SosPmApcString);
+        set(SosPmApcString, 0x19, 0x19, Ignore, SosPmApcString);
+        set(SosPmApcString, 0x1C, 0xFF, Ignore, SosPmApcString);
+
+        // OSC string; BEL ends it like ST (xterm)
+        set(OscString, 0x00, 0x06, Ignore, OscString);
+        set(OscString, 0x07, 0x07, None, Ground);
+        set(OscString, 0x08, 0x17, Ignore, OscString);
+        set(OscString, 0x19, 0x19, Ignore, OscString);
+        set(OscString, 0x1C, 0x1F, Ignore, OscString);
+        set(OscString, 0x20, 0xFF, OscPut, OscString);
+    }
+
+    void set(int state, int first, int last, Action action, int next)
+    {
+        for (int byte = first; byte <= last; ++byte) {
+            entries[state][byte] = static_cast<unsigned char>((action << 4) | next);
+        }
+    }
+
+    void executeC0(int state)
+    {
+        set(state, 0x00, 0x17, Execute, state);
+        set(state, 0x19, 0x19, Execute, state);
+        set(state, 0x1C, 0x1F, Execute, state);
+    }
+};
+
+const TransitionTable &transitionTable()
+{
+    static const TransitionTable table;
+    return table;
+}
+
+// Actions run when a state is entered or left
+inline Action entryAction(int state)
+{
+    switch (state) {
+    case Escape:
+    case CsiEntry:
+    case DcsEntry:
+        return Clear;
+    case OscString:
+        return OscStart;
+    case DcsPassthrough:
+        return Hook;
+    default:
+        return None;
+    }
+}
+
+inline Action exitAction(int state)
+{
+    switch (state) {
+    case OscString:
+        return OscEnd;
+    case DcsPassthrough:
+        return Unhook;
+    default:
+        return None;
+    }
+}
+
+// Length of the run of printable bytes (>= 0x20, except DEL) at the start of [p, end)
+inline const unsigned char *scanPrintable(const unsigned char *p, const unsigned char *end)
+{
+#ifdef VTPARSER_HAVE_SSE2
+    const __m128i space = _mm_set1_epi8(0x20);
+    const __m128i del = _mm_set1_epi8(0x7F);
+    while (end - p >= 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        // Unsigned "chunk >= 0x20" is max(chunk, 0x20) == chunk
+        __m128i printable = _mm_cmpeq_epi8(_mm_max_epu8(chunk, space), chunk);
+        __m128i stop = _mm_or_si128(_mm_xor_si128(printable, _mm_set1_epi8(-1)), _mm_cmpeq_epi8(chunk, del));
+        int mask = _mm_movemask_epi8(stop);
+        if (mask != 0) {
+            int offset = 0;
+            while (!(mask & 1)) {
+                mask >>= 1;
+                ++offset;
+            }
+            return p + offset;
+        }
+        p += 16;
+    }
+#endif
+    while (p < end && *p >= 0x20 && *p != 0x7F) {
+        ++p;
+    }
+    return p;
+}
+
+// DCS payload runs until CAN, SUB or ESC
+inline const unsigned char *scanPassthrough(const unsigned char *p, const unsigned char *end)
+{
+    while (p < end && *p != 0x18 && *p != 0x1A && *p != 0x1B && *p != 0x7F) {
+        ++p;
+    }
+    return p;
+}
+
+} // namespace
+
+VTParser::VTParser(VTParserHandler *handler)
+    : m_handler(handler), m_state(Ground), m_ignoreSequence(false), m_oscLength(0)
+{
+    clearSequence();
+}
+
+void VTParser::reset()
+{
+    m_state = Ground;
+    m_oscLength = 0;
+    clearSequence();
+}
+
+void VTParser::clearSequence()
+{
+    m_sequence.paramCount = 0;
+    m_sequence.subparamMask = 0;
+    m_sequence.intermediateCount = 0;
+    m_ignoreSequence = false;
+}
+
+void VTParser::feed(const char *data, int length)
+{
+    if (!m_handler) {
+        return;
+    }
+
+    const TransitionTable &table = transitionTable();
+    const unsigned char *p = reinterpret_cast<const unsigned char *>(data);
+    const unsigned char *end = p + length;
+
+    while (p < end) {
+        // Fast paths: hand whole runs to the handler instead of going byte by byte
+        if (m_state == Ground) {
+            const unsigned char *runEnd = scanPrintable(p, end);
+            if (runEnd != p) {
+                m_handler->vtPrint(reinterpret_cast<const char *>(p), static_cast<int>(runEnd - p));
+                p = runEnd;
+                if (p == end) {
+                    break;
+                }
+            }
+        } else if (m_state == DcsPassthrough) {
+            const unsigned char *runEnd = scanPassthrough(p, end);
+            if (runEnd != p) {
+                m_handler->vtDcsPut(reinterpret_cast<const char *>(p), static_cast<int>(runEnd - p));
+                p = runEnd;
+                if (p == end) {
+                    break;
+                }
+            }
+        }
+
+        unsigned char byte = *p++;
+        unsigned char entry = table.entries[m_state][byte];
+        unsigned char action = entry >> 4;
+        unsigned char next = entry & 0x0F;
+
+        if (next != m_state || byte == 0x1B || byte == 0x18 || byte == 0x1A) {
+            // Leaving the state (ESC/CAN/SUB re-enter even when already there)
+            Action onExit = exitAction(m_state);
+            if (onExit != None) {
+                perform(onExit, byte);
+            }
+            if (action != None) {
+                perform(action, byte);
+            }
+            m_state = next;
+            Action onEntry = entryAction(next);
+            if (onEntry != None) {
+                perform(onEntry, byte);
+            }
+        } else if (action != None) {
+            perform(action, byte);
+        }
+    }
+}
+
+void VTParser::perform(unsigned char action, unsigned char byte)
+{
+    switch (action) {
+    case Print:
+        m_handler->vtPrint(reinterpret_cast<const char *>(&byte), 1);
+        break;
+    case Execute:
+        m_handler->vtExecute(byte);
+        break;
+    case Clear:
+        clearSequence();
+        break;
+    case Collect:
+        if (m_sequence.intermediateCount < VTSequence::MaxIntermediates) {
+            m_sequence.intermediates[m_sequence.intermediateCount++] = static_cast<char>(byte);
+        } else {
+            m_ignoreSequence = true;
+        }
+        break;
+    case Param:
+        if (m_sequence.paramCount == 0) {
+            m_sequence.params[0] = 0;
+            m_sequence.paramCount = 1;
+        }
+        if (byte == ';' || byte == ':') {
+            if (m_sequence.paramCount < VTSequence::MaxParams) {
+                if (byte == ':') {
+                    m_sequence.subparamMask |= 1u << m_sequence.paramCount;
+                }
+                m_sequence.params[m_sequence.paramCount++] = 0;
+            } else {
+                m_ignoreSequence = true;
+            }
+        } else {
+            int &value = m_sequence.params[m_sequence.paramCount - 1];
+            // Clamp instead of overflowing on absurd parameters
+            if (value < 100000) {
+                value = value * 10 + (byte - '0');
+            }
+        }
+        break;
+    case EscDispatch:
+        if (!m_ignoreSequence) {
+            m_handler->vtEscDispatch(m_sequence, static_cast<char>(byte));
+        }
+        break;
+    case CsiDispatch:
+        if (!m_ignoreSequence) {
+            m_handler->vtCsiDispatch(m_sequence, static_cast<char>(byte));
+        }
+        break;
+    case Hook:
+        m_handler->vtDcsHook(m_sequence, static_cast<char>(byte));
+        break;
+    case Put:
+        m_handler->vtDcsPut(reinterpret_cast<const char *>(&byte), 1);
+        break;
+    case Unhook:
+        m_handler->vtDcsUnhook();
+        break;
+    case OscStart:
+        m_oscLength = 0;
+        break;
+    case OscPut:
+        if (m_oscLength < MaxOscLength) {
+            m_osc[m_oscLength++] = static_cast<char>(byte);
+        }
+        break;
+    case OscEnd:
+        // CAN/SUB abort the string instead of terminating it
+        if (byte != 0x18 && byte != 0x1A) {
+            m_handler->vtOscDispatch(m_osc, m_oscLength);
+        }
+        m_oscLength = 0;
+        break;
+    default:
+        break;
+    }
+}
@@ -0,0 +1,89 @@
+#ifndef VTPARSER_H
+#define VTPARSER_H
+
+// Byte-level DEC/ANSI escape sequence parser after Paul Williams' VT500 state machine
+// (https://vt100.net/emu/dec_ansi_parser). The parser keeps its state between calls to
+// feed(), so sequences split across SSH reads are handled, and it never allocates.
+//
+// Differences from the DEC diagram, matching what xterm does in UTF-8 mode:
+//  - bytes 0x80-0xFF are printable (they are UTF-8 continuation/lead bytes), so raw C1
+//    controls are not recognised;
+//  - BEL terminates an OSC string as well as ST.
+
+// Parameters and intermediates of one escape/control sequence
+struct VTSequence
+{
+    enum { MaxParams = 32, MaxIntermediates = 4 };
+
+    int params[MaxParams];
+    int paramCount;
+    // Bit i is set when params[i] was introduced by ':' (an SGR sub-parameter)
+    unsigned int subparamMask;
+    char intermediates[MaxIntermediates];
+    int intermediateCount;
+
+    // Omitted and zero parameters both mean "default" in the DEC syntax
+    int param(int index, int defaultValue = 0) const
+    {
+        return index < paramCount && params[index] > 0 ? params[index] : defaultValue;
+    }
+    bool isSubparam(int index) const
+    {
+        return index < paramCount && (subparamMask & (1u << index)) != 0;
+    }
+    // '?', '>', '<' or '=' introducing a private CSI sequence, 0 otherwise
+    char privateMarker() const
+    {
+        return intermediateCount > 0 && intermediates[0] >= 0x3C && intermediates[0] <= 0x3F
+               ? intermediates[0] : 0;
+    }
+};
+
+class VTParserHandler
+{
+public:
+    virtual ~VTParserHandler() {}
+
+    // A run of printable bytes, still encoded; decoding is up to the handler
+    virtual void vtPrint(const char *data, int length) = 0;
+    // C0 control such as CR, LF, BS, HT or BEL
+    virtual void vtExecute(unsigned char control) = 0;
+    virtual void vtEscDispatch(const VTSequence &sequence, char final) = 0;
+    virtual void vtCsiDispatch(const VTSequence &sequence, char final) = 0;
+    // Complete OSC payload, e.g. "0;window title"; longer strings are truncated
+    virtual void vtOscDispatch(const char *data, int length) = 0;
+
+    // Device control strings (DECRQSS, sixel, tmux passthrough, ...) are rare; the
+    // default implementation discards them
+    virtual void vtDcsHook(const VTSequence &sequence, char final) { (void)sequence; (void)final; }
+    virtual void vtDcsPut(const char *data, int length) { (void)data; (void)length; }
+    virtual void vtDcsUnhook() {}
+};
+
+class VTParser
+{
+public:
+    enum { MaxOscLength = 4096 };
+
+    explicit VTParser(VTParserHandler *handler = nullptr);
+
+    void setHandler(VTParserHandler *handler) { m_handler = handler; }
+    void feed(const char *data, int length);
+    void reset();
+
+    // True while the parser is between sequences, i.e. the next byte starts fresh output
+    bool isGround() const { return m_state == 0; }
+
+private:
+    VTParserHandler *m_handler;
+    unsigned char m_state;
+    VTSequence m_sequence;
+    bool m_ignoreSequence;
+    char m_osc[MaxOscLength];
+    int m_oscLength;
+
+    void perform(unsigned char action, unsigned char byte);
+    void clearSequence();
+};
+
+#endif // VTPARSER_H